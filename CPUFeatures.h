@@ -0,0 +1,164 @@
+#ifndef CPUFEATURES_H
+#define CPUFEATURES_H
+
+#include <string>
+#include <fstream>
+#include <cstdint>
+
+#if defined(__x86_64__) || defined(__i386__)
+	#include <cpuid.h>
+#elif defined(__aarch64__) || defined(__arm__)
+	#include <sys/auxv.h>
+	#include <asm/hwcap.h>
+#endif
+
+/**
+ * crypto-related features of the CPU we are running on.
+ * detected once at runtime, so one binary may be used on different
+ * machines and still select the fastest backend/code-path available
+ */
+class CPUFeatures {
+
+public:
+
+	/** AES instructions (AES-NI, ARMv8 crypto extensions) */
+	bool aes = false;
+
+	/** carry-less multiplication (PCLMULQDQ, ARMv8 PMULL). used by GCM */
+	bool pclmul = false;
+
+	/** vector AES (multiple AES blocks within AVX2/AVX-512 registers) */
+	bool vaes = false;
+
+	/** SHA-1/SHA-256 instructions (SHA-NI, ARMv8 SHA1/SHA2) */
+	bool sha = false;
+
+	/** AVX2 (including OS support for the ymm-registers) */
+	bool avx2 = false;
+
+	/** AVX-512 foundation (including OS support for the zmm-registers) */
+	bool avx512 = false;
+
+	/** singleton access */
+	static const CPUFeatures& get() {
+		static CPUFeatures inst;
+		return inst;
+	}
+
+	/** human readable list of all detected features */
+	std::string asString() const {
+		std::string res;
+		if (aes)	{res += "aes ";}
+		if (pclmul)	{res += "pclmul ";}
+		if (vaes)	{res += "vaes ";}
+		if (sha)	{res += "sha ";}
+		if (avx2)	{res += "avx2 ";}
+		if (avx512)	{res += "avx512 ";}
+		return (res.empty()) ? ("none") : (res.substr(0, res.length()-1));
+	}
+
+	/**
+	 * check whether the kernel's crypto API provides an accelerated (non-generic)
+	 * driver for the given algorithm, e.g. "cbc(aes)" or "sha256".
+	 * the driver with the highest priority is the one AF_ALG will use.
+	 */
+	static bool isKernelAccelerated(const std::string& algorithm) {
+
+		std::ifstream in("/proc/crypto");
+		std::string line;
+		std::string name;
+		std::string driver;
+		std::string bestDriver;
+		int bestPriority = -1;
+
+		while (std::getline(in, line)) {
+			const size_t pos = line.find(':');
+			if (pos == std::string::npos) {continue;}
+			const std::string key = trim(line.substr(0, pos));
+			const std::string val = trim(line.substr(pos+1));
+			if		("name" == key)		{name = val;}
+			else if	("driver" == key)	{driver = val;}
+			else if	("priority" == key && name == algorithm) {
+				const int priority = std::stoi(val);
+				if (priority > bestPriority) {bestPriority = priority; bestDriver = driver;}
+			}
+		}
+
+		if (bestDriver.empty()) {return false;}
+		return bestDriver.find("generic") == std::string::npos;
+
+	}
+
+private:
+
+	/** hidden ctor. use get() */
+	CPUFeatures() {
+		detect();
+	}
+
+	/** remove leading and trailing whitespace */
+	static std::string trim(const std::string& str) {
+		const size_t start = str.find_first_not_of(" \t");
+		const size_t end = str.find_last_not_of(" \t");
+		return (start == std::string::npos) ? ("") : (str.substr(start, end-start+1));
+	}
+
+#if defined(__x86_64__) || defined(__i386__)
+
+	/** read the extended control register (which register-states the OS saves) */
+	static uint64_t xgetbv() {
+		uint32_t eax, edx;
+		__asm__ volatile ("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+		return ((uint64_t)edx << 32) | eax;
+	}
+
+	void detect() {
+
+		uint32_t eax, ebx, ecx, edx;
+		if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx)) {return;}
+
+		aes = ecx & bit_AES;
+		pclmul = ecx & bit_PCLMUL;
+
+		// AVX-registers are only usable when the OS saves them
+		const bool osxsave = ecx & bit_OSXSAVE;
+		const uint64_t xcr0 = (osxsave) ? (xgetbv()) : (0);
+		const bool osYMM = (xcr0 & 0x06) == 0x06;
+		const bool osZMM = (xcr0 & 0xE6) == 0xE6;
+
+		if (!__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx)) {return;}
+
+		sha = ebx & bit_SHA;
+		avx2 = (ebx & bit_AVX2) && osYMM;
+		avx512 = (ebx & bit_AVX512F) && osZMM;
+		vaes = (ecx & bit_VAES) && osYMM;
+
+	}
+
+#elif defined(__aarch64__)
+
+	void detect() {
+		const unsigned long hwcap = getauxval(AT_HWCAP);
+		aes = hwcap & HWCAP_AES;
+		pclmul = hwcap & HWCAP_PMULL;
+		sha = (hwcap & HWCAP_SHA1) && (hwcap & HWCAP_SHA2);
+	}
+
+#elif defined(__arm__)
+
+	void detect() {
+		const unsigned long hwcap2 = getauxval(AT_HWCAP2);
+		aes = hwcap2 & HWCAP2_AES;
+		pclmul = hwcap2 & HWCAP2_PMULL;
+		sha = (hwcap2 & HWCAP2_SHA1) && (hwcap2 & HWCAP2_SHA2);
+	}
+
+#else
+
+	void detect() {;}
+
+#endif
+
+};
+
+#endif // CPUFEATURES_H
@@ -6,7 +6,15 @@
 #include "CMDLine.h"
 #include "cipher/CipherFactory.h"
 #include "derivation/KeyDerivationFactory.h"
+#include "derivation/KeyDerivationParams.h"
+#include "VolumeConfig.h"
 #include "iv/IVGeneratorFactory.h"
+#include "iv/IVGeneratorCached.h"
+#include "container/EncryptedContainer.h"
+#include "files/PathCache.h"
+#include "files/DirCache.h"
+#include "container/SizeCache.h"
+#include "files/FilePath.h"
 #include "Log.h"
 
 /**
@@ -14,6 +22,14 @@
  *  - cipher to use for filenames
  *  - cipher to use for file-data
  *  - IV-generator to use for file-data
+ *  - block-size to use for newly created files
+ *  - format of the encrypted file-names
+ *  - per-directory IVs for the encrypted file-names
+ *  - IV-cache
+ *  - path-cache
+ *  - directory-cache
+ *  - size-cache
+ *  - the volume's key-derivation parameters
  */
 class Configuration {
 	
@@ -26,13 +42,42 @@ class Configuration {
 	/** the iv-generator to use */
 	std::string ivGenerator;
 
+	/** the above names, resolved onto their backends once (e.g. "aes_cbc_256" -> "openssl_aes_cbc_256") */
+	std::string cipherFileDataBackend;
+	std::string cipherFileNamesBackend;
+	std::string ivGeneratorBackend;
+
 	/** the key-derivation to use */
 	std::string keyDerivation;
+
+	/** the key-derivation's parameters stored within the volume (if any) */
+	KeyDerivationParams keyDerivationParams;
+
+	/** the block-size to use for newly created files */
+	uint32_t blockSize;
+
+	/** IVs cached for all file-handles (if enabled) */
+	std::shared_ptr<IVCacheTable> ivCache;
+
+	/** the format of the encrypted file-names */
+	uint32_t nameFormat;
+
+	/** encrypt file-names using per-directory IVs */
+	bool dirIVs = false;
+
+	/** memory limit of the path-cache (bytes, 0: disabled) */
+	size_t pathCacheBytes;
+
+	/** memory limit of the directory-cache (bytes, 0: disabled) */
+	size_t dirCacheBytes;
+
+	/** maximum number of cached file-sizes (0: disabled) */
+	size_t sizeCacheEntries;
 	
 public:
 
 	/** empty-ctor */
-	Configuration() {
+	Configuration() : blockSize(Settings::BLK_SIZE), nameFormat(Settings::FILE_NAME_FORMAT_LEGACY), pathCacheBytes(Settings::PATH_CACHE_BYTES), dirCacheBytes(Settings::DIR_CACHE_BYTES), sizeCacheEntries(Settings::SIZE_CACHE_ENTRIES) {
 		;
 	}
 
@@ -41,67 +86,238 @@ public:
 //	ivGenerator("sha256"),
 //	keyDerivation("pbkdf2_sha256") {
 
-	/** ctor */
-	Configuration(const CMDLine& cmd) {
+	/**
+	 * ctor with the command-line and the volume config (empty for legacy volumes).
+	 * algorithms stored within the volume config need not be given.
+	 * 'legacy': mounting a volume without config, whose algorithm names keep their former meaning
+	 */
+	Configuration(const CMDLine& cmd, const VolumeConfig& volume = VolumeConfig(), const bool legacy = false) : blockSize(Settings::BLK_SIZE), nameFormat(Settings::FILE_NAME_FORMAT_LEGACY), pathCacheBytes(Settings::PATH_CACHE_BYTES), dirCacheBytes(Settings::DIR_CACHE_BYTES), sizeCacheEntries(Settings::SIZE_CACHE_ENTRIES) {
 
-		cipherFileData = cmd.getOption("cipher-filedata");
+		cipherFileData = getOption(cmd, volume, "cipher-filedata", CipherFactory::getAlgorithm);
+		cipherFileDataBackend = CipherFactory::resolve(cipherFileData);
 		getCipherFileData();
 
-		cipherFileNames = cmd.getOption("cipher-filename");
+		cipherFileNames = getOption(cmd, volume, "cipher-filename", CipherFactory::getAlgorithm);
+		cipherFileNamesBackend = CipherFactory::resolve(cipherFileNames);
 		getCipherFileNames();
 
-		ivGenerator = cmd.getOption("iv-gen");
+		ivGenerator = getOption(cmd, volume, "iv-gen", DigestFactory::getAlgorithm);
+		if (legacy) {ivGenerator = getLegacyIVGenerator(ivGenerator);}
+		ivGeneratorBackend = IVGeneratorFactory::getBackend(ivGenerator);
 		getIVGenerator(0, 0);
 
-		keyDerivation = cmd.getOption("key-derivation");
+		keyDerivation = getOption(cmd, volume, "key-derivation");
+		if (!volume.empty()) {keyDerivationParams = volume.getKeyDerivationParams();}
 		getKeyDerivation();
 
+		const std::string blkSize = getOption(cmd, volume, "block-size");
+		if (!blkSize.empty()) {
+			blockSize = std::stoul(blkSize);
+			if (!EncryptedContainer::isValidBlockSize(blockSize)) {
+				throw Exception("unsupported --block-size. must be a power of two between " + std::to_string(Settings::MIN_BLK_SIZE) + " and " + std::to_string(Settings::MAX_BLK_SIZE));
+			}
+		}
+
+		// volumes created before compact names were introduced (and legacy volumes) use the legacy format
+		if (volume.has("name-format")) {
+			setNameFormat(std::stoul(volume.get("name-format")));
+		}
+
+		// volumes created before per-directory IVs were introduced use the fixed IV
+		if (volume.has("dir-iv")) {
+			dirIVs = volume.get("dir-iv") == "1";
+		}
+
+		if (cmd.hasOption("iv-cache")) {
+			const uint32_t entries = std::stoul(cmd.getOption("iv-cache"));
+			if (entries) {ivCache = std::make_shared<IVCacheTable>(entries);}
+		}
+
+		if (cmd.hasOption("path-cache")) {
+			pathCacheBytes = std::stoull(cmd.getOption("path-cache"));
+		}
+
+		if (cmd.hasOption("dir-cache")) {
+			dirCacheBytes = std::stoull(cmd.getOption("dir-cache"));
+		}
+
+		if (cmd.hasOption("size-cache")) {
+			sizeCacheEntries = std::stoull(cmd.getOption("size-cache"));
+		}
+
+	}
+
+	/** store the algorithms within the given volume config */
+	void store(VolumeConfig& volume) const {
+		volume.set("cipher-filedata", cipherFileData);
+		volume.set("cipher-filename", cipherFileNames);
+		volume.set("iv-gen", ivGenerator);
+		volume.set("block-size", std::to_string(blockSize));
+		volume.set("name-format", std::to_string(nameFormat));
+		volume.set("dir-iv", (dirIVs) ? ("1") : ("0"));
+		volume.setKeyDerivationParams(KeyDerivationParams(keyDerivation, getKeyDerivation()->getParams()));
+	}
+
+	/** set the format of the encrypted file-names */
+	void setNameFormat(const uint32_t format) {
+		if (format != Settings::FILE_NAME_FORMAT_LEGACY && format != Settings::FILE_NAME_FORMAT_BASE64) {
+			throw Exception("unsupported file-name format: " + std::to_string(format));
+		}
+		nameFormat = format;
+	}
+
+	/** get the format of the encrypted file-names */
+	uint32_t getNameFormat() const {
+		return nameFormat;
+	}
+
+	/** encrypt file-names using per-directory IVs? */
+	void setDirIVs(const bool use) {
+		dirIVs = use;
+	}
+
+	/** are file-names encrypted using per-directory IVs? */
+	bool usesDirIVs() const {
+		return dirIVs;
+	}
+
+	/** use the given key-derivation parameters (e.g. calibrated for a new volume) */
+	void setKeyDerivationParams(const KeyDerivation::Params& params) {
+		keyDerivationParams = KeyDerivationParams(keyDerivation, params);
+		getKeyDerivation();
 	}
 
 	/** dump the configuration */
 	void showSettings() {
-		addLog("main", "file-name encryption: '"	+ cipherFileNames + "'");
-		addLog("main", "file-data encryption: '"	+ cipherFileData + "'");
+		addLog("main", "cpu features: "				+ CPUFeatures::get().asString());
+		addLog("main", "file-name encryption: "		+ describe(cipherFileNames, cipherFileNamesBackend));
+		addLog("main", "file-data encryption: "		+ describe(cipherFileData, cipherFileDataBackend));
 		addLog("main", "key-derivation: '"			+ keyDerivation + "'");
-		addLog("main", "iv-generator: '"			+ ivGenerator + "'");
+		addLog("main", "key-derivation params: "	+ ((keyDerivationParams.empty()) ? ("defaults") : (keyDerivationParams.asString())));
+		addLog("main", "iv-generator: "				+ describe(ivGenerator, IVGeneratorFactory::resolve(ivGenerator)));
+		addLog("main", "block-size (new files): "	+ std::to_string(blockSize));
+		addLog("main", "file-name format: "			+ std::string((nameFormat == Settings::FILE_NAME_FORMAT_BASE64) ? ("base64url") : ("legacy hex")));
+		addLog("main", "file-name IVs: "			+ std::string((dirIVs) ? ("per directory") : ("fixed")));
+		addLog("main", "iv-cache entries: "			+ std::to_string((ivCache) ? (ivCache->size()) : (0)));
+		addLog("main", "path-cache bytes: "			+ std::to_string(pathCacheBytes));
+		addLog("main", "dir-cache bytes: "			+ std::to_string(dirCacheBytes));
+		addLog("main", "size-cache entries: "		+ std::to_string(sizeCacheEntries));
 	}
 
 	/** get the cipher to use for file-data */
 	std::shared_ptr<Cipher> getCipherFileData() const {
 		if (cipherFileData.empty()) {throw Factory::onNotGiven("no --cipher-filedata given", CipherFactory::getSupported());}
-		return std::shared_ptr<Cipher>(CipherFactory::getByName(cipherFileData));
+		return std::shared_ptr<Cipher>(CipherFactory::getByName(cipherFileDataBackend));
 	}
 
 	/** get the cipher to use for file-data */
 	std::shared_ptr<Cipher> getCipherFileData(const uint8_t* key, const uint32_t keyLen) const {
 		if (cipherFileData.empty()) {throw Factory::onNotGiven("no --cipher-filedata given", CipherFactory::getSupported());}
-		return std::shared_ptr<Cipher>(CipherFactory::getByName(cipherFileData, key, keyLen));
+		return std::shared_ptr<Cipher>(CipherFactory::getByName(cipherFileDataBackend, key, keyLen));
 	}
 
 
 	/** get the cipher to use for file-names */
 	std::shared_ptr<Cipher> getCipherFileNames() const {
 		if (cipherFileNames.empty()) {throw Factory::onNotGiven("no --cipher-filename given", CipherFactory::getSupported());}
-		return std::shared_ptr<Cipher>(CipherFactory::getByName(cipherFileNames));
+		return std::shared_ptr<Cipher>(CipherFactory::getByName(cipherFileNamesBackend));
 	}
 
 	/** get the cipher to use for file-names */
 	std::shared_ptr<Cipher> getCipherFileNames(const uint8_t* key, const uint32_t keyLen) const {
 		if (cipherFileNames.empty()) {throw Factory::onNotGiven("no --cipher-filename given", CipherFactory::getSupported());}
-		return std::shared_ptr<Cipher>(CipherFactory::getByName(cipherFileNames, key, keyLen));
+		return std::shared_ptr<Cipher>(CipherFactory::getByName(cipherFileNamesBackend, key, keyLen));
 	}
 
 
-	/** get the key-derivation algorithm */
+	/** get the key-derivation algorithm, using the volume's parameters (if loaded) */
 	std::shared_ptr<KeyDerivation> getKeyDerivation() const {
 		if (keyDerivation.empty()) {throw Factory::onNotGiven("no --key-derivation given", KeyDerivationFactory::getSupported());}
-		return std::shared_ptr<KeyDerivation>(KeyDerivationFactory::getByName(keyDerivation));
+		std::shared_ptr<KeyDerivation> kd(KeyDerivationFactory::getByName(keyDerivation));
+		kd->setParams(keyDerivationParams.getParams());
+		return kd;
+	}
+
+	/** load the key-derivation parameters stored within the given (encrypted) volume, if any */
+	void loadKeyDerivationParams(const std::string& encRoot) {
+		const std::string file = encRoot + "/" + Settings::KDF_PARAMS_FILE;
+		if (!KeyDerivationParams::exists(file)) {return;}
+		const KeyDerivationParams params = KeyDerivationParams::load(file);
+		if (params.getName() != keyDerivation) {
+			throw Exception("the volume's key-derivation is '" + params.getName() + "' but --key-derivation=" + keyDerivation + " was given");
+		}
+		keyDerivationParams = params;
+		getKeyDerivation();
+	}
+
+	/** get a new path-cache. nullptr if disabled */
+	std::shared_ptr<PathCache> getPathCache() const {
+		if (!pathCacheBytes) {return nullptr;}
+		return std::make_shared<PathCache>(pathCacheBytes);
+	}
+
+	/** get a new directory-cache. nullptr if disabled */
+	std::shared_ptr<DirCache> getDirCache() const {
+		if (!dirCacheBytes) {return nullptr;}
+		return std::make_shared<DirCache>(dirCacheBytes);
+	}
+
+	/** get a new size-cache. nullptr if disabled */
+	std::shared_ptr<SizeCache> getSizeCache() const {
+		if (!sizeCacheEntries) {return nullptr;}
+		return std::make_shared<SizeCache>(sizeCacheEntries);
+	}
+
+	/** get the block-size to use for newly created files */
+	uint32_t getBlockSize() const {
+		return blockSize;
+	}
+
+	/**
+	 * the option from the volume config (if contained) or the command-line. both must not differ.
+	 * with 'getAlgorithm', the command-line's name is replaced by the algorithm it denotes
+	 */
+	static std::string getOption(const CMDLine& cmd, const VolumeConfig& volume, const std::string& key, std::string (*getAlgorithm)(const std::string&) = nullptr) {
+		std::string cli = cmd.getOption(key);
+		if (getAlgorithm) {cli = getAlgorithm(cli);}		// "auto" is a command-line convenience only
+		if (!volume.has(key)) {return cli;}
+		const std::string vol = volume.get(key);
+		if (!cli.empty() && cli != vol) {throw Exception("the volume uses --" + key + "=" + vol + " but --" + key + "=" + cli + " was given");}
+		return vol;
+	}
+
+	/** describe a configured name and the backend it was resolved to */
+	static std::string describe(const std::string& name, const std::string& resolved) {
+		if (name == resolved) {return "'" + name + "'";}
+		return "'" + name + "' -> '" + resolved + "'";
+	}
+
+	/**
+	 * legacy volumes (no volume config) were created while kernel_sha1 computed a truncated SHA-256.
+	 * such volumes keep their IVs using sha256_trunc20. plain "sha1" meant either one,
+	 * depending on whether the build supported the kernel, and is refused instead of guessing
+	 */
+	static std::string getLegacyIVGenerator(const std::string& name) {
+		if ("kernel_sha1" == name) {
+			addLog("main", "legacy volume: --iv-gen=kernel_sha1 denotes sha256_trunc20");
+			return "sha256_trunc20";
+		}
+		if ("sha1" == name) {
+			throw Exception("--iv-gen=sha1 is ambiguous for legacy volumes: builds with kernel support used a truncated SHA-256, all others SHA-1. use --iv-gen=sha256_trunc20 or --iv-gen=openssl_sha1 respectively");
+		}
+		return name;
 	}
 
-	/** get the iv-generator to use */
+	/**
+	 * get the iv-generator to use.
+	 * if the IV-cache is enabled, all generators share the same table.
+	 * containers prefill it with the first blocks of each opened file, see IVGenerator::prefill()
+	 */
 	std::shared_ptr<IVGenerator> getIVGenerator(const uint8_t* setup, const uint32_t setupLen) const {
 		if (ivGenerator.empty()) {throw Factory::onNotGiven("no --iv-gen given", IVGeneratorFactory::getSupported());}
-		return std::shared_ptr<IVGenerator>(IVGeneratorFactory::getByName(ivGenerator, setup, setupLen));
+		std::shared_ptr<IVGenerator> gen(IVGeneratorFactory::getByName(ivGeneratorBackend, setup, setupLen));
+		if (!ivCache) {return gen;}
+		return std::make_shared<IVGeneratorCached>(gen, ivCache);
 	}
 
 
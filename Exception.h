@@ -10,16 +10,20 @@
 class Exception : public std::exception {
 
 public:
-	Exception(const std::string& msg, const int _errno) : msg(msg + " [" + strerror(_errno) + "]") {;}
-	Exception(const std::string& msg) : msg(msg) {;}
-	Exception(const char* msg) : msg(msg) {;}
+	Exception(const std::string& msg, const int _errno) : msg(msg + " [" + strerror(_errno) + "]"), err(_errno) {;}
+	Exception(const std::string& msg) : msg(msg), err(0) {;}
+	Exception(const char* msg) : msg(msg), err(0) {;}
 
 private:
 	std::string msg;
+	int err;
 
 public:
 	const char* what() const throw() {return msg.c_str();}
 
+	/** the error-code (errno) describing the cause. 0 if unknown */
+	int getErrno() const {return err;}
+
 };
 
 #endif //EXCEPTION_H
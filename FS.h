@@ -5,13 +5,17 @@
 #include "Keys.h"
 #include "CMDLine.h"
 #include "Configuration.h"
+#include "Stats.h"
 
 #include "cipher/CipherFactory.h"
 #include "digest/DigestFactory.h"
 #include "container/EncryptedContainer.h"
 #include "files/FilePath.h"
+#include "files/DirStream.h"
 
 #include <cassert>
+#include <map>
+#include <mutex>
 
 #include <cstdlib>
 #include <stdio.h>
@@ -20,6 +24,7 @@
 #include <sys/time.h>
 #include <sys/file.h>
 #include <pwd.h>
+#include <pthread.h>
 
 
 /** convert from fuse file handle to custom type */
@@ -34,6 +39,117 @@
 /** prevent unused warnings */
 #define unused(var) (void) var;
 
+/**
+ * exceptions must not pass the FUSE (C) callbacks.
+ * they are returned as the exception's errno (EIO if unknown)
+ */
+template <typename T, T> struct Guard;
+template <typename... Args, int (*Func)(Args...)> struct Guard<int (*)(Args...), Func> {
+	static int call(Args... args) {
+		try {
+			return Func(args...);
+		} catch (const Exception& e) {
+			addLog("error", e.what());
+			return (e.getErrno()) ? (-e.getErrno()) : (-EIO);
+		} catch (const std::exception& e) {
+			addLog("error", e.what());
+			return -EIO;
+		}
+	}
+};
+#define GUARDED(func) Guard<decltype(&func), &func>::call
+
+
+/**
+ * per-directory IVs: rmdir() and rename() remove a folder's IV for a moment.
+ * an entry created within that folder meanwhile would be named using the fixed IV.
+ * creating entries is shared, removing (or replacing) folders is exclusive
+ */
+class DirIVLock {
+
+	pthread_rwlock_t lock = PTHREAD_RWLOCK_INITIALIZER;
+
+public:
+
+	/** creating an entry */
+	struct Shared {
+		DirIVLock& l;
+		Shared(DirIVLock& l) : l(l) {pthread_rwlock_rdlock(&l.lock);}
+		~Shared() {pthread_rwlock_unlock(&l.lock);}
+	};
+
+	/** removing or replacing a folder */
+	struct Exclusive {
+		DirIVLock& l;
+		Exclusive(DirIVLock& l) : l(l) {pthread_rwlock_wrlock(&l.lock);}
+		~Exclusive() {pthread_rwlock_unlock(&l.lock);}
+	};
+
+};
+
+/**
+ * all handles of the same file (and truncate()) share one container.
+ * the container caches the file's header (e.g. its size):
+ * separate containers would overwrite each other's changes
+ */
+class OpenFiles {
+
+public:
+
+	/** identifies a file independent of its (changing) path */
+	typedef std::pair<dev_t, ino_t> FileID;
+
+private:
+
+	struct Entry {
+		std::shared_ptr<EncryptedContainer> ec;
+		size_t handles = 0;
+	};
+
+	std::mutex mtx;
+	std::map<FileID, Entry> files;
+
+public:
+
+	/** get the container for the given opened file. the file's first handle creates it */
+	std::shared_ptr<EncryptedContainer> open(const int fd, const int flags, const Key& k, const Configuration& cfg, FileID& id) {
+
+		struct stat st;
+		if (fstat(fd, &st) < 0) {throw Exception("error while opening file", errno);}
+		id = FileID(st.st_dev, st.st_ino);
+
+		std::lock_guard<std::mutex> lock(mtx);
+		Entry& e = files[id];
+		if (!e.ec) {
+			try {
+				// the container uses its own descriptor: the first handle might be released before the others
+				const int ownFd = dup(fd);
+				if (ownFd < 0) {throw Exception("error while opening file", errno);}
+				e.ec = std::make_shared<EncryptedContainer>(
+					std::make_shared<FileContainer>(ownFd, flags, true),
+					std::shared_ptr<Cipher>(cfg.getCipherFileData(k.data, k.len)),
+					std::shared_ptr<IVGenerator>(cfg.getIVGenerator(k.data, k.len)),
+					cfg.getBlockSize()
+				);
+			} catch (...) {
+				files.erase(id);
+				throw;
+			}
+		}
+		++e.handles;
+		return e.ec;
+
+	}
+
+	/** a handle is done with the file's container. the last one flushes and closes it */
+	void release(const FileID& id, std::shared_ptr<EncryptedContainer>& ec) {
+		std::lock_guard<std::mutex> lock(mtx);
+		ec.reset();
+		const auto it = files.find(id);
+		if (it != files.end() && --it->second.handles == 0) {files.erase(it);}
+	}
+
+};
 
 /** the fuse-module's state */
 struct ModuleState {
@@ -47,6 +163,18 @@ struct ModuleState {
 	/** file-name encryption/decryption/translation */
 	FilePath* fp;
 
+	/** decrypted directory listings (optional) */
+	std::shared_ptr<DirCache> dirCache;
+
+	/** decrypted file-sizes (optional) */
+	std::shared_ptr<SizeCache> sizeCache;
+
+	/** creating entries vs. removing folders (and their IVs) */
+	DirIVLock dirIVLock;
+
+	/** the containers of all opened files */
+	OpenFiles openFiles;
+
 } module;
 
 
@@ -54,48 +182,51 @@ struct ModuleState {
  * file-handles attached to fuse-handles.
  * this is were things get a little-bit messy...
  * the ctor takes the user-key, the configuration and the file-descriptor
- * and setups the cipher, iv-generator and encryption-container from it
+ * and setups the cipher, iv-generator and encryption-container from it.
+ * the container is shared with all other handles of the same file
  */
 struct FileHandle {
 
 	// handle to an opened file
 	const int fd;
 
+	// the opened file
+	OpenFiles::FileID id;
+
 	// the container to use for accessing this file
-	EncryptedContainer ec;
+	std::shared_ptr<EncryptedContainer> ec;
 
 	FileHandle(const int fd, const int flags, const Key& k, const Configuration& cfg) :
-		fd(fd),
-		ec(
-			std::shared_ptr<FileContainer>(new FileContainer(fd, flags)),
-			std::shared_ptr<Cipher>(cfg.getCipherFileData(k.data, k.len)),
-			std::shared_ptr<IVGenerator>(cfg.getIVGenerator(k.data, k.len))
-		) {
+		fd(fd), id(), ec(module.openFiles.open(fd, flags, k, cfg, id)) {
+
+	}
 
+	~FileHandle() {
+		module.openFiles.release(id, ec);
 	}
 
 };
 
 /**
- * get the real file size for the given encrypted file.
- * TODO: ugly and slow as hell.. workarounds?
+ * get the real file size for the given encrypted file, with the given stats.
+ * served from the size-cache, which is filled when listing the folder
  */
-static size_t getContainerSize(const std::string& absPath) {
-	const int fd = open(absPath.c_str(), O_RDONLY);
-	EncryptedContainerHeader header;
-	pread(fd, &header, sizeof(header), 0);
-	close(fd);
-	return header.fileSize;
+static uint64_t getContainerSize(const char* absPath, const struct stat& st) {
+	if (module.sizeCache) {return module.sizeCache->get(AT_FDCWD, absPath, st);}
+	uint64_t size = 0;
+	SizeCache::read(AT_FDCWD, absPath, size);
+	return size;
 }
 
 /** get file/path attributes */
 int kcrypt_getattr(const char* relativePath, struct stat* statbuf) {
 
-	const std::string absPath = module.fp->getAbsolutePathEnc(relativePath);
+	PathBuffer absPath;
+	module.fp->getAbsolutePathEnc(relativePath, absPath);
 	const int res = lstat(absPath.c_str(), statbuf);
 
-	if (res >= 0) {
-		statbuf->st_size = getContainerSize(absPath);			// the decrypted size
+	if (res >= 0 && S_ISREG(statbuf->st_mode)) {
+		statbuf->st_size = getContainerSize(absPath.c_str(), *statbuf);		// the decrypted size
 	}
 
 	addLogRes("getattr", relativePath, res);
@@ -108,7 +239,7 @@ int kcrypt_fgetattr(const char* relativePath, struct stat* statbuf, struct fuse_
 
 	FileHandle* fh = (FileHandle*) fi->fh;
 	const int res = fstat(fh->fd, statbuf);
-	statbuf->st_size = fh->ec.getSize();			// the decrypted size
+	statbuf->st_size = fh->ec->getSize();			// the decrypted size
 	addLogRes("fgetattr", relativePath, res);
 	return resOrErrno(res);
 
@@ -117,7 +248,7 @@ int kcrypt_fgetattr(const char* relativePath, struct stat* statbuf, struct fuse_
 int kcrypt_fsync(const char* relativePath, int datasync, struct fuse_file_info* fi) {
 
 	FileHandle* fh = (FileHandle*) fi->fh;
-	int res = fh->ec.sync(datasync);
+	int res = fh->ec->sync(datasync);
 	addLogRes("fsync", relativePath, res);
 	return resOrErrno(res);
 
@@ -126,7 +257,8 @@ int kcrypt_fsync(const char* relativePath, int datasync, struct fuse_file_info*
 /** ?? */
 int kcrypt_access(const char* relativePath, int mask) {
 
-	const std::string absPath = module.fp->getAbsolutePathEnc(relativePath);
+	PathBuffer absPath;
+	module.fp->getAbsolutePathEnc(relativePath, absPath);
 	const int res = access(absPath.c_str(), mask);
 	addLogRes("access", relativePath, res);
 	return resOrErrno(res);
@@ -140,7 +272,8 @@ int kcrypt_open(const char* relativePath, struct fuse_file_info* fi) {
 	const int flags = (fi->flags & ~(0x3)) | O_RDWR;
 
 	// open the encrypted file
-	const std::string absPath = module.fp->getAbsolutePathEnc(relativePath);
+	PathBuffer absPath;
+	module.fp->getAbsolutePathEnc(relativePath, absPath);
 	const int fd = open(absPath.c_str(), flags);
 	addLogRes("open", relativePath, fd);
 
@@ -161,7 +294,7 @@ int kcrypt_release(const char* relativePath, struct fuse_file_info* fi) {
 
 	FileHandle* fh = (FileHandle*) fi->fh;		// order here is very important to prevent crashes
 	const int fd = fh->fd;						// remember the file-descriptor
-	delete fh;									// delete the handle, this will also flush the container!!
+	delete fh;									// delete the handle, the file's last handle will also flush the container!!
 	const int res = close(fd);					// now that everything is flushed, close the handle
 	addLogRes("release", relativePath, res);
 	return resOrErrno(res);
@@ -173,7 +306,7 @@ int kcrypt_read(const char* relativePath, char* dst, size_t size, off_t offset,
 
 	(void) relativePath;
 	FileHandle* fh = (FileHandle*) fi->fh;
-	return fh->ec.read((uint8_t*) dst, size, offset);
+	return fh->ec->read((uint8_t*) dst, size, offset);
 
 }
 
@@ -182,7 +315,7 @@ int kcrypt_write(const char* relativePath, const char* src, size_t size, off_t o
 
 	(void) relativePath;
 	FileHandle* fh = (FileHandle*) fi->fh;
-	return fh->ec.write((uint8_t*) src, size, offset);
+	return fh->ec->write((uint8_t*) src, size, offset);
 
 }
 
@@ -191,9 +324,35 @@ int kcrypt_write(const char* relativePath, const char* src, size_t size, off_t o
 /** rename the given file */
 int kcrypt_rename(const char* relativePath, const char* newRelativePath) {
 
-	const std::string absPath = module.fp->getAbsolutePathEnc(relativePath);
-	const std::string newAbsPath = module.fp->getAbsolutePathEnc(newRelativePath);
+	DirIVLock::Exclusive lock(module.dirIVLock);
+
+	PathBuffer absPath;
+	module.fp->getAbsolutePathEnc(relativePath, absPath);
+	PathBuffer newAbsPath;
+	module.fp->getAbsolutePathEnc(newRelativePath, newAbsPath);
+	const bool newLongName = module.fp->storeLongName(newRelativePath);
+
+	// replacing an (empty) folder: its IV would prevent this. the source folder keeps its own one
+	struct stat st;
+	uint8_t iv[Settings::FILE_PATH_DIR_IV_LEN];
+	bool removedIV = false;
+	if (module.fp->usesDirIVs() && strcmp(relativePath, newRelativePath) != 0 && lstat(newAbsPath.c_str(), &st) == 0 && S_ISDIR(st.st_mode)) {
+		try {
+			removedIV = module.fp->removeDirIV(newRelativePath, iv);
+		} catch (const Exception&) {
+			if (newLongName) {module.fp->removeLongName(newRelativePath);}
+			throw;
+		}
+	}
+
 	const int res = rename(absPath.c_str(), newAbsPath.c_str());
+	const int err = errno;
+	if (res != 0 && removedIV) {module.fp->restoreDirIV(newRelativePath, iv);}
+	if (res != 0 && newLongName) {module.fp->removeLongName(newRelativePath);}
+	errno = err;
+	if (res == 0 && strcmp(relativePath, newRelativePath) != 0) {module.fp->removeLongName(relativePath);}
+	module.fp->invalidate(relativePath);
+	module.fp->invalidate(newRelativePath);
 	addLogRes("rename", std::string(relativePath) + " -> " + newRelativePath, res);
 	return resOrErrno(res);
 
@@ -202,8 +361,11 @@ int kcrypt_rename(const char* relativePath, const char* newRelativePath) {
 /** delete the given file */
 int kcrypt_unlink(const char* relativePath) {
 
-	const std::string absPath = module.fp->getAbsolutePathEnc(relativePath);
+	PathBuffer absPath;
+	module.fp->getAbsolutePathEnc(relativePath, absPath);
 	const int res = unlink(absPath.c_str());
+	if (res == 0) {module.fp->removeLongName(relativePath);}
+	module.fp->invalidate(relativePath);
 	addLogRes("unlink", relativePath, res);
 	return resOrErrno(res);
 
@@ -212,7 +374,8 @@ int kcrypt_unlink(const char* relativePath) {
 /** change the given file's permissions */
 int kcrypt_chmod(const char* relativePath, mode_t mode) {
 
-	const std::string absPath = module.fp->getAbsolutePathEnc(relativePath);
+	PathBuffer absPath;
+	module.fp->getAbsolutePathEnc(relativePath, absPath);
 	const int res = chmod(absPath.c_str(), mode);
 	addLogRes("chmod", relativePath, res);
 	return resOrErrno(res);
@@ -222,7 +385,8 @@ int kcrypt_chmod(const char* relativePath, mode_t mode) {
 /** Change the owner and group of a file */
 int kcrypt_chown(const char* relativePath, uid_t uid, gid_t gid) {
 
-	const std::string absPath = module.fp->getAbsolutePathEnc(relativePath);
+	PathBuffer absPath;
+	module.fp->getAbsolutePathEnc(relativePath, absPath);
 	const int res = chown(absPath.c_str(), uid, gid);
 	addLogRes("chown", relativePath, res);
 	return resOrErrno(res);
@@ -232,7 +396,8 @@ int kcrypt_chown(const char* relativePath, uid_t uid, gid_t gid) {
 /** change the given file's last access time*/
 int kcrypt_utime(const char* relativePath, struct utimbuf* ubuf) {
 
-	const std::string absPath = module.fp->getAbsolutePathEnc(relativePath);
+	PathBuffer absPath;
+	module.fp->getAbsolutePathEnc(relativePath, absPath);
 	const int res = utime(absPath.c_str(), ubuf);
 	addLogRes("utime", relativePath, res);
 	return resOrErrno(res);
@@ -242,7 +407,8 @@ int kcrypt_utime(const char* relativePath, struct utimbuf* ubuf) {
 /** change the given file's last access and last modification time */
 int kcrypt_utimens(const char* relativePath, const struct timespec ts[2]) {
 
-	const std::string absPath = module.fp->getAbsolutePathEnc(relativePath);
+	PathBuffer absPath;
+	module.fp->getAbsolutePathEnc(relativePath, absPath);
 	struct timeval tv[2];
 	tv[0].tv_sec = ts[0].tv_sec; tv[0].tv_usec = ts[0].tv_nsec / 1000;
 	tv[1].tv_sec = ts[1].tv_sec; tv[1].tv_usec = ts[1].tv_nsec / 1000;
@@ -268,13 +434,39 @@ int kcrypt_lock(const char* relativePath, struct fuse_file_info* fi, int cmd, st
 /** change the given file's size */
 int kcrypt_truncate(const char* relativePath, off_t newsize) {
 
-	const std::string absPath = module.fp->getAbsolutePathEnc(relativePath);
-	// TODO: better ways?
-	newsize += 8192; // header and trailing blocks
-	const int res = truncate(absPath.c_str(), newsize);
+	PathBuffer absPath;
+	module.fp->getAbsolutePathEnc(relativePath, absPath);
+
+	// the container re-encrypts the last block and updates its header.
+	// it is shared with the file's open handles, which would otherwise keep the old size
+	const int fd = open(absPath.c_str(), O_RDWR);
+	if (fd < 0) {addLogRes("truncate", relativePath, fd); return -errno;}
+
+	int res;
+	try {
+		const Key k = module.keys.getFileDataKey();
+		FileHandle fh(fd, O_RDWR, k, module.cfg);
+		res = fh.ec->truncate(newsize);
+	} catch (...) {
+		close(fd);
+		throw;
+	}
+	const int err = errno;
+	close(fd);
+	errno = err;
+
 	addLogRes("truncate", std::string(relativePath) + " to " + std::to_string(newsize), res);
 	return resOrErrno(res);
-	return 0;
+
+}
+
+/** change the given opened file's size */
+int kcrypt_ftruncate(const char* relativePath, off_t newsize, struct fuse_file_info* fi) {
+
+	FileHandle* fh = (FileHandle*) fi->fh;
+	const int res = fh->ec->truncate(newsize);
+	addLogRes("ftruncate", std::string(relativePath) + " to " + std::to_string(newsize), res);
+	return resOrErrno(res);
 
 }
 
@@ -284,18 +476,56 @@ int kcrypt_truncate(const char* relativePath, off_t newsize) {
 /** create a new directory */
 int kcrypt_mkdir(const char* relativePath, mode_t mode) {
 
-	const std::string absPath = module.fp->getAbsolutePathEnc(relativePath);
-	const int res = mkdir(absPath.c_str(), mode);
+	DirIVLock::Shared lock(module.dirIVLock);
+
+	PathBuffer absPath;
+	module.fp->getAbsolutePathEnc(relativePath, absPath);
+	const bool newLongName = module.fp->storeLongName(relativePath);
+
+	// the folder's IV is stored within the folder: needs write access, even for read-only folders
+	const mode_t tmpMode = (module.fp->usesDirIVs()) ? (mode | S_IRWXU) : (mode);
+	const int res = mkdir(absPath.c_str(), tmpMode);
+	const int err = errno;
 	addLogRes("mkdir", relativePath, res);
-	return resOrErrno(res);
+	if (res != 0) {
+		if (newLongName) {module.fp->removeLongName(relativePath);}
+		return -err;
+	}
+
+	try {
+		module.fp->createDirIV(relativePath);
+	} catch (const Exception&) {
+		rmdir(absPath.c_str());
+		if (newLongName) {module.fp->removeLongName(relativePath);}
+		throw;
+	}
+
+	// restore the requested permissions (as masked by the umask)
+	struct stat st;
+	if (tmpMode != mode && stat(absPath.c_str(), &st) == 0) {
+		chmod(absPath.c_str(), (st.st_mode & 07777) & ~(S_IRWXU & ~mode));
+	}
+	return 0;
 
 }
 
 /** remove an existing directory */
 int kcrypt_rmdir(const char* relativePath) {
 
-	const std::string absPath = module.fp->getAbsolutePathEnc(relativePath);
+	DirIVLock::Exclusive lock(module.dirIVLock);
+
+	PathBuffer absPath;
+	module.fp->getAbsolutePathEnc(relativePath, absPath);
+
+	// the folder's IV would prevent removing it. (empty) folders that could not be removed get it back
+	uint8_t iv[Settings::FILE_PATH_DIR_IV_LEN];
+	const bool removedIV = module.fp->removeDirIV(relativePath, iv);
 	const int res = rmdir(absPath.c_str());
+	const int err = errno;
+	if (res != 0 && removedIV) {module.fp->restoreDirIV(relativePath, iv);}
+	errno = err;
+	if (res == 0) {module.fp->removeLongName(relativePath);}
+	module.fp->invalidate(relativePath);
 	addLogRes("rmdir", relativePath, res);
 	return resOrErrno(res);
 
@@ -303,8 +533,15 @@ int kcrypt_rmdir(const char* relativePath) {
 
 int kcrypt_mknod(const char* relativePath, mode_t mode, dev_t dev) {
 
-	const std::string absPath = module.fp->getAbsolutePathEnc(relativePath);
+	DirIVLock::Shared lock(module.dirIVLock);
+
+	PathBuffer absPath;
+	module.fp->getAbsolutePathEnc(relativePath, absPath);
+	const bool newLongName = module.fp->storeLongName(relativePath);
 	const int res = mknod(absPath.c_str(), mode, dev);
+	const int err = errno;
+	if (res != 0 && newLongName) {module.fp->removeLongName(relativePath);}
+	errno = err;
 	addLogRes("mknod", relativePath, res);
 	return resOrErrno(res);
 
@@ -313,23 +550,40 @@ int kcrypt_mknod(const char* relativePath, mode_t mode, dev_t dev) {
 /** newly create the given file */
 int kcrypt_create(const char* relativePath, const mode_t _mode, struct fuse_file_info* fi) {
 
-	const std::string absPath = module.fp->getAbsolutePathEnc(relativePath);
+	DirIVLock::Shared lock(module.dirIVLock);
+
+	PathBuffer absPath;
+	module.fp->getAbsolutePathEnc(relativePath, absPath);
+	const bool newLongName = module.fp->storeLongName(relativePath);
 
 	//const int mode = (_mode & ~(0x3)) | O_RDWR;
 	//const int fd = creat(absPath.c_str(), mode);
-	const int fd = open(absPath.c_str(), O_CREAT|O_RDWR, 0700);
+	// remember whether the file is new: only then it is removed again on errors
+	int fd = open(absPath.c_str(), O_CREAT|O_EXCL|O_RDWR, 0700);
+	const bool created = (fd >= 0);
+	if (fd < 0 && errno == EEXIST && !(fi->flags & O_EXCL)) {fd = open(absPath.c_str(), O_RDWR);}
+	const int err = errno;
 	std::cout << "create:" << fd << std::endl;
 	addLogRes("create", relativePath, fd);
+	if (fd < 0) {
+		if (newLongName) {module.fp->removeLongName(relativePath);}
+		return -err;
+	}
 
-	// create a new FileHandle for this newly created file
-	if (fd >= 0) {
+	// create a new FileHandle for this newly created file. writes the header (and the file's nonce)
+	try {
 		const Key k = module.keys.getFileDataKey();
 		FileHandle* fh = new FileHandle(fd, O_RDWR, k, module.cfg);
 		fi->fh = TO_FUSE_FH(fh);
+	} catch (...) {
+		close(fd);
+		if (created) {unlink(absPath.c_str());}
+		if (newLongName) {module.fp->removeLongName(relativePath);}
+		throw;
 	}
 
 	// done
-	return nullOrErrno(fd);
+	return 0;
 
 }
 
@@ -337,37 +591,35 @@ int kcrypt_create(const char* relativePath, const mode_t _mode, struct fuse_file
 /** open the given directory for reading its contents */
 int kcrypt_opendir(const char* relativePath, struct fuse_file_info* fi) {
 
-	const std::string absPath = module.fp->getAbsolutePathEnc(relativePath);
+	PathBuffer absPath;
+	module.fp->getAbsolutePathEnc(relativePath, absPath);
 
-	errno = 0;
 	DIR* dp = opendir(absPath.c_str());
+	const int err = errno;
 	addLogRes("opendir", relativePath, (ssize_t)dp);
+	if (dp == NULL) {return -err;}
 
 	// create a handle for this folder
-	if (dp != NULL) {fi->fh = TO_FUSE_FH( dp );}
-	return nullOrErrno(dp);
+	fi->fh = TO_FUSE_FH( new DirStream(dp, module.fp, module.dirCache, relativePath) );
+	return 0;
 
 }
 
-/** list all contents of a previously opened directory */
+/**
+ * list the contents of a previously opened directory, starting at the given offset.
+ * entries are passed in chunks along with the offset of their successor,
+ * until the kernel's buffer is full. the next call continues at that offset
+ */
 int kcrypt_readdir(const char* relativePath, void* buf, fuse_fill_dir_t filler, off_t offset, struct fuse_file_info* fi) {
 
-	unused(offset);
-
 	// get the handle for the previously opened dir
-	DIR* dp = (DIR*) fi->fh;
-	addLogRes("readdir", relativePath, (ssize_t)dp);
-
-	// read the directory and check whether it exists
-	struct dirent* de = readdir(dp);
-	if (de == 0) { return 0; }
+	DirStream* ds = (DirStream*) fi->fh;
+	addLogRes("readdir", relativePath, offset);
 
-	// read and add all entries
-	do {
-		std::string dec = module.fp->decrypt(de->d_name);
-		int res = filler(buf, dec.c_str(), NULL, 0);
-		if (res != 0) {return -ENOMEM;}
-	} while ((de = readdir(dp)) != NULL);
+	// libfuse 2 uses the entry's type only. the getattr() calls to follow fill the size-cache
+	ds->read(offset, [&] (const DirEntry& e, const struct stat& st, const off_t next) {
+		return filler(buf, e.plain.c_str(), &st, next) != 0;
+	});
 
 	return 0;
 
@@ -376,9 +628,10 @@ int kcrypt_readdir(const char* relativePath, void* buf, fuse_fill_dir_t filler,
 /** close the previously opened directory */
 int kcrypt_releasedir(const char* relativePath, struct fuse_file_info *fi) {
 
-	const std::string absPath = module.fp->getAbsolutePathEnc(relativePath);
-	DIR* dp = (DIR*) fi->fh;
-	const int res = closedir(dp);
+	DirStream* ds = (DirStream*) fi->fh;
+	if (ds->getSkipped()) {addLog("readdir", "skipped " + std::to_string(ds->getSkipped()) + " foreign entries");}
+	const int res = ds->close();
+	delete ds;
 	addLogRes("releasedir", relativePath, res);
 	return resOrErrno(res);
 
@@ -388,7 +641,8 @@ int kcrypt_releasedir(const char* relativePath, struct fuse_file_info *fi) {
 /** get filesystem stats */
 int kcrypt_statfs(const char* relativePath, struct statvfs* statv) {
 
-	const std::string absPath = module.fp->getAbsolutePathEnc(relativePath);
+	PathBuffer absPath;
+	module.fp->getAbsolutePathEnc(relativePath, absPath);
 	const int res = statvfs(absPath.c_str(), statv);
 	addLogRes("statfs", relativePath, res);
 	return resOrErrno(res);
@@ -407,6 +661,7 @@ void* kcrypt_init(struct fuse_conn_info* conn) {
 void kcrypt_destroy(void* userdata) {
 	unused(userdata);
 	addLog("destroy", "");
+	addLog("stats", Stats::get().asString());
 }
 
 
@@ -443,39 +698,40 @@ int startFuse(const CMDLine& args) {
 	kcrypt_ops.init = kcrypt_init;
 	kcrypt_ops.destroy = kcrypt_destroy;
 
-	kcrypt_ops.getattr = kcrypt_getattr;
-	kcrypt_ops.fsync = kcrypt_fsync;
-	kcrypt_ops.fgetattr = kcrypt_fgetattr;
-	kcrypt_ops.access = kcrypt_access;
-
-	kcrypt_ops.mkdir = kcrypt_mkdir;
-	kcrypt_ops.rmdir = kcrypt_rmdir;
-	kcrypt_ops.mknod = kcrypt_mknod;
-	kcrypt_ops.create = kcrypt_create;
-
-	kcrypt_ops.open = kcrypt_open;
-	kcrypt_ops.release = kcrypt_release;
-
-	kcrypt_ops.read = kcrypt_read;
-	kcrypt_ops.write = kcrypt_write;
-
-	kcrypt_ops.chown = kcrypt_chown;
-	kcrypt_ops.chmod = kcrypt_chmod;
-	kcrypt_ops.utime = kcrypt_utime;
-	kcrypt_ops.utimens = kcrypt_utimens;
-	kcrypt_ops.lock = kcrypt_lock;
-	kcrypt_ops.truncate = kcrypt_truncate;
-	kcrypt_ops.statfs = kcrypt_statfs;
-	kcrypt_ops.rename = kcrypt_rename;
-	kcrypt_ops.unlink = kcrypt_unlink;
-
-	kcrypt_ops.opendir = kcrypt_opendir;
-	kcrypt_ops.readdir = kcrypt_readdir;
-	kcrypt_ops.releasedir = kcrypt_releasedir;
-
-	kcrypt_ops.poll = kcrypt_poll;
-	kcrypt_ops.ioctl = kcrypt_ioctl;
-	kcrypt_ops.fsyncdir = kcrypt_fsyncdir;
+	kcrypt_ops.getattr = GUARDED(kcrypt_getattr);
+	kcrypt_ops.fsync = GUARDED(kcrypt_fsync);
+	kcrypt_ops.fgetattr = GUARDED(kcrypt_fgetattr);
+	kcrypt_ops.access = GUARDED(kcrypt_access);
+
+	kcrypt_ops.mkdir = GUARDED(kcrypt_mkdir);
+	kcrypt_ops.rmdir = GUARDED(kcrypt_rmdir);
+	kcrypt_ops.mknod = GUARDED(kcrypt_mknod);
+	kcrypt_ops.create = GUARDED(kcrypt_create);
+
+	kcrypt_ops.open = GUARDED(kcrypt_open);
+	kcrypt_ops.release = GUARDED(kcrypt_release);
+
+	kcrypt_ops.read = GUARDED(kcrypt_read);
+	kcrypt_ops.write = GUARDED(kcrypt_write);
+
+	kcrypt_ops.chown = GUARDED(kcrypt_chown);
+	kcrypt_ops.chmod = GUARDED(kcrypt_chmod);
+	kcrypt_ops.utime = GUARDED(kcrypt_utime);
+	kcrypt_ops.utimens = GUARDED(kcrypt_utimens);
+	kcrypt_ops.lock = GUARDED(kcrypt_lock);
+	kcrypt_ops.truncate = GUARDED(kcrypt_truncate);
+	kcrypt_ops.ftruncate = GUARDED(kcrypt_ftruncate);
+	kcrypt_ops.statfs = GUARDED(kcrypt_statfs);
+	kcrypt_ops.rename = GUARDED(kcrypt_rename);
+	kcrypt_ops.unlink = GUARDED(kcrypt_unlink);
+
+	kcrypt_ops.opendir = GUARDED(kcrypt_opendir);
+	kcrypt_ops.readdir = GUARDED(kcrypt_readdir);
+	kcrypt_ops.releasedir = GUARDED(kcrypt_releasedir);
+
+	kcrypt_ops.poll = GUARDED(kcrypt_poll);
+	kcrypt_ops.ioctl = GUARDED(kcrypt_ioctl);
+	kcrypt_ops.fsyncdir = GUARDED(kcrypt_fsyncdir);
 
 
 	// turn over control to fuse
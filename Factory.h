@@ -3,8 +3,21 @@
 
 #include <vector>
 #include <string>
+#include <map>
+#include <mutex>
+#include <chrono>
+#include <functional>
+#include <algorithm>
 
 #include "Exception.h"
+#include "CPUFeatures.h"
+
+namespace Settings {
+
+	/** how long to time each candidate implementation when calibrating */
+	static constexpr uint32_t CALIBRATION_MS = 5;
+
+}
 
 /**
  * base-class for all factories:
@@ -29,6 +42,100 @@ public:
 		return Exception(str);
 	}
 
+	/**
+	 * select the backend for a backend-independent name like "aes_cbc_256".
+	 * OpenSSL runs in user-space without any syscalls and is used whenever the CPU
+	 * accelerates the algorithm. the kernel is used when it provides a dedicated
+	 * driver (e.g. a crypto-engine) the CPU lacks, or when OpenSSL is not available
+	 */
+	static std::string selectBackend(const std::string& name, const bool cpuAccelerated, const std::string& kernelAlgorithm) {
+
+		bool openssl = false;
+		bool kernel = false;
+#ifdef WITH_OPENSSL
+		openssl = true;
+#endif
+#ifdef WITH_KERNEL
+		kernel = true;
+#endif
+
+		if (openssl && kernel) {
+			const bool useKernel = !cpuAccelerated && CPUFeatures::isKernelAccelerated(kernelAlgorithm);
+			return ((useKernel) ? ("kernel_") : ("openssl_")) + name;
+		}
+		if (kernel)		{return "kernel_" + name;}
+		if (openssl)	{return "openssl_" + name;}
+		return name;
+
+	}
+
+	/**
+	 * pick the fastest of several implementations of the same algorithm (e.g. openssl_sha256 and kernel_sha256)
+	 * by timing each candidate for a few milliseconds. 'measure' returns operations per second and may throw
+	 * for candidates that are unusable on this host. the first candidate serves as fallback.
+	 * the result is cached per alias, thus calibration happens only once per process.
+	 * the candidates are only determined (e.g. parsing /proc/crypto) when the alias is not yet cached
+	 */
+	static std::string calibrate(const std::string& alias, const std::function<std::vector<std::string>()>& getCandidates, const std::function<double(const std::string&)>& measure) {
+
+		static std::mutex mtx;
+		static std::map<std::string, std::string> cache;
+		std::lock_guard<std::mutex> lock(mtx);
+
+		auto it = cache.find(alias);
+		if (it != cache.end()) {return it->second;}
+
+		const std::vector<std::string> candidates = getCandidates();
+		std::string best = candidates.front();
+		if (candidates.size() > 1) {
+			double bestScore = 0;
+			for (const std::string& candidate : candidates) {
+				try {
+					const double score = measure(candidate);
+					if (score > bestScore) {bestScore = score; best = candidate;}
+				} catch (...) {
+					;	// not usable on this host
+				}
+			}
+		}
+
+		cache[alias] = best;
+		return best;
+
+	}
+
+	/** calibrate() using the given (fixed) candidates */
+	static std::string calibrate(const std::string& alias, const std::vector<std::string>& candidates, const std::function<double(const std::string&)>& measure) {
+		return calibrate(alias, [&candidates] () {return candidates;}, measure);
+	}
+
+	/** time the given operation for CALIBRATION_MS. returns the number of operations per second */
+	static double timeOperation(const std::function<void()>& op) {
+		op();
+		uint64_t count = 0;
+		const auto start = std::chrono::steady_clock::now();
+		const auto end = start + std::chrono::milliseconds(Settings::CALIBRATION_MS);
+		auto now = start;
+		do {
+			for (int i = 0; i < 16; ++i) {op();}
+			count += 16;
+			now = std::chrono::steady_clock::now();
+		} while (now < end);
+		return count / std::chrono::duration<double>(now-start).count();
+	}
+
+	/** the candidates for a backend-independent name: the preferred backend first, all others afterwards */
+	static std::vector<std::string> getCandidates(const std::string& name, const std::string& preferred, const std::vector<std::string>& supported) {
+		std::vector<std::string> res;
+		for (const std::string& backend : {std::string("openssl_"), std::string("kernel_"), std::string("native_")}) {
+			const std::string candidate = backend + name;
+			if (std::find(supported.begin(), supported.end(), candidate) == supported.end()) {continue;}
+			if (candidate == preferred) {res.insert(res.begin(), candidate);} else {res.push_back(candidate);}
+		}
+		if (res.empty()) {res.push_back(preferred);}
+		return res;
+	}
+
 	/** helper method to convert all supported entities to a string */
 	static std::string asString(const std::vector<std::string>& vec) {
 		std::string res;
@@ -1,17 +1,89 @@
 #ifndef HELPER_H
 #define HELPER_H
 
+#include <string>
+#include <cstdint>
+#include <cstdio>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/random.h>
+
+#include "Exception.h"
+
 class Helper {
 	
 public:
 
 	/** convert the given data into a hex-string */
 	static inline std::string toHexStr(const uint8_t* data, const uint32_t len) {
-		char out[len*2];
+		char out[len*2+1];		// sprintf() appends a terminating zero
 		for (uint32_t i = 0; i < len; i++)
         sprintf(out+i*2, "%02x", data[i]);
 		return std::string(out, len*2);
 	}
+
+	/** convert the given hex-string into exactly 'len' bytes. throws on invalid input */
+	static inline void fromHexStr(const std::string& hex, uint8_t* data, const uint32_t len) {
+		if (hex.length() != (size_t)len*2) {throw Exception("invalid hex-string length");}
+		for (uint32_t i = 0; i < len*2; ++i) {
+			const char c = hex[i];
+			uint8_t v;
+			if		(c >= '0' && c <= '9')	{v = c - '0';}
+			else if	(c >= 'a' && c <= 'f')	{v = c - 'a' + 10;}
+			else if	(c >= 'A' && c <= 'F')	{v = c - 'A' + 10;}
+			else							{throw Exception("invalid hex-string");}
+			if (i & 1)	{data[i/2] |= v;}
+			else		{data[i/2] = v << 4;}
+		}
+	}
+
+	/** fill the given buffer with cryptographically secure random bytes */
+	static inline void getRandom(uint8_t* dst, const size_t len) {
+		size_t done = 0;
+		while (done < len) {
+			const ssize_t res = getrandom(dst+done, len-done, 0);
+			if (res < 0) {
+				if (errno == EINTR) {continue;}
+				throw Exception("error while fetching random bytes", errno);
+			}
+			done += res;
+		}
+	}
+
+	/**
+	 * replace the given file atomically and durably by the given content:
+	 * write a temporary file, fsync() it, rename() it and fsync() the containing folder.
+	 * after a crash, either the former or the new content exists, never an empty or partial file
+	 */
+	static inline void writeFileAtomic(const std::string& file, const std::string& content) {
+
+		const std::string tmp = file + ".tmp";
+		const int fd = open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+		if (fd < 0) {throw Exception("could not create " + tmp, errno);}
+
+		size_t done = 0;
+		while (done < content.length()) {
+			const ssize_t res = write(fd, content.data()+done, content.length()-done);
+			if (res < 0 && errno == EINTR) {continue;}
+			if (res < 0) {const int err = errno; close(fd); unlink(tmp.c_str()); throw Exception("error while writing " + tmp, err);}
+			done += res;
+		}
+		if (fsync(fd) != 0) {const int err = errno; close(fd); unlink(tmp.c_str()); throw Exception("error while syncing " + tmp, err);}
+		if (close(fd) != 0) {const int err = errno; unlink(tmp.c_str()); throw Exception("error while closing " + tmp, err);}
+
+		if (rename(tmp.c_str(), file.c_str()) != 0) {const int err = errno; unlink(tmp.c_str()); throw Exception("could not replace " + file, err);}
+
+		// the rename itself is stored within the folder
+		const size_t pos = file.rfind('/');
+		const std::string folder = (pos == std::string::npos) ? (".") : ((pos == 0) ? ("/") : (file.substr(0, pos)));
+		const int dirFD = open(folder.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+		if (dirFD < 0) {throw Exception("could not open " + folder, errno);}
+		const int res = fsync(dirFD);
+		const int err = errno;
+		close(dirFD);
+		if (res != 0) {throw Exception("error while syncing " + folder, err);}
+
+	}
 	
 };
 
@@ -4,13 +4,17 @@
 #include <termios.h>
 #include <unistd.h>
 #include <memory>
+#include <thread>
+#include <exception>
 
 #include "Log.h"
 #include "Exception.h"
 #include "Helper.h"
 #include "Configuration.h"
+#include "VolumeConfig.h"
 #include "cipher/CipherFactory.h"
 #include "derivation/KeyDerivationFactory.h"
+#include "digest/DigestFactory.h"
 
 #define MAX_KEY_LEN		(1024/8)
 
@@ -30,6 +34,14 @@ struct Key {
  *  - user-password-input
  *  - key generation
  *  - key storage
+ *
+ * volumes with a volume config use random keys, wrapped with a key-encryption-key (KEK)
+ * derived from one password and the volume's random salt:
+ *		KEK = KDF(password, salt)							64 bytes
+ *		wrapped = AES-256-CBC_KEK[0:32](keyData + keyNames)	random IV
+ *		check = HMAC-SHA256_KEK[32:64](IV + wrapped)
+ * unlocking needs one derivation, changing the password just re-wraps the keys.
+ * legacy volumes derive both keys from two passwords using fixed salts
  */
 class Keys {
 
@@ -56,6 +68,108 @@ public:
 	const Key& getFileNameKey() {return keyNames;}
 	
 
+	/** create random keys for a new volume, protected by a new password (asked twice) */
+	void createVolume(const Configuration& cfg, VolumeConfig& volume) {
+		generate(cfg);
+		const std::string pass = readNewPassword("password");
+		addLog("keys", "wrapping keys, this may take some time");
+		wrap(cfg, pass, volume);
+	}
+
+	/** ask for the volume's password and unwrap its keys */
+	void unlockVolume(const Configuration& cfg, const VolumeConfig& volume) {
+		const std::string pass = readPassword("password");
+		addLog("keys", "unwrapping keys, this may take some time");
+		if (!unwrap(cfg, pass, volume)) {throw Exception("wrong password");}
+		addLog("keys", "keys unwrapped");
+	}
+
+	/** ask for the volume's current and a new password and re-wrap its keys (the volume's data is not touched) */
+	void changePassword(const Configuration& cfg, VolumeConfig& volume) {
+		unlockVolume(cfg, volume);
+		const std::string pass = readNewPassword("new password");
+		wrap(cfg, pass, volume);
+	}
+
+	/** create random keys */
+	void generate(const Configuration& cfg) {
+		keyData = Key(cfg.getCipherFileData()->getKeyLength());
+		keyNames = Key(cfg.getCipherFileNames()->getKeyLength());
+		Helper::getRandom(keyData.data, keyData.len);
+		Helper::getRandom(keyNames.data, keyNames.len);
+	}
+
+	/** wrap the current keys using the given password and a new random salt. stores the result within the volume config */
+	void wrap(const Configuration& cfg, const std::string& pass, VolumeConfig& volume) const {
+
+		uint8_t salt[Settings::VOLUME_SALT_LEN];
+		uint8_t iv[16];
+		Helper::getRandom(salt, sizeof(salt));
+		Helper::getRandom(iv, sizeof(iv));
+
+		uint8_t kek[64];
+		cfg.getKeyDerivation()->derive((const uint8_t*)pass.data(), pass.length(), salt, sizeof(salt), kek, sizeof(kek));
+
+		uint8_t plain[2*MAX_KEY_LEN] = {0};
+		const uint32_t len = getWrappedLength();
+		memcpy(plain, keyData.data, keyData.len);
+		memcpy(plain + keyData.len, keyNames.data, keyNames.len);
+
+		uint8_t wrapped[2*MAX_KEY_LEN];
+		uint8_t check[32];
+		std::unique_ptr<Cipher> cipher(CipherFactory::getByName("aes_cbc_256", kek, 32));
+		cipher->encrypt(plain, wrapped, len, iv, sizeof(iv));
+		getCheck(kek + 32, iv, wrapped, len, check);
+
+		volume.set("salt", Helper::toHexStr(salt, sizeof(salt)));
+		volume.set("key-iv", Helper::toHexStr(iv, sizeof(iv)));
+		volume.set("key", Helper::toHexStr(wrapped, len));
+		volume.set("key-check", Helper::toHexStr(check, sizeof(check)));
+
+		memset(kek, 0, sizeof(kek));
+		memset(plain, 0, sizeof(plain));
+
+	}
+
+	/** unwrap the keys stored within the volume config using the given password. false if the password is wrong */
+	bool unwrap(const Configuration& cfg, const std::string& pass, const VolumeConfig& volume) {
+
+		keyData = Key(cfg.getCipherFileData()->getKeyLength());
+		keyNames = Key(cfg.getCipherFileNames()->getKeyLength());
+		const uint32_t len = getWrappedLength();
+
+		uint8_t salt[Settings::VOLUME_SALT_LEN];
+		uint8_t iv[16];
+		uint8_t wrapped[2*MAX_KEY_LEN];
+		uint8_t check[32];
+		Helper::fromHexStr(volume.get("salt"), salt, sizeof(salt));
+		Helper::fromHexStr(volume.get("key-iv"), iv, sizeof(iv));
+		Helper::fromHexStr(volume.get("key"), wrapped, len);
+		Helper::fromHexStr(volume.get("key-check"), check, sizeof(check));
+
+		uint8_t kek[64];
+		cfg.getKeyDerivation()->derive((const uint8_t*)pass.data(), pass.length(), salt, sizeof(salt), kek, sizeof(kek));
+
+		// constant-time comparison
+		uint8_t expected[32];
+		getCheck(kek + 32, iv, wrapped, len, expected);
+		uint8_t diff = 0;
+		for (uint32_t i = 0; i < sizeof(check); ++i) {diff |= check[i] ^ expected[i];}
+		if (diff) {memset(kek, 0, sizeof(kek)); return false;}
+
+		uint8_t plain[2*MAX_KEY_LEN];
+		std::unique_ptr<Cipher> cipher(CipherFactory::getByName("aes_cbc_256", kek, 32));
+		cipher->decrypt(wrapped, plain, len, iv, sizeof(iv));
+		memcpy(keyData.data, plain, keyData.len);
+		memcpy(keyNames.data, plain + keyData.len, keyNames.len);
+
+		memset(kek, 0, sizeof(kek));
+		memset(plain, 0, sizeof(plain));
+		return true;
+
+	}
+
+
 	/** ask the user to enter his passwords and derive (strong) keys from it */
 	void askForPasswords(const Configuration& cfg) {
 		
@@ -82,15 +196,48 @@ public:
 		const uint8_t saltData[] = {169, 207, 98,	40, 50, 38, 22, 11, 217, 69, 165, 211, 130, 101, 244, 35};
 		const uint8_t saltName[] = {247, 193, 149, 73, 240, 9, 250, 139, 220, 189, 142, 60, 190, 149, 11, 7};
 		
-		// use password and salt to derive a strong 256-bit key
+		// use password and salt to derive a strong 256-bit key.
+		// both keys are independent: derive the file-name key within a second thread
 		addLog("keys", "deriving keys, this may take some time");
+		std::exception_ptr err;
+		std::thread names([&] () {
+			try {
+				keyDeriv->derive((uint8_t*)namePass.data(), namePass.length(), saltName, 16, keyNames.data, keyNames.len);
+			} catch (...) {
+				err = std::current_exception();
+			}
+		});
 		keyDeriv->derive((uint8_t*)dataPass.data(), dataPass.length(), saltData, 16, keyData.data, keyData.len);
-		keyDeriv->derive((uint8_t*)namePass.data(), namePass.length(), saltName, 16, keyNames.data, keyNames.len);
+		names.join();
+		if (err) {std::rethrow_exception(err);}
 		addLog("keys", "keys created");
 		
 	}
 
 private:
+
+	/** both keys, padded to the AES block size */
+	uint32_t getWrappedLength() const {
+		return (keyData.len + keyNames.len + 15) / 16 * 16;
+	}
+
+	/** the check value for the wrapped keys */
+	static void getCheck(const uint8_t* macKey, const uint8_t* iv, const uint8_t* wrapped, const uint32_t len, uint8_t* check) {
+		std::unique_ptr<Digest> hmac(DigestFactory::getByName("hmac_sha256"));
+		uint8_t in[16 + 2*MAX_KEY_LEN];
+		memcpy(in, iv, 16);
+		memcpy(in + 16, wrapped, len);
+		hmac->setKey(macKey, 32);
+		hmac->hash(in, 16 + len, check);
+	}
+
+	/** read a new password twice */
+	static std::string readNewPassword(const std::string& desc) {
+		const std::string pass = readPassword(desc);
+		if (pass.empty()) {throw Exception("the password must not be empty");}
+		if (pass != readPassword(desc + " (repeat)")) {throw Exception("the passwords do not match");}
+		return pass;
+	}
 	
 	/** read a password from std-in */
 	static std::string readPassword(const std::string& desc) {
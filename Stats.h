@@ -0,0 +1,77 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <atomic>
+#include <string>
+#include <cstdint>
+
+/**
+ * runtime statistics (e.g. cache hit rates).
+ * all counters are atomic and may be updated from any thread
+ */
+class Stats {
+
+public:
+
+	/** IV-cache: IVs served from the cache */
+	std::atomic<uint64_t> ivCacheHits;
+
+	/** IV-cache: IVs that had to be derived */
+	std::atomic<uint64_t> ivCacheMisses;
+
+	/** path-cache: encrypted paths served from the cache */
+	std::atomic<uint64_t> pathCacheHits;
+
+	/** path-cache: paths that had to be encrypted */
+	std::atomic<uint64_t> pathCacheMisses;
+
+	/** directory-cache: listings served from the cache */
+	std::atomic<uint64_t> dirCacheHits;
+
+	/** directory-cache: listings that had to be decrypted */
+	std::atomic<uint64_t> dirCacheMisses;
+
+	/** size-cache: decrypted file-sizes served from the cache */
+	std::atomic<uint64_t> sizeCacheHits;
+
+	/** size-cache: file-sizes that had to be read from the file's header */
+	std::atomic<uint64_t> sizeCacheMisses;
+
+	/** singleton access */
+	static Stats& get() {
+		static Stats inst;
+		return inst;
+	}
+
+	/** reset all counters */
+	void reset() {
+		ivCacheHits = 0;
+		ivCacheMisses = 0;
+		pathCacheHits = 0;
+		pathCacheMisses = 0;
+		dirCacheHits = 0;
+		dirCacheMisses = 0;
+		sizeCacheHits = 0;
+		sizeCacheMisses = 0;
+	}
+
+	/** human readable summary */
+	std::string asString() const {
+		return "iv-cache: " + hitRate(ivCacheHits, ivCacheMisses) + ", path-cache: " + hitRate(pathCacheHits, pathCacheMisses) + ", dir-cache: " + hitRate(dirCacheHits, dirCacheMisses) + ", size-cache: " + hitRate(sizeCacheHits, sizeCacheMisses);
+	}
+
+	/** "hits/total (x%)" */
+	static std::string hitRate(const uint64_t hits, const uint64_t misses) {
+		const uint64_t total = hits + misses;
+		const uint64_t percent = (total) ? (hits * 100 / total) : (0);
+		return std::to_string(hits) + "/" + std::to_string(total) + " hits (" + std::to_string(percent) + "%)";
+	}
+
+private:
+
+	/** hidden ctor. use get() */
+	Stats() : ivCacheHits(0), ivCacheMisses(0), pathCacheHits(0), pathCacheMisses(0), dirCacheHits(0), dirCacheMisses(0), sizeCacheHits(0), sizeCacheMisses(0) {;}
+
+};
+
+#endif // STATS_H
@@ -0,0 +1,139 @@
+#ifndef VOLUMECONFIG_H
+#define VOLUMECONFIG_H
+
+#include <string>
+#include <map>
+#include <fstream>
+#include <sstream>
+#include <cstdio>
+#include <sys/stat.h>
+
+#include "Exception.h"
+#include "Helper.h"
+#include "derivation/KeyDerivationParams.h"
+
+namespace Settings {
+
+	/** file within the encrypted root, describing the volume */
+	const constexpr char* VOLUME_CONFIG_FILE = ".kcryptfs.conf";
+
+	/** the current format of the volume config */
+	const constexpr uint32_t VOLUME_CONFIG_VERSION = 1;
+
+	/** length of the random salt for the key-derivation */
+	const constexpr uint32_t VOLUME_SALT_LEN = 32;
+
+}
+
+/**
+ * the volume config stored within the encrypted root as plain "key=value" lines:
+ *  - the algorithms (same names as the command-line options)
+ *  - the key-derivation's parameters ("kdf.xxx")
+ *  - a random salt
+ *  - the random master keys, wrapped (encrypted) with a key derived from the password
+ *  - a check value to detect wrong passwords
+ * nothing within is secret without the password. volumes without this file (legacy)
+ * derive their keys directly from two passwords using fixed salts
+ */
+class VolumeConfig {
+
+private:
+
+	/** all entries */
+	std::map<std::string, std::string> values;
+
+public:
+
+	/** get the config file's path within the given (encrypted) root */
+	static std::string getFile(const std::string& encRoot) {
+		return encRoot + "/" + Settings::VOLUME_CONFIG_FILE;
+	}
+
+	/** does the given (encrypted) root contain a volume config? */
+	static bool exists(const std::string& encRoot) {
+		struct stat st;
+		return stat(getFile(encRoot).c_str(), &st) == 0;
+	}
+
+	/** empty? (legacy volume) */
+	bool empty() const {
+		return values.empty();
+	}
+
+	/** get the given entry. empty if not contained */
+	std::string get(const std::string& key) const {
+		auto it = values.find(key);
+		return (it == values.end()) ? ("") : (it->second);
+	}
+
+	/** is the given entry contained? */
+	bool has(const std::string& key) const {
+		return values.find(key) != values.end();
+	}
+
+	/** set the given entry */
+	void set(const std::string& key, const std::string& val) {
+		if (key.empty() || key.find_first_of("=\n") != std::string::npos || val.find('\n') != std::string::npos) {
+			throw Exception("invalid volume config entry: " + key);
+		}
+		values[key] = val;
+	}
+
+	/** get the key-derivation and its parameters */
+	KeyDerivationParams getKeyDerivationParams() const {
+		KeyDerivation::Params params;
+		for (const auto& it : values) {
+			if (it.first.compare(0, 4, "kdf.") != 0) {continue;}
+			params[it.first.substr(4)] = (uint32_t) std::stoul(it.second);
+		}
+		return KeyDerivationParams(get("key-derivation"), params);
+	}
+
+	/** set the key-derivation and its parameters */
+	void setKeyDerivationParams(const KeyDerivationParams& params) {
+		for (auto it = values.begin(); it != values.end(); ) {
+			if (it->first.compare(0, 4, "kdf.") == 0) {it = values.erase(it);} else {++it;}
+		}
+		set("key-derivation", params.getName());
+		for (const auto& it : params.getParams()) {set("kdf." + it.first, std::to_string(it.second));}
+	}
+
+	/** load from the given (encrypted) root */
+	static VolumeConfig load(const std::string& encRoot) {
+
+		const std::string file = getFile(encRoot);
+		std::ifstream in(file);
+		if (!in) {throw Exception("could not open " + file);}
+
+		VolumeConfig res;
+		std::string line;
+		while (std::getline(in, line)) {
+			if (line.empty() || line[0] == '#') {continue;}
+			const size_t pos = line.find('=');
+			if (pos == std::string::npos) {throw Exception("invalid line within " + file + ": " + line);}
+			res.values[line.substr(0, pos)] = line.substr(pos+1);
+		}
+
+		if (res.get("version") != std::to_string(Settings::VOLUME_CONFIG_VERSION)) {
+			throw Exception("unsupported volume config version '" + res.get("version") + "' within " + file);
+		}
+		return res;
+
+	}
+
+	/** store within the given (encrypted) root. replaces an existing config atomically */
+	void save(const std::string& encRoot) {
+
+		set("version", std::to_string(Settings::VOLUME_CONFIG_VERSION));
+
+		// the only copy of the wrapped master key: must survive a crash
+		std::ostringstream out;
+		out << "# kCryptFS volume config. do not edit: changes render the volume unreadable!" << std::endl;
+		for (const auto& it : values) {out << it.first << "=" << it.second << std::endl;}
+		Helper::writeFileAtomic(getFile(encRoot), out.str());
+
+	}
+
+};
+
+#endif // VOLUMECONFIG_H
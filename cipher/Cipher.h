@@ -3,6 +3,8 @@
 
 #include <cstdint>
 
+#include "../Exception.h"
+
 /** interface for all ciphers */
 class Cipher {
 
@@ -22,12 +24,92 @@ public:
 	virtual void decrypt(const uint8_t* in, uint8_t* out, const uint32_t length, const uint8_t* iv, const uint32_t iv_length) = 0;
 	
 
+	/**
+	 * encrypt 'count' consecutive blocks of 'blkSize' bytes each, where every block uses its own IV.
+	 * 'ivs' holds count*iv_length bytes. ciphers may override this to process several blocks at once
+	 */
+	virtual void encryptBlocks(const uint8_t* in, uint8_t* out, const uint32_t blkSize, const uint32_t count, const uint8_t* ivs, const uint32_t iv_length) {
+		for (uint32_t i = 0; i < count; ++i) {
+			encrypt(in + i*blkSize, out + i*blkSize, blkSize, ivs + i*iv_length, iv_length);
+		}
+	}
+
+	/** decrypt 'count' consecutive blocks of 'blkSize' bytes each, where every block uses its own IV */
+	virtual void decryptBlocks(const uint8_t* in, uint8_t* out, const uint32_t blkSize, const uint32_t count, const uint8_t* ivs, const uint32_t iv_length) {
+		for (uint32_t i = 0; i < count; ++i) {
+			decrypt(in + i*blkSize, out + i*blkSize, blkSize, ivs + i*iv_length, iv_length);
+		}
+	}
+	
+
+	/**
+	 * decrypt 'count' independent messages (e.g. file-names), which all use the same IV.
+	 * the messages are stored back to back, message i has lengths[i] bytes. 'in' and 'out' must not overlap.
+	 * ciphers may override this to process all messages at once
+	 */
+	virtual void decryptMany(const uint8_t* in, uint8_t* out, const uint32_t* lengths, const uint32_t count, const uint8_t* iv, const uint32_t iv_length) {
+		for (uint32_t i = 0; i < count; ++i) {
+			decrypt(in, out, lengths[i], iv, iv_length);
+			in += lengths[i];
+			out += lengths[i];
+		}
+	}
+	
+
 	/** get the length the cipher needs for its keys */
 	virtual uint32_t getKeyLength() const = 0;
 
 	/** get the length the cipher needs for its IV */
 	virtual uint32_t getIVLength() const = 0;
 
+
+	/** get the length of the authentication tag. 0 for ciphers without integrity protection */
+	virtual uint32_t getTagLength() const {
+		return 0;
+	}
+
+	/**
+	 * authenticated encryption: encrypt the given input and write the resulting tag into the provided buffer.
+	 * the tag also covers 'aadLen' bytes of additional data, that are not encrypted (e.g. the block's position).
+	 * 'length' may be 0, authenticating the additional data only
+	 */
+	virtual void encryptAuth(const uint8_t* in, uint8_t* out, const uint32_t length, const uint8_t* iv, const uint32_t iv_length, const uint8_t* aad, const uint32_t aadLen, uint8_t* tag) {
+		(void) in; (void) out; (void) length; (void) iv; (void) iv_length; (void) aad; (void) aadLen; (void) tag;
+		throw Exception("cipher does not support authenticated encryption");
+	}
+
+	/** authenticated decryption: decrypt the given input and verify it (and the additional data) against the tag. returns false on mismatch */
+	virtual bool decryptAuth(const uint8_t* in, uint8_t* out, const uint32_t length, const uint8_t* iv, const uint32_t iv_length, const uint8_t* aad, const uint32_t aadLen, const uint8_t* tag) {
+		(void) in; (void) out; (void) length; (void) iv; (void) iv_length; (void) aad; (void) aadLen; (void) tag;
+		throw Exception("cipher does not support authenticated decryption");
+	}
+
+protected:
+
+	/**
+	 * decryptMany() for CBC ciphers: decrypt all messages as one within a single call.
+	 * CBC-decrypting a block only depends on the previous ciphertext block, thus afterwards just the
+	 * first block of every message needs fixing: it was chained to the previous message instead of the IV
+	 */
+	void decryptManyCBC(const uint8_t* in, uint8_t* out, const uint32_t* lengths, const uint32_t count, const uint8_t* iv, const uint32_t iv_length) {
+
+		uint32_t total = 0;
+		for (uint32_t i = 0; i < count; ++i) {
+			if (lengths[i] < iv_length || lengths[i] % iv_length) {throw Exception("CBC messages must be a multiple of the block-size");}
+			total += lengths[i];
+		}
+		if (!total) {return;}
+
+		decrypt(in, out, total, iv, iv_length);
+
+		uint32_t pos = lengths[0];
+		for (uint32_t i = 1; i < count; ++i) {
+			for (uint32_t j = 0; j < iv_length; ++j) {out[pos+j] ^= in[pos-iv_length+j] ^ iv[j];}
+			pos += lengths[i];
+		}
+
+	}
+
 };
 
 #endif // CIPHER_H
@@ -4,11 +4,16 @@
 #ifdef WITH_KERNEL
 
 #include <linux/if_alg.h>
+#include <linux/aio_abi.h>
 #include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <fcntl.h>
 #include <cstring>
 #include <unistd.h>
 #include <errno.h>
 #include <vector>
+#include <algorithm>
 #include <iostream>
 #include <string>
 
@@ -17,6 +22,16 @@
 
 #define SOL_ALG 279 
 
+namespace Settings {
+
+	/** blocks of at least this size are spliced into the kernel instead of being copied */
+	static constexpr uint32_t ALG_SPLICE_MIN = 16*1024;
+
+	/** number of blocks kept in flight using AIO. each one needs its own op-socket, as the IV is per socket */
+	static constexpr uint32_t ALG_IN_FLIGHT = 8;
+
+}
+
 /**
  * describes a cipher
  */
@@ -62,6 +77,9 @@ namespace CryptoAPICiphers {
 	const CryptoAPICipher AES_CBC_128 =	{"cbc(aes)", "aes_cbc_128", 128/8, 128/8};
 	const CryptoAPICipher AES_CBC_192 =	{"cbc(aes)", "aes_cbc_192", 192/8, 128/8};
 	const CryptoAPICipher AES_CBC_256 =	{"cbc(aes)", "aes_cbc_256", 256/8, 128/8};
+
+	// single blocks without IV. NOT for file-data/-names! used e.g. by the ESSIV generator
+	const CryptoAPICipher AES_ECB_256 =	{"ecb(aes)", "aes_ecb_256", 256/8, 0};
 }
 
 /**
@@ -75,8 +93,20 @@ private:
 	/** handle to the configuration socket */
 	int sckCfg;
 	
-	/** handle to the AES-socket */
-	int sckCipher;
+	/** handle to the op-socket, using the configured cipher and key */
+	int sckOp;
+
+	/** op-sockets for several blocks in flight. accepted on first use */
+	std::vector<int> sckBatch;
+
+	/** AIO context to read the results of all blocks in flight. 0: not (yet) available */
+	aio_context_t aioCtx;
+
+	/** AIO not available? -> one block after another */
+	bool aioFailed;
+	
+	/** pipe used to splice user-pages into the kernel */
+	int pipeFDs[2];
 	
 	/** cipher description */
 	CryptoAPICipher type;
@@ -84,7 +114,7 @@ private:
 public:
 	
 	/** ctor */
-	CipherCryptoAPI(const CryptoAPICipher& type) : sckCfg(-1), sckCipher(-1), type(type) {
+	CipherCryptoAPI(const CryptoAPICipher& type) : sckCfg(-1), sckOp(-1), aioCtx(0), aioFailed(false), pipeFDs{-1, -1}, type(type) {
 		init();
 	}
 	
@@ -119,6 +149,22 @@ public:
 	void decrypt(const uint8_t* in, uint8_t* out, const uint32_t length, const uint8_t* iv, const uint32_t iv_length) override {
 		crypt(in, out, length, iv, iv_length, ALG_OP_DECRYPT);
 	}
+
+	/** NOT THREAD SAFE encrypt several blocks, one request per block (one IV each), several in flight */
+	void encryptBlocks(const uint8_t* in, uint8_t* out, const uint32_t blkSize, const uint32_t count, const uint8_t* ivs, const uint32_t iv_length) override {
+		cryptBlocks(in, out, blkSize, count, ivs, iv_length, ALG_OP_ENCRYPT);
+	}
+
+	/** NOT THREAD SAFE decrypt several blocks, one request per block (one IV each), several in flight */
+	void decryptBlocks(const uint8_t* in, uint8_t* out, const uint32_t blkSize, const uint32_t count, const uint8_t* ivs, const uint32_t iv_length) override {
+		cryptBlocks(in, out, blkSize, count, ivs, iv_length, ALG_OP_DECRYPT);
+	}
+
+	/** NOT THREAD SAFE decrypt several messages using the same IV. CBC needs just one request for all of them */
+	void decryptMany(const uint8_t* in, uint8_t* out, const uint32_t* lengths, const uint32_t count, const uint8_t* iv, const uint32_t iv_length) override {
+		if (type.getName() == "cbc(aes)")	{decryptManyCBC(in, out, lengths, count, iv, iv_length);}
+		else								{Cipher::decryptMany(in, out, lengths, count, iv, iv_length);}
+	}
 	
 //	/**
 //	 * NOT THREAD SAFE
@@ -150,10 +196,16 @@ public:
 			throw Exception("unsupported key length: " + std::to_string(keyLen));
 		}
 
+		// the kernel refuses a new key (EBUSY) once an op-socket was used with the former one
+		if (sckOp >= 0) {close(sckOp); sckOp = -1;}
+		closeBatch();
+
 		// setting the key to use for the encryption
-		// NOTE: may this one also be called AFTER accept() is used?!
 		int res = setsockopt(sckCfg, SOL_ALG, ALG_SET_KEY, key, keyLen);
-		if (res < 0) {destroy(); throw Exception("could not set cipher-key");}
+		if (res < 0) {destroy(); throw Exception("could not set cipher-key", errno);}
+
+		sckOp = accept(sckCfg, NULL, 0);
+		if (sckOp < 0) {destroy(); throw Exception("could not create cipher-socket");}
 
 	}
 
@@ -222,8 +274,12 @@ private:
 		if (res < 0) {destroy(); throw Exception("could not bind api-socket");}
 				
 		// get a socket to access the configured algorithm
-		sckCipher = accept(sckCfg, NULL, 0);
-		if (sckCipher < 0) {destroy(); throw Exception("could not create cipher-socket");}
+		sckOp = accept(sckCfg, NULL, 0);
+		if (sckOp < 0) {destroy(); throw Exception("could not create cipher-socket");}
+
+		// pipe for zero-copy input of larger blocks
+		res = pipe2(pipeFDs, O_CLOEXEC);
+		if (res < 0) {destroy(); throw Exception("could not create splice-pipe");}
 				
 	}
 	
@@ -273,11 +329,103 @@ private:
 		
 	/** NOT THREAD SAFE perform encryption or decryption based on the given parameters */
 	void crypt(const uint8_t* in, uint8_t* out, const uint32_t length, const uint8_t* iv, const uint32_t iv_length, const uint32_t direction) {
-	
+		check(in, out, length, iv, iv_length);
+		request(sckOp, in, length, iv, iv_length, direction);
+		response(sckOp, out, length);
+	}
+
+	/**
+	 * NOT THREAD SAFE perform encryption or decryption of several blocks.
+	 * AF_ALG accepts one IV per op-socket and request, thus every block is sent to its own op-socket.
+	 * the results of up to ALG_IN_FLIGHT blocks are then read using one io_submit() and io_getevents(),
+	 * letting asynchronous drivers work on all of them concurrently.
+	 * without AIO, one block after another is processed on the same op-socket
+	 */
+	void cryptBlocks(const uint8_t* in, uint8_t* out, const uint32_t blkSize, const uint32_t count, const uint8_t* ivs, const uint32_t iv_length, const uint32_t direction) {
+
+		check(in, out, blkSize, ivs, iv_length);
+
+		if (count == 1 || !openBatch()) {
+			for (uint32_t b = 0; b < count; ++b) {
+				request(sckOp, in + b*blkSize, blkSize, ivs + b*iv_length, iv_length, direction);
+				response(sckOp, out + b*blkSize, blkSize);
+			}
+			return;
+		}
+
+		struct iocb cbs[Settings::ALG_IN_FLIGHT];
+		struct iocb* cbPtrs[Settings::ALG_IN_FLIGHT];
+
+		for (uint32_t b = 0; b < count; b += Settings::ALG_IN_FLIGHT) {
+
+			const uint32_t cnt = std::min(count - b, Settings::ALG_IN_FLIGHT);
+
+			// one request per socket, each with its own IV
+			for (uint32_t i = 0; i < cnt; ++i) {
+				request(sckBatch[i], in + (b+i)*blkSize, blkSize, ivs + (b+i)*iv_length, iv_length, direction);
+				memset(&cbs[i], 0, sizeof(cbs[i]));
+				cbs[i].aio_fildes = sckBatch[i];
+				cbs[i].aio_lio_opcode = IOCB_CMD_PREAD;
+				cbs[i].aio_buf = (uint64_t) (uintptr_t) (out + (b+i)*blkSize);
+				cbs[i].aio_nbytes = blkSize;
+				cbPtrs[i] = &cbs[i];
+			}
+
+			// read all results at once. those not accepted for AIO are read synchronously
+			long submitted = syscall(SYS_io_submit, aioCtx, (long) cnt, cbPtrs);
+			if (submitted < 0) {submitted = 0;}
+			for (uint32_t i = submitted; i < cnt; ++i) {response(sckBatch[i], out + (b+i)*blkSize, blkSize);}
+			complete(submitted, blkSize);
+
+		}
+
+	}
+
+	/** wait for the given number of submitted AIO reads */
+	void complete(const long submitted, const uint32_t length) {
+		struct io_event events[Settings::ALG_IN_FLIGHT];
+		long done = 0;
+		bool ok = true;
+		while (done < submitted) {
+			const long res = syscall(SYS_io_getevents, aioCtx, 1L, submitted - done, events, nullptr);
+			if (res < 0 && errno == EINTR) {continue;}
+			if (res < 0) {closeBatch(); throw Exception("error while waiting for encryption/decryption results", errno);}
+			for (long e = 0; e < res; ++e) {ok &= (events[e].res == (int64_t) length);}
+			done += res;
+		}
+		if (!ok) {throw Exception("error while reading encryption/decription result");}
+	}
+
+	/** accept the op-sockets and setup the AIO context for several blocks in flight. false if AIO is not available */
+	bool openBatch() {
+		if (aioFailed) {return false;}
+		if (!sckBatch.empty()) {return true;}
+		if (!aioCtx && syscall(SYS_io_setup, (long) Settings::ALG_IN_FLIGHT, &aioCtx) != 0) {aioCtx = 0; aioFailed = true; return false;}
+		for (uint32_t i = 0; i < Settings::ALG_IN_FLIGHT; ++i) {
+			const int sck = accept(sckCfg, NULL, 0);
+			if (sck < 0) {closeBatch(); throw Exception("could not create cipher-socket", errno);}
+			sckBatch.push_back(sck);
+		}
+		return true;
+	}
+
+	/** close the op-sockets for several blocks in flight. destroying the AIO context waits for outstanding reads */
+	void closeBatch() {
+		if (aioCtx) {syscall(SYS_io_destroy, aioCtx); aioCtx = 0;}
+		for (const int sck : sckBatch) {close(sck);}
+		sckBatch.clear();
+	}
+
+	/** sanity checks */
+	void check(const uint8_t* in, const uint8_t* out, const uint32_t length, const uint8_t* iv, const uint32_t iv_length) const {
 		if (!in || !out || !length)				{throw Exception("input, output or length is missing");}
-		if (!iv || !iv_length)					{throw Exception("IV or IV-length is missing");}
 		if (iv_length != type.getIVLength())	{throw Exception("invalid IV-length: " + std::to_string(iv_length));}
-		
+		if (iv_length && !iv)					{throw Exception("IV is missing");}
+	}
+
+	/** send one encryption/decryption request to the given op-socket */
+	void request(const int sck, const uint8_t* in, const uint32_t length, const uint8_t* iv, const uint32_t iv_length, const uint32_t direction) {
+
 		int32_t len;
 		struct iovec iov;
 		struct af_alg_iv* alg_iv;
@@ -303,14 +451,27 @@ private:
 		cmsg->cmsg_len = CMSG_LEN(4);
 		*(__u32 *)CMSG_DATA(cmsg) = direction;		// ALG_OP_DECRYPT vs. ALG_OP_DECRYPT
 
-		// 2nd msg content: set the initialization-vector
-		cmsg = CMSG_NXTHDR(&msg, cmsg);
-		cmsg->cmsg_level = SOL_ALG;
-		cmsg->cmsg_type = ALG_SET_IV;
-		cmsg->cmsg_len = CMSG_LEN(4+iv_length);
-		alg_iv = (af_alg_iv*)CMSG_DATA(cmsg);
-		alg_iv->ivlen = iv_length;
-		memcpy(alg_iv->iv, iv, iv_length);
+		// 2nd msg content: set the initialization-vector (if the cipher uses one)
+		if (iv_length) {
+			cmsg = CMSG_NXTHDR(&msg, cmsg);
+			cmsg->cmsg_level = SOL_ALG;
+			cmsg->cmsg_type = ALG_SET_IV;
+			cmsg->cmsg_len = CMSG_LEN(4+iv_length);
+			alg_iv = (af_alg_iv*)CMSG_DATA(cmsg);
+			alg_iv->ivlen = iv_length;
+			memcpy(alg_iv->iv, iv, iv_length);
+		} else {
+			msg.msg_controllen = sizeM1;
+		}
+
+		// larger blocks: send the configuration only and splice the data afterwards,
+		// so the kernel uses the user-pages directly instead of copying them
+		if (length >= Settings::ALG_SPLICE_MIN) {
+			len = sendmsg(sck, &msg, MSG_MORE);
+			if (len < 0) {throw Exception("error while configuring encryption/decryption");}
+			splice(sck, in, length);
+			return;
+		}
 
 		// 3: attach the to-be-encrypted/decrypted data
 		iov.iov_base = (void*) (uintptr_t)in;
@@ -319,23 +480,48 @@ private:
 		msg.msg_iovlen = 1;
 				
 		// send the configuration including the to-be-encrypted/decrypted data
-		len = sendmsg(sckCipher, &msg, 0);
+		len = sendmsg(sck, &msg, 0);
 		if (len != (ssize_t)length) {
 			throw Exception("error while requesting encryption/decryption of " + std::to_string(length) + " bytes");
 		}
-		
-		// read encryption/decryption result
-		len = read(sckCipher, out, length);
+
+	}
+
+	/** move the given user-memory into the op-socket: vmsplice() into the pipe, splice() from the pipe into the socket */
+	void splice(const int sck, const uint8_t* in, const uint32_t length) {
+		uint32_t done = 0;
+		while (done < length) {
+			struct iovec iov;
+			iov.iov_base = (void*) (uintptr_t) (in + done);
+			iov.iov_len = length - done;
+			const ssize_t inPipe = vmsplice(pipeFDs[1], &iov, 1, 0);
+			if (inPipe <= 0) {throw Exception("error while splicing data into the kernel");}
+			ssize_t moved = 0;
+			while (moved < inPipe) {
+				const bool last = (done + inPipe == length);
+				const ssize_t res = ::splice(pipeFDs[0], NULL, sck, NULL, inPipe - moved, last ? 0 : SPLICE_F_MORE);
+				if (res <= 0) {throw Exception("error while splicing data into the kernel");}
+				moved += res;
+			}
+			done += inPipe;
+		}
+	}
+
+	/** read one encryption/decryption result from the given op-socket */
+	void response(const int sck, uint8_t* out, const uint32_t length) {
+		const ssize_t len = read(sck, out, length);
 		if (len != (ssize_t)length) {
 			throw Exception("error while reading encryption/decription result");
 		}
-
 	}
 	
 	/** cleanup */
 	void destroy() {
 		if (sckCfg >= 0)	{close(sckCfg); sckCfg = -1;}
-		if (sckCipher >= 0)	{close(sckCipher); sckCipher = -1;}	
+		if (sckOp >= 0)		{close(sckOp); sckOp = -1;}
+		closeBatch();
+		if (pipeFDs[0] >= 0)	{close(pipeFDs[0]); pipeFDs[0] = -1;}
+		if (pipeFDs[1] >= 0)	{close(pipeFDs[1]); pipeFDs[1] = -1;}
 	}
 		
 };
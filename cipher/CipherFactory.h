@@ -7,31 +7,70 @@
 #include "CipherOpenSSL.h"
 
 #include <vector>
+#include <memory>
 
 class CipherFactory : private Factory {
 
 public:
 
-	/** get a cipher by its name */
-	static Cipher* getByName(const std::string& name) {
+	/** get a cipher by its name. backend-independent names like "aes_cbc_256" are resolved first */
+	static Cipher* getByName(const std::string& alias) {
+
+		const std::string name = resolve(alias);
 
 #ifdef WITH_OPENSSL
-		if ("openssl_aes_cbc_128" == name || "aes_cbc_128" == name)	{return new CipherOpenSSL(OpenSSLCiphers::AES_CBC_128);}
-		if ("openssl_aes_cbc_192" == name || "aes_cbc_192" == name)	{return new CipherOpenSSL(OpenSSLCiphers::AES_CBC_192);}
-		if ("openssl_aes_cbc_256" == name || "aes_cbc_256" == name)	{return new CipherOpenSSL(OpenSSLCiphers::AES_CBC_256);}
+		if ("openssl_aes_cbc_128" == name)			{return new CipherOpenSSL(OpenSSLCiphers::AES_CBC_128);}
+		if ("openssl_aes_cbc_192" == name)			{return new CipherOpenSSL(OpenSSLCiphers::AES_CBC_192);}
+		if ("openssl_aes_cbc_256" == name)			{return new CipherOpenSSL(OpenSSLCiphers::AES_CBC_256);}
+		if ("openssl_aes_gcm_128" == name)			{return new CipherOpenSSL(OpenSSLCiphers::AES_GCM_128);}
+		if ("openssl_aes_gcm_256" == name)			{return new CipherOpenSSL(OpenSSLCiphers::AES_GCM_256);}
+		if ("openssl_chacha20_poly1305" == name)	{return new CipherOpenSSL(OpenSSLCiphers::CHACHA20_POLY1305);}
+		if ("openssl_aes_ecb_256" == name)			{return new CipherOpenSSL(OpenSSLCiphers::AES_ECB_256);}
 #endif
 
 #ifdef WITH_KERNEL
-		if ("kernel_aes_cbc_128" == name || "aes_cbc_128" == name)	{return new CipherCryptoAPI(CryptoAPICiphers::AES_CBC_128);}
-		if ("kernel_aes_cbc_192" == name || "aes_cbc_192" == name)	{return new CipherCryptoAPI(CryptoAPICiphers::AES_CBC_192);}
-		if ("kernel_aes_cbc_256" == name || "aes_cbc_256" == name)	{return new CipherCryptoAPI(CryptoAPICiphers::AES_CBC_256);}
+		if ("kernel_aes_cbc_128" == name)			{return new CipherCryptoAPI(CryptoAPICiphers::AES_CBC_128);}
+		if ("kernel_aes_cbc_192" == name)			{return new CipherCryptoAPI(CryptoAPICiphers::AES_CBC_192);}
+		if ("kernel_aes_cbc_256" == name)			{return new CipherCryptoAPI(CryptoAPICiphers::AES_CBC_256);}
+		if ("kernel_aes_ecb_256" == name)			{return new CipherCryptoAPI(CryptoAPICiphers::AES_ECB_256);}
 #endif
 
 		// none found
-		throw onNotFound("unsupported cipher", name, getSupported());
+		throw onNotFound("unsupported cipher", alias, getSupported());
 		
 	}
 
+	/** the algorithm denoted by the given name: "auto" is the default algorithm (aes_cbc_256), all others name themselves */
+	static std::string getAlgorithm(const std::string& name) {
+		return ("auto" == name) ? ("aes_cbc_256") : (name);
+	}
+
+	/**
+	 * map a backend-independent name onto the fastest backend available on this machine.
+	 * if several backends provide the algorithm, a short calibration decides.
+	 * "auto" denotes the default algorithm (aes_cbc_256)
+	 */
+	static std::string resolve(const std::string& name) {
+		if ("auto" == name)																	{return resolve(getAlgorithm(name));}
+		if ("aes_cbc_128" == name || "aes_cbc_192" == name || "aes_cbc_256" == name)		{return calibrate(name, [&name] () {return getCandidates(name, selectBackend(name, CPUFeatures::get().aes, "cbc(aes)"), getSupported());}, measure);}
+		if ("aes_gcm_128" == name || "aes_gcm_256" == name || "chacha20_poly1305" == name)	{return "openssl_" + name;}
+		if ("aes_ecb_256" == name)															{return calibrate(name, [&name] () {return getCandidates(name, selectBackend(name, CPUFeatures::get().aes, "ecb(aes)"), getInternal());}, measure);}
+		return name;
+	}
+
+	/** calibration: encrypt one region of several 4 KiB blocks, as done for the file-data. returns regions per second */
+	static double measure(const std::string& name) {
+		const uint32_t blkSize = 4096;
+		const uint32_t blocks = 8;
+		std::unique_ptr<Cipher> cipher(getByName(name));
+		const uint32_t ivLen = cipher->getIVLength();
+		std::vector<uint8_t> key(cipher->getKeyLength());
+		std::vector<uint8_t> ivs(blocks * ivLen);
+		std::vector<uint8_t> buf(blocks * blkSize);
+		cipher->setKey(key.data(), key.size());
+		return timeOperation([&] () {cipher->encryptBlocks(buf.data(), buf.data(), blkSize, blocks, ivs.data(), ivLen);});
+	}
+
 	/** get a cipher by its name and directly set its key */
 	static Cipher* getByName(const std::string& name, const uint8_t* key, const uint32_t keyLen) {
 
@@ -41,6 +80,23 @@ public:
 
 	}
 
+	/** ciphers for internal use only (e.g. by IV-generators). not offered for file-data or file-names */
+	static std::vector<std::string> getInternal() {
+
+		std::vector<std::string> res;
+
+#ifdef WITH_OPENSSL
+		res.push_back("openssl_aes_ecb_256");
+#endif
+
+#ifdef WITH_KERNEL
+		res.push_back("kernel_aes_ecb_256");
+#endif
+
+		return res;
+
+	}
+
 	/** get all supported ciphers */
 	static std::vector<std::string> getSupported() {
 
@@ -50,6 +106,9 @@ public:
 		res.push_back("openssl_aes_cbc_128");
 		res.push_back("openssl_aes_cbc_192");
 		res.push_back("openssl_aes_cbc_256");
+		res.push_back("openssl_aes_gcm_128");
+		res.push_back("openssl_aes_gcm_256");
+		res.push_back("openssl_chacha20_poly1305");
 #endif
 
 #ifdef WITH_KERNEL
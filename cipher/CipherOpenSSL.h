@@ -5,6 +5,7 @@
 
 #include "Cipher.h"
 #include <string>
+#include <cstring>
 #include <openssl/evp.h>
 
 struct OpenSSLCipher {
@@ -22,10 +23,14 @@ private:
 	/** the cipher's IV length */
 	const uint32_t ivLen;
 
+	/** the cipher's tag length (authenticated ciphers only) */
+	const uint32_t tagLen;
+
 public:
 
 	/** ctor */
-	OpenSSLCipher(const EVP_CIPHER* cipher, const uint32_t keyLen, const uint32_t ivLen) : cipher(cipher), keyLen(keyLen), ivLen(ivLen) {;}
+	OpenSSLCipher(const EVP_CIPHER* cipher, const uint32_t keyLen, const uint32_t ivLen, const uint32_t tagLen = 0) :
+		cipher(cipher), keyLen(keyLen), ivLen(ivLen), tagLen(tagLen) {;}
 
 };
 
@@ -34,6 +39,14 @@ namespace OpenSSLCiphers {
 	const OpenSSLCipher AES_CBC_128 =	{EVP_aes_128_cbc(), 128/8, 128/8};
 	const OpenSSLCipher AES_CBC_192 =	{EVP_aes_192_cbc(), 192/8, 128/8};
 	const OpenSSLCipher AES_CBC_256 =	{EVP_aes_256_cbc(), 256/8, 128/8};
+
+	// single blocks without IV. NOT for file-data/-names! used e.g. by the ESSIV generator
+	const OpenSSLCipher AES_ECB_256 =	{EVP_aes_256_ecb(), 256/8, 0};
+
+	// authenticated ciphers: 96 bit nonce, 128 bit tag
+	const OpenSSLCipher AES_GCM_128 =		{EVP_aes_128_gcm(), 128/8, 96/8, 128/8};
+	const OpenSSLCipher AES_GCM_256 =		{EVP_aes_256_gcm(), 256/8, 96/8, 128/8};
+	const OpenSSLCipher CHACHA20_POLY1305 =	{EVP_chacha20_poly1305(), 256/8, 96/8, 128/8};
 }
 
 class CipherOpenSSL : public Cipher {
@@ -46,17 +59,25 @@ private:
 	/** configuration */
 	OpenSSLCipher cfg;
 
-	EVP_CIPHER_CTX dec;
-	EVP_CIPHER_CTX enc;
+	EVP_CIPHER_CTX* dec;
+	EVP_CIPHER_CTX* enc;
 
 public:
 
 	/** ctor */
 	CipherOpenSSL(const OpenSSLCipher& cfg) : key(), cfg(cfg) {
 
-		 EVP_CIPHER_CTX_init(&dec);
-		 EVP_CIPHER_CTX_init(&enc);
+		dec = EVP_CIPHER_CTX_new();
+		enc = EVP_CIPHER_CTX_new();
+		if (!dec || !enc) {throw Exception("out-of-memory");}
+		init();
+
+	}
 
+	/** dtor */
+	~CipherOpenSSL() {
+		EVP_CIPHER_CTX_free(dec);
+		EVP_CIPHER_CTX_free(enc);
 	}
 
 	/** no copy */
@@ -70,39 +91,43 @@ public:
 	virtual void setKey(const uint8_t* key, const uint32_t keyLen) {
 		if (keyLen != cfg.keyLen) {throw Exception("invalid key length");}
 		memcpy(this->key, key, keyLen);
+		init();
 	}
 
 	/** encrypt the given input data into the provided output buffer */
 	virtual void encrypt(const uint8_t* in, uint8_t* out, const uint32_t length, const uint8_t* iv, const uint32_t ivLength) {
 
-		EVP_EncryptInit_ex(&enc, cfg.cipher, nullptr, key, iv);		// set key and IV
-		EVP_CIPHER_CTX_set_padding(&enc, 0);						// do NOT add a padding
-		if (EVP_CIPHER_CTX_key_length(&enc) != (int)cfg.keyLen)		{throw Exception("invalid key length");}
-		if (EVP_CIPHER_CTX_iv_length(&enc) != (int)ivLength)		{throw Exception("invlaid IV length");}
+		if (EVP_CIPHER_CTX_iv_length(enc) != (int)ivLength)			{throw Exception("invlaid IV length");}
+		EVP_EncryptInit_ex(enc, nullptr, nullptr, nullptr, iv);		// new IV, keep the key-schedule
 
 		int outLen = 0;
-		EVP_EncryptUpdate(&enc, out, &outLen, in, length);
+		EVP_EncryptUpdate(enc, out, &outLen, in, length);
 		if (outLen != (int)length) {throw Exception("error while encrypting data");}
-		//EVP_EncryptFinal(&enc, out, &outLen);						// needed only for padding?
+		//EVP_EncryptFinal(enc, out, &outLen);						// needed only for padding?
 
 	}
 
 	/** ecrypt the given input data into the provided output buffer */
 	virtual void decrypt(const uint8_t* in, uint8_t* out, const uint32_t length, const uint8_t* iv, const uint32_t ivLength) {
 
-		EVP_DecryptInit_ex(&dec, cfg.cipher, nullptr, key, iv);		// set key and IV
-		EVP_CIPHER_CTX_set_padding(&dec, 0);						// do NOT check for padding
-		if (EVP_CIPHER_CTX_key_length(&dec) != (int)cfg.keyLen)		{throw Exception("invalid key length");}
-		if (EVP_CIPHER_CTX_iv_length(&dec) != (int)ivLength)		{throw Exception("invlaid IV length");}
+		if (EVP_CIPHER_CTX_iv_length(dec) != (int)ivLength)			{throw Exception("invlaid IV length");}
+		EVP_DecryptInit_ex(dec, nullptr, nullptr, nullptr, iv);		// new IV, keep the key-schedule
 
 		int outLen = 0;
-		EVP_DecryptUpdate(&dec, out, &outLen, in, length);
+		EVP_DecryptUpdate(dec, out, &outLen, in, length);
 		if (outLen != (int)length) {throw Exception("error while decrypting data");}
-		//EVP_DecryptFinal(&dec, out, &outLen);						// needed only for padding?
+		//EVP_DecryptFinal(dec, out, &outLen);						// needed only for padding?
 
 	}
 
 
+	/** CBC decrypts all messages within one call, which pipelines the AES-NI rounds of several blocks */
+	virtual void decryptMany(const uint8_t* in, uint8_t* out, const uint32_t* lengths, const uint32_t count, const uint8_t* iv, const uint32_t ivLength) {
+		if (EVP_CIPHER_mode(cfg.cipher) == EVP_CIPH_CBC_MODE)	{decryptManyCBC(in, out, lengths, count, iv, ivLength);}
+		else													{Cipher::decryptMany(in, out, lengths, count, iv, ivLength);}
+	}
+
+
 	/** get the length the cipher needs for its keys */
 	virtual uint32_t getKeyLength() const {
 		return cfg.keyLen;
@@ -114,6 +139,76 @@ public:
 		return cfg.ivLen;
 	}
 
+
+	/** get the length of the authentication tag */
+	virtual uint32_t getTagLength() const {
+		return cfg.tagLen;
+	}
+
+	/**
+	 * authenticated encryption (GCM, Poly1305).
+	 * OpenSSL uses AES-NI and PCLMUL (GHASH) here, whenever the CPU supports them
+	 */
+	virtual void encryptAuth(const uint8_t* in, uint8_t* out, const uint32_t length, const uint8_t* iv, const uint32_t ivLength, const uint8_t* aad, const uint32_t aadLen, uint8_t* tag) {
+
+		if (!cfg.tagLen) {throw Exception("cipher does not support authenticated encryption");}
+
+		if (EVP_CIPHER_CTX_iv_length(enc) != (int)ivLength)			{throw Exception("invlaid IV length");}
+		EVP_EncryptInit_ex(enc, nullptr, nullptr, nullptr, iv);		// new IV, keep the key-schedule
+
+		// additional data: no output buffer
+		int outLen = 0;
+		if (aadLen && EVP_EncryptUpdate(enc, nullptr, &outLen, aad, aadLen) != 1) {throw Exception("error while adding authenticated data");}
+
+		if (length) {
+			EVP_EncryptUpdate(enc, out, &outLen, in, length);
+			if (outLen != (int)length) {throw Exception("error while encrypting data");}
+		}
+
+		EVP_EncryptFinal_ex(enc, out+length, &outLen);
+		if (EVP_CIPHER_CTX_ctrl(enc, EVP_CTRL_AEAD_GET_TAG, cfg.tagLen, tag) != 1) {throw Exception("error while creating the tag");}
+
+	}
+
+	/** authenticated decryption. returns false if the data does not match the given tag */
+	virtual bool decryptAuth(const uint8_t* in, uint8_t* out, const uint32_t length, const uint8_t* iv, const uint32_t ivLength, const uint8_t* aad, const uint32_t aadLen, const uint8_t* tag) {
+
+		if (!cfg.tagLen) {throw Exception("cipher does not support authenticated decryption");}
+
+		if (EVP_CIPHER_CTX_iv_length(dec) != (int)ivLength)			{throw Exception("invlaid IV length");}
+		EVP_DecryptInit_ex(dec, nullptr, nullptr, nullptr, iv);		// new IV, keep the key-schedule
+
+		int outLen = 0;
+		if (aadLen && EVP_DecryptUpdate(dec, nullptr, &outLen, aad, aadLen) != 1) {throw Exception("error while adding authenticated data");}
+
+		if (length) {
+			EVP_DecryptUpdate(dec, out, &outLen, in, length);
+			if (outLen != (int)length) {throw Exception("error while decrypting data");}
+		}
+
+		if (EVP_CIPHER_CTX_ctrl(dec, EVP_CTRL_AEAD_SET_TAG, cfg.tagLen, (void*)tag) != 1) {throw Exception("error while setting the tag");}
+		return EVP_DecryptFinal_ex(dec, out+length, &outLen) == 1;
+
+	}
+
+private:
+
+	/**
+	 * (re-)initialize both contexts with cipher and key.
+	 * the key-schedule is computed only here, en-/decryption just sets a new IV
+	 */
+	void init() {
+
+		EVP_EncryptInit_ex(enc, cfg.cipher, nullptr, key, nullptr);
+		EVP_CIPHER_CTX_set_padding(enc, 0);							// do NOT add a padding
+		if (EVP_CIPHER_CTX_key_length(enc) != (int)cfg.keyLen)		{throw Exception("invalid key length");}
+
+		EVP_DecryptInit_ex(dec, cfg.cipher, nullptr, key, nullptr);
+		EVP_CIPHER_CTX_set_padding(dec, 0);							// do NOT check for padding
+		if (EVP_CIPHER_CTX_key_length(dec) != (int)cfg.keyLen)		{throw Exception("invalid key length");}
+
+	}
+
 };
 
 #endif
@@ -3,18 +3,60 @@
 
 #include "../cipher/Cipher.h"
 #include "../iv/IVGeneratorFactory.h"
+#include "../Helper.h"
+
+#include <algorithm>
 
 
 namespace Settings {
 
-	/** the block-size to use for CBC encryption. each block has its own IV */
+	/** the (default) block-size to use for CBC encryption. each block has its own IV */
 	const constexpr int BLK_SIZE = 4096;
 
+	/** smallest block-size a container may use */
+	const constexpr int MIN_BLK_SIZE = 4096;
+
+	/** largest block-size a container may use */
+	const constexpr int MAX_BLK_SIZE = 64*1024;
+
 	/** the length of the initialization-vector to use */
 	const constexpr int MAX_IV_LEN = 64;
 
+	/** number of blocks to derive IVs for (and to en-/decrypt) at once */
+	const constexpr int IV_BATCH = 64;
+
+	/** authenticated ciphers: max length of the random per-block nonce */
+	const constexpr int AUTH_NONCE_LEN = 12;
+
+	/** authenticated ciphers: max length of the per-block tag */
+	const constexpr int AUTH_TAG_LEN = 16;
+
+	/** length of the container's random per-file nonce */
+	const constexpr int FILE_NONCE_LEN = 16;
+
 }
 
+/**
+ * nonce and tag of one authenticated block.
+ * stored out-of-line within the container's metadata blocks,
+ * thus the payload blocks keep their size.
+ * an all-zero entry denotes a block that was never written (beyond the file's end only)
+ */
+struct BlockAuth {
+	uint8_t nonce[Settings::AUTH_NONCE_LEN];
+	uint8_t tag[Settings::AUTH_TAG_LEN];
+	uint8_t pad[4];
+} __attribute__ ((__packed__));
+
+/**
+ * additional (not encrypted) data covered by each block's tag:
+ * blocks can not be moved to another position or into another file
+ */
+struct BlockAAD {
+	uint8_t fileNonce[Settings::FILE_NONCE_LEN];
+	uint64_t index;
+} __attribute__ ((__packed__));
+
 /**
  * helper class to ensure we always work an aligned blocks.
  * those are needed for the cipher to work as expected.
@@ -22,11 +64,14 @@ namespace Settings {
  * NOT THREAD SAFE (depends on cipher and iv-generator)
  */
 class AlignedRegion {
+
+	/** the block-size to align to */
+	const uint32_t blkSize;
 		
-	/** start-address. aligned to BLK_SIZE */
+	/** start-address. aligned to blkSize */
 	const off_t alignedStart;
 	
-	/** end-address. aligned to BLK_SIZE */
+	/** end-address. aligned to blkSize */
 	const off_t alignedEnd;
 
 	/** size of the region between start and end */
@@ -34,22 +79,27 @@ class AlignedRegion {
 	
 	/** buffer to hold both, encrypted and decrypted data for above region-size */
 	uint8_t* buffer;
+
+	/** nonce and tag for every block within the region (authenticated ciphers only) */
+	BlockAuth* auth;
 	
 public:
 
-	/** align the given start-address to multiples of BLK_SIZE */
-	static inline off_t alignStart(const off_t unalignedStart)						{return (unalignedStart / Settings::BLK_SIZE) * Settings::BLK_SIZE;}
+	/** align the given start-address to multiples of blkSize */
+	static inline off_t alignStart(const off_t unalignedStart, const uint32_t blkSize = Settings::BLK_SIZE)					{return (unalignedStart / blkSize) * blkSize;}
 
-	/** align the given end-address to multiples of BLK_SIZE */
-	static inline off_t alignEnd(const off_t unalignedStart, const size_t size) 	{return ((size + unalignedStart - 1) / Settings::BLK_SIZE + 1) * Settings::BLK_SIZE;}
+	/** align the given end-address to multiples of blkSize */
+	static inline off_t alignEnd(const off_t unalignedStart, const size_t size, const uint32_t blkSize = Settings::BLK_SIZE)	{return ((size + unalignedStart - 1) / blkSize + 1) * blkSize;}
 	
 public:	
 	
 	/** ctor */
-	AlignedRegion(const off_t unalignedStart, const size_t size) :
-		alignedStart(alignStart(unalignedStart)),
-		alignedEnd(alignEnd(unalignedStart, size)),
-		alignedSize(alignedEnd-alignedStart) {
+	AlignedRegion(const off_t unalignedStart, const size_t size, const uint32_t blkSize = Settings::BLK_SIZE) :
+		blkSize(blkSize),
+		alignedStart(alignStart(unalignedStart, blkSize)),
+		alignedEnd(alignEnd(unalignedStart, size, blkSize)),
+		alignedSize(alignedEnd-alignedStart),
+		auth(nullptr) {
 
 		// allocate buffer for both: the encrypted AND decrypted data
 		// note: using 4k aligned buffers did not yield any performance increase
@@ -68,6 +118,8 @@ public:
 	~AlignedRegion() {
 		free(buffer);
 		buffer = nullptr;
+		free(auth);
+		auth = nullptr;
 	}
 	
 
@@ -81,6 +133,11 @@ public:
 	size_t getSize() const {
 		return alignedSize;
 	}
+
+	/** get the size of each block within the region */
+	uint32_t getBlockSize() const {
+		return blkSize;
+	}
 	
 	/** get a buffer to store the encpryted data to */
 	uint8_t* getEncBuffer() {
@@ -91,14 +148,30 @@ public:
 	uint8_t* getDecBuffer() {
 		return buffer + getSize();						// 2nd half of the buffer
 	}
+
+	/** get the number of blocks within this region */
+	size_t getNumBlocks() const {
+		return getSize() / blkSize;
+	}
+
+	/** get the nonce/tag buffer. one entry per block. allocated on first use */
+	BlockAuth* getAuthBuffer() {
+		if (auth == nullptr) {
+			auth = (BlockAuth*) calloc(getNumBlocks(), sizeof(BlockAuth));
+			if (auth == nullptr) {throw Exception("out-of-memory");}
+		}
+		return auth;
+	}
 	
 	/** decrypt the WHOLE data within the encryption buffer */
-	void decrypt(Cipher& cipher, IVGenerator& ivGen) {
-		uint8_t iv[Settings::MAX_IV_LEN];
+	void decrypt(Cipher& cipher, const IVGenerator& ivGen) {
+		uint8_t ivs[Settings::IV_BATCH * Settings::MAX_IV_LEN];
 		const uint32_t ivLen = cipher.getIVLength();
-		for (size_t s = 0; s < getSize(); s += Settings::BLK_SIZE) {
-			ivGen.getIV(alignedStart + s, iv, ivLen);
-			cipher.decrypt(getEncBuffer()+s, getDecBuffer()+s, Settings::BLK_SIZE, iv, ivLen);
+		for (size_t b = 0; b < getNumBlocks(); b += Settings::IV_BATCH) {
+			const uint32_t cnt = std::min(getNumBlocks() - b, (size_t) Settings::IV_BATCH);
+			const size_t s = b * blkSize;
+			ivGen.getIVs(alignedStart + s, blkSize, cnt, ivs, ivLen);
+			cipher.decryptBlocks(getEncBuffer()+s, getDecBuffer()+s, blkSize, cnt, ivs, ivLen);
 		}
 	}
 
@@ -110,7 +183,7 @@ public:
 	 *
 	 * returns the number of decrypted blocks (for testing)
 	 */
-	int decryptForOverwrite(Cipher& cipher, IVGenerator& ivGen, const off_t writeStart, const size_t writeSize) {
+	int decryptForOverwrite(Cipher& cipher, const IVGenerator& ivGen, const off_t writeStart, const size_t writeSize) {
 
 		int blocks = 0;
 
@@ -121,18 +194,18 @@ public:
 		// partially overwriting the first block? -> decrypt it
 		if (writeStart != alignedStart) {
 			ivGen.getIV(alignedStart, iv, ivLen);
-			cipher.decrypt(getEncBuffer(), getDecBuffer(), Settings::BLK_SIZE, iv, ivLen);
+			cipher.decrypt(getEncBuffer(), getDecBuffer(), blkSize, iv, ivLen);
 			++blocks;
 		}
 
 		// if the whole aligned region contains only one block at all, and we already decrypted it, we are done
-		if (getSize() == Settings::BLK_SIZE && blocks > 0) {return blocks;}
+		if (getSize() == blkSize && blocks > 0) {return blocks;}
 
 		// partially overwriting the last block -> decrypt it
 		if (writeEnd != alignedEnd) {
-			const off_t o = getSize()-Settings::BLK_SIZE;
+			const off_t o = getSize()-blkSize;
 			ivGen.getIV(alignedStart+o, iv, ivLen);
-			cipher.decrypt(getEncBuffer()+o, getDecBuffer()+o, Settings::BLK_SIZE, iv, ivLen);
+			cipher.decrypt(getEncBuffer()+o, getDecBuffer()+o, blkSize, iv, ivLen);
 			++blocks;
 		}
 
@@ -142,13 +215,112 @@ public:
 	}
 
 	/** encrypt the WHOLE data within the decryption buffer */
-	void encrypt(Cipher& cipher, IVGenerator& ivGen) {
-		uint8_t iv[Settings::MAX_IV_LEN];
+	void encrypt(Cipher& cipher, const IVGenerator& ivGen) {
+		uint8_t ivs[Settings::IV_BATCH * Settings::MAX_IV_LEN];
+		const uint32_t ivLen = cipher.getIVLength();
+		for (size_t b = 0; b < getNumBlocks(); b += Settings::IV_BATCH) {
+			const uint32_t cnt = std::min(getNumBlocks() - b, (size_t) Settings::IV_BATCH);
+			const size_t s = b * blkSize;
+			ivGen.getIVs(alignedStart + s, blkSize, cnt, ivs, ivLen);
+			cipher.encryptBlocks(getDecBuffer()+s, getEncBuffer()+s, blkSize, cnt, ivs, ivLen);
+		}
+	}
+
+
+	/**
+	 * authenticated ciphers: decrypt and verify the WHOLE data within the encryption buffer
+	 * using the nonces/tags from the auth-buffer, the file's nonce and its (authenticated) size.
+	 * returns false if at least one block does not match its tag
+	 */
+	bool decryptAuth(Cipher& cipher, const uint8_t* fileNonce, const uint64_t fileSize) {
+		bool ok = true;
+		for (size_t s = 0; s < getSize(); s += blkSize) {
+			ok &= decryptAuthBlock(cipher, s, fileNonce, fileSize);
+		}
+		return ok;
+	}
+
+	/**
+	 * authenticated ciphers: decrypt and verify only the blocks that will not be completely overwritten.
+	 * returns the number of decrypted blocks or -1 if verification failed
+	 */
+	int decryptAuthForOverwrite(Cipher& cipher, const uint8_t* fileNonce, const uint64_t fileSize, const off_t writeStart, const size_t writeSize) {
+
+		int blocks = 0;
+		const off_t writeEnd = writeStart + writeSize;
+
+		// partially overwriting the first block? -> decrypt it
+		if (writeStart != alignedStart) {
+			if (!decryptAuthBlock(cipher, 0, fileNonce, fileSize)) {return -1;}
+			++blocks;
+		}
+
+		// if the whole aligned region contains only one block at all, and we already decrypted it, we are done
+		if (getSize() == blkSize && blocks > 0) {return blocks;}
+
+		// partially overwriting the last block -> decrypt it
+		if (writeEnd != alignedEnd) {
+			if (!decryptAuthBlock(cipher, getSize()-blkSize, fileNonce, fileSize)) {return -1;}
+			++blocks;
+		}
+
+		return blocks;
+
+	}
+
+	/** authenticated ciphers: encrypt the WHOLE data within the decryption buffer using new random nonces */
+	void encryptAuth(Cipher& cipher, const uint8_t* fileNonce) {
+
 		const uint32_t ivLen = cipher.getIVLength();
-		for (size_t s = 0; s < getSize(); s += Settings::BLK_SIZE) {
-			ivGen.getIV(alignedStart + s, iv, ivLen);
-			cipher.encrypt(getDecBuffer()+s, getEncBuffer()+s, Settings::BLK_SIZE, iv, ivLen);
+		BlockAuth* ba = getAuthBuffer();
+
+		// one random nonce per block. fetched for IV_BATCH blocks at once
+		uint8_t nonces[Settings::IV_BATCH * Settings::AUTH_NONCE_LEN];
+
+		for (size_t b = 0; b < getNumBlocks(); b += Settings::IV_BATCH) {
+			const uint32_t cnt = std::min(getNumBlocks() - b, (size_t) Settings::IV_BATCH);
+			Helper::getRandom(nonces, cnt * Settings::AUTH_NONCE_LEN);
+			for (uint32_t i = 0; i < cnt; ++i) {
+				const size_t s = (b+i) * blkSize;
+				const BlockAAD aad = getAAD(s, fileNonce);
+				memset(&ba[b+i], 0, sizeof(BlockAuth));
+				memcpy(ba[b+i].nonce, &nonces[i*Settings::AUTH_NONCE_LEN], ivLen);
+				cipher.encryptAuth(getDecBuffer()+s, getEncBuffer()+s, blkSize, ba[b+i].nonce, ivLen, (const uint8_t*) &aad, sizeof(aad), ba[b+i].tag);
+			}
+		}
+
+	}
+
+private:
+
+	/** authenticated ciphers: the additional data for the block at the given region-offset */
+	BlockAAD getAAD(const size_t s, const uint8_t* fileNonce) const {
+		BlockAAD aad;
+		memcpy(aad.fileNonce, fileNonce, sizeof(aad.fileNonce));
+		aad.index = (alignedStart + s) / blkSize;
+		return aad;
+	}
+
+	/**
+	 * authenticated ciphers: decrypt the block at the given region-offset.
+	 * blocks beyond the file's end may be never written (all-zero entry).
+	 * below the file's end, every block must have been written
+	 */
+	bool decryptAuthBlock(Cipher& cipher, const size_t s, const uint8_t* fileNonce, const uint64_t fileSize) {
+
+		static const BlockAuth empty = {};
+		const BlockAuth& ba = getAuthBuffer()[s / blkSize];
+
+		// never written
+		if (memcmp(&ba, &empty, sizeof(BlockAuth)) == 0) {
+			if ((uint64_t) (alignedStart + s) < fileSize) {return false;}
+			memset(getDecBuffer()+s, 0, blkSize);
+			return true;
 		}
+
+		const BlockAAD aad = getAAD(s, fileNonce);
+		return cipher.decryptAuth(getEncBuffer()+s, getDecBuffer()+s, blkSize, ba.nonce, cipher.getIVLength(), (const uint8_t*) &aad, sizeof(aad), ba.tag);
+
 	}
 				
 };
@@ -19,6 +19,9 @@ public:
 	/** synchronize with the filesystem */
 	virtual int sync(const int datasync) = 0;
 
+	/** change the container's size. returns 0 on success */
+	virtual int truncate(const off_t size) = 0;
+
 };
 
 #endif // CONTAINER_H
@@ -9,18 +9,45 @@
 #include <mutex>
 #include <thread>
 #include <memory>
+#include <vector>
+#include <cstddef>
 
 /**
  * the header at the beginning of every encrypted container.
  * is padded to 4096 bytes to ensure nice block-alignments
+ *
+ * version 0: no block-size stored. always uses 4096 byte blocks
+ * version 1: block-size is stored within the header
+ *
+ * authenticated ciphers: all fields before headerNonce are covered by headerTag
  */
 struct EncryptedContainerHeader {
 	uint32_t version;
 	uint64_t fileSize;
-	uint8_t pad[4084];
+	uint32_t blockSize;
+	uint8_t fileNonce[Settings::FILE_NONCE_LEN];		// random per file, salts all IVs. all-zero: legacy container
+	uint8_t headerNonce[Settings::AUTH_NONCE_LEN];
+	uint8_t headerTag[Settings::AUTH_TAG_LEN];
+	uint8_t pad[4036];
 } __attribute__ ((__packed__));
 
+namespace Settings {
 
+	/** the current container version */
+	const constexpr uint32_t CONTAINER_VERSION = 1;
+
+	/**
+	 * authenticated ciphers: number of payload blocks described by one metadata block.
+	 * the container is split into groups of one metadata block (BLK_SIZE, holding nonce+tag per block)
+	 * followed by this number of payload blocks (of the container's block-size):
+	 *		[header][meta 0][blk 0] .. [blk 127][meta 1][blk 128] ..
+	 */
+	const constexpr int AUTH_BLKS_PER_META = BLK_SIZE / sizeof(BlockAuth);
+
+	/** authenticated ciphers: number of blocks to write at once, when filling the gap between the file's end and a write beyond it */
+	const constexpr int AUTH_GAP_BLKS = 16;
+
+}
 
 /**
  * container implementation that will encrypt all written
@@ -43,6 +70,12 @@ private:
 	/** the header at the beginning of the container */
 	EncryptedContainerHeader header;
 
+	/** the block-size used by this container (from the header) */
+	uint32_t blkSize;
+
+	/** authenticated cipher? -> nonce and tag are stored within metadata blocks */
+	const bool authenticated;
+
 	/** thread-synchronization */
 	std::mutex mtx;
 
@@ -53,19 +86,20 @@ public:
 	 * @param container the container to write to / read from
 	 * @param cipher the cipher to use for encryption/decryption
 	 * @param ivGen the iv-generator to use for encryption/decryption
+	 * @param newBlkSize the block-size to use, if the container is newly created. existing containers use the size from their header
 	 */
-	EncryptedContainer(std::shared_ptr<Container> container, std::shared_ptr<Cipher> cipher, std::shared_ptr<IVGenerator> ivGen) :
-		container(container), cipher(cipher), ivGen(ivGen), header() {
+	EncryptedContainer(std::shared_ptr<Container> container, std::shared_ptr<Cipher> cipher, std::shared_ptr<IVGenerator> ivGen, const uint32_t newBlkSize = Settings::BLK_SIZE) :
+		container(container), cipher(cipher), ivGen(ivGen), header(), blkSize(0), authenticated(isAuthenticated(cipher.get())) {
 
-		readHeader();
+		readHeader(newBlkSize);
 
 	}
 
 	/** convenience CTOR for testing */
-	EncryptedContainer(Container* container, Cipher* cipher, IVGenerator* ivGen) :
-		container(container), cipher(cipher), ivGen(ivGen), header() {
+	EncryptedContainer(Container* container, Cipher* cipher, IVGenerator* ivGen, const uint32_t newBlkSize = Settings::BLK_SIZE) :
+		container(container), cipher(cipher), ivGen(ivGen), header(), blkSize(0), authenticated(isAuthenticated(cipher)) {
 
-		readHeader();
+		readHeader(newBlkSize);
 
 	}
 	
@@ -77,7 +111,9 @@ public:
 
 	/** synchronize with the underlying container */
 	int sync(const int datasync) override {
-		writeHeader();
+		mtx.lock();
+			writeHeader();
+		mtx.unlock();
 		return container->sync(datasync);
 	}
 	
@@ -85,6 +121,16 @@ public:
 	size_t getSize() const {
 		return header.fileSize;
 	}
+
+	/** get the block-size used by this container */
+	uint32_t getBlockSize() const {
+		return blkSize;
+	}
+
+	/** is the given block-size supported? (power of two between MIN_BLK_SIZE and MAX_BLK_SIZE) */
+	static bool isValidBlockSize(const uint32_t size) {
+		return size >= Settings::MIN_BLK_SIZE && size <= Settings::MAX_BLK_SIZE && (size & (size-1)) == 0;
+	}
 	
 	/**
 	 * read 'size' bytes from the given 'offset' into the provided 'dst'
@@ -94,7 +140,11 @@ public:
 	
 		//std::cout << "reading" << std::endl;
 
-		AlignedRegion reg(offset, size);
+		AlignedRegion reg(offset, size, blkSize);
+
+		// authenticated: the data and its nonces/tags must be read at once. a write in between would change both
+		std::unique_lock<std::mutex> lock(mtx, std::defer_lock);
+		if (authenticated) {lock.lock();}
 
 		// read the aligned, encrypted region
 		ssize_t read = doRead(reg.getEncBuffer(), reg.getSize(), reg.getStart());
@@ -103,7 +153,7 @@ public:
 		// could we read the whole requested region? if not, round "read" down to the nearest block-size
 		// this works as offset is block-size aligned as well
 		if ((size_t) read != reg.getSize()) {
-			read = AlignedRegion::alignStart(read);
+			read = AlignedRegion::alignStart(read, blkSize);
 			//std::cout << "note: rounding down to: " << read << std::endl;
 		}
 		
@@ -111,9 +161,14 @@ public:
 		if (read == 0) {return 0;}
 
 		// decrypt the whole region
-		mtx.lock();
-			reg.decrypt(*cipher, *ivGen);
-		mtx.unlock();
+		if (!authenticated) {lock.lock();}
+			if (authenticated) {
+				readAuth(reg);
+				if (!reg.decryptAuth(*cipher, header.fileNonce, header.fileSize)) {return -EIO;}
+			} else {
+				reg.decrypt(*cipher, *ivGen);
+			}
+		lock.unlock();
 		
 		// calculate the to-be-fetched offset within the block-aligned region
 		const size_t regOffset = (offset - reg.getStart());
@@ -138,7 +193,7 @@ public:
 		if (size > 1024*128) {throw Exception("large block request: " + std::to_string(size));}
 
 		// align everything to the configured block-size
-		AlignedRegion reg(offset, size);
+		AlignedRegion reg(offset, size, blkSize);
 
 		mtx.lock();
 		
@@ -155,15 +210,30 @@ public:
 			// to speed things up: decrypt only blocks that are partially overwritten
 			if (read != 0) {
 				//reg.decrypt(*cipher, *ivGen);
-				reg.decryptForOverwrite(*cipher, *ivGen, offset, size);
+				if (authenticated) {
+					readAuth(reg);
+					if (reg.decryptAuthForOverwrite(*cipher, header.fileNonce, header.fileSize, offset, size) < 0) {mtx.unlock(); return -EIO;}
+				} else {
+					reg.decryptForOverwrite(*cipher, *ivGen, offset, size);
+				}
 			}
 
+			// nothing stored beyond the read data: zeros (instead of uninitialized memory)
+			memset(reg.getDecBuffer()+read, 0, reg.getSize()-read);
+
+			// authenticated: blocks between the file's end and the region must exist as well
+			if (authenticated && (uint64_t) reg.getStart() > header.fileSize) {fillGap(reg.getStart());}
+
 			// overwrite with the to-be-written data
 			const ssize_t outStart = (offset - reg.getStart());
 			memcpy(reg.getDecBuffer()+outStart, src, size);
 
 			// re-encrypt the WHOLE region
-			reg.encrypt(*cipher, *ivGen);
+			if (authenticated) {
+				reg.encryptAuth(*cipher, header.fileNonce);
+			} else {
+				reg.encrypt(*cipher, *ivGen);
+			}
 
 			// write-back the WHOLE region
 			const ssize_t written = doWrite(reg.getEncBuffer(), reg.getSize(), reg.getStart());
@@ -172,6 +242,9 @@ public:
 			if (written == -1)						{throw Exception("writing failed");}
 			if (written != (ssize_t)reg.getSize())	{throw Exception("could not write the whole region");}
 
+			// write-back the nonces/tags of the WHOLE region
+			if (authenticated) {writeAuth(reg);}
+
 			// update the file-size
 			if ((offset+size) > header.fileSize) {
 				header.fileSize = offset+size;
@@ -185,31 +258,265 @@ public:
 	
 	}
 
+	/**
+	 * change the decrypted content-size.
+	 * the block containing the new end is re-encrypted with zeros behind the end,
+	 * and all blocks behind it (including their nonces/tags) are removed.
+	 * authenticated ciphers: growing stores encrypted zeros (see fillGap)
+	 * returns 0 on success
+	 */
+	int truncate(const off_t size) override {
+
+		std::lock_guard<std::mutex> lock(mtx);
+
+		// everything behind the (old or new) end must read as zeros
+		zeroTail(std::min((uint64_t) size, header.fileSize));
+
+		const off_t blocks = (size + blkSize - 1) / blkSize;
+
+		if ((uint64_t) size > header.fileSize) {
+
+			if (authenticated) {fillGap(blocks * blkSize);}
+
+		} else {
+
+			// the nonces/tags of removed blocks within the last (remaining) metadata block
+			if (authenticated && blocks % Settings::AUTH_BLKS_PER_META != 0) {
+				const size_t len = (Settings::AUTH_BLKS_PER_META - blocks % Settings::AUTH_BLKS_PER_META) * sizeof(BlockAuth);
+				const std::vector<uint8_t> empty(len, 0);
+				if (container->write(empty.data(), len, getPhysicalAuthOffset(blocks)) != (ssize_t) len) {return -1;}
+			}
+
+			// remove all blocks behind the new end
+			const off_t end = (blocks) ? (getPhysicalOffset((blocks-1) * blkSize) + blkSize) : ((off_t) sizeof(header));
+			if (container->truncate(end) != 0) {return -1;}
+
+		}
+
+		header.fileSize = size;
+		writeHeader();
+		return 0;
+
+	}
+
 private:
 
 	friend class FileContainer_HeaderUpdate_Test;
 
-	/** writing. takes care of the header */
+	/** does the given cipher provide authentication? */
+	static bool isAuthenticated(const Cipher* cipher) {
+		if (!cipher || !cipher->getTagLength()) {return false;}
+		if (cipher->getIVLength() > Settings::AUTH_NONCE_LEN)	{throw Exception("unsupported nonce length");}
+		if (cipher->getTagLength() > Settings::AUTH_TAG_LEN)	{throw Exception("unsupported tag length");}
+		return true;
+	}
+
+	/** authenticated ciphers: physical size of one group (metadata block followed by its payload blocks) */
+	off_t getPhysicalGroupSize() const {
+		return Settings::BLK_SIZE + (off_t) Settings::AUTH_BLKS_PER_META * blkSize;
+	}
+
+	/** get the physical position of the given (payload) offset. skips the header and all metadata blocks */
+	off_t getPhysicalOffset(const off_t offset) const {
+		if (!authenticated) {return offset + sizeof(header);}
+		const off_t blk = offset / blkSize;
+		const off_t group = blk / Settings::AUTH_BLKS_PER_META;
+		const off_t idx = blk % Settings::AUTH_BLKS_PER_META;
+		return sizeof(header) + group * getPhysicalGroupSize() + Settings::BLK_SIZE + idx * blkSize + (offset % blkSize);
+	}
+
+	/** get the physical position of the metadata entry for the given (payload) block */
+	off_t getPhysicalAuthOffset(const off_t blk) const {
+		const off_t group = blk / Settings::AUTH_BLKS_PER_META;
+		const off_t idx = blk % Settings::AUTH_BLKS_PER_META;
+		return sizeof(header) + group * getPhysicalGroupSize() + idx * sizeof(BlockAuth);
+	}
+
+	/** get the number of bytes, starting at offset, that are physically contiguous (until the next metadata block) */
+	size_t getContiguous(const off_t offset, const size_t size) const {
+		if (!authenticated) {return size;}
+		const off_t groupSize = (off_t) Settings::AUTH_BLKS_PER_META * blkSize;
+		const off_t groupEnd = (offset / groupSize + 1) * groupSize;
+		return std::min((size_t)(groupEnd - offset), size);
+	}
+
+	/** writing. takes care of the header and metadata blocks */
 	ssize_t doWrite(const uint8_t* src, const size_t size, const off_t offset) {
-		return container->write(src, size, offset+sizeof(header));
+		size_t done = 0;
+		while (done < size) {
+			const size_t len = getContiguous(offset+done, size-done);
+			const ssize_t res = container->write(src+done, len, getPhysicalOffset(offset+done));
+			if (res < 0) {return res;}
+			done += res;
+			if ((size_t)res != len) {break;}
+		}
+		return done;
 	}
 
-	/** reading. takes care of the header */
+	/** reading. takes care of the header and metadata blocks */
 	ssize_t doRead(uint8_t* dst, const size_t size, const off_t offset) {
-		return container->read(dst, size, offset+sizeof(header));
+		size_t done = 0;
+		while (done < size) {
+			const size_t len = getContiguous(offset+done, size-done);
+			const ssize_t res = container->read(dst+done, len, getPhysicalOffset(offset+done));
+			if (res < 0) {return (done) ? (ssize_t)done : res;}
+			done += res;
+			if ((size_t)res != len) {break;}
+		}
+		return done;
+	}
+
+	/** read the nonces/tags for all blocks of the given region. missing entries are zero */
+	void readAuth(AlignedRegion& reg) {
+		BlockAuth* ba = reg.getAuthBuffer();
+		const off_t first = reg.getStart() / blkSize;
+		for (size_t b = 0; b < reg.getNumBlocks(); ) {
+			const size_t cnt = std::min(reg.getNumBlocks() - b, (size_t)(Settings::AUTH_BLKS_PER_META - (first+b) % Settings::AUTH_BLKS_PER_META));
+			const size_t len = cnt * sizeof(BlockAuth);
+			const ssize_t res = container->read((uint8_t*) &ba[b], len, getPhysicalAuthOffset(first+b));
+			const size_t got = (res > 0) ? (res) : (0);
+			if (got < len) {memset((uint8_t*) &ba[b] + got, 0, len - got);}
+			b += cnt;
+		}
+	}
+
+	/** re-encrypt the block containing the given end with zeros behind it. nothing to-do for aligned ends or missing blocks */
+	void zeroTail(const uint64_t end) {
+
+		if (end % blkSize == 0) {return;}
+
+		AlignedRegion reg(end, 1, blkSize);
+		const ssize_t read = doRead(reg.getEncBuffer(), reg.getSize(), reg.getStart());
+		if (read != (ssize_t) reg.getSize()) {return;}
+
+		if (authenticated) {
+			readAuth(reg);
+			if (!reg.decryptAuth(*cipher, header.fileNonce, header.fileSize)) {throw Exception("block does not match its tag", EIO);}
+		} else {
+			reg.decrypt(*cipher, *ivGen);
+		}
+
+		memset(reg.getDecBuffer() + (end - reg.getStart()), 0, reg.getSize() - (end - reg.getStart()));
+
+		if (authenticated) {
+			reg.encryptAuth(*cipher, header.fileNonce);
+		} else {
+			reg.encrypt(*cipher, *ivGen);
+		}
+
+		if (doWrite(reg.getEncBuffer(), reg.getSize(), reg.getStart()) != (ssize_t) reg.getSize()) {throw Exception("could not write the whole region");}
+		if (authenticated) {writeAuth(reg);}
+
+	}
+
+	/**
+	 * authenticated ciphers: write encrypted zeros for all blocks between the file's end and the given (aligned) offset.
+	 * every block below the file's end must have a valid tag, thus files are never sparse
+	 */
+	void fillGap(const off_t end) {
+		const off_t first = (header.fileSize + blkSize - 1) / blkSize;
+		const off_t last = end / blkSize;
+		for (off_t b = first; b < last; b += Settings::AUTH_GAP_BLKS) {
+			const off_t cnt = std::min(last - b, (off_t) Settings::AUTH_GAP_BLKS);
+			AlignedRegion reg(b * blkSize, cnt * blkSize, blkSize);
+			memset(reg.getDecBuffer(), 0, reg.getSize());
+			reg.encryptAuth(*cipher, header.fileNonce);
+			const ssize_t written = doWrite(reg.getEncBuffer(), reg.getSize(), reg.getStart());
+			if (written != (ssize_t)reg.getSize()) {throw Exception("could not write the whole region");}
+			writeAuth(reg);
+		}
+	}
+
+	/** write the nonces/tags for all blocks of the given region */
+	void writeAuth(AlignedRegion& reg) {
+		const BlockAuth* ba = reg.getAuthBuffer();
+		const off_t first = reg.getStart() / blkSize;
+		for (size_t b = 0; b < reg.getNumBlocks(); ) {
+			const size_t cnt = std::min(reg.getNumBlocks() - b, (size_t)(Settings::AUTH_BLKS_PER_META - (first+b) % Settings::AUTH_BLKS_PER_META));
+			const ssize_t len = cnt * sizeof(BlockAuth);
+			const ssize_t res = container->write((const uint8_t*) &ba[b], len, getPhysicalAuthOffset(first+b));
+			if (res != len) {throw Exception("error while writing nonces/tags", errno);}
+			b += cnt;
+		}
 	}
 	
+	/** read the container's header. false for new (or still empty) containers */
+	bool loadHeader() {
+		memset(&header, 0, sizeof(header));
+		const ssize_t res = container->read((uint8_t*) &header, sizeof(header), 0);
+		if (res <= 0) {memset(&header, 0, sizeof(header));}		// for new files, reading the header may fail
+		return !(header.version == 0 && header.fileSize == 0);
+	}
+
+	/** all containers: only one at a time may create a new container's header */
+	static std::mutex& getCreateMutex() {
+		static std::mutex mtx;
+		return mtx;
+	}
+
 	/** read the container's header */
-	void readHeader() {
+	void readHeader(const uint32_t newBlkSize) {
+
+		if (!loadHeader()) {
+
+			// new (or still empty) container: use the requested block-size and a random nonce.
+			// the header is written right away: other handles opening the same file use the same nonce
+			std::lock_guard<std::mutex> lock(getCreateMutex());
+			if (!loadHeader()) {
+				uint8_t b;
+				if (authenticated && container->read(&b, 1, sizeof(header)) > 0) {throw Exception("container has payload but no header", EIO);}
+				if (!isValidBlockSize(newBlkSize)) {throw Exception("unsupported block-size: " + std::to_string(newBlkSize));}
+				header.version = Settings::CONTAINER_VERSION;
+				header.blockSize = newBlkSize;
+				Helper::getRandom(header.fileNonce, sizeof(header.fileNonce));
+				writeHeader();
+			}
 
-		// for new files, reading the header may fail
-		const ssize_t res = container->read((uint8_t*) &header, sizeof(header), 0);
-		(void) res;
+		}
+
+		if (authenticated && !verifyHeader()) {throw Exception("container header does not match its tag", EIO);}
+
+		if (header.version == 0) {
 
+			// containers created before the block-size was configurable
+			header.blockSize = Settings::BLK_SIZE;
+
+		}
+
+		if (!isValidBlockSize(header.blockSize)) {throw Exception("container uses an unsupported block-size: " + std::to_string(header.blockSize));}
+		blkSize = header.blockSize;
+
+		// derive this file's IV-seed (once)
+		if (ivGen) {ivGen->setFileNonce(header.fileNonce, sizeof(header.fileNonce));}
+
+		// the IVs of the file's (first) blocks, if cached: small files are likely read as a whole
+		if (ivGen && !authenticated) {
+			const uint64_t blocks = (header.fileSize + blkSize - 1) / blkSize;
+			ivGen->prefill(0, blkSize, (uint32_t) std::min(blocks, (uint64_t) UINT32_MAX));
+		}
+
+	}
+
+	/** authenticated ciphers: the header's fields covered by its tag */
+	static constexpr size_t getHeaderAADLength() {
+		return offsetof(EncryptedContainerHeader, headerNonce);
+	}
+
+	/** authenticated ciphers: does the header match its tag? */
+	bool verifyHeader() {
+		return cipher->decryptAuth(nullptr, nullptr, 0, header.headerNonce, cipher->getIVLength(), (const uint8_t*) &header, getHeaderAADLength(), header.headerTag);
 	}
 
 	/** write the container's header */
-	void writeHeader() const {
+	void writeHeader() {
+
+		// authenticated ciphers: new nonce and tag for the header's current state
+		if (authenticated) {
+			memset(header.headerNonce, 0, sizeof(header.headerNonce));
+			memset(header.headerTag, 0, sizeof(header.headerTag));
+			Helper::getRandom(header.headerNonce, cipher->getIVLength());
+			cipher->encryptAuth(nullptr, nullptr, 0, header.headerNonce, cipher->getIVLength(), (const uint8_t*) &header, getHeaderAADLength(), header.headerTag);
+		}
 
 		// write the header and ensure success
 		const ssize_t res = container->write((uint8_t*) &header, sizeof(header), 0);
@@ -26,8 +26,8 @@ protected:
 
 public:
 
-	/** create from an external file-descriptor. do NOT close the description on destruction */
-	FileContainer(const int fd, const int flags) : fd(fd), flags(flags), closeOnExit(false) {
+	/** create from an external file-descriptor. close it on destruction only if requested */
+	FileContainer(const int fd, const int flags, const bool closeOnExit = false) : fd(fd), flags(flags), closeOnExit(closeOnExit) {
 		;
 	}
 
@@ -50,6 +50,11 @@ public:
 			return fsync(fd);
 		}
 	}
+
+	/** change the file's size */
+	int truncate(const off_t size) {
+		return ftruncate(fd, size);
+	}
 	
 		
 protected:
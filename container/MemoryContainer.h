@@ -35,7 +35,7 @@ public:
 		if (read > 0) {
 			memcpy(dst, data.data()+offset, read);
 		}
-		return read;
+		return (read > 0) ? (read) : (0);		// like pread(): nothing beyond the end
 
 	}
 
@@ -45,6 +45,12 @@ public:
 		return 0;
 	}
 
+	/** change the container's size */
+	virtual int truncate(const off_t size) override {
+		data.resize(size);
+		return 0;
+	}
+
 };
 
 #endif // MEMORY_CONTAINER_H
@@ -0,0 +1,151 @@
+#ifndef SIZE_CACHE_H
+#define SIZE_CACHE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <list>
+#include <unordered_map>
+#include <ctime>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "EncryptedContainer.h"
+#include "../Stats.h"
+
+namespace Settings {
+
+	/** default number of decrypted file-sizes to cache. covers folders with 100k+ files (about 150 bytes per entry) */
+	const constexpr size_t SIZE_CACHE_ENTRIES = 128 * 1024;
+
+	/**
+	 * sizes of files modified within the last seconds are not cached:
+	 * another modification within the same timestamp-tick would go unnoticed
+	 */
+	const constexpr time_t SIZE_CACHE_MIN_AGE = 2;
+
+}
+
+/**
+ * decrypted sizes of encrypted containers, keyed by the backing file's device and inode.
+ * reading the size otherwise means opening the file and reading its header.
+ * a size is valid as long as the backing file's size, mtime and ctime are unchanged.
+ * when the limit is reached, the least recently used size is dropped
+ */
+class SizeCache {
+
+private:
+
+	struct Key {
+		dev_t dev;
+		ino_t ino;
+		bool operator == (const Key& o) const {return dev == o.dev && ino == o.ino;}
+	};
+
+	struct KeyHash {
+		size_t operator () (const Key& k) const {return std::hash<uint64_t>()((uint64_t)k.ino ^ ((uint64_t)k.dev << 40));}
+	};
+
+	struct Entry {
+		off_t encSize;
+		struct timespec mtime;
+		struct timespec ctime;
+		uint64_t size;
+		std::list<Key>::iterator lru;
+	};
+
+	std::mutex mtx;
+	std::unordered_map<Key, Entry, KeyHash> map;
+
+	/** all keys, most recently used first */
+	std::list<Key> lru;
+
+	/** maximum number of entries */
+	const size_t maxEntries;
+
+public:
+
+	/** ctor with the maximum number of entries */
+	SizeCache(const size_t maxEntries) : maxEntries(maxEntries) {
+		;
+	}
+
+	/** no copy */
+	SizeCache(const SizeCache& o) = delete;
+
+	/** no assign */
+	void operator = (const SizeCache& o) = delete;
+
+
+	/** get the decrypted size of the given (backing) file, with the given stats, within the given folder */
+	uint64_t get(const int dirFD, const char* name, const struct stat& st) {
+
+		{
+			std::lock_guard<std::mutex> lock(mtx);
+			auto it = map.find(Key{st.st_dev, st.st_ino});
+			if (it != map.end()) {
+				const Entry& e = it->second;
+				if (e.encSize == st.st_size && isSame(e.mtime, st.st_mtim) && isSame(e.ctime, st.st_ctim)) {
+					++Stats::get().sizeCacheHits;
+					lru.splice(lru.begin(), lru, e.lru);
+					return e.size;
+				}
+				lru.erase(e.lru);
+				map.erase(it);
+			}
+		}
+
+		++Stats::get().sizeCacheMisses;
+		uint64_t size;
+		if (!read(dirFD, name, size)) {return 0;}
+
+		// unless modified just now
+		if (time(nullptr) - st.st_mtim.tv_sec < Settings::SIZE_CACHE_MIN_AGE) {return size;}
+		if (time(nullptr) - st.st_ctim.tv_sec < Settings::SIZE_CACHE_MIN_AGE) {return size;}
+
+		std::lock_guard<std::mutex> lock(mtx);
+		const Key key{st.st_dev, st.st_ino};
+		auto it = map.find(key);
+		if (it != map.end()) {
+			lru.erase(it->second.lru);					// added by another thread meanwhile
+			map.erase(it);
+		} else if (map.size() >= maxEntries && !lru.empty()) {
+			map.erase(lru.back());
+			lru.pop_back();
+		}
+		lru.push_front(key);
+		map[key] = Entry{st.st_size, st.st_mtim, st.st_ctim, size, lru.begin()};
+		return size;
+
+	}
+
+	/** number of cached sizes */
+	size_t size() {
+		std::lock_guard<std::mutex> lock(mtx);
+		return map.size();
+	}
+
+	/**
+	 * read the decrypted size from the header of the given (backing) file within the given folder.
+	 * only the size field is read, not the whole header. false if the file could not be read
+	 */
+	static bool read(const int dirFD, const char* name, uint64_t& size) {
+		const int fd = openat(dirFD, name, O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+		if (fd < 0) {return false;}
+		size = 0;
+		const ssize_t res = pread(fd, &size, sizeof(size), offsetof(EncryptedContainerHeader, fileSize));
+		close(fd);
+		if (res == 0) {size = 0; return true;}		// empty file, no header yet
+		return res == (ssize_t) sizeof(size);
+	}
+
+private:
+
+	static bool isSame(const struct timespec& a, const struct timespec& b) {
+		return a.tv_sec == b.tv_sec && a.tv_nsec == b.tv_nsec;
+	}
+
+};
+
+#endif // SIZE_CACHE_H
@@ -0,0 +1,148 @@
+#ifndef BLAKE2B_H
+#define BLAKE2B_H
+
+#include <cstdint>
+#include <cstring>
+
+#include "../Exception.h"
+
+/** BLAKE2b constants */
+namespace Blake2bConst {
+
+	static const uint64_t IV[8] = {
+		0x6a09e667f3bcc908ULL, 0xbb67ae8584caa73bULL, 0x3c6ef372fe94f82bULL, 0xa54ff53a5f1d36f1ULL,
+		0x510e527fade682d1ULL, 0x9b05688c2b3e6c1fULL, 0x1f83d9abfb41bd6bULL, 0x5be0cd19137e2179ULL
+	};
+
+	static const uint8_t SIGMA[12][16] = {
+		{ 0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 10, 11, 12, 13, 14, 15},
+		{14, 10,  4,  8,  9, 15, 13,  6,  1, 12,  0,  2, 11,  7,  5,  3},
+		{11,  8, 12,  0,  5,  2, 15, 13, 10, 14,  3,  6,  7,  1,  9,  4},
+		{ 7,  9,  3,  1, 13, 12, 11, 14,  2,  6,  5, 10,  4,  0, 15,  8},
+		{ 9,  0,  5,  7,  2,  4, 10, 15, 14,  1, 11, 12,  6,  8,  3, 13},
+		{ 2, 12,  6, 10,  0, 11,  8,  3,  4, 13,  7,  5, 15, 14,  1,  9},
+		{12,  5,  1, 15, 14, 13,  4, 10,  0,  7,  6,  3,  9,  2,  8, 11},
+		{13, 11,  7, 14, 12,  1,  3,  9,  5,  0, 15,  4,  8,  6,  2, 10},
+		{ 6, 15, 14,  9, 11,  3,  0,  8, 12,  2, 13,  7,  1,  4, 10,  5},
+		{10,  2,  8,  4,  7,  6,  1,  5, 15, 11,  9, 14,  3, 12, 13,  0},
+		{ 0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 10, 11, 12, 13, 14, 15},
+		{14, 10,  4,  8,  9, 15, 13,  6,  1, 12,  0,  2, 11,  7,  5,  3}
+	};
+
+}
+
+/**
+ * BLAKE2b (RFC 7693) without key, 1 to 64 bytes of output.
+ * used by Argon2
+ */
+class Blake2b {
+
+private:
+
+	uint64_t h[8];
+	uint64_t t[2];
+	uint8_t buf[128];
+	uint32_t bufLen;
+	const uint32_t outLen;
+
+public:
+
+	/** ctor with the output length (1-64 bytes) */
+	Blake2b(const uint32_t outLen) : t{0, 0}, bufLen(0), outLen(outLen) {
+		if (outLen < 1 || outLen > 64) {throw Exception("BLAKE2b output must be 1 to 64 bytes");}
+		memcpy(h, Blake2bConst::IV, sizeof(h));
+		h[0] ^= 0x01010000ULL ^ outLen;
+	}
+
+	/** append data */
+	void update(const uint8_t* in, size_t inLen) {
+		while (inLen) {
+			// the last block must be compressed by final(), thus only compress when more data follows
+			if (bufLen == sizeof(buf)) {
+				increment(sizeof(buf));
+				compress(buf, false);
+				bufLen = 0;
+			}
+			const size_t use = (inLen < sizeof(buf) - bufLen) ? (inLen) : (sizeof(buf) - bufLen);
+			memcpy(buf + bufLen, in, use);
+			bufLen += use; in += use; inLen -= use;
+		}
+	}
+
+	/** append a 32 bit little-endian value */
+	void update32(const uint32_t val) {
+		const uint8_t tmp[4] = {(uint8_t)val, (uint8_t)(val >> 8), (uint8_t)(val >> 16), (uint8_t)(val >> 24)};
+		update(tmp, 4);
+	}
+
+	/** get the hash (outLen bytes) */
+	void final(uint8_t* out) {
+		increment(bufLen);
+		memset(buf + bufLen, 0, sizeof(buf) - bufLen);
+		compress(buf, true);
+		uint8_t tmp[64];
+		for (int i = 0; i < 8; ++i) {
+			for (int j = 0; j < 8; ++j) {tmp[i*8+j] = (uint8_t)(h[i] >> (8*j));}
+		}
+		memcpy(out, tmp, outLen);
+	}
+
+	/** one-shot */
+	static void hash(const uint8_t* in, const size_t inLen, uint8_t* out, const uint32_t outLen) {
+		Blake2b b(outLen);
+		b.update(in, inLen);
+		b.final(out);
+	}
+
+private:
+
+	void increment(const uint64_t inc) {
+		t[0] += inc;
+		if (t[0] < inc) {++t[1];}
+	}
+
+	static uint64_t rotr(const uint64_t x, const int n) {
+		return (x >> n) | (x << (64 - n));
+	}
+
+	static void G(uint64_t* v, const int a, const int b, const int c, const int d, const uint64_t x, const uint64_t y) {
+		v[a] = v[a] + v[b] + x;	v[d] = rotr(v[d] ^ v[a], 32);
+		v[c] = v[c] + v[d];		v[b] = rotr(v[b] ^ v[c], 24);
+		v[a] = v[a] + v[b] + y;	v[d] = rotr(v[d] ^ v[a], 16);
+		v[c] = v[c] + v[d];		v[b] = rotr(v[b] ^ v[c], 63);
+	}
+
+	void compress(const uint8_t* block, const bool last) {
+
+		uint64_t m[16];
+		for (int i = 0; i < 16; ++i) {
+			m[i] = 0;
+			for (int j = 0; j < 8; ++j) {m[i] |= (uint64_t)block[i*8+j] << (8*j);}
+		}
+
+		uint64_t v[16];
+		memcpy(v, h, sizeof(h));
+		memcpy(v+8, Blake2bConst::IV, sizeof(h));
+		v[12] ^= t[0];
+		v[13] ^= t[1];
+		if (last) {v[14] = ~v[14];}
+
+		for (int r = 0; r < 12; ++r) {
+			const uint8_t* s = Blake2bConst::SIGMA[r];
+			G(v, 0, 4,  8, 12, m[s[ 0]], m[s[ 1]]);
+			G(v, 1, 5,  9, 13, m[s[ 2]], m[s[ 3]]);
+			G(v, 2, 6, 10, 14, m[s[ 4]], m[s[ 5]]);
+			G(v, 3, 7, 11, 15, m[s[ 6]], m[s[ 7]]);
+			G(v, 0, 5, 10, 15, m[s[ 8]], m[s[ 9]]);
+			G(v, 1, 6, 11, 12, m[s[10]], m[s[11]]);
+			G(v, 2, 7,  8, 13, m[s[12]], m[s[13]]);
+			G(v, 3, 4,  9, 14, m[s[14]], m[s[15]]);
+		}
+
+		for (int i = 0; i < 8; ++i) {h[i] ^= v[i] ^ v[i+8];}
+
+	}
+
+};
+
+#endif // BLAKE2B_H
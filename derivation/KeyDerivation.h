@@ -2,15 +2,96 @@
 #define KEYDERIVATION_H
 
 #include <cstdint>
+#include <string>
+#include <map>
+#include <thread>
+#include <chrono>
+#include <exception>
+#include <vector>
+
+namespace Settings {
+
+	/** the time (milliseconds) to unlock a volume, the key-derivation's parameters are calibrated for */
+	const constexpr uint32_t KDF_UNLOCK_MS = 1000;
+
+	/** volumes with a volume config derive one key (unwrapping the master key) */
+	const constexpr uint32_t KDF_DERIVATIONS_VOLUME = 1;
+
+	/** legacy volumes derive two keys concurrently (file-data and file-name key) */
+	const constexpr uint32_t KDF_DERIVATIONS_LEGACY = 2;
+
+}
 
 /** interface for all key-derivation functions */
 class KeyDerivation {
 
 public:
 
-	/** use the given password and salt to derive a key of the requested length */
+	/** the (tunable) cost parameters, e.g. iterations or memory, by name */
+	typedef std::map<std::string, uint32_t> Params;
+
+	/** dtor */
+	virtual ~KeyDerivation() {;}
+
+	/** THREAD SAFE: use the given password and salt to derive a key of the requested length */
 	virtual void derive(const uint8_t* pass, const uint32_t passLen, const uint8_t* salt, const uint32_t saltLen, uint8_t* out, const uint32_t outLen) = 0;
 
+	/** get the current cost parameters */
+	virtual Params getParams() const {
+		return Params();
+	}
+
+	/** use the given (e.g. stored) cost parameters. missing ones keep their current value */
+	virtual void setParams(const Params& params) {
+		(void) params;
+	}
+
+	/**
+	 * tune the cost parameters, never below their defaults, to unlock a volume within about the given time.
+	 * unlocking performs the given number of concurrent derivations (KDF_DERIVATIONS_VOLUME or KDF_DERIVATIONS_LEGACY)
+	 */
+	virtual void calibrate(const uint32_t ms, const uint32_t derivations) {
+		(void) ms; (void) derivations;
+	}
+
+	/** milliseconds to unlock a volume with the current parameters, using the given number of concurrent derivations */
+	double measureUnlock(const uint32_t derivations) {
+
+		const uint8_t pass[] = "calibration";
+		const uint8_t salt[16] = {0};
+		std::vector<uint8_t> out(derivations * 32);
+		std::vector<std::exception_ptr> err(derivations);
+		std::vector<std::thread> threads;
+
+		const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		for (uint32_t i = 1; i < derivations; ++i) {
+			threads.push_back(std::thread([&, i] () {
+				try {derive(pass, sizeof(pass), salt, sizeof(salt), &out[i*32], 32);} catch (...) {err[i] = std::current_exception();}
+			}));
+		}
+		try {derive(pass, sizeof(pass), salt, sizeof(salt), &out[0], 32);} catch (...) {err[0] = std::current_exception();}
+		for (std::thread& t : threads) {t.join();}
+		for (const std::exception_ptr& e : err) {if (e) {std::rethrow_exception(e);}}
+
+		return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+	}
+
+protected:
+
+	/** get the given parameter, or the fallback if it is not contained */
+	static uint32_t getParam(const Params& params, const std::string& name, const uint32_t fallback) {
+		auto it = params.find(name);
+		return (it == params.end()) ? (fallback) : (it->second);
+	}
+
+	/** scale the given cost linearly to the target time, never below the given minimum */
+	static uint32_t scale(const uint32_t cost, const double measuredMS, const uint32_t targetMS, const uint32_t min) {
+		const double res = (double)cost * targetMS / measuredMS;
+		if (res < min) {return min;}
+		if (res > 0xFFFFFFFF) {return 0xFFFFFFFF;}
+		return (uint32_t)res;
+	}
 
 };
 
@@ -0,0 +1,368 @@
+#ifndef KEYDERIVATIONARGON2_H
+#define KEYDERIVATIONARGON2_H
+
+#include "KeyDerivation.h"
+#include "Blake2b.h"
+#include "../Exception.h"
+
+#include <vector>
+#include <thread>
+#include <cstring>
+#include <algorithm>
+
+namespace Settings {
+
+	/** default Argon2 parameters (volumes without stored parameters) */
+	const constexpr uint32_t ARGON2_PASSES = 3;
+	const constexpr uint32_t ARGON2_MEMORY_KIB = 64*1024;
+	const constexpr uint32_t ARGON2_LANES = 4;
+
+	/** calibration does not use more memory than this */
+	const constexpr uint32_t ARGON2_MAX_MEMORY_KIB = 1024*1024;
+
+}
+
+/** the Argon2 variants */
+enum class Argon2Type : uint32_t {
+	D = 0,		// data-dependent addressing
+	I = 1,		// data-independent addressing
+	ID = 2,		// data-independent for the first half of the first pass, data-dependent afterwards
+};
+
+/**
+ * key-derivation using Argon2 (RFC 9106, version 0x13) without any library.
+ * the memory is split into lanes, which are filled by one thread each
+ * (all lanes within a slice are independent), thus the derivation uses
+ * several cores without being any weaker.
+ *		passes:		number of passes over the memory
+ *		memory:		KiB (1 KiB blocks)
+ *		lanes:		degree of parallelism
+ */
+class KeyDerivationArgon2 : public KeyDerivation {
+
+private:
+
+	/** one 1 KiB block */
+	struct Block {
+		uint64_t v[128];
+	};
+
+	/** the state of one derivation */
+	struct Instance {
+		std::vector<Block> mem;
+		uint32_t laneLen;
+		uint32_t segLen;
+	};
+
+	/** synchronization points per pass */
+	static constexpr uint32_t SLICES = 4;
+
+	const Argon2Type type;
+
+	uint32_t passes = Settings::ARGON2_PASSES;
+	uint32_t memory = Settings::ARGON2_MEMORY_KIB;
+	uint32_t lanes = Settings::ARGON2_LANES;
+
+	/** optional secret and associated data (K and X within the RFC) */
+	std::vector<uint8_t> secret;
+	std::vector<uint8_t> ad;
+
+public:
+
+	/** ctor */
+	KeyDerivationArgon2(const Argon2Type type = Argon2Type::ID) : type(type) {
+		;
+	}
+
+	/** set the optional secret value (K) */
+	void setSecret(const uint8_t* data, const uint32_t len) {
+		secret.assign(data, data + len);
+	}
+
+	/** set the optional associated data (X) */
+	void setAssociatedData(const uint8_t* data, const uint32_t len) {
+		ad.assign(data, data + len);
+	}
+
+	void derive(const uint8_t* pass, const uint32_t passLen, const uint8_t* salt, const uint32_t saltLen, uint8_t* out, const uint32_t outLen) override {
+
+		if (outLen < 4) {throw Exception("Argon2 output must be at least 4 bytes");}
+		if (saltLen < 8) {throw Exception("Argon2 salt must be at least 8 bytes");}
+
+		// H0
+		uint8_t h0[64 + 8];
+		Blake2b b(64);
+		b.update32(lanes);
+		b.update32(outLen);
+		b.update32(memory);
+		b.update32(passes);
+		b.update32(0x13);
+		b.update32((uint32_t)type);
+		b.update32(passLen);			b.update(pass, passLen);
+		b.update32(saltLen);			b.update(salt, saltLen);
+		b.update32(secret.size());		b.update(secret.data(), secret.size());
+		b.update32(ad.size());			b.update(ad.data(), ad.size());
+		b.final(h0);
+
+		// memory: a multiple of lanes * slices, at least two blocks per segment
+		Instance inst;
+		const uint32_t blocks = std::max(memory, 2 * SLICES * lanes);
+		inst.segLen = blocks / (lanes * SLICES);
+		inst.laneLen = inst.segLen * SLICES;
+		inst.mem.resize((size_t)inst.laneLen * lanes);
+
+		// the first two blocks of each lane
+		uint8_t tmp[1024];
+		for (uint32_t l = 0; l < lanes; ++l) {
+			for (uint32_t i = 0; i < 2; ++i) {
+				store32(h0 + 64, i);
+				store32(h0 + 68, l);
+				hashLong(h0, sizeof(h0), tmp, sizeof(tmp));
+				load(inst.mem[(size_t)l * inst.laneLen + i], tmp);
+			}
+		}
+
+		// all passes. within each slice, the lanes are filled concurrently
+		std::vector<std::thread> threads;
+		for (uint32_t p = 0; p < passes; ++p) {
+			for (uint32_t s = 0; s < SLICES; ++s) {
+				for (uint32_t l = 1; l < lanes; ++l) {
+					threads.push_back(std::thread(&KeyDerivationArgon2::fillSegment, this, std::ref(inst), p, s, l));
+				}
+				fillSegment(inst, p, s, 0);
+				for (std::thread& t : threads) {t.join();}
+				threads.clear();
+			}
+		}
+
+		// xor of all lanes' last block
+		Block last = inst.mem[inst.laneLen - 1];
+		for (uint32_t l = 1; l < lanes; ++l) {
+			xorBlock(last, inst.mem[(size_t)l * inst.laneLen + inst.laneLen - 1]);
+		}
+		store(last, tmp);
+		hashLong(tmp, sizeof(tmp), out, outLen);
+
+		// wipe
+		memset(tmp, 0, sizeof(tmp));
+		memset(h0, 0, sizeof(h0));
+		memset(&last, 0, sizeof(last));
+		memset(inst.mem.data(), 0, inst.mem.size() * sizeof(Block));
+
+	}
+
+	Params getParams() const override {
+		return Params{{"passes", passes}, {"memory", memory}, {"lanes", lanes}};
+	}
+
+	void setParams(const Params& params) override {
+		const uint32_t _passes = getParam(params, "passes", passes);
+		const uint32_t _memory = getParam(params, "memory", memory);
+		const uint32_t _lanes = getParam(params, "lanes", lanes);
+		if (_passes < 1) {throw Exception("Argon2 needs at least one pass");}
+		if (_lanes < 1 || _lanes > 0xFFFFFF) {throw Exception("Argon2 lanes must be between 1 and 2^24-1");}
+		if (_memory < 8 * _lanes) {throw Exception("Argon2 needs at least 8 KiB of memory per lane");}
+		passes = _passes; memory = _memory; lanes = _lanes;
+	}
+
+	/**
+	 * one lane per core. memory is doubled while the target time allows it
+	 * (memory-hardness is the main protection), the remaining time is spent on passes
+	 */
+	void calibrate(const uint32_t ms, const uint32_t derivations) override {
+
+		passes = Settings::ARGON2_PASSES;
+		memory = Settings::ARGON2_MEMORY_KIB;
+		lanes = std::max(Settings::ARGON2_LANES, std::thread::hardware_concurrency());
+
+		double took = measureUnlock(derivations);
+		while (took * 2 <= ms && memory * 2 <= Settings::ARGON2_MAX_MEMORY_KIB) {
+			memory *= 2;
+			took = measureUnlock(derivations);
+		}
+		passes = scale(passes, took, ms, Settings::ARGON2_PASSES);
+
+	}
+
+private:
+
+	static void store32(uint8_t* dst, const uint32_t val) {
+		dst[0] = (uint8_t)val; dst[1] = (uint8_t)(val >> 8); dst[2] = (uint8_t)(val >> 16); dst[3] = (uint8_t)(val >> 24);
+	}
+
+	static void load(Block& b, const uint8_t* src) {
+		for (int i = 0; i < 128; ++i) {
+			b.v[i] = 0;
+			for (int j = 0; j < 8; ++j) {b.v[i] |= (uint64_t)src[i*8+j] << (8*j);}
+		}
+	}
+
+	static void store(const Block& b, uint8_t* dst) {
+		for (int i = 0; i < 128; ++i) {
+			for (int j = 0; j < 8; ++j) {dst[i*8+j] = (uint8_t)(b.v[i] >> (8*j));}
+		}
+	}
+
+	static void xorBlock(Block& dst, const Block& src) {
+		for (int i = 0; i < 128; ++i) {dst.v[i] ^= src.v[i];}
+	}
+
+	/** variable-length hash H' */
+	static void hashLong(const uint8_t* in, const uint32_t inLen, uint8_t* out, const uint32_t outLen) {
+
+		uint8_t lenLE[4];
+		store32(lenLE, outLen);
+
+		if (outLen <= 64) {
+			Blake2b b(outLen);
+			b.update(lenLE, 4);
+			b.update(in, inLen);
+			b.final(out);
+			return;
+		}
+
+		// 32 bytes of each 64 byte hash, the last one as a whole
+		uint8_t v[64];
+		Blake2b b(64);
+		b.update(lenLE, 4);
+		b.update(in, inLen);
+		b.final(v);
+		memcpy(out, v, 32); out += 32;
+		uint32_t remaining = outLen - 32;
+		while (remaining > 64) {
+			Blake2b::hash(v, 64, v, 64);
+			memcpy(out, v, 32); out += 32;
+			remaining -= 32;
+		}
+		Blake2b::hash(v, 64, out, remaining);
+
+	}
+
+	static uint64_t rotr(const uint64_t x, const int n) {
+		return (x >> n) | (x << (64 - n));
+	}
+
+	/** multiplication-hardened addition */
+	static uint64_t fBlaMka(const uint64_t x, const uint64_t y) {
+		return x + y + 2 * (uint64_t)(uint32_t)x * (uint32_t)y;
+	}
+
+	static void G(uint64_t& a, uint64_t& b, uint64_t& c, uint64_t& d) {
+		a = fBlaMka(a, b);	d = rotr(d ^ a, 32);
+		c = fBlaMka(c, d);	b = rotr(b ^ c, 24);
+		a = fBlaMka(a, b);	d = rotr(d ^ a, 16);
+		c = fBlaMka(c, d);	b = rotr(b ^ c, 63);
+	}
+
+	/** the permutation P on 16 words */
+	static void P(uint64_t& v0, uint64_t& v1, uint64_t& v2, uint64_t& v3, uint64_t& v4, uint64_t& v5, uint64_t& v6, uint64_t& v7,
+				  uint64_t& v8, uint64_t& v9, uint64_t& v10, uint64_t& v11, uint64_t& v12, uint64_t& v13, uint64_t& v14, uint64_t& v15) {
+		G(v0, v4, v8, v12);	G(v1, v5, v9, v13);	G(v2, v6, v10, v14);	G(v3, v7, v11, v15);
+		G(v0, v5, v10, v15);	G(v1, v6, v11, v12);	G(v2, v7, v8, v13);	G(v3, v4, v9, v14);
+	}
+
+	/** compression G(prev, ref), written to (or xored into) next */
+	static void fillBlock(const Block& prev, const Block& ref, Block& next, const bool withXor) {
+
+		Block r;
+		Block tmp;
+		for (int i = 0; i < 128; ++i) {r.v[i] = prev.v[i] ^ ref.v[i];}
+		tmp = r;
+		if (withXor) {xorBlock(tmp, next);}
+
+		// rows
+		for (int i = 0; i < 8; ++i) {
+			uint64_t* v = &r.v[16*i];
+			P(v[0], v[1], v[2], v[3], v[4], v[5], v[6], v[7], v[8], v[9], v[10], v[11], v[12], v[13], v[14], v[15]);
+		}
+
+		// columns
+		for (int i = 0; i < 8; ++i) {
+			uint64_t* v = &r.v[2*i];
+			P(v[0], v[1], v[16], v[17], v[32], v[33], v[48], v[49], v[64], v[65], v[80], v[81], v[96], v[97], v[112], v[113]);
+		}
+
+		for (int i = 0; i < 128; ++i) {next.v[i] = tmp.v[i] ^ r.v[i];}
+
+	}
+
+	/** the next 128 pseudo-random values for data-independent addressing */
+	static void nextAddresses(Block& addresses, Block& input, const Block& zero) {
+		++input.v[6];
+		fillBlock(zero, input, addresses, false);
+		fillBlock(zero, addresses, addresses, false);
+	}
+
+	/** the block (within the reference lane) to use for the given position */
+	uint32_t indexAlpha(const Instance& inst, const uint32_t pass, const uint32_t slice, const uint32_t index, const uint32_t rand, const bool sameLane) const {
+
+		uint32_t area;
+		if (pass == 0) {
+			if (slice == 0)		{area = index - 1;}
+			else if (sameLane)	{area = slice * inst.segLen + index - 1;}
+			else				{area = slice * inst.segLen - ((index == 0) ? 1 : 0);}
+		} else {
+			if (sameLane)		{area = inst.laneLen - inst.segLen + index - 1;}
+			else				{area = inst.laneLen - inst.segLen - ((index == 0) ? 1 : 0);}
+		}
+
+		uint64_t rel = rand;
+		rel = (rel * rel) >> 32;
+		rel = area - 1 - (((uint64_t)area * rel) >> 32);
+
+		const uint32_t start = (pass != 0 && slice != SLICES - 1) ? ((slice + 1) * inst.segLen) : (0);
+		return (uint32_t)((start + rel) % inst.laneLen);
+
+	}
+
+	/** fill one segment (slice within a lane) */
+	void fillSegment(Instance& inst, const uint32_t pass, const uint32_t slice, const uint32_t lane) const {
+
+		const bool independent = (type == Argon2Type::I) || (type == Argon2Type::ID && pass == 0 && slice < SLICES / 2);
+
+		Block zero = {};
+		Block input = {};
+		Block addresses = {};
+		if (independent) {
+			input.v[0] = pass;
+			input.v[1] = lane;
+			input.v[2] = slice;
+			input.v[3] = inst.mem.size();
+			input.v[4] = passes;
+			input.v[5] = (uint64_t)type;
+		}
+
+		uint32_t startIdx = 0;
+		if (pass == 0 && slice == 0) {
+			startIdx = 2;
+			if (independent) {nextAddresses(addresses, input, zero);}
+		}
+
+		size_t cur = (size_t)lane * inst.laneLen + slice * inst.segLen + startIdx;
+		size_t prev = (cur % inst.laneLen == 0) ? (cur + inst.laneLen - 1) : (cur - 1);
+
+		for (uint32_t i = startIdx; i < inst.segLen; ++i, ++cur, ++prev) {
+
+			if (cur % inst.laneLen == 1) {prev = cur - 1;}
+
+			uint64_t rand;
+			if (independent) {
+				if (i % 128 == 0) {nextAddresses(addresses, input, zero);}
+				rand = addresses.v[i % 128];
+			} else {
+				rand = inst.mem[prev].v[0];
+			}
+
+			const uint32_t refLane = (pass == 0 && slice == 0) ? (lane) : ((uint32_t)((rand >> 32) % lanes));
+			const uint32_t refIdx = indexAlpha(inst, pass, slice, i, (uint32_t)rand, refLane == lane);
+			const Block& ref = inst.mem[(size_t)refLane * inst.laneLen + refIdx];
+
+			fillBlock(inst.mem[prev], ref, inst.mem[cur], pass != 0);
+
+		}
+
+	}
+
+};
+
+#endif // KEYDERIVATIONARGON2_H
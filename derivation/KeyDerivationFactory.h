@@ -5,6 +5,7 @@
 #include "KeyDerivation.h"
 #include "KeyDerivationOpenSSL.h"
 #include "KeyDerivationSCrypt.h"
+#include "KeyDerivationArgon2.h"
 
 
 
@@ -24,6 +25,8 @@ public:
 		if ("scrypt" == name)											{return new KeyDerivationSCrypt();}
 #endif
 
+		if ("argon2id" == name)											{return new KeyDerivationArgon2(Argon2Type::ID);}
+
 		// none found
 		throw onNotFound("unsupported key-derivation", name, getSupported());
 
@@ -43,6 +46,8 @@ public:
 		res.push_back("scrypt");
 #endif
 
+		res.push_back("argon2id");
+
 		return res;
 
 	}
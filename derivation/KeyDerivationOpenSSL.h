@@ -5,8 +5,16 @@
 
 #include "KeyDerivation.h"
 #include "openssl/evp.h"
+#include <algorithm>
 #include "../Exception.h"
 
+namespace Settings {
+
+	/** default number of PBKDF2 iterations (volumes without stored parameters) */
+	const constexpr uint32_t PBKDF2_ITERATIONS = 1024*256;
+
+}
+
 struct OpenSSLKeyDerivation {
 
 private:
@@ -40,7 +48,7 @@ private:
 	OpenSSLKeyDerivation cfg;
 
 	/** number of iterations */
-	const int iter = 1024*256;
+	uint32_t iter = Settings::PBKDF2_ITERATIONS;
 
 public:
 
@@ -51,11 +59,27 @@ public:
 
 	void derive(const uint8_t* pass, const uint32_t passLen, const uint8_t* salt, const uint32_t saltLen, uint8_t* out, const uint32_t outLen) override {
 
-		const int res = PKCS5_PBKDF2_HMAC((const char*)pass, passLen, salt, saltLen, iter, cfg.digest, outLen, out);
+		const int res = PKCS5_PBKDF2_HMAC((const char*)pass, passLen, salt, saltLen, (int)iter, cfg.digest, outLen, out);
 		if (res != 1) {throw Exception("error while deriving key");}
 
 	}
 
+	Params getParams() const override {
+		return Params{{"iterations", iter}};
+	}
+
+	void setParams(const Params& params) override {
+		const uint32_t i = getParam(params, "iterations", iter);
+		if (i < 1 || i > 0x7FFFFFFF) {throw Exception("invalid number of PBKDF2 iterations");}
+		iter = i;
+	}
+
+	/** PBKDF2 is strictly serial: the time scales linearly with the iterations */
+	void calibrate(const uint32_t ms, const uint32_t derivations) override {
+		iter = Settings::PBKDF2_ITERATIONS;
+		iter = std::min(scale(iter, measureUnlock(derivations), ms, Settings::PBKDF2_ITERATIONS), (uint32_t)0x7FFFFFFF);
+	}
+
 
 
 };
@@ -0,0 +1,106 @@
+#ifndef KEYDERIVATIONPARAMS_H
+#define KEYDERIVATIONPARAMS_H
+
+#include <string>
+#include <fstream>
+#include <sstream>
+#include <sys/stat.h>
+
+#include "KeyDerivation.h"
+#include "../Exception.h"
+#include "../Helper.h"
+
+namespace Settings {
+
+	/** file within the encrypted root, storing the calibrated key-derivation parameters */
+	const constexpr char* KDF_PARAMS_FILE = ".kcryptfs.kdf";
+
+}
+
+/**
+ * the name and cost parameters of a volume's key-derivation.
+ * stored as plain "key=value" lines: the parameters are not secret
+ */
+class KeyDerivationParams {
+
+private:
+
+	/** the key-derivation's name */
+	std::string name;
+
+	/** its cost parameters */
+	KeyDerivation::Params params;
+
+public:
+
+	/** empty ctor */
+	KeyDerivationParams() {
+		;
+	}
+
+	/** ctor */
+	KeyDerivationParams(const std::string& name, const KeyDerivation::Params& params) : name(name), params(params) {
+		;
+	}
+
+	/** get the key-derivation's name */
+	const std::string& getName() const {return name;}
+
+	/** get the cost parameters */
+	const KeyDerivation::Params& getParams() const {return params;}
+
+	/** empty? (nothing stored) */
+	bool empty() const {return name.empty();}
+
+	/** does the given file exist? */
+	static bool exists(const std::string& file) {
+		struct stat st;
+		return stat(file.c_str(), &st) == 0;
+	}
+
+	/** load from the given file */
+	static KeyDerivationParams load(const std::string& file) {
+
+		std::ifstream in(file);
+		if (!in) {throw Exception("could not open " + file);}
+
+		KeyDerivationParams res;
+		std::string line;
+		while (std::getline(in, line)) {
+			if (line.empty() || line[0] == '#') {continue;}
+			const size_t pos = line.find('=');
+			if (pos == std::string::npos) {throw Exception("invalid line within " + file + ": " + line);}
+			const std::string key = line.substr(0, pos);
+			const std::string val = line.substr(pos+1);
+			if ("kdf" == key) {res.name = val; continue;}
+			try {
+				res.params[key] = (uint32_t) std::stoul(val);
+			} catch (...) {
+				throw Exception("invalid value within " + file + ": " + line);
+			}
+		}
+
+		if (res.name.empty()) {throw Exception("no key-derivation within " + file);}
+		return res;
+
+	}
+
+	/** store to the given file. replaces an existing one atomically */
+	void save(const std::string& file) const {
+		std::ostringstream out;
+		out << "# kCryptFS key-derivation parameters. changing them changes the keys!" << std::endl;
+		out << "kdf=" << name << std::endl;
+		for (const auto& it : params) {out << it.first << "=" << it.second << std::endl;}
+		Helper::writeFileAtomic(file, out.str());
+	}
+
+	/** get as one-line string */
+	std::string asString() const {
+		std::string str = name;
+		for (const auto& it : params) {str += " " + it.first + "=" + std::to_string(it.second);}
+		return str;
+	}
+
+};
+
+#endif // KEYDERIVATIONPARAMS_H
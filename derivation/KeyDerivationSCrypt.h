@@ -5,9 +5,33 @@
 
 #include <libscrypt.h>
 
-/** key-derivation using SCrypt */
+#include "KeyDerivation.h"
+#include "../Exception.h"
+
+namespace Settings {
+
+	/** default scrypt parameters (volumes without stored parameters) */
+	const constexpr uint32_t SCRYPT_N = 16384;
+	const constexpr uint32_t SCRYPT_R = 8;
+	const constexpr uint32_t SCRYPT_P = 16;
+
+	/** calibration does not exceed this N (N * r * 128 bytes of memory) */
+	const constexpr uint32_t SCRYPT_MAX_N = 1024*1024;
+
+}
+
+/**
+ * key-derivation using SCrypt.
+ * NOTE: libscrypt processes the p lanes one after another
+ */
 class KeyDerivationSCrypt : public KeyDerivation {
 
+private:
+
+	uint32_t N = Settings::SCRYPT_N;
+	uint32_t r = Settings::SCRYPT_R;
+	uint32_t p = Settings::SCRYPT_P;
+
 public:
 
 	/** ctor */
@@ -17,17 +41,33 @@ public:
 
 	void derive(const uint8_t* pass, const uint32_t passLen, const uint8_t* salt, const uint32_t saltLen, uint8_t* out, const uint32_t outLen) override {
 
-
-		static constexpr int _SCRYPT_N = 16384;
-		static constexpr int _SCRYPT_r = 8;
-		static constexpr int _SCRYPT_p = 16;
-
-		const int res = libscrypt_scrypt(pass, passLen, salt, saltLen, _SCRYPT_N, _SCRYPT_r, _SCRYPT_p, out, outLen);
+		const int res = libscrypt_scrypt(pass, passLen, salt, saltLen, N, r, p, out, outLen);
 		if (res != 0) {throw Exception("error while creating scrypt hash");}
 
 	}
 
+	Params getParams() const override {
+		return Params{{"N", N}, {"r", r}, {"p", p}};
+	}
+
+	void setParams(const Params& params) override {
+		const uint32_t _N = getParam(params, "N", N);
+		const uint32_t _r = getParam(params, "r", r);
+		const uint32_t _p = getParam(params, "p", p);
+		if (_N < 2 || (_N & (_N - 1))) {throw Exception("scrypt N must be a power of two");}
+		if (_r < 1 || _p < 1) {throw Exception("scrypt r and p must be at least 1");}
+		N = _N; r = _r; p = _p;
+	}
 
+	/** the memory grows with N, thus only N is doubled (the lanes are not processed in parallel) */
+	void calibrate(const uint32_t ms, const uint32_t derivations) override {
+		N = Settings::SCRYPT_N; r = Settings::SCRYPT_R; p = Settings::SCRYPT_P;
+		double took = measureUnlock(derivations);
+		while (took * 2 <= ms && N * 2 <= Settings::SCRYPT_MAX_N) {
+			N *= 2;
+			took = measureUnlock(derivations);
+		}
+	}
 
 };
 
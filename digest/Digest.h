@@ -1,6 +1,8 @@
 #ifndef DIGEST_H
 #define DIGEST_H
 
+#include "../Exception.h"
+
 class Digest {
 	
 public:
@@ -9,8 +11,46 @@ public:
 
 	/** get the hash (digest) for the given input into the provided output buffer */
 	virtual void hash(const uint8_t* in, const uint32_t inLen, uint8_t* out) = 0;
+
+	/**
+	 * hash 'count' independent inputs of 'inLen' bytes each, stored back-to-back within 'in'.
+	 * 'out' receives count*getSize() bytes. implementations may hash several inputs in parallel
+	 */
+	virtual void hashMany(const uint8_t* in, const uint32_t inLen, const uint32_t count, uint8_t* out) {
+		const uint32_t size = getSize();
+		for (uint32_t i = 0; i < count; ++i) {
+			hash(in + i*inLen, inLen, out + i*size);
+		}
+	}
 	
 
+	/** set the key of keyed digests (HMAC). all others do not support a key */
+	virtual void setKey(const uint8_t* key, const uint32_t keyLen) {
+		(void) key; (void) keyLen;
+		throw Exception("digest does not support a key");
+	}
+
+	/**
+	 * set a prefix, that is (virtually) prepended to every input of hashPrefixed().
+	 * the digest's state after absorbing the prefix is computed only once, here
+	 */
+	virtual void setPrefix(const uint8_t* prefix, const uint32_t prefixLen) = 0;
+
+	/**
+	 * THREAD SAFE: get the hash of prefix+input into the provided output buffer.
+	 * continues from the state after the prefix, thus any number of threads may call this concurrently
+	 */
+	virtual void hashPrefixed(const uint8_t* in, const uint32_t inLen, uint8_t* out) const = 0;
+
+	/** THREAD SAFE: hashPrefixed() for 'count' inputs of 'inLen' bytes each, stored back-to-back */
+	virtual void hashManyPrefixed(const uint8_t* in, const uint32_t inLen, const uint32_t count, uint8_t* out) const {
+		const uint32_t size = getSize();
+		for (uint32_t i = 0; i < count; ++i) {
+			hashPrefixed(in + i*inLen, inLen, out + i*size);
+		}
+	}
+
+
 	/** start building a digest. followed by append() and get() */
 	virtual void start() = 0;
 
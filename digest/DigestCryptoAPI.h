@@ -5,12 +5,14 @@
 
 #include <linux/if_alg.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <cstring>
 #include <unistd.h>
 #include <errno.h>
 #include <vector>
 #include <iostream>
 #include <string>
+#include <mutex>
 
 #include "../Exception.h"
 #include "Digest.h"
@@ -27,11 +29,14 @@ private:
 	
 	/** the digesst's output length */
 	const uint32_t len;
+
+	/** does the digest need a key (HMAC)? */
+	const bool keyed;
 	
 public:
 	
 	/** ctor */
-	CryptoAPIDigest(const std::string& name, const uint32_t len) : name(name), len(len) {;}
+	CryptoAPIDigest(const std::string& name, const uint32_t len, const bool keyed = false) : name(name), len(len), keyed(keyed) {;}
 	
 	/** get the digest's name */
 	const std::string& getName() const {return name;}
@@ -39,19 +44,27 @@ public:
 	/** get the digest's output size */
 	uint32_t getSize() const {return len;}
 
+	/** does the digest need a key (HMAC)? */
+	bool isKeyed() const {return keyed;}
+
 };
 
 /** all available digests */
 namespace CryptoAPIDigests {
-	const CryptoAPIDigest SHA1 =	{"sha256", 20};
+	const CryptoAPIDigest SHA1 =	{"sha1", 20};
+	const CryptoAPIDigest SHA256_TRUNC20 =	{"sha256", 20};		// legacy: what kernel_sha1 used to be
 	const CryptoAPIDigest SHA256 =	{"sha256", 32};
 	const CryptoAPIDigest SHA512 =	{"sha512", 64};
 	const CryptoAPIDigest MD5 =		{"md5", 16};
+	const CryptoAPIDigest HMAC_SHA256 =	{"hmac(sha256)", 32, true};
 }
 
 /**
- * several digest-implementations based on the kernel's crypto API
+ * several digest-implementations based on the kernel's crypto API.
+ * keyed digests (HMAC) keep their key within the kernel (set once, see setKey)
+ * and can not be used before a key is set.
  * NOTE: this class is NOT intended to be thread-safe!!
+ * (except for hashPrefixed() and hashManyPrefixed())
  */
 class DigestCryptoAPI : public Digest {
 	
@@ -62,6 +75,18 @@ private:
 	
 	/** handle to the digest-socket */
 	int sckDigest;
+
+	/** handle to a digest-socket holding the state after absorbing the prefix (see setPrefix) */
+	int sckPrefix;
+
+	/** digest-socket for prefix+message in one go, shared by all threads (see mtxBatch) */
+	int sckBatch;
+
+	/** a copy of the prefix, sent along with every message via sckBatch */
+	std::vector<uint8_t> prefix;
+
+	/** guards the batch-socket */
+	mutable std::mutex mtxBatch;
 	
 	/** the type of digest to use */
 	const CryptoAPIDigest& type;
@@ -69,7 +94,7 @@ private:
 public:
 	
 	/** ctor with type */
-	DigestCryptoAPI(const CryptoAPIDigest& type) : sckCfg(-1), sckDigest(-1), type(type) {
+	DigestCryptoAPI(const CryptoAPIDigest& type) : sckCfg(-1), sckDigest(-1), sckPrefix(-1), sckBatch(-1), type(type) {
 		init();
 	}
 	
@@ -85,14 +110,18 @@ public:
 	void operator = (const DigestCryptoAPI& c) = delete;
 	
 	/** move */
-	DigestCryptoAPI(DigestCryptoAPI&& c) : sckCfg(c.sckCfg), sckDigest(c.sckDigest), type(c.type) {
+	DigestCryptoAPI(DigestCryptoAPI&& c) : sckCfg(c.sckCfg), sckDigest(c.sckDigest), sckPrefix(c.sckPrefix), sckBatch(c.sckBatch), prefix(std::move(c.prefix)), type(c.type) {
 		c.sckCfg = -1;
 		c.sckDigest = -1;
+		c.sckPrefix = -1;
+		c.sckBatch = -1;
 	}
 	
 
 	void hash(const uint8_t* in, const uint32_t inLen, uint8_t* out) override {
-		
+
+		if (sckDigest < 0)			{throw Exception("digest needs a key");}
+
 		// send data
 		const ssize_t sent = send(sckDigest, in, inLen, MSG_DONTWAIT);
 		if (sent != inLen)			{throw Exception("failed to start digest");}
@@ -103,12 +132,85 @@ public:
 		
 	}
 	
+	/** set the HMAC-key (once) within the kernel. all following messages just send the data */
+	void setKey(const uint8_t* key, const uint32_t keyLen) override {
+
+		if (!type.isKeyed())		{throw Exception("digest does not support a key");}
+
+		// the kernel refuses a new key (EBUSY) while operation-sockets exist.
+		// they can only be created (again) once the key is known
+		closeOps();
+
+		const int res = setsockopt(sckCfg, SOL_ALG, ALG_SET_KEY, key, keyLen);
+		if (res < 0)				{throw Exception("could not set HMAC-key", errno);}
+
+		openOps();
+
+	}
+
+	void setPrefix(const uint8_t* prefix, const uint32_t prefixLen) override {
+
+		this->prefix.assign(prefix, prefix + prefixLen);
+		if (sckPrefix >= 0) {close(sckPrefix); sckPrefix = -1;}
+
+		// keyed digest without key: applied by setKey()
+		if (sckDigest < 0) {return;}
+
+		// a socket of its own, that absorbed the prefix but is never finalized
+		sckPrefix = accept(sckCfg, NULL, 0);
+		if (sckPrefix < 0)			{throw Exception("could not create Digest-socket");}
+
+		const ssize_t sent = send(sckPrefix, prefix, prefixLen, MSG_MORE);
+		if (sent != prefixLen)		{throw Exception("failed to absorb the digest's prefix");}
+
+	}
+
+	/**
+	 * THREAD SAFE. if the batch-socket is unused, prefix and message are sent together
+	 * (two syscalls). otherwise the prefix' state is cloned (four syscalls)
+	 */
+	void hashPrefixed(const uint8_t* in, const uint32_t inLen, uint8_t* out) const override {
+
+		if (sckPrefix < 0)			{throw Exception("digest needs a key");}
+
+		{
+			std::unique_lock<std::mutex> lock(mtxBatch, std::try_to_lock);
+			if (lock.owns_lock()) {hashBatch(prefix.data(), prefix.size(), in, inLen, 1, out); return;}
+		}
+
+		// accept() on an operation-socket clones its current state (the prefix)
+		const int sck = accept(sckPrefix, NULL, 0);
+		if (sck < 0)				{throw Exception("could not clone the digest's state");}
+
+		const ssize_t sent = send(sck, in, inLen, 0);
+		const ssize_t got = (sent == inLen) ? (read(sck, out, type.getSize())) : (-1);
+		close(sck);
+
+		if (sent != inLen)			{throw Exception("failed to start digest");}
+		if (got != type.getSize())	{throw Exception("failed to read the digest result");}
+
+	}
+
+	/**
+	 * THREAD SAFE: hash several prefixed messages. the prefix and the message are sent together
+	 * (two syscalls per message instead of cloning the prefix' state). if another thread is
+	 * using the batch-socket, falls back to hashPrefixed()
+	 */
+	void hashManyPrefixed(const uint8_t* in, const uint32_t inLen, const uint32_t count, uint8_t* out) const override {
+		if (sckPrefix < 0)			{throw Exception("digest needs a key");}
+		std::unique_lock<std::mutex> lock(mtxBatch, std::try_to_lock);
+		if (!lock.owns_lock()) {Digest::hashManyPrefixed(in, inLen, count, out); return;}
+		hashBatch(prefix.data(), prefix.size(), in, inLen, count, out);
+	}
+
 	void start() override {
 		;
 	}
 
 	void append(const uint8_t* in, const uint32_t inLen, const bool finalize) override {
-	
+
+		if (sckDigest < 0)			{throw Exception("digest needs a key");}
+
 		// send data
 		const int flags = (finalize) ? (0) : (MSG_MORE);
 		const ssize_t sent = send(sckDigest, in, inLen, flags);
@@ -149,24 +251,68 @@ private:
 		
 		res = bind(sckCfg, (struct sockaddr*)&sa, sizeof(sa));
 		if (res < 0) {destroy(); throw Exception("could not bind api-socket");}
-				
-		// setting the key to use (this means we get a HMAC)
-		//const int key = 0;
-		//const int keyLen = 4;
-		//res = setsockopt(sckCfg, SOL_ALG, ALG_SET_KEY, &key, keyLen);
-		//if (res < 0) {destroy(); throw Exception("could not set HMAC-key");}	
-		
-		// get a socket to access the configured algorithm
+
+		// keyed digests (HMAC) get their sockets once the key is set
+		if (type.isKeyed()) {return;}
+
+		try {openOps();} catch (...) {destroy(); throw;}
+
+	}
+
+	/** get the sockets to access the configured algorithm */
+	void openOps() {
+
 		sckDigest = accept(sckCfg, NULL, 0);
-		if (sckDigest < 0) {destroy(); throw Exception("could not create Digest-socket");}
-	
-				
+		if (sckDigest < 0) {throw Exception("could not create Digest-socket");}
+
+		sckBatch = accept(sckCfg, NULL, 0);
+		if (sckBatch < 0) {throw Exception("could not create Digest-socket");}
+
+		// the current prefix (empty until configured otherwise)
+		const std::vector<uint8_t> cur = prefix;
+		setPrefix(cur.data(), cur.size());
+
+	}
+
+	/** close all sockets but the configuration */
+	void closeOps() {
+		if (sckDigest >= 0)	{close(sckDigest); sckDigest = -1;}
+		if (sckPrefix >= 0)	{close(sckPrefix); sckPrefix = -1;}
+		if (sckBatch >= 0)	{close(sckBatch); sckBatch = -1;}
 	}
 			
+	/**
+	 * hash each (prefix+)message via the batch-socket: one sendmsg() and one read() per message.
+	 * the kernel computes synchronously, thus more sockets would not hash any faster
+	 */
+	void hashBatch(const uint8_t* prefix, const uint32_t prefixLen, const uint8_t* in, const uint32_t inLen, const uint32_t count, uint8_t* out) const {
+
+		const uint32_t size = type.getSize();
+
+		for (uint32_t i = 0; i < count; ++i) {
+
+			struct iovec iov[2];
+			iov[0].iov_base = (void*) prefix;
+			iov[0].iov_len = prefixLen;
+			iov[1].iov_base = (void*) (in + i*inLen);
+			iov[1].iov_len = inLen;
+			struct msghdr msg = {};
+			msg.msg_iov = (prefixLen) ? (&iov[0]) : (&iov[1]);
+			msg.msg_iovlen = (prefixLen) ? (2) : (1);
+			const ssize_t sent = sendmsg(sckBatch, &msg, 0);
+			if (sent != prefixLen + inLen)	{throw Exception("failed to start digest");}
+
+			const ssize_t got = read(sckBatch, out + i*size, size);
+			if (got != size)				{throw Exception("failed to read the digest result");}
+
+		}
+
+	}
+
 	/** cleanup */
 	void destroy() {
 		if (sckCfg >= 0)	{close(sckCfg); sckCfg = -1;}
-		if (sckDigest >= 0)	{close(sckDigest); sckDigest = -1;}	
+		closeOps();
 	}
 	
 };
@@ -5,31 +5,74 @@
 #include "Digest.h"
 #include "DigestCryptoAPI.h"
 #include "DigestOpenSSL.h"
+#include "DigestNative.h"
 
 #include <vector>
+#include <memory>
 
 class DigestFactory : private Factory {
 	
 public:
 
-	static Digest* getByName(const std::string& name) {
+	/** get a digest by its name. backend-independent names like "sha256" are resolved first */
+	static Digest* getByName(const std::string& alias) {
+
+		const std::string name = resolve(alias);
 
 #ifdef WITH_KERNEL
-		if ("kernel_sha1" == name	|| "sha1" == name)		{return new DigestCryptoAPI(CryptoAPIDigests::SHA1);}
-		if ("kernel_sha256" == name	|| "sha256" == name)	{return new DigestCryptoAPI(CryptoAPIDigests::SHA256);}
-		if ("kernel_sha512" == name	|| "sha512" == name)	{return new DigestCryptoAPI(CryptoAPIDigests::SHA512);}
-		if ("kernel_md5" == name	|| "md5" == name)		{return new DigestCryptoAPI(CryptoAPIDigests::MD5);}
+		if ("kernel_sha1" == name)		{return new DigestCryptoAPI(CryptoAPIDigests::SHA1);}
+		if ("kernel_sha256_trunc20" == name)	{return new DigestCryptoAPI(CryptoAPIDigests::SHA256_TRUNC20);}
+		if ("kernel_sha256" == name)	{return new DigestCryptoAPI(CryptoAPIDigests::SHA256);}
+		if ("kernel_sha512" == name)	{return new DigestCryptoAPI(CryptoAPIDigests::SHA512);}
+		if ("kernel_md5" == name)		{return new DigestCryptoAPI(CryptoAPIDigests::MD5);}
+		if ("kernel_hmac_sha256" == name)	{return new DigestCryptoAPI(CryptoAPIDigests::HMAC_SHA256);}
 #endif
 
 #ifdef WITH_OPENSSL
-		if ("openssl_sha1" == name		|| "sha1" == name)		{return new DigestOpenSSL(OpenSSLDigests::SHA1);}
-		if ("openssl_sha256" == name	|| "sha256" == name)	{return new DigestOpenSSL(OpenSSLDigests::SHA256);}
-		if ("openssl_sha512" == name	|| "sha512" == name)	{return new DigestOpenSSL(OpenSSLDigests::SHA512);}
-		if ("openssl_md5" == name		|| "md5" == name)		{return new DigestOpenSSL(OpenSSLDigests::MD5);}
+		if ("openssl_sha1" == name)		{return new DigestOpenSSL(OpenSSLDigests::SHA1);}
+		if ("openssl_sha256" == name)	{return new DigestOpenSSL(OpenSSLDigests::SHA256);}
+		if ("openssl_sha256_trunc20" == name)	{return new DigestOpenSSL(OpenSSLDigests::SHA256_TRUNC20);}
+		if ("openssl_sha512" == name)	{return new DigestOpenSSL(OpenSSLDigests::SHA512);}
+		if ("openssl_md5" == name)		{return new DigestOpenSSL(OpenSSLDigests::MD5);}
+		if ("openssl_hmac_sha256" == name)	{return new DigestOpenSSL(OpenSSLDigests::HMAC_SHA256);}
+#endif
+
+#ifdef WITH_NATIVE
+		if ("native_sha1" == name)		{return new DigestNative(NativeDigests::SHA1);}
+		if ("native_sha256" == name)	{return new DigestNative(NativeDigests::SHA256);}
 #endif
 
-		throw onNotFound("unsupported digest", name, getSupported());
+		throw onNotFound("unsupported digest", alias, getSupported());
+
+	}
+
+	/** the algorithm denoted by the given name: "auto" is the default algorithm (sha256), all others name themselves */
+	static std::string getAlgorithm(const std::string& name) {
+		return ("auto" == name) ? ("sha256") : (name);
+	}
+
+	/**
+	 * map a backend-independent name onto the fastest backend available on this machine.
+	 * if several backends provide the algorithm, a short calibration decides.
+	 * "auto" denotes the default algorithm (sha256).
+	 * "sha256_trunc20" is the first 20 bytes of SHA-256, computed by kernel_sha1 before it became SHA-1
+	 */
+	static std::string resolve(const std::string& name) {
+		if ("auto" == name)						{return resolve(getAlgorithm(name));}
+		if ("sha1" == name || "sha256" == name)	{return calibrate(name, [&name] () {return getCandidates(name, selectBackend(name, CPUFeatures::get().sha, name), getSupported());}, measure);}
+		if ("sha256_trunc20" == name)			{return calibrate(name, [&name] () {return getCandidates(name, selectBackend(name, CPUFeatures::get().sha, "sha256"), getSupported());}, measure);}
+		if ("sha512" == name || "md5" == name)	{return calibrate(name, [&name] () {return getCandidates(name, selectBackend(name, false, name), getSupported());}, measure);}
+		if ("hmac_sha256" == name)				{return calibrate(name, [&name] () {return getCandidates(name, selectBackend(name, CPUFeatures::get().sha, "hmac(sha256)"), getKeyed());}, measure);}
+		return name;
+	}
 
+	/** calibration: hash short inputs, as done by the IV-generators. returns hashes per second */
+	static double measure(const std::string& name) {
+		std::unique_ptr<Digest> digest(getByName(name));
+		uint8_t in[40] = {0};
+		uint8_t out[64];
+		if (name.find("hmac") != std::string::npos) {digest->setKey(in, 32);}
+		return timeOperation([&] () {digest->hash(in, sizeof(in), out);});
 	}
 
 
@@ -41,6 +84,7 @@ public:
 #ifdef WITH_OPENSSL
 		res.push_back("openssl_sha1");
 		res.push_back("openssl_sha256");
+		res.push_back("openssl_sha256_trunc20");
 		res.push_back("openssl_sha512");
 		res.push_back("openssl_md5");
 #endif
@@ -48,10 +92,33 @@ public:
 #ifdef WITH_KERNEL
 		res.push_back("kernel_sha1");
 		res.push_back("kernel_sha256");
+		res.push_back("kernel_sha256_trunc20");
 		res.push_back("kernel_sha512");
 		res.push_back("kernel_md5");
 #endif
 
+#ifdef WITH_NATIVE
+		res.push_back("native_sha1");
+		res.push_back("native_sha256");
+#endif
+
+		return res;
+
+	}
+
+	/** get all supported keyed digests (HMAC). they need a key before use, e.g. by IV-generators */
+	static std::vector<std::string> getKeyed() {
+
+		std::vector<std::string> res;
+
+#ifdef WITH_OPENSSL
+		res.push_back("openssl_hmac_sha256");
+#endif
+
+#ifdef WITH_KERNEL
+		res.push_back("kernel_hmac_sha256");
+#endif
+
 		return res;
 
 	}
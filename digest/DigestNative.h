@@ -0,0 +1,289 @@
+#ifndef DIGEST_NATIVE_H
+#define DIGEST_NATIVE_H
+
+#ifdef WITH_NATIVE
+
+#include "../Exception.h"
+#include "../CPUFeatures.h"
+#include "Digest.h"
+#include "NativeSHA.h"
+
+#include <cstring>
+#include <algorithm>
+
+/** the compression kernel to use */
+enum class NativeKernel {
+	AUTO,		// fastest one supported by the CPU
+	SCALAR,		// portable C++
+	SHANI,		// SHA extensions (one message at a time)
+	AVX2,		// portable C++ for single messages, AVX2 for eight messages at once
+};
+
+/**
+ * describes a native digest
+ */
+struct NativeDigest {
+
+private:
+
+	friend class DigestNative;
+
+	/** the initial state */
+	const uint32_t* iv;
+
+	/** the number of state words */
+	const uint32_t words;
+
+	/** the kernels (nullptr: not available on this architecture) */
+	const NativeSHA::Compress scalar;
+	const NativeSHA::Compress shani;
+	const NativeSHA::CompressX8 avx2;
+
+public:
+
+	/** ctor */
+	NativeDigest(const uint32_t* iv, const uint32_t words, NativeSHA::Compress scalar, NativeSHA::Compress shani, NativeSHA::CompressX8 avx2) :
+		iv(iv), words(words), scalar(scalar), shani(shani), avx2(avx2) {;}
+
+	/** get the digest's output size */
+	uint32_t getSize() const {return words * 4;}
+
+};
+
+/** all available digests */
+namespace NativeDigests {
+#ifdef NATIVE_SHA_X86
+	const NativeDigest SHA1 =		{NativeSHA::IV1, 5, NativeSHA::sha1Scalar, NativeSHA::sha1SHANI, NativeSHA::sha1AVX2x8};
+	const NativeDigest SHA256 =		{NativeSHA::IV256, 8, NativeSHA::sha256Scalar, NativeSHA::sha256SHANI, NativeSHA::sha256AVX2x8};
+#else
+	const NativeDigest SHA1 =		{NativeSHA::IV1, 5, NativeSHA::sha1Scalar, nullptr, nullptr};
+	const NativeDigest SHA256 =		{NativeSHA::IV256, 8, NativeSHA::sha256Scalar, nullptr, nullptr};
+#endif
+}
+
+/**
+ * SHA-1 and SHA-256 without any library or syscall.
+ * the kernel (SHA-NI, AVX2 multi-buffer, portable) is selected at runtime.
+ * inputs that fit into a single block (e.g. the 40 bytes of seed+offset
+ * hashed by the IV-generators) are padded on the stack and need just one compression.
+ * NOTE: this class is NOT intended to be thread-safe!!
+ * (except for hashPrefixed(), which continues from a copy of the prefix' state)
+ */
+class DigestNative : public Digest {
+
+private:
+
+	/** state of one (running) hash */
+	struct State {
+		uint32_t h[8];
+		uint8_t buf[64];
+		uint32_t bufLen;
+		uint64_t total;
+	};
+
+	/** the type of digest to use */
+	const NativeDigest cfg;
+
+	/** the kernel for single messages */
+	NativeSHA::Compress compress;
+
+	/** the kernel for eight single-block messages. nullptr: not available */
+	NativeSHA::CompressX8 compressX8;
+
+	/** the running hash (start/append/get) */
+	State cur;
+
+	/** the state after absorbing the prefix (see setPrefix) */
+	State prefix;
+
+public:
+
+	/** ctor with type and kernel. throws if the CPU does not support the kernel */
+	DigestNative(const NativeDigest& cfg, const NativeKernel kernel = NativeKernel::AUTO) : cfg(cfg), compress(cfg.scalar), compressX8(nullptr) {
+
+		const CPUFeatures& cpu = CPUFeatures::get();
+		const bool shani = cpu.sha && cfg.shani;
+		const bool avx2 = cpu.avx2 && cfg.avx2;
+
+		switch (kernel) {
+			case NativeKernel::AUTO:
+				// SHA-NI hashes a single block faster than AVX2 hashes eight
+				if		(shani)	{compress = cfg.shani;}
+				else if	(avx2)	{compressX8 = cfg.avx2;}
+				break;
+			case NativeKernel::SCALAR:
+				break;
+			case NativeKernel::SHANI:
+				if (!shani) {throw Exception("CPU does not support SHA-NI");}
+				compress = cfg.shani;
+				break;
+			case NativeKernel::AVX2:
+				if (!avx2) {throw Exception("CPU does not support AVX2");}
+				compressX8 = cfg.avx2;
+				break;
+		}
+
+		init(cur);
+		setPrefix(nullptr, 0);
+
+	}
+
+	/** no copy */
+	DigestNative(const DigestNative& c) = delete;
+
+	/** no assign */
+	void operator = (const DigestNative& c) = delete;
+
+
+	void hash(const uint8_t* in, const uint32_t inLen, uint8_t* out) override {
+		State s;
+		init(s);
+		finish(s, in, inLen, out);
+	}
+
+	void hashMany(const uint8_t* in, const uint32_t inLen, const uint32_t count, uint8_t* out) override {
+		State s;
+		init(s);
+		finishMany(s, in, inLen, count, out);
+	}
+
+	void setPrefix(const uint8_t* prefix, const uint32_t prefixLen) override {
+		init(this->prefix);
+		absorb(this->prefix, prefix, prefixLen);
+	}
+
+	void hashPrefixed(const uint8_t* in, const uint32_t inLen, uint8_t* out) const override {
+		finish(prefix, in, inLen, out);
+	}
+
+	void hashManyPrefixed(const uint8_t* in, const uint32_t inLen, const uint32_t count, uint8_t* out) const override {
+		finishMany(prefix, in, inLen, count, out);
+	}
+
+	void start() override {
+		init(cur);
+	}
+
+	void append(const uint8_t* in, const uint32_t inLen, const bool finalize) override {
+		(void) finalize;
+		absorb(cur, in, inLen);
+	}
+
+	void get(uint8_t* out) override {
+		finish(cur, nullptr, 0, out);
+		init(cur);
+	}
+
+	uint32_t getSize() const override {
+		return cfg.getSize();
+	}
+
+private:
+
+	void init(State& s) const {
+		memcpy(s.h, cfg.iv, cfg.words * 4);
+		s.bufLen = 0;
+		s.total = 0;
+	}
+
+	void absorb(State& s, const uint8_t* in, uint32_t inLen) const {
+
+		if (!inLen) {return;}
+		s.total += inLen;
+
+		// complete the buffered block
+		if (s.bufLen) {
+			const uint32_t use = std::min(inLen, 64 - s.bufLen);
+			memcpy(s.buf + s.bufLen, in, use);
+			s.bufLen += use; in += use; inLen -= use;
+			if (s.bufLen < 64) {return;}
+			compress(s.h, s.buf, 1);
+			s.bufLen = 0;
+		}
+
+		// all complete blocks directly from the input
+		const uint32_t blocks = inLen / 64;
+		if (blocks) {compress(s.h, in, blocks); in += blocks*64; inLen -= blocks*64;}
+
+		// remainder
+		if (inLen) {memcpy(s.buf, in, inLen); s.bufLen = inLen;}
+
+	}
+
+	/** does the given state plus input (plus padding) fit into a single block? */
+	static bool isSingleBlock(const State& s, const uint32_t inLen) {
+		return s.bufLen + inLen <= 55;
+	}
+
+	/** the (padded) last block for the given state and input. only if isSingleBlock() */
+	static void padSingle(const State& s, const uint8_t* in, const uint32_t inLen, uint8_t* block) {
+		memcpy(block, s.buf, s.bufLen);
+		if (inLen) {memcpy(block + s.bufLen, in, inLen);}
+		block[s.bufLen + inLen] = 0x80;
+		memset(block + s.bufLen + inLen + 1, 0, 55 - s.bufLen - inLen);
+		const uint64_t bits = (s.total + inLen) * 8;
+		NativeSHA::store32be(block + 56, (uint32_t)(bits >> 32));
+		NativeSHA::store32be(block + 60, (uint32_t)(bits));
+	}
+
+	/** output the state's words (big endian) */
+	void output(const uint32_t* h, uint8_t* out) const {
+		for (uint32_t i = 0; i < cfg.words; ++i) {NativeSHA::store32be(out + i*4, h[i]);}
+	}
+
+	/** digest of the given state plus input. the state is not modified */
+	void finish(const State& s, const uint8_t* in, const uint32_t inLen, uint8_t* out) const {
+
+		// fast path: just one block
+		if (isSingleBlock(s, inLen)) {
+			uint8_t block[64];
+			uint32_t h[8];
+			padSingle(s, in, inLen, block);
+			memcpy(h, s.h, sizeof(h));
+			compress(h, block, 1);
+			output(h, out);
+			return;
+		}
+
+		State tmp = s;
+		absorb(tmp, in, inLen);
+
+		uint8_t block[128] = {0};
+		memcpy(block, tmp.buf, tmp.bufLen);
+		block[tmp.bufLen] = 0x80;
+		const uint32_t len = (tmp.bufLen <= 55) ? (64) : (128);
+		const uint64_t bits = tmp.total * 8;
+		NativeSHA::store32be(block + len - 8, (uint32_t)(bits >> 32));
+		NativeSHA::store32be(block + len - 4, (uint32_t)(bits));
+		compress(tmp.h, block, len / 64);
+		output(tmp.h, out);
+
+	}
+
+	/** digests of 'count' inputs, each appended to the given state. eight at once, if available */
+	void finishMany(const State& s, const uint8_t* in, const uint32_t inLen, const uint32_t count, uint8_t* out) const {
+
+		const uint32_t size = getSize();
+		uint32_t i = 0;
+
+		if (compressX8 && isSingleBlock(s, inLen)) {
+			uint8_t blocks[8 * 64];
+			uint32_t h[8 * 8];
+			for (; i + 8 <= count; i += 8) {
+				for (uint32_t j = 0; j < 8; ++j) {padSingle(s, in + (i+j)*inLen, inLen, blocks + j*64);}
+				compressX8(s.h, blocks, h);
+				for (uint32_t j = 0; j < 8; ++j) {output(h + j*cfg.words, out + (i+j)*size);}
+			}
+		}
+
+		for (; i < count; ++i) {
+			finish(s, in + i*inLen, inLen, out + i*size);
+		}
+
+	}
+
+};
+
+#endif
+
+#endif // DIGEST_NATIVE_H
@@ -7,6 +7,7 @@
 #include "Digest.h"
 
 #include <openssl/evp.h>
+#include <vector>
 
 /**
  * describes a crypto-api digest
@@ -23,10 +24,13 @@ private:
 	/** the digesst's output length */
 	const uint32_t len;
 
+	/** does the digest need a key (HMAC)? */
+	const bool keyed;
+
 public:
 
 	/** ctor */
-	OpenSSLDigest(const EVP_MD* digest, const uint32_t len) : digest(digest), len(len) {;}
+	OpenSSLDigest(const EVP_MD* digest, const uint32_t len, const bool keyed = false) : digest(digest), len(len), keyed(keyed) {;}
 
 	/** get the digest's output size */
 	uint32_t getSize() const {return len;}
@@ -37,13 +41,19 @@ public:
 namespace OpenSSLDigests {
 	const OpenSSLDigest SHA1 =		{EVP_sha1(), 20};
 	const OpenSSLDigest SHA256 =	{EVP_sha256(), 32};
+	const OpenSSLDigest SHA256_TRUNC20 =	{EVP_sha256(), 20};	// legacy: the first 20 bytes only
 	const OpenSSLDigest SHA512 =	{EVP_sha512(), 64};
 	const OpenSSLDigest MD5 =		{EVP_md5(), 16};
+	const OpenSSLDigest HMAC_SHA256 =	{EVP_sha256(), 32, true};
 }
 
 /**
- * several digest-implementations based on the openSSL's crypto
+ * several digest-implementations based on the openSSL's crypto.
+ * keyed digests (HMAC) can not be used before a key is set (see setKey).
+ * HMAC is built from the plain digest: the states after absorbing key^ipad and key^opad
+ * are computed once per key, every message then just copies them
  * NOTE: this class is NOT intended to be thread-safe!!
+ * (except for hashPrefixed(), which continues from a copy of the prefix' state)
  */
 class DigestOpenSSL : public Digest {
 
@@ -53,18 +63,32 @@ private:
 	const OpenSSLDigest cfg;
 
 	/** the digest */
-	EVP_MD_CTX ctx;
+	EVP_MD_CTX* ctx;
+
+	/** the digest's state after absorbing the prefix (see setPrefix) */
+	EVP_MD_CTX* ctxPrefix;
+
+	/** a copy of the prefix, absorbed again when the key changes */
+	std::vector<uint8_t> prefix;
+
+	/** keyed digests only: the states after absorbing key^ipad (inner) and key^opad (outer) */
+	EVP_MD_CTX* ctxInner;
+	EVP_MD_CTX* ctxOuter;
+
+	/** keyed digests only: was a key set? */
+	bool hasKey;
 
 public:
 
 	/** ctor with type */
-	DigestOpenSSL(const OpenSSLDigest& cfg) : cfg(cfg) {
-		;
+	DigestOpenSSL(const OpenSSLDigest& cfg) : cfg(cfg), ctx(EVP_MD_CTX_new()), ctxPrefix(EVP_MD_CTX_new()), ctxInner(EVP_MD_CTX_new()), ctxOuter(EVP_MD_CTX_new()), hasKey(false) {
+		if (!ctx || !ctxPrefix || !ctxInner || !ctxOuter) {destroy(); throw Exception("could not create digest context");}
+		setPrefix(nullptr, 0);
 	}
 
 	/** dtor */
 	~DigestOpenSSL() {
-		;
+		destroy();
 	}
 
 	/** no copy */
@@ -76,33 +100,133 @@ public:
 
 	void hash(const uint8_t* in, const uint32_t inLen, uint8_t* out) override {
 
-		unsigned int outLen = 0;
-		EVP_DigestInit(&ctx, cfg.digest);
-		EVP_DigestUpdate(&ctx, in, inLen);
-		EVP_DigestFinal(&ctx, out, &outLen);
-		if (outLen != cfg.getSize()) {throw Exception("error while calculating digest");}
+		begin(ctx);
+		update(ctx, in, inLen);
+		finish(ctx, out);
+
+	}
+
+	void setKey(const uint8_t* key, const uint32_t keyLen) override {
+
+		if (!cfg.keyed) {throw Exception("digest does not support a key");}
+
+		// keys larger than one block are hashed first, smaller ones zero-padded
+		const int blockSize = EVP_MD_block_size(cfg.digest);
+		uint8_t k[EVP_MAX_MD_SIZE > 128 ? EVP_MAX_MD_SIZE : 128] = {0};
+		if (blockSize <= 0 || blockSize > (int)sizeof(k)) {throw Exception("unsupported HMAC block-size");}
+		if (keyLen > (uint32_t)blockSize) {
+			unsigned int len = 0;
+			if (EVP_Digest(key, keyLen, k, &len, cfg.digest, nullptr) != 1) {throw Exception("could not hash the HMAC-key");}
+		} else {
+			memcpy(k, key, keyLen);
+		}
+
+		uint8_t pad[sizeof(k)];
+		for (int i = 0; i < blockSize; ++i) {pad[i] = k[i] ^ 0x36;}
+		if (EVP_DigestInit_ex(ctxInner, cfg.digest, nullptr) != 1 || EVP_DigestUpdate(ctxInner, pad, blockSize) != 1) {throw Exception("could not set HMAC-key");}
+		for (int i = 0; i < blockSize; ++i) {pad[i] = k[i] ^ 0x5c;}
+		if (EVP_DigestInit_ex(ctxOuter, cfg.digest, nullptr) != 1 || EVP_DigestUpdate(ctxOuter, pad, blockSize) != 1) {throw Exception("could not set HMAC-key");}
+		memset(k, 0, sizeof(k));
+		memset(pad, 0, sizeof(pad));
+		hasKey = true;
+
+		// the prefix' state depends on the key
+		const std::vector<uint8_t> cur = prefix;
+		setPrefix(cur.data(), cur.size());
+
+	}
+
+	void setPrefix(const uint8_t* prefix, const uint32_t prefixLen) override {
+		this->prefix.assign(prefix, prefix + prefixLen);
+		if (cfg.keyed && !hasKey) {return;}	// applied by setKey()
+		begin(ctxPrefix);
+		update(ctxPrefix, prefix, prefixLen);
+	}
+
+	void hashPrefixed(const uint8_t* in, const uint32_t inLen, uint8_t* out) const override {
+
+		// one scratch context per thread, overwritten with the prefix' state on every call
+		if (cfg.keyed && !hasKey) {throw Exception("digest needs a key");}
+		EVP_MD_CTX* tmp = getThreadContext();
+		if (EVP_MD_CTX_copy_ex(tmp, ctxPrefix) != 1) {throw Exception("could not copy digest context");}
+		update(tmp, in, inLen);
+		finish(tmp, out);
 
 	}
 
 	void start() override {
-		EVP_DigestInit(&ctx, cfg.digest);
+		begin(ctx);
 	}
 
 	void append(const uint8_t* in, const uint32_t inLen, const bool finalize) override {
 		(void) finalize;
-		EVP_DigestUpdate(&ctx, in, inLen);
+		update(ctx, in, inLen);
 	}
 
 	void get(uint8_t* out) override {
-		unsigned int outLen = 0;
-		EVP_DigestFinal(&ctx, out, &outLen);
-		if (outLen != cfg.getSize()) {throw Exception("error while calculating digest");}
+		finish(ctx, out);
 	}
 
 	uint32_t getSize() const override {
 		return cfg.len;
 	}
 
+private:
+
+	/** (re-)initialize the given context: plain digest or HMAC */
+	void begin(EVP_MD_CTX* c) const {
+		if (cfg.keyed) {
+			if (!hasKey) {throw Exception("digest needs a key");}
+			if (EVP_MD_CTX_copy_ex(c, ctxInner) != 1) {throw Exception("could not initialize HMAC");}
+		} else {
+			if (EVP_DigestInit_ex(c, cfg.digest, nullptr) != 1) {throw Exception("could not initialize digest");}
+		}
+	}
+
+	void update(EVP_MD_CTX* c, const uint8_t* in, const uint32_t inLen) const {
+		if (EVP_DigestUpdate(c, in, inLen) != 1) {throw Exception("error while calculating digest");}
+	}
+
+	/** finalize the given context. HMAC: continue with the outer hash (re-using the context) */
+	void finish(EVP_MD_CTX* c, uint8_t* out) const {
+		unsigned int outLen = 0;
+		if (cfg.keyed) {
+			uint8_t inner[EVP_MAX_MD_SIZE];
+			EVP_DigestFinal_ex(c, inner, &outLen);
+			if (outLen != cfg.getSize() || EVP_MD_CTX_copy_ex(c, ctxOuter) != 1) {throw Exception("error while calculating digest");}
+			EVP_DigestUpdate(c, inner, outLen);
+		}
+		if (cfg.getSize() == (uint32_t) EVP_MD_size(cfg.digest)) {
+			EVP_DigestFinal_ex(c, out, &outLen);
+			if (outLen != cfg.getSize()) {throw Exception("error while calculating digest");}
+			return;
+		}
+		// truncated digests (legacy) keep the first bytes only
+		uint8_t full[EVP_MAX_MD_SIZE];
+		EVP_DigestFinal_ex(c, full, &outLen);
+		if (outLen < cfg.getSize()) {throw Exception("error while calculating digest");}
+		memcpy(out, full, cfg.getSize());
+	}
+
+	/** get the calling thread's scratch context (allocated once per thread, freed on thread exit) */
+	static EVP_MD_CTX* getThreadContext() {
+		struct Holder {
+			EVP_MD_CTX* ctx = EVP_MD_CTX_new();
+			~Holder() {EVP_MD_CTX_free(ctx);}
+		};
+		static thread_local Holder holder;
+		if (!holder.ctx) {throw Exception("could not create digest context");}
+		return holder.ctx;
+	}
+
+	/** cleanup */
+	void destroy() {
+		if (ctx)		{EVP_MD_CTX_free(ctx); ctx = nullptr;}
+		if (ctxPrefix)	{EVP_MD_CTX_free(ctxPrefix); ctxPrefix = nullptr;}
+		if (ctxInner)	{EVP_MD_CTX_free(ctxInner); ctxInner = nullptr;}
+		if (ctxOuter)	{EVP_MD_CTX_free(ctxOuter); ctxOuter = nullptr;}
+	}
+
 };
 
 #endif
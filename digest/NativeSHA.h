@@ -0,0 +1,324 @@
+#ifndef NATIVE_SHA_H
+#define NATIVE_SHA_H
+
+#ifdef WITH_NATIVE
+
+#include <cstdint>
+#include <cstddef>
+
+#if defined(__x86_64__) || defined(__i386__)
+	#define NATIVE_SHA_X86
+	#include <immintrin.h>
+#endif
+
+/**
+ * compression functions for SHA-1 and SHA-256:
+ * portable C++, SHA-NI (one message, several blocks)
+ * and AVX2 multi-buffer (eight single-block messages at once).
+ * the accelerated kernels are compiled for their instruction set
+ * only, and must be selected at runtime (see CPUFeatures)
+ */
+namespace NativeSHA {
+
+	/** the SHA-256 round constants */
+	alignas(64) static const uint32_t K256[64] = {
+		0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+		0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+		0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+		0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+		0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+		0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+		0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+		0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+	};
+
+	/** the initial states */
+	static const uint32_t IV1[5] = {0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476, 0xc3d2e1f0};
+	static const uint32_t IV256[8] = {0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19};
+
+	/** the SHA-1 round constants (one per 20 rounds) */
+	static const uint32_t K1[4] = {0x5a827999, 0x6ed9eba1, 0x8f1bbcdc, 0xca62c1d6};
+
+	/** compress 'numBlocks' consecutive 64-byte blocks into the given state */
+	typedef void (*Compress)(uint32_t* state, const uint8_t* data, size_t numBlocks);
+
+	/** compress eight single 64-byte blocks (back-to-back), each starting from the same state, into eight states (back-to-back) */
+	typedef void (*CompressX8)(const uint32_t* state, const uint8_t* blocks, uint32_t* out);
+
+	inline uint32_t rotr(const uint32_t x, const int n) {return (x >> n) | (x << (32-n));}
+	inline uint32_t rotl(const uint32_t x, const int n) {return (x << n) | (x >> (32-n));}
+
+	inline uint32_t load32be(const uint8_t* p) {
+		return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | ((uint32_t)p[3]);
+	}
+
+	inline void store32be(uint8_t* p, const uint32_t v) {
+		p[0] = (uint8_t)(v >> 24); p[1] = (uint8_t)(v >> 16); p[2] = (uint8_t)(v >> 8); p[3] = (uint8_t)v;
+	}
+
+
+	/** portable SHA-256 */
+	inline void sha256Scalar(uint32_t* state, const uint8_t* data, size_t numBlocks) {
+
+		for (; numBlocks; --numBlocks, data += 64) {
+
+			uint32_t w[64];
+			for (int t = 0; t < 16; ++t) {w[t] = load32be(data + t*4);}
+			for (int t = 16; t < 64; ++t) {
+				const uint32_t s0 = rotr(w[t-15], 7) ^ rotr(w[t-15], 18) ^ (w[t-15] >> 3);
+				const uint32_t s1 = rotr(w[t-2], 17) ^ rotr(w[t-2], 19) ^ (w[t-2] >> 10);
+				w[t] = w[t-16] + s0 + w[t-7] + s1;
+			}
+
+			uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+			uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+
+			for (int t = 0; t < 64; ++t) {
+				const uint32_t t1 = h + (rotr(e, 6) ^ rotr(e, 11) ^ rotr(e, 25)) + ((e & f) ^ (~e & g)) + K256[t] + w[t];
+				const uint32_t t2 = (rotr(a, 2) ^ rotr(a, 13) ^ rotr(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+				h = g; g = f; f = e; e = d + t1;
+				d = c; c = b; b = a; a = t1 + t2;
+			}
+
+			state[0] += a; state[1] += b; state[2] += c; state[3] += d;
+			state[4] += e; state[5] += f; state[6] += g; state[7] += h;
+
+		}
+
+	}
+
+	/** portable SHA-1 */
+	inline void sha1Scalar(uint32_t* state, const uint8_t* data, size_t numBlocks) {
+
+		for (; numBlocks; --numBlocks, data += 64) {
+
+			uint32_t w[80];
+			for (int t = 0; t < 16; ++t) {w[t] = load32be(data + t*4);}
+			for (int t = 16; t < 80; ++t) {w[t] = rotl(w[t-3] ^ w[t-8] ^ w[t-14] ^ w[t-16], 1);}
+
+			uint32_t a = state[0], b = state[1], c = state[2], d = state[3], e = state[4];
+
+			for (int t = 0; t < 80; ++t) {
+				uint32_t f;
+				if		(t < 20)	{f = (b & c) | (~b & d);}
+				else if	(t < 40)	{f = b ^ c ^ d;}
+				else if	(t < 60)	{f = (b & c) | (b & d) | (c & d);}
+				else				{f = b ^ c ^ d;}
+				const uint32_t tmp = rotl(a, 5) + f + e + K1[t/20] + w[t];
+				e = d; d = c; c = rotl(b, 30); b = a; a = tmp;
+			}
+
+			state[0] += a; state[1] += b; state[2] += c; state[3] += d; state[4] += e;
+
+		}
+
+	}
+
+#ifdef NATIVE_SHA_X86
+
+	/** SHA-256 using the SHA extensions (SHA-NI) */
+	__attribute__((target("sha,sse4.1")))
+	inline void sha256SHANI(uint32_t* state, const uint8_t* data, size_t numBlocks) {
+
+		const __m128i MASK = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+
+		// state into the layout used by the instructions: ABEF and CDGH
+		__m128i tmp = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*) &state[0]), 0xB1);
+		__m128i state1 = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*) &state[4]), 0x1B);
+		__m128i state0 = _mm_alignr_epi8(tmp, state1, 8);
+		state1 = _mm_blend_epi16(state1, tmp, 0xF0);
+
+		for (; numBlocks; --numBlocks, data += 64) {
+
+			const __m128i save0 = state0;
+			const __m128i save1 = state1;
+
+			__m128i w[4];
+			for (int i = 0; i < 4; ++i) {w[i] = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*) (data + i*16)), MASK);}
+
+			// 16 times 4 rounds. the schedule keeps the last 16 words
+			for (int i = 0; i < 16; ++i) {
+				if (i >= 4) {
+					__m128i m = _mm_sha256msg1_epu32(w[i&3], w[(i+1)&3]);
+					m = _mm_add_epi32(m, _mm_alignr_epi8(w[(i+3)&3], w[(i+2)&3], 4));
+					w[i&3] = _mm_sha256msg2_epu32(m, w[(i+3)&3]);
+				}
+				__m128i msg = _mm_add_epi32(w[i&3], _mm_load_si128((const __m128i*) &K256[i*4]));
+				state1 = _mm_sha256rnds2_epu32(state1, state0, msg);
+				msg = _mm_shuffle_epi32(msg, 0x0E);
+				state0 = _mm_sha256rnds2_epu32(state0, state1, msg);
+			}
+
+			state0 = _mm_add_epi32(state0, save0);
+			state1 = _mm_add_epi32(state1, save1);
+
+		}
+
+		// back to ABCD and EFGH
+		tmp = _mm_shuffle_epi32(state0, 0x1B);
+		state1 = _mm_shuffle_epi32(state1, 0xB1);
+		state0 = _mm_blend_epi16(tmp, state1, 0xF0);
+		state1 = _mm_alignr_epi8(state1, tmp, 8);
+		_mm_storeu_si128((__m128i*) &state[0], state0);
+		_mm_storeu_si128((__m128i*) &state[4], state1);
+
+	}
+
+	/** four SHA-1 rounds. the round-function must be an immediate */
+	__attribute__((target("sha,sse4.1")))
+	inline __m128i sha1Rounds4(const __m128i abcd, const __m128i e, const int func) {
+		switch (func) {
+			case 0:		return _mm_sha1rnds4_epu32(abcd, e, 0);
+			case 1:		return _mm_sha1rnds4_epu32(abcd, e, 1);
+			case 2:		return _mm_sha1rnds4_epu32(abcd, e, 2);
+			default:	return _mm_sha1rnds4_epu32(abcd, e, 3);
+		}
+	}
+
+	/** SHA-1 using the SHA extensions (SHA-NI) */
+	__attribute__((target("sha,sse4.1")))
+	inline void sha1SHANI(uint32_t* state, const uint8_t* data, size_t numBlocks) {
+
+		const __m128i MASK = _mm_set_epi64x(0x0001020304050607ULL, 0x08090a0b0c0d0e0fULL);
+
+		__m128i abcd = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*) state), 0x1B);
+		__m128i e0 = _mm_set_epi32((int)state[4], 0, 0, 0);
+
+		for (; numBlocks; --numBlocks, data += 64) {
+
+			const __m128i saveABCD = abcd;
+			const __m128i saveE = e0;
+
+			__m128i w[4];
+			for (int i = 0; i < 4; ++i) {w[i] = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*) (data + i*16)), MASK);}
+
+			// 20 times 4 rounds. E of every group is derived from A of the group before
+			__m128i prev = abcd;
+			for (int i = 0; i < 20; ++i) {
+				if (i >= 4) {
+					const __m128i m = _mm_xor_si128(_mm_sha1msg1_epu32(w[i&3], w[(i+1)&3]), w[(i+2)&3]);
+					w[i&3] = _mm_sha1msg2_epu32(m, w[(i+3)&3]);
+				}
+				const __m128i e = (i == 0) ? (_mm_add_epi32(e0, w[0])) : (_mm_sha1nexte_epu32(prev, w[i&3]));
+				prev = abcd;
+				abcd = sha1Rounds4(abcd, e, i/5);
+			}
+
+			e0 = _mm_sha1nexte_epu32(prev, saveE);
+			abcd = _mm_add_epi32(abcd, saveABCD);
+
+		}
+
+		abcd = _mm_shuffle_epi32(abcd, 0x1B);
+		_mm_storeu_si128((__m128i*) state, abcd);
+		state[4] = (uint32_t)_mm_extract_epi32(e0, 3);
+
+	}
+
+
+	__attribute__((target("avx2")))
+	inline __m256i rotr8(const __m256i x, const int n) {
+		return _mm256_or_si256(_mm256_srli_epi32(x, n), _mm256_slli_epi32(x, 32-n));
+	}
+
+	/** word 'idx' (big endian) of eight 64-byte blocks, one per lane */
+	__attribute__((target("avx2")))
+	inline __m256i load8(const uint8_t* blocks, const int idx) {
+		const uint8_t* p = blocks + idx*4;
+		return _mm256_setr_epi32(
+			(int)load32be(p + 0*64), (int)load32be(p + 1*64), (int)load32be(p + 2*64), (int)load32be(p + 3*64),
+			(int)load32be(p + 4*64), (int)load32be(p + 5*64), (int)load32be(p + 6*64), (int)load32be(p + 7*64)
+		);
+	}
+
+	/** store the eight lanes of one state-word */
+	__attribute__((target("avx2")))
+	inline void store8(uint32_t* out, const int numWords, const int idx, const __m256i v) {
+		alignas(32) uint32_t tmp[8];
+		_mm256_store_si256((__m256i*) tmp, v);
+		for (int lane = 0; lane < 8; ++lane) {out[lane*numWords + idx] = tmp[lane];}
+	}
+
+	/** SHA-256 of eight single blocks in parallel, one per 32 bit lane (AVX2) */
+	__attribute__((target("avx2")))
+	inline void sha256AVX2x8(const uint32_t* state, const uint8_t* blocks, uint32_t* out) {
+
+		__m256i w[16];
+		for (int t = 0; t < 16; ++t) {w[t] = load8(blocks, t);}
+
+		__m256i s[8];
+		for (int i = 0; i < 8; ++i) {s[i] = _mm256_set1_epi32((int)state[i]);}
+		__m256i a = s[0], b = s[1], c = s[2], d = s[3], e = s[4], f = s[5], g = s[6], h = s[7];
+
+		for (int t = 0; t < 64; ++t) {
+
+			// message schedule, in-place within the last 16 words
+			if (t >= 16) {
+				const __m256i w15 = w[(t-15)&15];
+				const __m256i w2 = w[(t-2)&15];
+				const __m256i s0 = _mm256_xor_si256(_mm256_xor_si256(rotr8(w15, 7), rotr8(w15, 18)), _mm256_srli_epi32(w15, 3));
+				const __m256i s1 = _mm256_xor_si256(_mm256_xor_si256(rotr8(w2, 17), rotr8(w2, 19)), _mm256_srli_epi32(w2, 10));
+				w[t&15] = _mm256_add_epi32(_mm256_add_epi32(w[t&15], s0), _mm256_add_epi32(w[(t-7)&15], s1));
+			}
+
+			const __m256i S1 = _mm256_xor_si256(_mm256_xor_si256(rotr8(e, 6), rotr8(e, 11)), rotr8(e, 25));
+			const __m256i ch = _mm256_xor_si256(_mm256_and_si256(e, f), _mm256_andnot_si256(e, g));
+			const __m256i t1 = _mm256_add_epi32(_mm256_add_epi32(_mm256_add_epi32(h, S1), _mm256_add_epi32(ch, w[t&15])), _mm256_set1_epi32((int)K256[t]));
+			const __m256i S0 = _mm256_xor_si256(_mm256_xor_si256(rotr8(a, 2), rotr8(a, 13)), rotr8(a, 22));
+			const __m256i maj = _mm256_xor_si256(_mm256_and_si256(a, b), _mm256_and_si256(c, _mm256_xor_si256(a, b)));
+			const __m256i t2 = _mm256_add_epi32(S0, maj);
+
+			h = g; g = f; f = e; e = _mm256_add_epi32(d, t1);
+			d = c; c = b; b = a; a = _mm256_add_epi32(t1, t2);
+
+		}
+
+		store8(out, 8, 0, _mm256_add_epi32(a, s[0]));	store8(out, 8, 1, _mm256_add_epi32(b, s[1]));
+		store8(out, 8, 2, _mm256_add_epi32(c, s[2]));	store8(out, 8, 3, _mm256_add_epi32(d, s[3]));
+		store8(out, 8, 4, _mm256_add_epi32(e, s[4]));	store8(out, 8, 5, _mm256_add_epi32(f, s[5]));
+		store8(out, 8, 6, _mm256_add_epi32(g, s[6]));	store8(out, 8, 7, _mm256_add_epi32(h, s[7]));
+
+	}
+
+	/** SHA-1 of eight single blocks in parallel, one per 32 bit lane (AVX2) */
+	__attribute__((target("avx2")))
+	inline void sha1AVX2x8(const uint32_t* state, const uint8_t* blocks, uint32_t* out) {
+
+		__m256i w[16];
+		for (int t = 0; t < 16; ++t) {w[t] = load8(blocks, t);}
+
+		__m256i s[5];
+		for (int i = 0; i < 5; ++i) {s[i] = _mm256_set1_epi32((int)state[i]);}
+		__m256i a = s[0], b = s[1], c = s[2], d = s[3], e = s[4];
+
+		for (int t = 0; t < 80; ++t) {
+
+			if (t >= 16) {
+				const __m256i x = _mm256_xor_si256(_mm256_xor_si256(w[(t-3)&15], w[(t-8)&15]), _mm256_xor_si256(w[(t-14)&15], w[t&15]));
+				w[t&15] = rotr8(x, 31);
+			}
+
+			__m256i f;
+			if		(t < 20)	{f = _mm256_or_si256(_mm256_and_si256(b, c), _mm256_andnot_si256(b, d));}
+			else if	(t < 40)	{f = _mm256_xor_si256(_mm256_xor_si256(b, c), d);}
+			else if	(t < 60)	{f = _mm256_or_si256(_mm256_and_si256(b, c), _mm256_and_si256(d, _mm256_or_si256(b, c)));}
+			else				{f = _mm256_xor_si256(_mm256_xor_si256(b, c), d);}
+
+			const __m256i tmp = _mm256_add_epi32(_mm256_add_epi32(rotr8(a, 27), f), _mm256_add_epi32(_mm256_add_epi32(e, w[t&15]), _mm256_set1_epi32((int)K1[t/20])));
+			e = d; d = c; c = rotr8(b, 2); b = a; a = tmp;
+
+		}
+
+		store8(out, 5, 0, _mm256_add_epi32(a, s[0]));	store8(out, 5, 1, _mm256_add_epi32(b, s[1]));
+		store8(out, 5, 2, _mm256_add_epi32(c, s[2]));	store8(out, 5, 3, _mm256_add_epi32(d, s[3]));
+		store8(out, 5, 4, _mm256_add_epi32(e, s[4]));
+
+	}
+
+#endif
+
+}
+
+#endif
+
+#endif // NATIVE_SHA_H
@@ -0,0 +1,161 @@
+#ifndef DIR_CACHE_H
+#define DIR_CACHE_H
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <ctime>
+#include <sys/stat.h>
+#include <dirent.h>
+
+namespace Settings {
+
+	/** default memory limit of the directory-cache (bytes) */
+	const constexpr size_t DIR_CACHE_BYTES = 16 * 1024 * 1024;
+
+	/**
+	 * listings of directories modified within the last seconds are not cached:
+	 * another modification within the same timestamp-tick would go unnoticed
+	 */
+	const constexpr time_t DIR_CACHE_MIN_AGE = 2;
+
+}
+
+/** one entry of a decrypted directory listing */
+struct DirEntry {
+
+	/** the encrypted name, as stored within the backing folder */
+	std::string enc;
+
+	/** the decrypted name */
+	std::string plain;
+
+	/** the entry's type (DT_REG, DT_DIR, ..., DT_UNKNOWN) */
+	unsigned char type;
+
+	/** position of the following entry within the backing folder (telldir/seekdir) */
+	off_t next;
+
+	/** ctor */
+	DirEntry(const std::string& enc, const std::string& plain, const unsigned char type = DT_UNKNOWN, const off_t next = 0) :
+		enc(enc), plain(plain), type(type), next(next) {;}
+
+};
+
+/** the decrypted listing of one directory */
+typedef std::vector<DirEntry> DirListing;
+
+/**
+ * decrypted directory listings, keyed by the backing directory's device and inode.
+ * a listing is valid as long as the directory's mtime and ctime are unchanged
+ * (every create, unlink and rename within the directory updates both).
+ * when the memory limit is reached, all listings are dropped
+ */
+class DirCache {
+
+private:
+
+	struct Key {
+		dev_t dev;
+		ino_t ino;
+		bool operator == (const Key& o) const {return dev == o.dev && ino == o.ino;}
+	};
+
+	struct KeyHash {
+		size_t operator () (const Key& k) const {return std::hash<uint64_t>()((uint64_t)k.ino ^ ((uint64_t)k.dev << 40));}
+	};
+
+	struct Entry {
+		struct timespec mtime;
+		struct timespec ctime;
+		size_t bytes;
+		std::shared_ptr<const DirListing> listing;
+	};
+
+	std::mutex mtx;
+	std::unordered_map<Key, Entry, KeyHash> map;
+	size_t bytes = 0;
+
+	/** memory limit (bytes) */
+	const size_t maxBytes;
+
+public:
+
+	/** ctor with the memory limit (bytes) */
+	DirCache(const size_t maxBytes) : maxBytes(maxBytes) {
+		;
+	}
+
+	/** no copy */
+	DirCache(const DirCache& o) = delete;
+
+	/** no assign */
+	void operator = (const DirCache& o) = delete;
+
+
+	/** get the listing for the given (backing) directory. nullptr if not cached or outdated */
+	std::shared_ptr<const DirListing> get(const struct stat& st) {
+		std::lock_guard<std::mutex> lock(mtx);
+		auto it = map.find(Key{st.st_dev, st.st_ino});
+		if (it == map.end()) {return nullptr;}
+		if (!isSame(it->second.mtime, st.st_mtim) || !isSame(it->second.ctime, st.st_ctim)) {
+			bytes -= it->second.bytes;
+			map.erase(it);
+			return nullptr;
+		}
+		return it->second.listing;
+	}
+
+	/** store the listing for the given (backing) directory, unless it was modified just now */
+	void put(const struct stat& st, const std::shared_ptr<const DirListing>& listing) {
+
+		if (time(nullptr) - st.st_mtim.tv_sec < Settings::DIR_CACHE_MIN_AGE) {return;}
+		if (time(nullptr) - st.st_ctim.tv_sec < Settings::DIR_CACHE_MIN_AGE) {return;}
+
+		size_t cost = 128;
+		for (const DirEntry& e : *listing) {cost += getCost(e);}
+		if (cost > maxBytes) {return;}
+
+		std::lock_guard<std::mutex> lock(mtx);
+		const Key key{st.st_dev, st.st_ino};
+		auto it = map.find(key);
+		if (it != map.end()) {bytes -= it->second.bytes; map.erase(it);}
+		if (bytes + cost > maxBytes) {map.clear(); bytes = 0;}
+		map[key] = Entry{st.st_mtim, st.st_ctim, cost, listing};
+		bytes += cost;
+
+	}
+
+	/** number of cached listings */
+	size_t size() {
+		std::lock_guard<std::mutex> lock(mtx);
+		return map.size();
+	}
+
+	/** the memory limit (bytes) */
+	size_t getMaxBytes() const {
+		return maxBytes;
+	}
+
+	/** memory used by one cached entry (approximately, bytes) */
+	static size_t getCost(const DirEntry& e) {
+		return e.enc.length() + e.plain.length() + sizeof(DirEntry);
+	}
+
+	/** memory used by all cached listings (approximately, bytes) */
+	size_t getBytes() {
+		std::lock_guard<std::mutex> lock(mtx);
+		return bytes;
+	}
+
+private:
+
+	static bool isSame(const struct timespec& a, const struct timespec& b) {
+		return a.tv_sec == b.tv_sec && a.tv_nsec == b.tv_nsec;
+	}
+
+};
+
+#endif // DIR_CACHE_H
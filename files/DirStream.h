@@ -0,0 +1,222 @@
+#ifndef DIR_STREAM_H
+#define DIR_STREAM_H
+
+#include <string>
+#include <memory>
+#include <functional>
+#include <cerrno>
+#include <cstring>
+#include <dirent.h>
+#include <sys/stat.h>
+
+#include "../Exception.h"
+#include "../Stats.h"
+#include "FilePath.h"
+#include "DirCache.h"
+
+namespace Settings {
+
+	/** number of backing entries to read and decrypt at once when streaming a directory */
+	const constexpr size_t DIR_STREAM_CHUNK = 256;
+
+}
+
+/**
+ * one opened (backing) directory, listed in chunks.
+ * every delivered entry comes with the offset of its successor: the backing folder's
+ * seekdir() cookie, or the position within the cached listing. listings continue
+ * at any previously delivered offset, thus huge directories need bounded memory only.
+ * entries come with their type only: libfuse 2 ignores all other attributes,
+ * and reading them (let alone the decrypted sizes) would slow down every listing
+ */
+class DirStream {
+
+public:
+
+	/** receives one decrypted entry, its attributes (type only) and the offset of the next one. returns true if no more entries fit */
+	typedef std::function<bool(const DirEntry& e, const struct stat& st, const off_t next)> Emit;
+
+private:
+
+	/** the backing directory */
+	DIR* dp;
+
+	/** name decryption */
+	FilePath* fp;
+
+	/** decrypted listings (optional) */
+	std::shared_ptr<DirCache> cache;
+
+	/** the (decrypted) path of the directory, to seed the path-cache */
+	std::string relativePath;
+
+	/** the IV of the names within this directory */
+	uint8_t iv[Settings::FILE_PATH_DIR_IV_LEN];
+
+	/** the backing directory's stats when the listing (re)started */
+	struct stat st;
+
+	/** listing started? */
+	bool started = false;
+
+	/** offset following the last delivered entry */
+	off_t pos = 0;
+
+	/** decrypted entries not yet delivered */
+	DirListing pending;
+	size_t pendingIdx = 0;
+
+	/** the cached listing, when served from the cache */
+	std::shared_ptr<const DirListing> cached;
+
+	/** the complete listing, collected for the cache while reading from start to end */
+	std::shared_ptr<DirListing> collect;
+	size_t collectBytes = 0;
+
+	/** number of foreign (not decryptable) entries */
+	size_t skipped = 0;
+
+public:
+
+	/** ctor. takes ownership of the given backing directory */
+	DirStream(DIR* dp, FilePath* fp, const std::shared_ptr<DirCache>& cache, const std::string& relativePath) :
+		dp(dp), fp(fp), cache(cache), relativePath(relativePath) {
+		;
+	}
+
+	/** dtor */
+	~DirStream() {
+		close();
+	}
+
+	/** no copy */
+	DirStream(const DirStream& o) = delete;
+
+	/** no assign */
+	void operator = (const DirStream& o) = delete;
+
+
+	/**
+	 * deliver all entries starting at the given offset (0: from the beginning),
+	 * until either the directory's end is reached, or emit() reports no more space
+	 */
+	void read(const off_t offset, const Emit& emit) {
+
+		if (offset == 0 || !started) {restart();}
+
+		// served from the cache: offsets are positions within the listing
+		if (cached) {
+			for (size_t i = (size_t) offset; i < cached->size(); ++i) {
+				if (emitEntry(emit, (*cached)[i], (off_t) (i + 1))) {return;}
+			}
+			return;
+		}
+
+		// continue somewhere else than where the last call stopped?
+		if (offset != pos) {seek(offset);}
+
+		while (true) {
+			for (; pendingIdx < pending.size(); ++pendingIdx) {
+				const DirEntry& e = pending[pendingIdx];
+				if (emitEntry(emit, e, e.next)) {return;}
+				pos = e.next;
+			}
+			if (!readChunk()) {break;}
+		}
+
+		// the whole directory was read in order
+		if (collect) {cache->put(st, collect); collect.reset();}
+
+	}
+
+	/** number of foreign entries, skipped so far */
+	size_t getSkipped() const {
+		return skipped;
+	}
+
+	/** close the backing directory */
+	int close() {
+		if (!dp) {return 0;}
+		const int res = closedir(dp);
+		dp = nullptr;
+		return res;
+	}
+
+private:
+
+	/** pass the given entry and its type. true if no more entries fit */
+	bool emitEntry(const Emit& emit, const DirEntry& e, const off_t next) {
+		struct stat st;
+		memset(&st, 0, sizeof(st));
+		st.st_mode = DTTOIF(e.type);
+		return emit(e, st, next);
+	}
+
+	/** start reading from the beginning, using the cached listing, if any */
+	void restart() {
+
+		if (!started) {fp->getDirIV(relativePath.c_str(), iv);}
+		started = true;
+		pending.clear();
+		pendingIdx = 0;
+		cached.reset();
+		collect.reset();
+		collectBytes = 0;
+		rewinddir(dp);
+		pos = 0;
+
+		if (!cache || fstat(dirfd(dp), &st) != 0) {return;}
+		cached = cache->get(st);
+		if (cached) {
+			++Stats::get().dirCacheHits;
+		} else {
+			++Stats::get().dirCacheMisses;
+			collect = std::make_shared<DirListing>();
+		}
+
+	}
+
+	/** continue reading at the given offset, as delivered before */
+	void seek(const off_t offset) {
+		pending.clear();
+		pendingIdx = 0;
+		collect.reset();
+		seekdir(dp, offset);
+		pos = offset;
+	}
+
+	/** read and decrypt the next chunk of entries. false if the directory's end was reached */
+	bool readChunk() {
+
+		pending.clear();
+		pendingIdx = 0;
+
+		struct dirent* de;
+		size_t cnt = 0;
+		errno = 0;
+		while (cnt < Settings::DIR_STREAM_CHUNK && (de = ::readdir(dp)) != nullptr) {
+			++cnt;
+			if (FilePath::isInternal(de->d_name)) {continue;}
+			pending.push_back(DirEntry(de->d_name, "", de->d_type, de->d_off));
+		}
+		if (errno) {throw Exception("error while reading the directory " + relativePath, errno);}
+		if (cnt == 0) {return false;}
+
+		skipped += fp->decryptEntries(dirfd(dp), pending, iv);
+
+		// the entries are likely accessed next (ls -l, file managers)
+		fp->seed(relativePath.c_str(), pending);
+
+		// keep the listing for the cache, unless it grows too large
+		if (collect) {
+			for (const DirEntry& e : pending) {collectBytes += DirCache::getCost(e); collect->push_back(e);}
+			if (collectBytes > cache->getMaxBytes()) {collect.reset();}
+		}
+
+		return true;
+
+	}
+
+};
+
+#endif // DIR_STREAM_H
@@ -5,24 +5,79 @@
 #include <memory>
 #include <string.h>
 #include <mutex>
+#include <unordered_map>
+#include <functional>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
 
 #include "../cipher/Cipher.h"
+#include "../Exception.h"
 #include "FilePathSplitter.h"
+#include "PathCache.h"
+#include "PathBuffer.h"
+#include "DirCache.h"
+#include "NameCodec.h"
+#include "../derivation/Blake2b.h"
+#include "../Stats.h"
+#include "../Helper.h"
 
 namespace Settings {
 
-	/** maximum filename length (encrypted) */
+	/** legacy names: filename length (encrypted) */
 	const int FILE_PATH_ML = 192;
 
-	/** maximum filename length (unencrypted) */
+	/** legacy names: maximum filename length (unencrypted) */
 	const int FILE_PATH_ML2 = FILE_PATH_ML/2;
 
+	/** legacy names: zero-padded to 96 bytes, encrypted, hex-encoded using 'a' to 'p' (192 characters) */
+	const constexpr uint32_t FILE_NAME_FORMAT_LEGACY = 1;
+
+	/** compact names: zero-padded to the next 16 bytes, encrypted, base64url-encoded (22 characters per 16 bytes) */
+	const constexpr uint32_t FILE_NAME_FORMAT_BASE64 = 2;
+
+	/** the format used for new volumes */
+	const constexpr uint32_t FILE_NAME_FORMAT_CURRENT = FILE_NAME_FORMAT_BASE64;
+
+	/** compact names: maximum filename length (unencrypted). 176 bytes are 235 characters (max 255) */
+	const constexpr uint32_t FILE_NAME_BASE64_ML = 176;
+
+	/** compact names: padding granularity (cipher block) */
+	const constexpr uint32_t FILE_NAME_BASE64_BLOCK = 16;
+
+	/** compact names: maximum filename length (unencrypted) for names stored as hash + side-car */
+	const constexpr uint32_t FILE_NAME_LONG_ML = 255;
+
+	/** long names: the first character of the stored (hashed) name. never part of base64url */
+	const constexpr char FILE_NAME_LONG_PREFIX = '~';
+
+	/** long names: the side-car file holding the full encrypted name, within the same folder */
+	const constexpr char* FILE_NAME_LONG_SIDECAR = ".kcryptfs.long.";
+
+	/** long names: number of cached side-cars (hashed -> full encrypted name) */
+	const constexpr size_t FILE_NAME_LONG_CACHE = 4096;
+
+	/** listings: names are decrypted in batches of (at least) this many bytes, using one cipher call each */
+	const constexpr uint32_t FILE_NAME_BATCH_BYTES = 16 * 1024;
+
 	/** fixed initialization vector */
 	const uint8_t FILE_PATH_IV[16] = {230, 81, 128, 34, 117, 47, 203, 62, 69, 45, 240, 49, 152, 122, 86, 190};
 
 	/** fixed initialization vector length */
 //	const uint32_t FILE_PATH_IV_LEN = 16;
 
+	/** per-directory IVs: the file within each (backing) folder holding the IV for the names within this folder */
+	const constexpr char* FILE_PATH_DIR_IV = ".kcryptfs.diriv";
+
+	/** per-directory IVs: length (bytes) */
+	const constexpr uint32_t FILE_PATH_DIR_IV_LEN = sizeof(FILE_PATH_IV);
+
+	/** per-directory IVs: number of cached IVs */
+	const constexpr size_t FILE_PATH_DIR_IV_CACHE = 16 * 1024;
+
+	/** prefix of kCryptFS' own (unencrypted) files within the encrypted folders. encrypted names never start with a dot */
+	const constexpr char* FILE_PATH_INTERNAL_PREFIX = ".kcryptfs.";
+
 }
 
 /**
@@ -45,15 +100,69 @@ private:
 
 	/** thread-sync */
 	std::mutex mtx;
+
+	/** encrypted paths by their plaintext path (optional) */
+	std::shared_ptr<PathCache> cache;
+
+	/** the format of the encrypted names */
+	const uint32_t nameFormat;
+
+	/** long names: full encrypted names by their hashed names */
+	std::unordered_map<std::string, std::string> longNames;
+
+	/** thread-sync for longNames */
+	std::mutex longMtx;
+
+	/** names are encrypted using the IV of their folder (if it has one) instead of the fixed IV */
+	const bool dirIVs;
+
+	/** per-directory IVs by the folder's (plaintext) path. folders without IV are not cached */
+	struct DirIV {uint8_t iv[Settings::FILE_PATH_DIR_IV_LEN];};
+	std::unordered_map<std::string, DirIV> dirIVCache;
+
+	/** thread-sync for dirIVCache */
+	std::mutex dirIVMtx;
+
+	/** encrypted names (raw bytes), to be decrypted at once */
+	struct NameBatch {
+		std::vector<uint8_t> in = std::vector<uint8_t>(Settings::FILE_NAME_BATCH_BYTES + Settings::FILE_NAME_LONG_ML + 1);
+		std::vector<uint8_t> out = std::vector<uint8_t>(Settings::FILE_NAME_BATCH_BYTES + Settings::FILE_NAME_LONG_ML + 1);
+		std::vector<uint32_t> lengths;
+		std::vector<size_t> entries;		// index within the listing
+		uint32_t used = 0;
+	};
 	
 public:
 	
 	/** ctor */
-	FilePath(const char* mountSrcPath, std::shared_ptr<Cipher> cipher) :  mountSrcPath(mountSrcPath), cipher(cipher) {
-		;
+	FilePath(const char* mountSrcPath, std::shared_ptr<Cipher> cipher, std::shared_ptr<PathCache> cache = nullptr, const uint32_t nameFormat = Settings::FILE_NAME_FORMAT_LEGACY, const bool dirIVs = false) :
+		mountSrcPath(mountSrcPath), cipher(cipher), cache(cache), nameFormat(nameFormat), dirIVs(dirIVs) {
+		if (nameFormat != Settings::FILE_NAME_FORMAT_LEGACY && nameFormat != Settings::FILE_NAME_FORMAT_BASE64) {
+			throw Exception("unsupported file-name format: " + std::to_string(nameFormat));
+		}
+	}
+
+	/** get the format of the encrypted names */
+	uint32_t getNameFormat() const {
+		return nameFormat;
+	}
+
+	/** are names encrypted using per-directory IVs? */
+	bool usesDirIVs() const {
+		return dirIVs;
 	}
 	
 	
+	/** is the given (encrypted) name one of kCryptFS' own files, which must not be listed? */
+	static bool isInternal(const char* name) {
+		return strncmp(name, Settings::FILE_PATH_INTERNAL_PREFIX, strlen(Settings::FILE_PATH_INTERNAL_PREFIX)) == 0;
+	}
+
+	/** is the given (encrypted) name a hashed long name, with its full name in a side-car? */
+	static bool isLong(const char* name) {
+		return name[0] == Settings::FILE_NAME_LONG_PREFIX;
+	}
+
 	/** get the given realtive file's full path name. this one does NOT decrypt the given relative filename */
 	std::string getAbsolutePath(const char* relativePath) const {
 		return mountSrcPath + relativePath;
@@ -61,77 +170,244 @@ public:
 	
 	/** get the given realtive file's full path name. thos one DOES decrypt the given realtive filename */
 	std::string getAbsolutePathEnc(const char* relativePath) {
-		return mountSrcPath + encryptRelativeFileName(relativePath);
+		PathBuffer buf;
+		getAbsolutePathEnc(relativePath, buf);
+		return buf.str();
+	}
+
+	/** write the given realtive file's full (encrypted) path name into the buffer. no heap allocations for short and cached names */
+	void getAbsolutePathEnc(const char* relativePath, PathBuffer& dst) {
+		dst.clear();
+		dst.append(mountSrcPath);
+		encryptRelativeFileName(relativePath, dst);
 	}
 	
-	/** decrypt the given (relative!) filename */
+	/** decrypt the given (relative!) filename, component by component, each using the IV of its folder */
 	std::string decryptRelativeFileName(const char* relativeFileName) {
-		FilePathSplitter splt(relativeFileName);
-		while (splt.hasNext()) {
-			splt.setCur( decrypt(splt.next()) );
+		const size_t len = strlen(relativeFileName);
+		FilePathParts parts(relativeFileName, len);
+		PathView part;
+		std::string res;
+		size_t pos = 0;
+		uint8_t iv[Settings::FILE_PATH_DIR_IV_LEN];
+		while (parts.next(part)) {
+			const size_t start = part.data - relativeFileName;
+			getDirIV(res.data(), res.length(), relativeFileName, (start) ? (start - 1) : (0), iv);
+			res.append(relativeFileName + pos, start - pos);
+			res += decrypt(part.str(), iv);
+			pos = start + part.len;
 		}
-		return splt.getPath();
-		//std::vector<std::string> parts = split(relativeFileName);
-		//const std::string res = implode(decrypt(parts));
-		////std::cout << "#" << relativeFileName << " -> " << res << std::endl;
-		//return res;
+		res.append(relativeFileName + pos, len - pos);
+		return res;
 	}
 
-	/** encrypt the given (relative!) filename */
+	/** encrypt the given (relative!) filename. uses the path-cache, if any */
 	std::string encryptRelativeFileName(const char* relativeFileName) {
-		FilePathSplitter splt(relativeFileName);
-		while (splt.hasNext()) {
-			splt.setCur( encrypt(splt.next()) );
+		PathBuffer buf;
+		encryptRelativeFileName(relativeFileName, buf);
+		return buf.str();
+	}
+
+	/** encrypt the given (relative!) filename and append it to the buffer. uses the path-cache, if any */
+	void encryptRelativeFileName(const char* relativeFileName, PathBuffer& dst) {
+		const size_t len = strlen(relativeFileName);
+		if (cache)	{encryptCached(relativeFileName, len, dst);}
+		else		{encryptRelativeFileNameUncached(relativeFileName, len, dst);}
+	}
+
+	/** add the entries of the given folder's (decrypted) listing to the path-cache */
+	void seed(const char* relativeDir, const DirListing& listing) {
+		if (!cache) {return;}
+		const std::string dir = (strcmp(relativeDir, "/") == 0) ? ("") : (relativeDir);
+		PathBuffer buf;
+		if (!dir.empty()) {encryptCached(dir.data(), dir.length(), buf);}
+		const std::string dirEnc = buf.str();
+		for (const DirEntry& e : listing) {
+			if ("." == e.plain || ".." == e.plain) {continue;}
+			cache->put(dir + "/" + e.plain, dirEnc + "/" + e.enc);
 		}
-		return splt.getPath();
-		//std::vector<std::string> parts = split(relativeFileName);
-		//const std::string res = implode(encrypt(parts));
-		////std::cout << "#" << relativeFileName << " -> " << res << std::endl;
-		//return res;
 	}
 
-	/** encrypt one part of a filename (folder, name itself) */
-	std::string encrypt(const std::string& str) {
+	/** the given path (and everything below) was created, renamed or deleted */
+	void invalidate(const char* relativeFileName) {
+		if (cache) {cache->invalidate(relativeFileName);}
+		if (dirIVs) {
+			std::lock_guard<std::mutex> lock(dirIVMtx);
+			for (auto it = dirIVCache.begin(); it != dirIVCache.end(); ) {
+				if (PathCache::isBelow(it->first, relativeFileName))	{it = dirIVCache.erase(it);}
+				else													{++it;}
+			}
+		}
+	}
+
+	/** get the IV for the names within the given (relative!) folder. the fixed IV for folders without one */
+	void getDirIV(const char* relativeDir, uint8_t* iv) {
+		const size_t len = (strcmp(relativeDir, "/") == 0) ? (0) : (strlen(relativeDir));
+		PathBuffer enc;
+		if (dirIVs && len) {encryptRelativeFileName(relativeDir, enc);}
+		getDirIV(relativeDir, len, enc.c_str(), enc.length(), iv);
+	}
+
+	/** the given (relative!) folder was just created: store its new, random IV. names below it might be cached using the former one */
+	void createDirIV(const char* relativePath) {
+		if (dirIVs) {writeDirIV(getAbsolutePathEnc(relativePath));}
+		invalidate(relativePath);
+	}
+
+	/**
+	 * the given (relative!) folder is about to be removed (or replaced): remove its IV, which would prevent removing the folder.
+	 * the IV is kept for folders that are not empty (ENOTEMPTY).
+	 * returns true if the IV was removed. its bytes are provided within 'iv' (optional), to restore it if removing the folder fails
+	 */
+	bool removeDirIV(const char* relativePath, uint8_t* iv = nullptr) {
+
+		if (!dirIVs) {return false;}
+		PathBuffer folder;
+		getAbsolutePathEnc(relativePath, folder);
+
+		DIR* dp = opendir(folder.c_str());
+		if (!dp) {throw Exception("could not open the folder", errno);}
+		bool empty = true;
+		bool hasIV = false;
+		struct dirent* de;
+		while (empty && (de = readdir(dp)) != nullptr) {
+			if (strcmp(de->d_name, ".") == 0 || strcmp(de->d_name, "..") == 0)	{continue;}
+			if (strcmp(de->d_name, Settings::FILE_PATH_DIR_IV) == 0)			{hasIV = true; continue;}
+			empty = false;
+		}
+		if (!empty) {closedir(dp); throw Exception("folder not empty", ENOTEMPTY);}
+		if (!hasIV) {closedir(dp); return false;}
+
+		const std::string file = std::string(folder.c_str()) + "/" + Settings::FILE_PATH_DIR_IV;
+		if (iv) {
+			try {readDirIV(file.c_str(), iv);} catch (const Exception&) {closedir(dp); throw;}
+		}
+		int res = unlinkat(dirfd(dp), Settings::FILE_PATH_DIR_IV, 0);
+		if (res != 0 && errno == EACCES) {
+			res = withWriteAccess(dirfd(dp), [&] () {return unlinkat(dirfd(dp), Settings::FILE_PATH_DIR_IV, 0);});
+		}
+		const int err = errno;
+		closedir(dp);
+
+		if (res != 0) {throw Exception("could not remove the folder's IV", err);}
+		invalidate(relativePath);
+		return true;
+
+	}
+
+	/** removing the given (relative!) folder failed: store the IV it had before removeDirIV() */
+	void restoreDirIV(const char* relativePath, const uint8_t* iv) {
+		const std::string folder = getAbsolutePathEnc(relativePath);
+		try {
+			writeDirIV(folder, iv);
+		} catch (const Exception& e) {
+			if (e.getErrno() != EACCES) {throw;}
+			const int fd = open(folder.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+			if (fd < 0) {throw;}
+			int res;
+			try {res = withWriteAccess(fd, [&] () {writeDirIV(folder, iv); return 0;});} catch (...) {close(fd); throw;}
+			close(fd);
+			if (res != 0) {throw;}
+		}
+		invalidate(relativePath);
+	}
+
+	/**
+	 * run the given operation with temporary write access to the given (backing) folder.
+	 * read-only folders (e.g. chmod 555) still need their IV to be removed or restored
+	 */
+	static int withWriteAccess(const int dirFD, const std::function<int()>& func) {
+		struct stat st;
+		if (fstat(dirFD, &st) != 0) {return -1;}
+		const mode_t mode = st.st_mode & 07777;
+		if (fchmod(dirFD, mode | S_IWUSR | S_IXUSR) != 0) {return -1;}
+		int res;
+		try {res = func();} catch (...) {fchmod(dirFD, mode); throw;}
+		const int err = errno;
+		fchmod(dirFD, mode);
+		errno = err;
+		return res;
+	}
+
+	/** store a new, random IV within the given (absolute, backing) folder */
+	static void writeDirIV(const std::string& absFolder) {
+		uint8_t iv[Settings::FILE_PATH_DIR_IV_LEN];
+		Helper::getRandom(iv, sizeof(iv));
+		writeDirIV(absFolder, iv);
+	}
+
+	/** store the given IV within the given (absolute, backing) folder */
+	static void writeDirIV(const std::string& absFolder, const uint8_t* iv) {
+		const std::string file = absFolder + "/" + Settings::FILE_PATH_DIR_IV;
+		const int fd = open(file.c_str(), O_WRONLY | O_CREAT | O_EXCL, 0444);
+		if (fd < 0) {throw Exception("could not create the folder's IV", errno);}
+		const ssize_t res = write(fd, iv, Settings::FILE_PATH_DIR_IV_LEN);
+		const int err = errno;
+		close(fd);
+		if (res != (ssize_t)Settings::FILE_PATH_DIR_IV_LEN) {unlink(file.c_str()); throw Exception("could not write the folder's IV", (res < 0) ? (err) : (EIO));}
+	}
+
+	/** encrypt the given (relative!) filename, component by component */
+	std::string encryptRelativeFileNameUncached(const char* relativeFileName) {
+		PathBuffer buf;
+		encryptRelativeFileNameUncached(relativeFileName, strlen(relativeFileName), buf);
+		return buf.str();
+	}
+
+	/** encrypt one part of a filename (folder, name itself), using the given IV (of its folder). throws ENAMETOOLONG for too long names */
+	std::string encrypt(const std::string& str, const uint8_t* iv = Settings::FILE_PATH_IV) {
+		PathBuffer buf;
+		encrypt(PathView{str.data(), str.length()}, buf, iv);
+		return buf.str();
+	}
+
+	/** encrypt one part of a filename (folder, name itself) and append it to the buffer. throws ENAMETOOLONG for too long names */
+	void encrypt(const PathView& name, PathBuffer& dst, const uint8_t* iv = Settings::FILE_PATH_IV) {
 		
 		// skip always present folders
-		if ("." == str || ".." == str) {return str;}
+		if (name == "." || name == "..") {dst.append(name.data, name.len); return;}
+
+		if (nameFormat == Settings::FILE_NAME_FORMAT_BASE64) {
+			if (name.len > Settings::FILE_NAME_BASE64_ML)	{dst.append(encryptLong(name.str(), iv));}
+			else											{encryptBase64(name, dst, iv);}
+			return;
+		}
 		
-		// input filename (max 128 chars)
+		// input filename (max 96 chars)
+		if (name.len > (size_t)Settings::FILE_PATH_ML2) {throw Exception("file-name too long", ENAMETOOLONG);}
 		uint8_t in[Settings::FILE_PATH_ML2] = {};
-		memcpy(in, str.data(), str.length());
+		memcpy(in, name.data, name.len);
 		
 		mtx.lock();
 
 		// get encrypted filename
 		const uint32_t ivLen = cipher->getIVLength();
 		uint8_t out[Settings::FILE_PATH_ML2];
-		cipher->encrypt(in, out, Settings::FILE_PATH_ML2, Settings::FILE_PATH_IV, ivLen);
+		cipher->encrypt(in, out, Settings::FILE_PATH_ML2, iv, ivLen);
 		
 		mtx.unlock();
 
 		// convert him to a hex string
-		std::string hex; hex.resize(Settings::FILE_PATH_ML);
-		byteToHex(out, Settings::FILE_PATH_ML2, (char*)hex.data());
-		return hex;
+		NameCodec::toHex(out, Settings::FILE_PATH_ML2, dst.extend(Settings::FILE_PATH_ML));
 		
 	}
 	
-	/** decrypt one part of a filename (folder, name itself) */
-	std::string decrypt(const std::string& str) {
+	/** decrypt one part of a filename (folder, name itself), using the given IV (of its folder) */
+	std::string decrypt(const std::string& str, const uint8_t* iv = Settings::FILE_PATH_IV) {
 		
 		// skip always present folders
 		if ("." == str || ".." == str) {return str;}
-				
-		// convert hexed input filename to raw bytes
-		uint8_t in[Settings::FILE_PATH_ML2];
-		hexToByte(str.data(), str.length(), in);
+
+		// convert the input filename to raw bytes
+		uint8_t in[Settings::FILE_NAME_LONG_ML+1];
+		const uint32_t len = decode(str, in);
 		
 		mtx.lock();
 
 		// decode the input filename
 		const uint32_t ivLen = cipher->getIVLength();
-		uint8_t out[Settings::FILE_PATH_ML2+1] = {};				// has space for one trailing zero
-		cipher->decrypt(in, out, Settings::FILE_PATH_ML2, Settings::FILE_PATH_IV, ivLen);
+		uint8_t out[Settings::FILE_NAME_LONG_ML+2] = {};			// has space for one trailing zero
+		cipher->decrypt(in, out, len, iv, ivLen);
 
 		mtx.unlock();
 
@@ -139,22 +415,321 @@ public:
 		return std::string((const char*) out);
 		
 	}
+
+	/** decrypt one entry of the given (backing) folder, using the folder's IV. long names are read from their side-car, unless cached */
+	std::string decryptEntry(const int dirFD, const char* name, const uint8_t* iv = Settings::FILE_PATH_IV) {
+		if (nameFormat == Settings::FILE_NAME_FORMAT_BASE64 && isLong(name) && !hasLongName(name)) {
+			loadLongName(dirFD, name);
+		}
+		return decrypt(name, iv);
+	}
+
+	/**
+	 * decrypt the (encrypted) names of the given entries of the given (backing) folder, using the folder's IV.
+	 * the names are decrypted in batches, using one cipher call per batch.
+	 * entries that were not encrypted by us are removed. returns the number of removed entries
+	 */
+	size_t decryptEntries(const int dirFD, DirListing& entries, const uint8_t* iv = Settings::FILE_PATH_IV) {
+
+		NameBatch batch;
+		std::vector<bool> foreign(entries.size(), false);
+		size_t skipped = 0;
+
+		for (size_t i = 0; i < entries.size(); ++i) {
+
+			// skip always present folders
+			const std::string& name = entries[i].enc;
+			if ("." == name || ".." == name) {entries[i].plain = name; continue;}
+
+			// convert to raw bytes (long names: read the side-car first)
+			try {
+				if (nameFormat == Settings::FILE_NAME_FORMAT_BASE64 && isLong(name.c_str()) && !hasLongName(name)) {
+					loadLongName(dirFD, name.c_str());
+				}
+				const uint32_t len = decode(name, &batch.in[batch.used]);
+				batch.used += len;
+				batch.lengths.push_back(len);
+				batch.entries.push_back(i);
+			} catch (const Exception&) {
+				foreign[i] = true;
+				++skipped;
+				continue;
+			}
+
+			if (batch.used >= Settings::FILE_NAME_BATCH_BYTES) {decryptBatch(batch, entries, iv);}
+
+		}
+
+		decryptBatch(batch, entries, iv);
+
+		// remove foreign entries, keep the order
+		if (skipped) {
+			size_t j = 0;
+			for (size_t i = 0; i < entries.size(); ++i) {
+				if (foreign[i]) {continue;}
+				if (i != j) {entries[j] = std::move(entries[i]);}
+				++j;
+			}
+			entries.erase(entries.begin() + j, entries.end());
+		}
+
+		return skipped;
+
+	}
+
+	/**
+	 * the given path is about to be created (or renamed to): store its side-car, if its name is a long one.
+	 * returns true if the side-car did not exist before: it must be removed again, if creating the path fails
+	 */
+	bool storeLongName(const char* relativePath) {
+
+		std::string enc;
+		const std::string file = getSideCarPath(relativePath, enc);
+		if (file.empty()) {return false;}
+		const std::string full = getLongName(enc);
+
+		bool created = true;
+		int fd = open(file.c_str(), O_WRONLY | O_CREAT | O_EXCL, 0644);
+		if (fd < 0 && errno == EEXIST) {
+			created = false;
+			fd = open(file.c_str(), O_WRONLY | O_TRUNC);
+		}
+		if (fd < 0) {throw Exception("could not create the side-car of a long file-name", errno);}
+		const ssize_t res = write(fd, full.data(), full.length());
+		const int err = errno;
+		close(fd);
+		if (res != (ssize_t)full.length()) {
+			if (created) {unlink(file.c_str());}
+			throw Exception("could not write the side-car of a long file-name", (res < 0) ? (err) : (EIO));
+		}
+		return created;
+
+	}
+
+	/** the given path was deleted (or renamed): remove its side-car, if its name is a long one */
+	void removeLongName(const char* relativePath) {
+		std::string enc;
+		const std::string file = getSideCarPath(relativePath, enc);
+		if (!file.empty()) {unlink(file.c_str());}
+	}
 	
 private:
-	
-	/** convert from hex-string to a byte array */
-	static void hexToByte(const char* chars, const int charsLen, uint8_t* bytes) {
-		for(int i = 0; i < charsLen / 2; ++i) {
-			bytes[i] = ((chars[i*2+0]-'a') << 0) | ((chars[i*2+1]-'a') << 4);
+
+	/** encrypt the given (relative!) filename, component by component, each using the IV of its folder, and append it to the buffer */
+	void encryptRelativeFileNameUncached(const char* relativeFileName, const size_t len, PathBuffer& dst) {
+		const size_t start = dst.length();
+		FilePathParts parts(relativeFileName, len);
+		PathView part;
+		uint8_t iv[Settings::FILE_PATH_DIR_IV_LEN];
+		while (parts.next(part)) {
+			const size_t pos = part.data - relativeFileName;
+			getDirIV(relativeFileName, (pos) ? (pos - 1) : (0), dst.c_str() + start, dst.length() - start, iv);
+			dst.append('/');
+			encrypt(part, dst, iv);
 		}
+		if (len && relativeFileName[len-1] == '/') {dst.append('/');}
 	}
-	
-	/** convert from a byte-array to a hex string */
-	static void byteToHex(const uint8_t* bytes, const int bytesLen, char* chars) {
-		for (int i = 0; i < bytesLen; ++i) {
-			chars[i*2+0] = 'a' + ((bytes[i] >> 0) & 0xF);
-			chars[i*2+1] = 'a' + ((bytes[i] >> 4) & 0xF);
+
+	/** long names: encrypt the name and store it as hash of the encrypted name. the full one is kept for its side-car */
+	std::string encryptLong(const std::string& str, const uint8_t* iv) {
+		PathBuffer buf;
+		encryptBase64(PathView{str.data(), str.length()}, buf, iv);
+		const std::string full = buf.str();
+		uint8_t hash[32];
+		Blake2b::hash((const uint8_t*)full.data(), full.length(), hash, sizeof(hash));
+		const std::string name = Settings::FILE_NAME_LONG_PREFIX + NameCodec::toBase64(hash, sizeof(hash));
+		rememberLongName(name, full);
+		return name;
+	}
+
+	/** long names: is the full encrypted name for the given hashed one known? */
+	bool hasLongName(const std::string& name) {
+		std::lock_guard<std::mutex> lock(longMtx);
+		return longNames.find(name) != longNames.end();
+	}
+
+	/** long names: get the full encrypted name for the given hashed one. throws if unknown */
+	std::string getLongName(const std::string& name) {
+		std::lock_guard<std::mutex> lock(longMtx);
+		auto it = longNames.find(name);
+		if (it == longNames.end()) {throw Exception("unknown long file-name: " + name, EINVAL);}
+		return it->second;
+	}
+
+	/** long names: cache the full encrypted name for the given hashed one. the cache is cleared when full */
+	void rememberLongName(const std::string& name, const std::string& full) {
+		std::lock_guard<std::mutex> lock(longMtx);
+		if (longNames.size() >= Settings::FILE_NAME_LONG_CACHE) {longNames.clear();}
+		longNames[name] = full;
+	}
+
+	/** long names: read the side-car for the given hashed name within the given (backing) folder */
+	void loadLongName(const int dirFD, const char* name) {
+
+		const std::string file = std::string(Settings::FILE_NAME_LONG_SIDECAR) + (name + 1);
+		const int fd = openat(dirFD, file.c_str(), O_RDONLY);
+		if (fd < 0) {throw Exception(std::string("missing side-car for long file-name: ") + name, EINVAL);}
+		char buf[512];
+		const ssize_t len = read(fd, buf, sizeof(buf));
+		close(fd);
+		if (len <= 0) {throw Exception(std::string("invalid side-car for long file-name: ") + name, EINVAL);}
+
+		// the side-car must match the hashed name
+		const std::string full(buf, len);
+		uint8_t hash[32];
+		Blake2b::hash((const uint8_t*)full.data(), full.length(), hash, sizeof(hash));
+		if (Settings::FILE_NAME_LONG_PREFIX + NameCodec::toBase64(hash, sizeof(hash)) != name) {
+			throw Exception(std::string("invalid side-car for long file-name: ") + name, EINVAL);
 		}
+		rememberLongName(name, full);
+
+	}
+
+	/** long names: the (absolute) side-car for the given relative path and its encrypted name. empty for short names */
+	std::string getSideCarPath(const char* relativePath, std::string& enc) {
+		if (nameFormat != Settings::FILE_NAME_FORMAT_BASE64) {return "";}
+		const char* slash = strrchr(relativePath, '/');
+		const char* name = (slash) ? (slash + 1) : (relativePath);
+		if (strlen(name) <= Settings::FILE_NAME_BASE64_ML) {return "";}
+		const size_t dirLen = (slash) ? (slash - relativePath) : (0);
+		const std::string dir(relativePath, dirLen);
+		PathBuffer encDir;
+		if (dirLen) {encryptRelativeFileName(dir.c_str(), encDir);}
+		uint8_t iv[Settings::FILE_PATH_DIR_IV_LEN];
+		getDirIV(dir.data(), dirLen, encDir.c_str(), encDir.length(), iv);
+		enc = encrypt(name, iv);
+		return mountSrcPath + encDir.str() + "/" + Settings::FILE_NAME_LONG_SIDECAR + enc.substr(1);
+	}
+
+	/**
+	 * get the IV for the names within the given folder, given as plaintext and encrypted relative path (root: empty).
+	 * the IV is read from the folder once and cached afterwards. folders without IV use the fixed one
+	 */
+	void getDirIV(const char* plain, const size_t plainLen, const char* enc, const size_t encLen, uint8_t* iv) {
+
+		memcpy(iv, Settings::FILE_PATH_IV, Settings::FILE_PATH_DIR_IV_LEN);
+		if (!dirIVs) {return;}
+
+		static thread_local std::string key;
+		key.assign(plain, plainLen);
+		{
+			std::lock_guard<std::mutex> lock(dirIVMtx);
+			auto it = dirIVCache.find(key);
+			if (it != dirIVCache.end()) {memcpy(iv, it->second.iv, Settings::FILE_PATH_DIR_IV_LEN); return;}
+		}
+
+		PathBuffer file;
+		file.append(mountSrcPath);
+		file.append(enc, encLen);
+		file.append('/');
+		file.append(Settings::FILE_PATH_DIR_IV, strlen(Settings::FILE_PATH_DIR_IV));
+		DirIV entry;
+		if (!readDirIV(file.c_str(), entry.iv)) {return;}
+		memcpy(iv, entry.iv, Settings::FILE_PATH_DIR_IV_LEN);
+
+		std::lock_guard<std::mutex> lock(dirIVMtx);
+		if (dirIVCache.size() >= Settings::FILE_PATH_DIR_IV_CACHE) {dirIVCache.clear();}
+		dirIVCache[key] = entry;
+
+	}
+
+	/** per-directory IVs: read the given IV-file. false if there is none (or the folder does not exist) */
+	static bool readDirIV(const char* file, uint8_t* iv) {
+		const int fd = open(file, O_RDONLY | O_CLOEXEC);
+		if (fd < 0) {
+			if (errno == ENOENT || errno == ENOTDIR) {return false;}
+			throw Exception(std::string("could not read the folder's IV: ") + file, errno);
+		}
+		const ssize_t len = read(fd, iv, Settings::FILE_PATH_DIR_IV_LEN);
+		close(fd);
+		if (len != (ssize_t)Settings::FILE_PATH_DIR_IV_LEN) {throw Exception(std::string("invalid folder IV: ") + file, EIO);}
+		return true;
+	}
+
+	/** compact names: only pad to the cipher's block-size */
+	void encryptBase64(const PathView& name, PathBuffer& dst, const uint8_t* iv) {
+
+		if (name.len > Settings::FILE_NAME_LONG_ML) {throw Exception("file-name too long", ENAMETOOLONG);}
+		const uint32_t blk = Settings::FILE_NAME_BASE64_BLOCK;
+		const uint32_t len = (name.len == 0) ? (blk) : ((name.len + blk - 1) / blk * blk);
+
+		uint8_t in[Settings::FILE_NAME_LONG_ML+1] = {};
+		uint8_t out[Settings::FILE_NAME_LONG_ML+1];
+		memcpy(in, name.data, name.len);
+		{
+			std::lock_guard<std::mutex> lock(mtx);
+			cipher->encrypt(in, out, len, iv, cipher->getIVLength());
+		}
+
+		NameCodec::toBase64(out, len, dst.extend(NameCodec::getBase64Length(len)));
+
+	}
+
+	/** convert the given encrypted name into the cipher's input (dst: FILE_NAME_LONG_ML+1 bytes). returns its length. throws for names that were not encrypted by us */
+	uint32_t decode(const std::string& str, uint8_t* dst) {
+
+		if (nameFormat == Settings::FILE_NAME_FORMAT_BASE64) {
+			const std::string full = (isLong(str.c_str())) ? (getLongName(str)) : (str);
+			const int len = NameCodec::fromBase64(full.data(), full.length(), dst, Settings::FILE_NAME_LONG_ML+1);
+			if (len <= 0 || len % Settings::FILE_NAME_BASE64_BLOCK) {throw Exception("not an encrypted file-name: " + str, EINVAL);}
+			return len;
+		}
+
+		if (str.length() != (size_t)Settings::FILE_PATH_ML || !NameCodec::fromHex(str.data(), str.length(), dst)) {
+			throw Exception("not an encrypted file-name: " + str, EINVAL);
+		}
+		return Settings::FILE_PATH_ML2;
+
+	}
+
+	/** decrypt the names within the batch and fill in their listing-entries */
+	void decryptBatch(NameBatch& batch, DirListing& dst, const uint8_t* iv) {
+
+		if (batch.lengths.empty()) {return;}
+		{
+			std::lock_guard<std::mutex> lock(mtx);
+			cipher->decryptMany(batch.in.data(), batch.out.data(), batch.lengths.data(), batch.lengths.size(), iv, cipher->getIVLength());
+		}
+
+		// names are zero-padded
+		uint32_t pos = 0;
+		for (size_t i = 0; i < batch.lengths.size(); ++i) {
+			const char* name = (const char*) &batch.out[pos];
+			dst[batch.entries[i]].plain.assign(name, strnlen(name, batch.lengths[i]));
+			pos += batch.lengths[i];
+		}
+
+		batch.lengths.clear();
+		batch.entries.clear();
+		batch.used = 0;
+
+	}
+
+	/**
+	 * encrypt the given path using the cache. on a miss, the parent folder's
+	 * (usually cached) encrypted path is reused and just the last component is encrypted.
+	 * all folders along the path are cached as well
+	 */
+	void encryptCached(const char* plain, const size_t len, PathBuffer& dst) {
+
+		const size_t start = dst.length();
+		if (cache->get(plain, len, dst)) {++Stats::get().pathCacheHits; return;}
+		++Stats::get().pathCacheMisses;
+
+		// no parent
+		const char* slash = (const char*) memrchr(plain, '/', len);
+		if (!slash || (len == 1 && plain[0] == '/')) {encryptRelativeFileNameUncached(plain, len, dst); return;}
+
+		// parent + encrypted name ("/a/" -> "/A/"), using the parent's IV
+		const size_t pos = slash - plain;
+		if (pos) {encryptCached(plain, pos, dst);}
+		uint8_t iv[Settings::FILE_PATH_DIR_IV_LEN];
+		if (pos + 1 < len) {getDirIV(plain, pos, dst.c_str() + start, dst.length() - start, iv);}
+		dst.append('/');
+		if (pos + 1 < len) {encrypt(PathView{slash + 1, len - pos - 1}, dst, iv);}
+
+		cache->put(plain, len, dst.c_str() + start, dst.length() - start);
+
 	}
 		
 };
@@ -2,8 +2,63 @@
 #define FILE_PATH_SPLITTER_H
 
 #include <string>
+#include <cstring>
 #include "../Exception.h"
 
+/** non-owning view of one part of a path (C++11 has no std::string_view) */
+struct PathView {
+
+	/** the first character (not zero-terminated) */
+	const char* data;
+
+	/** the number of characters */
+	size_t len;
+
+	/** compare against the given zero-terminated string */
+	bool operator == (const char* str) const {
+		return strncmp(data, str, len) == 0 && str[len] == 0;
+	}
+
+	/** copy of the viewed characters */
+	std::string str() const {
+		return std::string(data, len);
+	}
+
+};
+
+/**
+ * allocation-free counterpart of the FilePathSplitter:
+ * iterates over the subfolders/files of the given path, without copying it.
+ * the path must outlive the iterator
+ */
+class FilePathParts {
+
+private:
+
+	const char* path;
+	const size_t len;
+	size_t pos = 0;
+
+public:
+
+	/** ctor with the path and its length */
+	FilePathParts(const char* path, const size_t len) : path(path), len(len) {
+		;
+	}
+
+	/** get the next subfolder/file. false if none is left */
+	bool next(PathView& part) {
+		while (pos < len && path[pos] == '/') {++pos;}
+		if (pos >= len) {return false;}
+		const char* end = (const char*) memchr(path + pos, '/', len - pos);
+		const size_t partLen = (end) ? (end - (path + pos)) : (len - pos);
+		part = PathView{path + pos, partLen};
+		pos += partLen;
+		return true;
+	}
+
+};
+
 /**
  * helper class to split a long path
  *		e.g.: /path/to/my/files/notes.txt
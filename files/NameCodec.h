@@ -0,0 +1,177 @@
+#ifndef NAME_CODEC_H
+#define NAME_CODEC_H
+
+#include <string>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__SSE2__)
+	#define NAME_CODEC_SSE2
+	#include <emmintrin.h>
+#endif
+
+/**
+ * text-encodings for encrypted file-names.
+ * base64url (RFC 4648, without padding) only uses characters that are valid within file-names.
+ * the legacy hex-like encoding uses 'a' to 'p', low nibble first (SSE2 for 16 bytes at once, where available)
+ */
+class NameCodec {
+
+public:
+
+	/** legacy: encode the given bytes into 2*len characters */
+	static void toHex(const uint8_t* bytes, const uint32_t len, char* chars) {
+
+		uint32_t i = 0;
+
+#ifdef NAME_CODEC_SSE2
+		const __m128i mask = _mm_set1_epi8(0x0F);
+		const __m128i a = _mm_set1_epi8('a');
+		for (; i + 16 <= len; i += 16) {
+			const __m128i v = _mm_loadu_si128((const __m128i*)(bytes + i));
+			const __m128i lo = _mm_and_si128(v, mask);
+			const __m128i hi = _mm_and_si128(_mm_srli_epi16(v, 4), mask);
+			_mm_storeu_si128((__m128i*)(chars + i*2 +  0), _mm_add_epi8(_mm_unpacklo_epi8(lo, hi), a));
+			_mm_storeu_si128((__m128i*)(chars + i*2 + 16), _mm_add_epi8(_mm_unpackhi_epi8(lo, hi), a));
+		}
+#endif
+
+		for (; i < len; ++i) {
+			chars[i*2+0] = 'a' + ((bytes[i] >> 0) & 0xF);
+			chars[i*2+1] = 'a' + ((bytes[i] >> 4) & 0xF);
+		}
+
+	}
+
+	/** legacy: decode the given characters into len/2 bytes. false for odd lengths or characters other than 'a' to 'p' */
+	static bool fromHex(const char* chars, const uint32_t len, uint8_t* bytes) {
+
+		if (len % 2) {return false;}
+		uint32_t i = 0;
+
+#ifdef NAME_CODEC_SSE2
+		const __m128i a = _mm_set1_epi8('a');
+		const __m128i max = _mm_set1_epi8(15);
+		const __m128i lo = _mm_set1_epi16(0x000F);
+		const __m128i hi = _mm_set1_epi16(0x00F0);
+		__m128i invalid = _mm_setzero_si128();
+		for (; i + 32 <= len; i += 32) {
+			const __m128i v0 = _mm_sub_epi8(_mm_loadu_si128((const __m128i*)(chars + i +  0)), a);
+			const __m128i v1 = _mm_sub_epi8(_mm_loadu_si128((const __m128i*)(chars + i + 16)), a);
+			invalid = _mm_or_si128(invalid, _mm_or_si128(_mm_subs_epu8(v0, max), _mm_subs_epu8(v1, max)));		// non-zero above 15
+			const __m128i w0 = _mm_or_si128(_mm_and_si128(v0, lo), _mm_and_si128(_mm_srli_epi16(v0, 4), hi));
+			const __m128i w1 = _mm_or_si128(_mm_and_si128(v1, lo), _mm_and_si128(_mm_srli_epi16(v1, 4), hi));
+			_mm_storeu_si128((__m128i*)(bytes + i/2), _mm_packus_epi16(w0, w1));
+		}
+		if (_mm_movemask_epi8(_mm_cmpeq_epi8(invalid, _mm_setzero_si128())) != 0xFFFF) {return false;}
+#endif
+
+		for (; i < len; i += 2) {
+			const uint8_t l = (uint8_t)(chars[i+0] - 'a');
+			const uint8_t h = (uint8_t)(chars[i+1] - 'a');
+			if ((l | h) > 15) {return false;}
+			bytes[i/2] = (uint8_t)(l | (h << 4));
+		}
+		return true;
+
+	}
+
+	/** number of characters needed to encode the given number of bytes */
+	static uint32_t getBase64Length(const uint32_t numBytes) {
+		return (numBytes * 4 + 2) / 3;
+	}
+
+	/** encode the given bytes */
+	static std::string toBase64(const uint8_t* bytes, const uint32_t len) {
+		std::string res;
+		res.resize(getBase64Length(len));
+		toBase64(bytes, len, &res[0]);
+		return res;
+	}
+
+	/** encode the given bytes into getBase64Length(len) characters */
+	static void toBase64(const uint8_t* bytes, const uint32_t len, char* dst) {
+
+		const char* chars = getBase64Chars();
+
+		uint32_t i = 0;
+		for (; i + 3 <= len; i += 3) {
+			const uint32_t v = (bytes[i] << 16) | (bytes[i+1] << 8) | bytes[i+2];
+			*dst++ = chars[(v >> 18) & 63];
+			*dst++ = chars[(v >> 12) & 63];
+			*dst++ = chars[(v >>  6) & 63];
+			*dst++ = chars[(v >>  0) & 63];
+		}
+
+		if (len - i == 1) {
+			const uint32_t v = bytes[i] << 16;
+			*dst++ = chars[(v >> 18) & 63];
+			*dst++ = chars[(v >> 12) & 63];
+		} else if (len - i == 2) {
+			const uint32_t v = (bytes[i] << 16) | (bytes[i+1] << 8);
+			*dst++ = chars[(v >> 18) & 63];
+			*dst++ = chars[(v >> 12) & 63];
+			*dst++ = chars[(v >>  6) & 63];
+		}
+
+	}
+
+	/** decode the given characters into at most maxLen bytes. returns the number of bytes, or -1 for invalid input */
+	static int fromBase64(const char* chars, const uint32_t len, uint8_t* bytes, const uint32_t maxLen) {
+
+		if (len % 4 == 1) {return -1;}
+		const uint32_t numBytes = len * 3 / 4;
+		if (numBytes > maxLen) {return -1;}
+
+		const uint8_t* values = getBase64Values();
+		const uint8_t* in = (const uint8_t*) chars;
+		uint32_t out = 0;
+		uint32_t i = 0;
+
+		// 4 characters -> 3 bytes. invalid characters have the highest bit set
+		for (; i + 4 <= len; i += 4) {
+			const uint8_t a = values[in[i+0]], b = values[in[i+1]], c = values[in[i+2]], d = values[in[i+3]];
+			if ((a | b | c | d) & 0x80) {return -1;}
+			const uint32_t v = (a << 18) | (b << 12) | (c << 6) | d;
+			bytes[out++] = (uint8_t)(v >> 16);
+			bytes[out++] = (uint8_t)(v >> 8);
+			bytes[out++] = (uint8_t)(v >> 0);
+		}
+
+		// remaining 2 or 3 characters. the unused trailing bits must be zero (one encoding per input)
+		if (i < len) {
+			const bool three = (len - i == 3);
+			const uint8_t a = values[in[i+0]], b = values[in[i+1]], c = (three) ? (values[in[i+2]]) : (0);
+			if ((a | b | c) & 0x80) {return -1;}
+			const uint32_t v = (a << 18) | (b << 12) | (c << 6);
+			if (v & ((three) ? (0xFF) : (0xFFFF))) {return -1;}
+			bytes[out++] = (uint8_t)(v >> 16);
+			if (three) {bytes[out++] = (uint8_t)(v >> 8);}
+		}
+
+		return out;
+
+	}
+
+private:
+
+	/** the base64url alphabet */
+	static const char* getBase64Chars() {
+		return "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789-_";
+	}
+
+	/** the 6-bit value of every character. 0xFF if invalid */
+	static const uint8_t* getBase64Values() {
+		static const struct Values {
+			uint8_t v[256];
+			Values() {
+				memset(v, 0xFF, sizeof(v));
+				for (int i = 0; i < 64; ++i) {v[(uint8_t)getBase64Chars()[i]] = (uint8_t)i;}
+			}
+		} values;
+		return values.v;
+	}
+
+};
+
+#endif // NAME_CODEC_H
@@ -0,0 +1,89 @@
+#ifndef PATH_BUFFER_H
+#define PATH_BUFFER_H
+
+#include <string>
+#include <cstring>
+#include <climits>
+
+#include "../Exception.h"
+
+/**
+ * fixed-size buffer for (encrypted) paths, usually placed on the stack.
+ * paths are limited to PATH_MAX anyways, thus translating them never touches the heap
+ */
+class PathBuffer {
+
+private:
+
+	/** the zero-terminated path */
+	char buf[PATH_MAX];
+
+	/** the path's length */
+	size_t len = 0;
+
+public:
+
+	/** empty ctor */
+	PathBuffer() {
+		buf[0] = 0;
+	}
+
+	/** no copy */
+	PathBuffer(const PathBuffer& o) = delete;
+
+	/** no assign */
+	void operator = (const PathBuffer& o) = delete;
+
+
+	/** append n characters, to be written by the caller. throws ENAMETOOLONG if the path would exceed PATH_MAX */
+	char* extend(const size_t n) {
+		if (len + n >= sizeof(buf)) {throw Exception("path too long", ENAMETOOLONG);}
+		char* res = buf + len;
+		len += n;
+		buf[len] = 0;
+		return res;
+	}
+
+	/** append the given characters */
+	void append(const char* str, const size_t n) {
+		memcpy(extend(n), str, n);
+	}
+
+	/** append the given string */
+	void append(const std::string& str) {
+		append(str.data(), str.length());
+	}
+
+	/** append one character */
+	void append(const char c) {
+		*extend(1) = c;
+	}
+
+	/** shorten the path to the given length */
+	void truncate(const size_t n) {
+		if (n < len) {len = n; buf[len] = 0;}
+	}
+
+	/** remove everything */
+	void clear() {
+		truncate(0);
+	}
+
+	/** the zero-terminated path */
+	const char* c_str() const {
+		return buf;
+	}
+
+	/** the path's length */
+	size_t length() const {
+		return len;
+	}
+
+	/** copy of the path */
+	std::string str() const {
+		return std::string(buf, len);
+	}
+
+};
+
+#endif // PATH_BUFFER_H
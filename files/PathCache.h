@@ -0,0 +1,164 @@
+#ifndef PATH_CACHE_H
+#define PATH_CACHE_H
+
+#include <string>
+#include <mutex>
+#include <atomic>
+#include <unordered_map>
+#include <functional>
+
+#include "PathBuffer.h"
+
+namespace Settings {
+
+	/** default memory limit of the path-cache (bytes) */
+	const constexpr size_t PATH_CACHE_BYTES = 4 * 1024 * 1024;
+
+	/** number of independently locked shards */
+	const constexpr uint32_t PATH_CACHE_SHARDS = 16;
+
+}
+
+/**
+ * concurrent cache mapping plaintext relative paths (e.g. "/a/b/file") onto their
+ * encrypted counterparts. the paths are spread over several shards, each with its own mutex.
+ * every shard holds up to 1/PATH_CACHE_SHARDS of the memory limit and is cleared when full
+ */
+class PathCache {
+
+private:
+
+	struct Shard {
+		std::mutex mtx;
+		std::unordered_map<std::string, std::string> map;
+		size_t bytes = 0;
+	};
+
+	/** all shards */
+	mutable Shard shards[Settings::PATH_CACHE_SHARDS];
+
+	/** memory limit per shard (bytes) */
+	const size_t maxShardBytes;
+
+public:
+
+	/** ctor with the memory limit (bytes) */
+	PathCache(const size_t maxBytes) : maxShardBytes(maxBytes / Settings::PATH_CACHE_SHARDS) {
+		;
+	}
+
+	/** no copy */
+	PathCache(const PathCache& o) = delete;
+
+	/** no assign */
+	void operator = (const PathCache& o) = delete;
+
+
+	/** get the encrypted path for the given plaintext one. false if not cached */
+	bool get(const std::string& plain, std::string& enc) const {
+		Shard& s = getShard(plain);
+		std::lock_guard<std::mutex> lock(s.mtx);
+		auto it = s.map.find(plain);
+		if (it == s.map.end()) {return false;}
+		enc = it->second;
+		return true;
+	}
+
+	/** get the encrypted path for the given plaintext one and append it to the buffer. false if not cached. no heap allocations */
+	bool get(const char* plain, const size_t len, PathBuffer& enc) const {
+		const std::string& key = getKey(plain, len);
+		Shard& s = getShard(key);
+		std::lock_guard<std::mutex> lock(s.mtx);
+		auto it = s.map.find(key);
+		if (it == s.map.end()) {return false;}
+		enc.append(it->second);
+		return true;
+	}
+
+	/** store the encrypted path for the given plaintext one */
+	void put(const std::string& plain, const std::string& enc) {
+		const size_t bytes = getCost(plain, enc);
+		if (bytes > maxShardBytes) {return;}
+		Shard& s = getShard(plain);
+		std::lock_guard<std::mutex> lock(s.mtx);
+		if (s.bytes + bytes > maxShardBytes) {s.map.clear(); s.bytes = 0;}
+		if (s.map.emplace(plain, enc).second) {s.bytes += bytes;}
+	}
+
+	/** store the encrypted path for the given plaintext one */
+	void put(const char* plain, const size_t plainLen, const char* enc, const size_t encLen) {
+		put(std::string(plain, plainLen), std::string(enc, encLen));
+	}
+
+	/** remove the given path and all paths below (e.g. after renaming or deleting a folder) */
+	void invalidate(const std::string& plain) {
+		for (Shard& s : shards) {
+			std::lock_guard<std::mutex> lock(s.mtx);
+			for (auto it = s.map.begin(); it != s.map.end(); ) {
+				if (isBelow(it->first, plain)) {
+					s.bytes -= getCost(it->first, it->second);
+					it = s.map.erase(it);
+				} else {
+					++it;
+				}
+			}
+		}
+	}
+
+	/** remove all entries */
+	void clear() {
+		for (Shard& s : shards) {
+			std::lock_guard<std::mutex> lock(s.mtx);
+			s.map.clear();
+			s.bytes = 0;
+		}
+	}
+
+	/** number of cached paths */
+	size_t size() const {
+		size_t res = 0;
+		for (Shard& s : shards) {
+			std::lock_guard<std::mutex> lock(s.mtx);
+			res += s.map.size();
+		}
+		return res;
+	}
+
+	/** memory used by all cached paths (approximately, bytes) */
+	size_t getBytes() const {
+		size_t res = 0;
+		for (Shard& s : shards) {
+			std::lock_guard<std::mutex> lock(s.mtx);
+			res += s.bytes;
+		}
+		return res;
+	}
+
+	/** is 'path' the given prefix or located below it? */
+	static bool isBelow(const std::string& path, const std::string& prefix) {
+		if (path.compare(0, prefix.length(), prefix) != 0) {return false;}
+		return path.length() == prefix.length() || path[prefix.length()] == '/' || prefix == "/";
+	}
+
+private:
+
+	/** the given path as lookup-key. uses a per-thread string, which keeps its capacity between calls */
+	static const std::string& getKey(const char* plain, const size_t len) {
+		static thread_local std::string key;
+		key.assign(plain, len);
+		return key;
+	}
+
+	/** the shard for the given path */
+	Shard& getShard(const std::string& plain) const {
+		return shards[std::hash<std::string>()(plain) % Settings::PATH_CACHE_SHARDS];
+	}
+
+	/** approximate memory used by one entry (strings and hash-node) */
+	static size_t getCost(const std::string& plain, const std::string& enc) {
+		return plain.length() + enc.length() + 96;
+	}
+
+};
+
+#endif // PATH_CACHE_H
@@ -13,8 +13,43 @@ public:
 	/** set-up the IV-generator */
 	virtual void setup(const uint8_t* setup, const uint32_t setupLen) = 0;
 
-	/** generate a new IV for the given file-offset into the provided buffer */
-	virtual void getIV(const size_t pos, uint8_t* iv, const uint32_t ivLen) = 0;
+	/**
+	 * salt all following IVs with the given per-file nonce (from the container's header).
+	 * the per-file seed is derived only once, here. an all-zero nonce denotes
+	 * a legacy container, using the IVs derived from the key only
+	 */
+	virtual void setFileNonce(const uint8_t* nonce, const uint32_t nonceLen) = 0;
+
+	/** is the given nonce all-zero? (legacy container) */
+	static bool isLegacyNonce(const uint8_t* nonce, const uint32_t nonceLen) {
+		for (uint32_t i = 0; i < nonceLen; ++i) {if (nonce[i]) {return false;}}
+		return true;
+	}
+
+	/**
+	 * generate a new IV for the given file-offset into the provided buffer.
+	 * const: once set-up, any number of threads may derive IVs concurrently
+	 */
+	virtual void getIV(const size_t pos, uint8_t* iv, const uint32_t ivLen) const = 0;
+
+	/**
+	 * generate the IVs for 'count' consecutive blocks, starting at file-offset 'pos',
+	 * each 'stride' bytes apart. 'ivs' receives count*ivLen bytes.
+	 * generators may override this to process all blocks at once
+	 */
+	virtual void getIVs(const size_t pos, const uint32_t stride, const uint32_t count, uint8_t* ivs, const uint32_t ivLen) const {
+		for (uint32_t i = 0; i < count; ++i) {
+			getIV(pos + (size_t)i*stride, ivs + i*ivLen, ivLen);
+		}
+	}
+
+	/**
+	 * derive the IVs of 'count' blocks up front, if the generator caches them (after setFileNonce()).
+	 * all others ignore this
+	 */
+	virtual void prefill(const size_t pos, const uint32_t stride, const uint32_t count) const {
+		(void) pos; (void) stride; (void) count;
+	}
 
 };
 
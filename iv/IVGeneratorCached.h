@@ -0,0 +1,238 @@
+#ifndef IV_GEN_CACHED_H
+#define IV_GEN_CACHED_H
+
+#include "../Exception.h"
+#include "../Stats.h"
+#include "IVGenerator.h"
+
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <cstring>
+#include <algorithm>
+
+namespace Settings {
+
+	/** the IV-cache stores IVs up to this length */
+	const constexpr int IV_CACHE_IV_LEN = 16;
+
+	/** maximum number of blocks to derive up front when opening a file (all of a small file), when the IV-cache is enabled */
+	const constexpr int IV_CACHE_PREFILL = 256;
+
+}
+
+/**
+ * direct-mapped table of IVs, keyed by the file's domain and the block's file-offset.
+ * the domain is the file's 128 bit nonce (all-zero for legacy containers). IVs depend only
+ * on key, nonce and offset, thus one table may be shared by all generators using the same key,
+ * from any number of threads:
+ * every entry is guarded by a sequence counter. readers never block,
+ * a concurrently modified entry is just treated as a miss
+ */
+class IVCacheTable {
+
+private:
+
+	struct Entry {
+		std::atomic<uint64_t> seq;		// odd while being written
+		std::atomic<uint64_t> domain[2];	// the file's domain
+		std::atomic<uint64_t> pos;		// offset + 1 (0 = empty)
+		std::atomic<uint64_t> iv[2];
+	};
+
+	/** all entries. the number is a power of two */
+	std::unique_ptr<Entry[]> entries;
+
+	/** index-mask */
+	const uint64_t mask;
+
+public:
+
+	/** ctor with the (minimum) number of entries */
+	IVCacheTable(const uint32_t numEntries) : mask(roundUp(numEntries) - 1) {
+		entries.reset(new Entry[mask+1]);
+		for (uint64_t i = 0; i <= mask; ++i) {
+			entries[i].seq = 0;
+			entries[i].domain[0] = 0;
+			entries[i].domain[1] = 0;
+			entries[i].pos = 0;
+			entries[i].iv[0] = 0;
+			entries[i].iv[1] = 0;
+		}
+	}
+
+	/** get the number of entries */
+	uint64_t size() const {
+		return mask + 1;
+	}
+
+	/** get the IV (IV_CACHE_IV_LEN bytes) for the given domain and offset. false if not cached */
+	bool get(const uint64_t* domain, const size_t pos, uint8_t* iv) const {
+		const Entry& e = entries[index(domain, pos)];
+		const uint64_t seq1 = e.seq.load(std::memory_order_acquire);
+		if (seq1 & 1) {return false;}
+		if (e.pos.load(std::memory_order_relaxed) != pos+1) {return false;}
+		if (e.domain[0].load(std::memory_order_relaxed) != domain[0]) {return false;}
+		if (e.domain[1].load(std::memory_order_relaxed) != domain[1]) {return false;}
+		const uint64_t iv0 = e.iv[0].load(std::memory_order_relaxed);
+		const uint64_t iv1 = e.iv[1].load(std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_acquire);
+		if (e.seq.load(std::memory_order_relaxed) != seq1) {return false;}
+		memcpy(iv+0, &iv0, 8);
+		memcpy(iv+8, &iv1, 8);
+		return true;
+	}
+
+	/** store the IV (IV_CACHE_IV_LEN bytes) for the given domain and offset. skipped if another thread is writing the same entry */
+	void put(const uint64_t* domain, const size_t pos, const uint8_t* iv) {
+		Entry& e = entries[index(domain, pos)];
+		uint64_t seq = e.seq.load(std::memory_order_relaxed);
+		if (seq & 1) {return;}
+		if (!e.seq.compare_exchange_strong(seq, seq+1, std::memory_order_acquire)) {return;}
+		uint64_t iv0, iv1;
+		memcpy(&iv0, iv+0, 8);
+		memcpy(&iv1, iv+8, 8);
+		e.domain[0].store(domain[0], std::memory_order_relaxed);
+		e.domain[1].store(domain[1], std::memory_order_relaxed);
+		e.pos.store(pos+1, std::memory_order_relaxed);
+		e.iv[0].store(iv0, std::memory_order_relaxed);
+		e.iv[1].store(iv1, std::memory_order_relaxed);
+		e.seq.store(seq+2, std::memory_order_release);
+	}
+
+private:
+
+	/** spread the (block-aligned) offsets of all files over all entries */
+	uint64_t index(const uint64_t* domain, const size_t pos) const {
+		return (((uint64_t)pos ^ domain[0] ^ domain[1]) * 0x9E3779B97F4A7C15ull >> 20) & mask;
+	}
+
+	/** next power of two */
+	static uint64_t roundUp(const uint32_t num) {
+		uint64_t res = 1;
+		while (res < num) {res <<= 1;}
+		return res;
+	}
+
+};
+
+/**
+ * decorator caching the IVs of another generator within an IVCacheTable.
+ * rewriting the same blocks (databases, VM images) does not need to
+ * derive their IVs again.
+ */
+class IVGeneratorCached : public IVGenerator {
+
+private:
+
+	/** the generator deriving the IVs */
+	std::shared_ptr<IVGenerator> gen;
+
+	/** the (shared) table */
+	std::shared_ptr<IVCacheTable> table;
+
+	/** the current file's domain within the table: its nonce (all-zero: legacy, without nonce) */
+	uint64_t domain[2];
+
+public:
+
+	/** ctor with the (already set-up) generator to cache */
+	IVGeneratorCached(const std::shared_ptr<IVGenerator>& gen, const std::shared_ptr<IVCacheTable>& table) : gen(gen), table(table), domain{0, 0} {
+		;
+	}
+
+	/** no copy */
+	IVGeneratorCached(const IVGeneratorCached& c) = delete;
+
+	/** no assign */
+	void operator = (const IVGeneratorCached& c) = delete;
+
+
+	/** set-up the underlying generator. NOTE: the table must not contain IVs of another key */
+	void setup(const uint8_t* setup, const uint32_t setupLen) override {
+		gen->setup(setup, setupLen);
+	}
+
+	/** forward the nonce and switch to the file's domain */
+	void setFileNonce(const uint8_t* nonce, const uint32_t nonceLen) override {
+		if (nonceLen > sizeof(domain)) {throw Exception("nonce-length must be max 16 byte");}
+		gen->setFileNonce(nonce, nonceLen);
+		domain[0] = 0;
+		domain[1] = 0;
+		memcpy(domain, nonce, nonceLen);
+	}
+
+	/** get the IV from the table, or derive (and cache) it */
+	void getIV(const size_t pos, uint8_t* iv, const uint32_t ivLen) const override {
+
+		if (ivLen > Settings::IV_CACHE_IV_LEN) {gen->getIV(pos, iv, ivLen); return;}
+
+		uint8_t tmp[Settings::IV_CACHE_IV_LEN];
+		if (table->get(domain, pos, tmp)) {
+			++Stats::get().ivCacheHits;
+		} else {
+			++Stats::get().ivCacheMisses;
+			gen->getIV(pos, tmp, sizeof(tmp));
+			table->put(domain, pos, tmp);
+		}
+		memcpy(iv, tmp, ivLen);
+
+	}
+
+	/** get all IVs from the table. if any of them is missing, derive the whole batch at once */
+	void getIVs(const size_t pos, const uint32_t stride, const uint32_t count, uint8_t* ivs, const uint32_t ivLen) const override {
+
+		if (ivLen > Settings::IV_CACHE_IV_LEN) {gen->getIVs(pos, stride, count, ivs, ivLen); return;}
+
+		const uint32_t batch = 64;
+		uint8_t tmp[batch * Settings::IV_CACHE_IV_LEN];
+
+		for (uint32_t done = 0; done < count; done += batch) {
+
+			const uint32_t cnt = std::min(count - done, batch);
+			const size_t start = pos + (size_t)done * stride;
+
+			uint32_t hits = 0;
+			for (uint32_t i = 0; i < cnt; ++i) {
+				if (!table->get(domain, start + (size_t)i*stride, &tmp[i*Settings::IV_CACHE_IV_LEN])) {break;}
+				++hits;
+			}
+
+			if (hits == cnt) {
+				Stats::get().ivCacheHits += cnt;
+			} else {
+				Stats::get().ivCacheHits += hits;
+				Stats::get().ivCacheMisses += cnt - hits;
+				gen->getIVs(start + (size_t)hits*stride, stride, cnt - hits, &tmp[hits*Settings::IV_CACHE_IV_LEN], Settings::IV_CACHE_IV_LEN);
+				for (uint32_t i = hits; i < cnt; ++i) {
+					table->put(domain, start + (size_t)i*stride, &tmp[i*Settings::IV_CACHE_IV_LEN]);
+				}
+			}
+
+			for (uint32_t i = 0; i < cnt; ++i) {
+				memcpy(&ivs[(done+i)*ivLen], &tmp[i*Settings::IV_CACHE_IV_LEN], ivLen);
+			}
+
+		}
+
+	}
+
+	/** derive and store the IVs for the given blocks (at most IV_CACHE_PREFILL) of the current file up front, using batched calls */
+	void prefill(const size_t pos, const uint32_t stride, const uint32_t maxCount) const override {
+		const uint32_t count = (uint32_t) std::min((uint64_t) std::min(maxCount, (uint32_t) Settings::IV_CACHE_PREFILL), table->size());
+		const uint32_t batch = 64;
+		uint8_t tmp[batch * Settings::IV_CACHE_IV_LEN];
+		for (uint32_t done = 0; done < count; done += batch) {
+			const uint32_t cnt = std::min(count - done, batch);
+			const size_t start = pos + (size_t)done * stride;
+			if (table->get(domain, start, tmp) && table->get(domain, start + (size_t)(cnt-1)*stride, tmp)) {continue;}
+			gen->getIVs(start, stride, cnt, tmp, Settings::IV_CACHE_IV_LEN);
+			for (uint32_t i = 0; i < cnt; ++i) {
+				table->put(domain, start + (size_t)i*stride, &tmp[i*Settings::IV_CACHE_IV_LEN]);
+			}
+		}
+	}
+
+};
+
+#endif // IV_GEN_CACHED_H
@@ -7,20 +7,27 @@
 #include "IVGenerator.h"
 
 #include <memory>
+#include <cstring>
+#include <algorithm>
 
 /**
  * create initialization-vectors (IVs)
  * based on the SHA256 of the user's key
  * and the the requested sector:
- *		IV = SHA(SHA(key)+offset)
+ *		IV = SHA(seed+offset)
+ * where the seed is SHA(key) for legacy containers,
+ * or SHA(SHA(key)+nonce) for containers with a per-file nonce.
+ * the digest absorbs the seed once (setPrefix) and every IV continues
+ * from that state. getIV()/getIVs() are const and keep all scratch
+ * space on the caller's stack: THREAD SAFE after setup()/setFileNonce()
  */
 class IVGeneratorDefault : public IVGenerator {
 
 private:
 		
-	/** setup hash. max 64 bytes (a little room after the hash) */
-	uint8_t setupHash[64];
-	
+	/** hash of the user's key. max 64 bytes */
+	uint8_t keyHash[64];
+
 	/** the digest to use */
 	std::shared_ptr<Digest> digest;
 
@@ -49,34 +56,62 @@ public:
 
 		if (setupLen > 32) {throw Exception("setup-length must be max 32 byte");}
 
-		// hash the secret key (once)
-		digest->hash(setup, setupLen, setupHash);
+		// hash the secret key (once) and use it as seed until a nonce is given
+		digest->hash(setup, setupLen, keyHash);
+		digest->setPrefix(keyHash, digest->getSize());
+
+	}
+
+	/** derive the file's seed from the key's hash and the file's nonce (once per file) */
+	void setFileNonce(const uint8_t* nonce, const uint32_t nonceLen) override {
+
+		const uint32_t size = digest->getSize();
+		if (isLegacyNonce(nonce, nonceLen)) {digest->setPrefix(keyHash, size); return;}
+		if (nonceLen > 64) {throw Exception("nonce-length must be max 64 byte");}
+
+		uint8_t tmp[64 + 64];
+		uint8_t seed[64];
+		memcpy(tmp, keyHash, size);
+		memcpy(tmp + size, nonce, nonceLen);
+		digest->hash(tmp, size + nonceLen, seed);
+		digest->setPrefix(seed, size);
+		memset(seed, 0, sizeof(seed));
 
 	}
 	
-	/** NOT THREAD SAFE! generate a new IV for the given file-offset */
-	void getIV(const size_t pos, uint8_t* iv, const uint32_t ivLen) override {
-		
-		//if (ivLen != 16) {throw Exception("only 128Bit IV supported");}
-		
-		// temporal store
+	/** THREAD SAFE: generate a new IV for the given file-offset */
+	void getIV(const size_t pos, uint8_t* iv, const uint32_t ivLen) const override {
+
+		// hash of the seed (already absorbed) and the offset: SHA(seed+offset)
 		uint8_t tmpIV[64];
+		digest->hashPrefixed((const uint8_t*)&pos, sizeof(pos), tmpIV);
 
-		// quite hacky: we append the 8-byte position after the end of the user-key (unused space)
-		// definitely NOT thread-safe.. but the hash itself isnt thread-safe either..
-		// hash of the password hash and the offset: SHA(SHA(key)+offset)
-		const uint32_t size = digest->getSize();
-		memcpy(&setupHash[size], &pos, sizeof(pos));
-		digest->hash(setupHash, size+sizeof(pos), tmpIV);
-		
-		// hash of the password hash and the offset: SHA(SHA(key)+offset)
-		//sha.append(setupHash, size, false);
-		//sha.append((uint8_t*)&pos, sizeof(size_t), true);
-		//sha.get(tmpIV);
-		
 		// use only some parts of the 256Bit hash
-		memcpy(iv, tmpIV, std::min(ivLen, size));
-		
+		memcpy(iv, tmpIV, std::min(ivLen, digest->getSize()));
+
+	}
+
+	/** THREAD SAFE: generate the IVs for several blocks using one batched digest call */
+	void getIVs(const size_t pos, const uint32_t stride, const uint32_t count, uint8_t* ivs, const uint32_t ivLen) const override {
+
+		const uint32_t size = digest->getSize();
+		const uint32_t batch = 64;
+
+		// all offsets back-to-back (the seed is the digest's prefix)
+		size_t in[batch];
+		uint8_t out[batch * 64];
+
+		for (uint32_t done = 0; done < count; done += batch) {
+			const uint32_t cnt = std::min(count - done, batch);
+			for (uint32_t i = 0; i < cnt; ++i) {
+				in[i] = pos + (size_t)(done+i) * stride;
+			}
+			digest->hashManyPrefixed((const uint8_t*)in, sizeof(size_t), cnt, out);
+			for (uint32_t i = 0; i < cnt; ++i) {
+				memcpy(&ivs[(done+i)*ivLen], &out[i*size], std::min(ivLen, size));
+			}
+		}
+
 	}
 	
 };
@@ -0,0 +1,126 @@
+#ifndef IV_GEN_ESSIV_H
+#define IV_GEN_ESSIV_H
+
+#include "../digest/Digest.h"
+#include "../cipher/Cipher.h"
+#include "../Exception.h"
+#include "IVGenerator.h"
+
+#include <memory>
+#include <mutex>
+#include <cstring>
+#include <algorithm>
+
+/**
+ * create initialization-vectors (IVs) "encrypted salt-sector IV" style:
+ * the (block-)offset is encrypted using AES with a key derived from the user's key:
+ *		salt = SHA256(key)							legacy containers
+ *		salt = SHA256(SHA256(key)+nonce)			containers with a per-file nonce
+ *		IV = AES-256_salt(offset)
+ * this is one AES block per IV instead of one hash per IV and benefits from AES-NI.
+ * NOT compatible with IVGeneratorDefault (different IVs for existing files).
+ * the cipher's context is not reentrant, concurrent callers are serialized
+ */
+class IVGeneratorESSIV : public IVGenerator {
+
+private:
+
+	/** the digest to derive the AES-key from the user's key */
+	std::shared_ptr<Digest> digest;
+
+	/** single-block cipher (ECB) to encrypt the offsets with */
+	std::shared_ptr<Cipher> cipher;
+
+	/** hash of the user's key */
+	uint8_t keyHash[64];
+
+	/** guards the cipher's context */
+	mutable std::mutex mtx;
+
+public:
+
+	/** ctor with the digest (32 bytes output) and the ECB cipher (256 bit key) to use */
+	IVGeneratorESSIV(const std::shared_ptr<Digest>& digest, const std::shared_ptr<Cipher>& cipher) : digest(digest), cipher(cipher) {
+		if (digest->getSize() != cipher->getKeyLength()) {throw Exception("digest size must match the cipher's key length");}
+		if (cipher->getIVLength() != 0) {throw Exception("ESSIV needs a single-block cipher without IV");}
+	}
+
+	/** no copy */
+	IVGeneratorESSIV(const IVGeneratorESSIV& c) = delete;
+
+	/** no assign */
+	void operator = (const IVGeneratorESSIV& c) = delete;
+
+
+	/** initialize the generator (once) */
+	void setup(const uint8_t* setup, const uint32_t setupLen) override {
+
+		if (setupLen > 32) {throw Exception("setup-length must be max 32 byte");}
+
+		// the salt (hash of the secret key) is the key for all IVs
+		digest->hash(setup, setupLen, keyHash);
+		cipher->setKey(keyHash, cipher->getKeyLength());
+
+	}
+
+	/** derive the file's salt from the key's hash and the file's nonce (once per file) */
+	void setFileNonce(const uint8_t* nonce, const uint32_t nonceLen) override {
+
+		if (isLegacyNonce(nonce, nonceLen)) {cipher->setKey(keyHash, cipher->getKeyLength()); return;}
+		if (nonceLen > 64) {throw Exception("nonce-length must be max 64 byte");}
+
+		const uint32_t size = digest->getSize();
+		uint8_t tmp[64 + 64];
+		uint8_t salt[64];
+		memcpy(tmp, keyHash, size);
+		memcpy(tmp + size, nonce, nonceLen);
+		digest->hash(tmp, size + nonceLen, salt);
+		cipher->setKey(salt, cipher->getKeyLength());
+		memset(salt, 0, sizeof(salt));
+
+	}
+
+	/** THREAD SAFE: generate a new IV for the given file-offset */
+	void getIV(const size_t pos, uint8_t* iv, const uint32_t ivLen) const override {
+
+		// one AES block: the offset, zero-padded
+		uint8_t in[16] = {0};
+		uint8_t out[16];
+		memcpy(in, &pos, sizeof(pos));
+		{
+			std::lock_guard<std::mutex> lock(mtx);
+			cipher->encrypt(in, out, sizeof(in), nullptr, 0);
+		}
+
+		memcpy(iv, out, std::min(ivLen, (uint32_t)sizeof(out)));
+
+	}
+
+	/** THREAD SAFE: generate the IVs for several blocks: all offsets within one ECB call (pipelined AES) */
+	void getIVs(const size_t pos, const uint32_t stride, const uint32_t count, uint8_t* ivs, const uint32_t ivLen) const override {
+
+		const uint32_t batch = 64;
+		uint8_t in[batch * 16];
+		uint8_t out[batch * 16];
+
+		for (uint32_t done = 0; done < count; done += batch) {
+			const uint32_t cnt = std::min(count - done, batch);
+			memset(in, 0, cnt * 16);
+			for (uint32_t i = 0; i < cnt; ++i) {
+				const size_t p = pos + (size_t)(done+i) * stride;
+				memcpy(&in[i*16], &p, sizeof(p));
+			}
+			{
+				std::lock_guard<std::mutex> lock(mtx);
+				cipher->encrypt(in, out, cnt * 16, nullptr, 0);
+			}
+			for (uint32_t i = 0; i < cnt; ++i) {
+				memcpy(&ivs[(done+i)*ivLen], &out[i*16], std::min(ivLen, (uint32_t)16));
+			}
+		}
+
+	}
+
+};
+
+#endif // IV_GEN_ESSIV_H
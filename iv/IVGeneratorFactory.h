@@ -4,6 +4,9 @@
 #include <string>
 #include "IVGenerator.h"
 #include "IVGeneratorDefault.h"
+#include "IVGeneratorESSIV.h"
+#include "IVGeneratorHMAC.h"
+#include "../cipher/CipherFactory.h"
 
 #include "../Factory.h"
 
@@ -19,6 +22,22 @@ public:
 //		else if	("sha512" == name)	{IVGenerator* gen = new IVGeneratorDefault("sha512");	gen->setup(setup, setupLen); return gen;}
 //		else if	("md5" == name)		{IVGenerator* gen = new IVGeneratorDefault("md5");		gen->setup(setup, setupLen); return gen;}
 
+		if ("essiv_sha256" == name) {
+			std::shared_ptr<Digest> digest(DigestFactory::getByName("sha256"));
+			std::shared_ptr<Cipher> cipher(CipherFactory::getByName("aes_ecb_256"));
+			IVGenerator* gen = new IVGeneratorESSIV(digest, cipher);
+			gen->setup(setup, setupLen);
+			return gen;
+		}
+
+		if ("hmac_sha256" == name) {
+			std::shared_ptr<Digest> digest(DigestFactory::getByName("sha256"));
+			std::shared_ptr<Digest> hmac(DigestFactory::getByName("hmac_sha256"));
+			IVGenerator* gen = new IVGeneratorHMAC(digest, hmac);
+			gen->setup(setup, setupLen);
+			return gen;
+		}
+
 		Digest* digest = DigestFactory::getByName(name);
 		IVGenerator* gen = new IVGeneratorDefault(std::shared_ptr<Digest>(digest));
 		gen->setup(setup, setupLen);
@@ -28,9 +47,28 @@ public:
 
 	}
 
-	/** supported is everything available from the DigestFactory */
+	/** map a backend-independent name onto the fastest backend available on this machine */
+	static std::string resolve(const std::string& name) {
+		if ("essiv_sha256" == name) {return "essiv_sha256 (" + DigestFactory::resolve("sha256") + ", " + CipherFactory::resolve("aes_ecb_256") + ")";}
+		if ("hmac_sha256" == name) {return "hmac_sha256 (" + DigestFactory::resolve("sha256") + ", " + DigestFactory::resolve("hmac_sha256") + ")";}
+		return DigestFactory::resolve(name);
+	}
+
+	/**
+	 * the name to create generators by without resolving it again: plain digests are mapped onto their backend.
+	 * ESSIV and HMAC keep their name, their digests and ciphers are resolved when created (cached)
+	 */
+	static std::string getBackend(const std::string& name) {
+		if ("essiv_sha256" == name || "hmac_sha256" == name) {return name;}
+		return DigestFactory::resolve(name);
+	}
+
+	/** supported is everything available from the DigestFactory plus ESSIV and HMAC */
 	static std::vector<std::string> getSupported() {
-		return DigestFactory::getSupported();
+		std::vector<std::string> res = DigestFactory::getSupported();
+		if (!CipherFactory::getInternal().empty()) {res.push_back("essiv_sha256");}
+		if (!DigestFactory::getKeyed().empty()) {res.push_back("hmac_sha256");}
+		return res;
 	}
 
 };
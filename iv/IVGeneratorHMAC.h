@@ -0,0 +1,104 @@
+#ifndef IV_GEN_HMAC_H
+#define IV_GEN_HMAC_H
+
+#include "../digest/Digest.h"
+#include "../Exception.h"
+#include "IVGenerator.h"
+
+#include <memory>
+#include <cstring>
+#include <algorithm>
+
+/**
+ * create initialization-vectors (IVs) using a keyed hash of the (block-)offset:
+ *		key = SHA256(key)							legacy containers
+ *		key = SHA256(SHA256(key)+nonce)				containers with a per-file nonce
+ *		IV = HMAC-SHA256_key(offset)
+ * the key is set only once per file and stays within the backend
+ * (the kernel keeps it via ALG_SET_KEY), thus every IV just sends the 8 byte offset.
+ * NOT compatible with IVGeneratorDefault (different IVs for existing files)
+ */
+class IVGeneratorHMAC : public IVGenerator {
+
+private:
+
+	/** the digest to derive the HMAC-key from the user's key */
+	std::shared_ptr<Digest> digest;
+
+	/** the keyed digest to hash the offsets with */
+	std::shared_ptr<Digest> hmac;
+
+	/** hash of the user's key */
+	uint8_t keyHash[64];
+
+public:
+
+	/** ctor with the digest and the keyed digest (HMAC) to use */
+	IVGeneratorHMAC(const std::shared_ptr<Digest>& digest, const std::shared_ptr<Digest>& hmac) : digest(digest), hmac(hmac) {
+		;
+	}
+
+	/** no copy */
+	IVGeneratorHMAC(const IVGeneratorHMAC& c) = delete;
+
+	/** no assign */
+	void operator = (const IVGeneratorHMAC& c) = delete;
+
+
+	/** initialize the generator (once) */
+	void setup(const uint8_t* setup, const uint32_t setupLen) override {
+
+		if (setupLen > 32) {throw Exception("setup-length must be max 32 byte");}
+
+		// the hash of the secret key is the HMAC-key until a nonce is given
+		digest->hash(setup, setupLen, keyHash);
+		hmac->setKey(keyHash, digest->getSize());
+
+	}
+
+	/** derive the file's HMAC-key from the key's hash and the file's nonce (once per file) */
+	void setFileNonce(const uint8_t* nonce, const uint32_t nonceLen) override {
+
+		const uint32_t size = digest->getSize();
+		if (isLegacyNonce(nonce, nonceLen)) {hmac->setKey(keyHash, size); return;}
+		if (nonceLen > 64) {throw Exception("nonce-length must be max 64 byte");}
+
+		uint8_t tmp[64 + 64];
+		uint8_t key[64];
+		memcpy(tmp, keyHash, size);
+		memcpy(tmp + size, nonce, nonceLen);
+		digest->hash(tmp, size + nonceLen, key);
+		hmac->setKey(key, size);
+		memset(key, 0, sizeof(key));
+
+	}
+
+	/** THREAD SAFE: generate a new IV for the given file-offset */
+	void getIV(const size_t pos, uint8_t* iv, const uint32_t ivLen) const override {
+		uint8_t tmp[64];
+		hmac->hashPrefixed((const uint8_t*)&pos, sizeof(pos), tmp);
+		memcpy(iv, tmp, std::min(ivLen, hmac->getSize()));
+	}
+
+	/** THREAD SAFE: generate the IVs for several blocks using one batched call */
+	void getIVs(const size_t pos, const uint32_t stride, const uint32_t count, uint8_t* ivs, const uint32_t ivLen) const override {
+
+		const uint32_t size = hmac->getSize();
+		const uint32_t batch = 64;
+		size_t in[batch];
+		uint8_t out[batch * 64];
+
+		for (uint32_t done = 0; done < count; done += batch) {
+			const uint32_t cnt = std::min(count - done, batch);
+			for (uint32_t i = 0; i < cnt; ++i) {in[i] = pos + (size_t)(done+i) * stride;}
+			hmac->hashManyPrefixed((const uint8_t*)in, sizeof(size_t), cnt, out);
+			for (uint32_t i = 0; i < cnt; ++i) {
+				memcpy(&ivs[(done+i)*ivLen], &out[i*size], std::min(ivLen, size));
+			}
+		}
+
+	}
+
+};
+
+#endif // IV_GEN_HMAC_H
@@ -32,17 +32,127 @@ void showUsage() {
 	std::cout << "\tjust run all test-cases and exit" << std::endl;
 	std::cout << std::endl;
 
+	std::cout << "kCryptFS -init [algorithms] [--block-size=bytes] [--unlock-time=ms] /path/encrypted" << std::endl;
+	std::cout << "\tcreate a new volume within the (empty) encrypted folder: random keys protected by one password." << std::endl;
+	std::cout << "\tthe algorithms are stored, the key-derivation is calibrated to unlock within the given time (default " << Settings::KDF_UNLOCK_MS << " ms)" << std::endl;
+	std::cout << std::endl;
+
+	std::cout << "kCryptFS -passwd /path/encrypted" << std::endl;
+	std::cout << "\tchange the password of a volume created using -init" << std::endl;
+	std::cout << std::endl;
+
+	std::cout << "kCryptFS -calibrate --key-derivation=argon2id [--unlock-time=ms] /path/encrypted" << std::endl;
+	std::cout << "\tlegacy volumes (two passwords, without -init): tune the key-derivation's cost to unlock within the given time" << std::endl;
+	std::cout << "\tand store the parameters within the (new and empty) encrypted folder" << std::endl;
+	std::cout << std::endl;
+
 	std::cout << "kCryptFS [options] /path/encrypted /path/decrypted" << std::endl;
 	std::cout << "\t-foreground    run in foreground" << std::endl;
 	std::cout << "\t-log           enable logging to std::out" << std::endl;
 	std::cout << "\t-allow-other   allow access to other users as well" << std::endl;
 	std::cout << "\t-uid username  run under a different user" << std::endl;
+	std::cout << "\t--block-size=bytes  block-size for newly created files (4096 - 65536, default 4096)" << std::endl;
+	std::cout << "\t--iv-cache=entries  cache the IVs of up to this many blocks (default 0: disabled)" << std::endl;
+	std::cout << "\t--dir-cache=bytes   memory limit for caching decrypted directory listings (default " << Settings::DIR_CACHE_BYTES << ", 0: disabled)" << std::endl;
+	std::cout << "\t--path-cache=bytes  memory limit for caching encrypted paths (default " << Settings::PATH_CACHE_BYTES << ", 0: disabled)" << std::endl;
+	std::cout << "\t--size-cache=entries  cache the decrypted sizes of up to this many files (default " << Settings::SIZE_CACHE_ENTRIES << ", 0: disabled)" << std::endl;
+	std::cout << "\t--cipher-filedata=auto, --iv-gen=auto, ...  use the default algorithm with the fastest backend on this machine" << std::endl;
+	std::cout << "\t(volumes created using -init need none of the algorithms)" << std::endl;
 	std::cout << "\t example" << std::endl;
 	std::cout << "\t-foreground --cipher-filedata=openssl_aes_cbc_256 --cipher-filename=openssl_aes_cbc_256 \\" << std::endl;
 	std::cout << "\t\t--key-derivation=openssl_pbkdf2_sha512 --iv-gen=openssl_sha256 /tmp/enc /tmp/dec" << std::endl;
 
 }
 
+/** does the given folder exist and is empty? */
+bool isEmptyFolder(const std::string& path) {
+	DIR* dp = opendir(path.c_str());
+	if (!dp) {throw Exception("encrypted folder not found: " + path);}
+	struct dirent* de;
+	bool empty = true;
+	while ((de = readdir(dp)) != nullptr) {
+		if (strcmp(de->d_name, ".") != 0 && strcmp(de->d_name, "..") != 0) {empty = false;}
+	}
+	closedir(dp);
+	return empty;
+}
+
+/** the time to unlock a volume, the key-derivation is calibrated for */
+uint32_t getUnlockTime(const CMDLine& args) {
+	return (args.hasOption("unlock-time")) ? (std::stoul(args.getOption("unlock-time"))) : (Settings::KDF_UNLOCK_MS);
+}
+
+/** create a new volume */
+int initVolume(const CMDLine& args) {
+
+	const std::string encPath = args[args.size()-1];
+	if (VolumeConfig::exists(encPath)) {throw Exception("the folder already contains a volume");}
+	if (!isEmptyFolder(encPath)) {throw Exception("new volumes can only be created within an empty folder");}
+
+	Configuration cfg(args);
+	cfg.setNameFormat(Settings::FILE_NAME_FORMAT_CURRENT);
+	cfg.setDirIVs(true);
+
+	const uint32_t ms = getUnlockTime(args);
+	std::cout << "calibrating the key-derivation for " << ms << " ms, this may take some time" << std::endl;
+	std::shared_ptr<KeyDerivation> kd = cfg.getKeyDerivation();
+	kd->calibrate(ms, Settings::KDF_DERIVATIONS_VOLUME);
+	cfg.setKeyDerivationParams(kd->getParams());
+
+	VolumeConfig volume;
+	cfg.store(volume);
+	Keys keys;
+	keys.createVolume(cfg, volume);
+	volume.save(encPath);
+	FilePath::writeDirIV(encPath);
+
+	std::cout << "volume created within " << encPath << std::endl;
+	return 0;
+
+}
+
+/** change the password of a volume */
+int changePassword(const CMDLine& args) {
+
+	const std::string encPath = args[args.size()-1];
+	if (!VolumeConfig::exists(encPath)) {throw Exception("no volume config found. legacy volumes derive their keys from the passwords directly");}
+
+	VolumeConfig volume = VolumeConfig::load(encPath);
+	Configuration cfg(args, volume);
+	Keys keys;
+	keys.changePassword(cfg, volume);
+	volume.save(encPath);
+
+	std::cout << "password changed" << std::endl;
+	return 0;
+
+}
+
+/** calibrate the key-derivation for a new legacy volume */
+int calibrate(const CMDLine& args) {
+
+	const std::string encPath = args[args.size()-1];
+	const std::string file = encPath + "/" + Settings::KDF_PARAMS_FILE;
+
+	// the keys depend on the parameters: existing files would become unreadable
+	if (!isEmptyFolder(encPath)) {throw Exception("calibration changes the keys and is only possible for an empty encrypted folder");}
+
+	const std::string name = args.getOption("key-derivation");
+	if (name.empty()) {throw Factory::onNotGiven("no --key-derivation given", KeyDerivationFactory::getSupported());}
+	const uint32_t ms = getUnlockTime(args);
+
+	std::cout << "calibrating '" << name << "' for " << ms << " ms, this may take some time" << std::endl;
+	std::unique_ptr<KeyDerivation> kd(KeyDerivationFactory::getByName(name));
+	kd->calibrate(ms, Settings::KDF_DERIVATIONS_LEGACY);
+	const KeyDerivationParams params(name, kd->getParams());
+	std::cout << "unlocking takes " << (int)kd->measureUnlock(Settings::KDF_DERIVATIONS_LEGACY) << " ms using: " << params.asString() << std::endl;
+
+	params.save(file);
+	std::cout << "stored within " << file << std::endl;
+	return 0;
+
+}
+
 /** start */
 int main(int argc, char* argv[]) {
 	    
@@ -58,6 +168,14 @@ int main(int argc, char* argv[]) {
 	// run tests?
 	if(args.hasSwitch("test")) {return runTests(0, nullptr);}
 
+	// volume management?
+	if (args.hasSwitch("init") || args.hasSwitch("passwd") || args.hasSwitch("calibrate")) {
+		if (argc < 3) {showUsage(); return -1;}
+		if (args.hasSwitch("init"))		{return initVolume(args);}
+		if (args.hasSwitch("passwd"))	{return changePassword(args);}
+		return calibrate(args);
+	}
+
 	// mount!
 
 	// sanity check
@@ -66,22 +184,31 @@ int main(int argc, char* argv[]) {
 	// enable the log?
 	if (args.hasSwitch("log")) { Log::get().setEnabled(true); }
 
+	// the encrypted folder
+	const char* absEncPath = realpath(args[args.size()-2].c_str(), nullptr);
+	if (!absEncPath) {throw Exception("mount path not found!");}
+
+	// the volume's config. none for legacy volumes
+	VolumeConfig volume;
+	if (VolumeConfig::exists(absEncPath)) {volume = VolumeConfig::load(absEncPath);}
+	addLog("main", std::string("volume config: ") + ((volume.empty()) ? ("none (legacy)") : (Settings::VOLUME_CONFIG_FILE)));
+
 	// load and show settings
-	module.cfg = Configuration(args);
+	module.cfg = Configuration(args, volume, volume.empty());
+	if (volume.empty()) {module.cfg.loadKeyDerivationParams(absEncPath);}
 	module.cfg.showSettings();
 
 	// insert passwords
-	module.keys.askForPasswords(module.cfg);
+	if (volume.empty())	{module.keys.askForPasswords(module.cfg);}
+	else				{module.keys.unlockVolume(module.cfg, volume);}
 
 	// configure the path-name encryption/decryption/translation
 	{
 		const Key k = module.keys.getFileNameKey();
 		std::shared_ptr<Cipher> cipher(module.cfg.getCipherFileNames(k.data, k.len));
-
-		const char* absEncPath = realpath(args[args.size()-2].c_str(), nullptr);
-		if (!absEncPath) {throw Exception("mount path not found!");}
-
-		module.fp = new FilePath( absEncPath, cipher ) ;
+		module.fp = new FilePath( absEncPath, cipher, module.cfg.getPathCache(), module.cfg.getNameFormat(), module.cfg.usesDirIVs() ) ;
+		module.dirCache = module.cfg.getDirCache();
+		module.sizeCache = module.cfg.getSizeCache();
 
 	}
 
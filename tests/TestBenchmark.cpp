@@ -2,6 +2,8 @@
 
 #ifdef WITH_TESTS
 
+#include <dirent.h>
+
 static constexpr int BLK_SIZE = 4096;
 
 TEST(Benchmark, IVGen) {
@@ -9,7 +11,7 @@ TEST(Benchmark, IVGen) {
 	uint8_t setup[32];
 	uint32_t setupLen = 16;
 
-	std::vector<std::string> algos = {"sha1", "sha256", "md5"};
+	std::vector<std::string> algos = {"sha1", "sha256", "md5", "essiv_sha256", "hmac_sha256"};
 
 	for (const std::string& algo : algos) {
 
@@ -27,6 +29,16 @@ TEST(Benchmark, IVGen) {
 		auto diff = std::chrono::duration<double>(end-start).count();
 		std::cout << algo << ":\t" << count / diff << " iv/sec. " << count/diff*BLK_SIZE/1024.0f/1024.f << " MB/sec" << std::endl;
 
+		// batched: the IVs for one region of 32 blocks per call
+		uint8_t ivs[32*16];
+		start = std::chrono::high_resolution_clock::now();
+		for (uint32_t i = 0; i < count; i += 32) {
+			gen->getIVs(i*BLK_SIZE, BLK_SIZE, 32, ivs, ivLen);
+		}
+		end = std::chrono::high_resolution_clock::now();
+		diff = std::chrono::duration<double>(end-start).count();
+		std::cout << algo << " (32 per call):\t" << count / diff << " iv/sec. " << count/diff*BLK_SIZE/1024.0f/1024.f << " MB/sec" << std::endl;
+
 	}
 
 }
@@ -55,16 +67,45 @@ void _testBenchmark(const std::string& name, Cipher* cipher) {
 
 }
 
+/** encrypt several blocks per call, as done by AlignedRegion */
+void _testBenchmarkBlocks(const std::string& name, Cipher* cipher, const uint32_t blkSize) {
+
+	uint8_t key[32];
+	uint32_t keyLen = cipher->getKeyLength();
+	uint32_t ivLen = cipher->getIVLength();
+
+	const uint32_t blocks = 16;
+	std::vector<uint8_t> ivs(blocks * ivLen);
+	std::vector<uint8_t> src(blocks * blkSize);
+	std::vector<uint8_t> dst(blocks * blkSize);
+
+	cipher->setKey(key, keyLen);
+
+	auto start = std::chrono::high_resolution_clock::now();
+	const uint32_t count = 1024*1024*512 / blkSize / blocks;
+	for (uint32_t i = 0; i < count; ++i) {
+		cipher->encryptBlocks(src.data(), dst.data(), blkSize, blocks, ivs.data(), ivLen);
+	}
+	auto end = std::chrono::high_resolution_clock::now();
+	auto diff = std::chrono::duration<double>(end-start).count();
+	std::cout << name << " (" << blocks << "x" << blkSize << "):\t" << count*blocks/diff*blkSize/1024.0f/1024.f << " MB/sec" << std::endl;
+
+}
+
 TEST(Benchmark, Ciphers) {
 
 #ifdef WITH_KERNEL
 	CipherCryptoAPI aes128a(CryptoAPICiphers::AES_CBC_128); _testBenchmark( "kernel_aes_cbc_128", &aes128a );
 	CipherCryptoAPI aes256a(CryptoAPICiphers::AES_CBC_256); _testBenchmark( "kernel_aes_cbc_256", &aes256a );
+	_testBenchmarkBlocks( "kernel_aes_cbc_256", &aes256a, 4096 );
+	_testBenchmarkBlocks( "kernel_aes_cbc_256", &aes256a, 64*1024 );
 #endif
 
 #ifdef WITH_OPENSSL
 	CipherOpenSSL aes128b(OpenSSLCiphers::AES_CBC_128); _testBenchmark( "openssl_aes_cbc_128", &aes128b );
 	CipherOpenSSL aes256b(OpenSSLCiphers::AES_CBC_256); _testBenchmark( "openssl_aes_cbc_256", &aes256b );
+	_testBenchmarkBlocks( "openssl_aes_cbc_256", &aes256b, 4096 );
+	_testBenchmarkBlocks( "openssl_aes_cbc_256", &aes256b, 64*1024 );
 #endif
 
 }
@@ -84,7 +125,35 @@ void _testBenchmark(const std::string& name, Digest* digest) {
 
 }
 
+/** IV-generator style hashing: 32 byte prefix plus 8 byte offset. one per call vs. 64 per call */
+void _testBenchmarkPrefixed(const std::string& name, Digest* digest) {
+
+	const uint8_t prefix[32] = {0};
+	digest->setPrefix(prefix, sizeof(prefix));
+
+	const uint32_t batch = 64;
+	uint64_t in[batch];
+	uint8_t out[batch * 64];
+	for (uint32_t i = 0; i < batch; ++i) {in[i] = i * 4096;}
+
+	const uint32_t count = 512000;
+	auto start = std::chrono::high_resolution_clock::now();
+	for (uint32_t i = 0; i < count; ++i) {
+		digest->hashPrefixed((uint8_t*)&in[i % batch], sizeof(uint64_t), out);
+	}
+	auto end = std::chrono::high_resolution_clock::now();
+	auto diff = std::chrono::duration<double>(end-start).count();
+	std::cout << name << " (prefixed): " << count / diff << " blocks/sec." << std::endl;
+
+	start = std::chrono::high_resolution_clock::now();
+	for (uint32_t i = 0; i < count; i += batch) {
+		digest->hashManyPrefixed((uint8_t*)in, sizeof(uint64_t), batch, out);
+	}
+	end = std::chrono::high_resolution_clock::now();
+	diff = std::chrono::duration<double>(end-start).count();
+	std::cout << name << " (prefixed, " << batch << " per call): " << count / diff << " blocks/sec." << std::endl;
 
+}
 
 TEST(Benchmark, Digests) {
 
@@ -92,28 +161,32 @@ TEST(Benchmark, Digests) {
 	DigestCryptoAPI md5a(CryptoAPIDigests::MD5); _testBenchmark( "kernel_md5", &md5a );
 	DigestCryptoAPI sha256a(CryptoAPIDigests::SHA256); _testBenchmark( "kernel_sha256", &sha256a );
 	DigestCryptoAPI sha512a(CryptoAPIDigests::SHA512); _testBenchmark( "kernel_sha512", &sha512a );
+	_testBenchmarkPrefixed( "kernel_sha256", &sha256a );
 #endif
 
 #ifdef WITH_OPENSSL
 	DigestOpenSSL md5b(OpenSSLDigests::MD5); _testBenchmark( "openssl_md5", &md5b );
 	DigestOpenSSL sha256b(OpenSSLDigests::SHA256); _testBenchmark( "openssl_sha256", &sha256b );
 	DigestOpenSSL sha512b(OpenSSLDigests::SHA512); _testBenchmark( "openssl_sha512", &sha512b );
+	_testBenchmarkPrefixed( "openssl_sha256", &sha256b );
 #endif
 
-}
-
-TEST(Benchmark, Container) {
-
-	uint8_t key[32];
-	uint32_t keyLen = 32;
-
-	std::shared_ptr<IVGenerator> ivGen(IVGeneratorFactory::getByName("sha256", key, keyLen));
-	std::shared_ptr<Cipher> cipher(CipherFactory::getByName("aes_cbc_256", key, keyLen));
+#ifdef WITH_NATIVE
+	DigestNative sha1c(NativeDigests::SHA1); _testBenchmark( "native_sha1", &sha1c );
+	DigestNative sha256c(NativeDigests::SHA256); _testBenchmark( "native_sha256", &sha256c );
+	DigestNative sha256d(NativeDigests::SHA256, NativeKernel::SCALAR); _testBenchmark( "native_sha256 (portable)", &sha256d );
+	_testBenchmarkPrefixed( "native_sha256", &sha256c );
+	_testBenchmarkPrefixed( "native_sha256 (portable)", &sha256d );
+#endif
 
+}
 
+void _testBenchmarkContainer(const std::string& name, std::shared_ptr<Cipher> cipher, std::shared_ptr<IVGenerator> ivGen) {
 
 	const uint8_t src[1024*64] = {};
 
+	std::cout << name << std::endl;
+
 	{
 		std::shared_ptr<MemoryContainer> fc(new MemoryContainer());
 		EncryptedContainer efc(fc, cipher, ivGen);
@@ -166,6 +239,225 @@ TEST(Benchmark, Container) {
 		std::cout << "unaligned 64k: " << 1024/diff << " MB/sec" << std::endl;
 	}
 
+	{
+		std::shared_ptr<MemoryContainer> fc(new MemoryContainer());
+		EncryptedContainer efc(fc, cipher, ivGen);
+		uint8_t dst[1024*64];
+		for (int i = 0; i < 256; ++i) {efc.write(src, 65536, i*65536);}
+		auto start = std::chrono::high_resolution_clock::now();
+		for (int i = 0; i < 1024*16; ++i) {
+			int offset = (i % 256) * 65536;
+			efc.read(dst, 65536, offset);
+		}
+		auto end = std::chrono::high_resolution_clock::now();
+		auto diff = std::chrono::duration<double>(end-start).count();
+		std::cout << "    read 64k: " << 1024/diff << " MB/sec" << std::endl;
+	}
+
+}
+
+TEST(Benchmark, Container) {
+
+	uint8_t key[32];
+	uint32_t keyLen = 32;
+
+	std::shared_ptr<IVGenerator> ivGen(IVGeneratorFactory::getByName("sha256", key, keyLen));
+	std::shared_ptr<Cipher> cipher(CipherFactory::getByName("aes_cbc_256", key, keyLen));
+	_testBenchmarkContainer("aes_cbc_256", cipher, ivGen);
+
+#ifdef WITH_OPENSSL
+	// authenticated: random nonce and tag per block
+	std::shared_ptr<Cipher> gcm(CipherFactory::getByName("openssl_aes_gcm_256", key, keyLen));
+	_testBenchmarkContainer("openssl_aes_gcm_256", gcm, ivGen);
+	std::shared_ptr<Cipher> chacha(CipherFactory::getByName("openssl_chacha20_poly1305", key, keyLen));
+	_testBenchmarkContainer("openssl_chacha20_poly1305", chacha, ivGen);
+#endif
+
+}
+
+TEST(Benchmark, ContainerBlockSizes) {
+
+	uint8_t key[32];
+	uint32_t keyLen = 32;
+
+	std::shared_ptr<IVGenerator> ivGen(IVGeneratorFactory::getByName("sha256", key, keyLen));
+	std::shared_ptr<Cipher> cipher(CipherFactory::getByName("aes_cbc_256", key, keyLen));
+
+	const int size = 1024*128;
+	uint8_t buf[size] = {};
+
+	for (const uint32_t blkSize : {4096, 8192, 16384, 32768, 65536}) {
+
+		std::shared_ptr<MemoryContainer> fc(new MemoryContainer());
+		EncryptedContainer efc(fc, cipher, ivGen, blkSize);
+
+		// sequential 128k writes
+		auto start = std::chrono::high_resolution_clock::now();
+		for (int i = 0; i < 1024*4; ++i) {
+			efc.write(buf, size, (i % 256) * size);
+		}
+		auto end = std::chrono::high_resolution_clock::now();
+		auto diff = std::chrono::duration<double>(end-start).count();
+		std::cout << blkSize << ":\t seq. write 128k: " << 512/diff << " MB/sec";
+
+		// sequential 128k reads
+		start = std::chrono::high_resolution_clock::now();
+		for (int i = 0; i < 1024*4; ++i) {
+			efc.read(buf, size, (i % 256) * size);
+		}
+		end = std::chrono::high_resolution_clock::now();
+		diff = std::chrono::duration<double>(end-start).count();
+		std::cout << "\t seq. read 128k: " << 512/diff << " MB/sec";
+
+		// random 4k writes (partial blocks for larger block-sizes)
+		start = std::chrono::high_resolution_clock::now();
+		for (int i = 0; i < 1024*16; ++i) {
+			efc.write(buf, 4096, (rand() % 8192) * 4096);
+		}
+		end = std::chrono::high_resolution_clock::now();
+		diff = std::chrono::duration<double>(end-start).count();
+		std::cout << "\t rand. write 4k: " << 64/diff << " MB/sec" << std::endl;
+
+	}
+
+}
+
+TEST(Benchmark, PathCache) {
+
+	uint8_t key[32] = {};
+	std::shared_ptr<Cipher> cipher(CipherFactory::getByName("aes_cbc_256", key, 32));
+	const std::string path = "/home/user/documents/projects/kCryptFS/src/files/FilePath.h";
+
+	for (int cached = 0; cached < 2; ++cached) {
+		FilePath fp("/", cipher, (cached) ? (std::make_shared<PathCache>(Settings::PATH_CACHE_BYTES)) : (nullptr));
+		const uint32_t count = 1024*16;
+		auto start = std::chrono::high_resolution_clock::now();
+		for (uint32_t i = 0; i < count; ++i) {
+			fp.encryptRelativeFileName(path.c_str());
+		}
+		auto end = std::chrono::high_resolution_clock::now();
+		auto diff = std::chrono::duration<double>(end-start).count();
+		std::cout << ((cached) ? ("cached") : ("uncached")) << " (depth 8):\t" << count / diff << " paths/sec" << std::endl;
+
+		// absolute path into a stack-buffer (as used by all FUSE calls)
+		PathBuffer buf;
+		start = std::chrono::high_resolution_clock::now();
+		for (uint32_t i = 0; i < count; ++i) {
+			fp.getAbsolutePathEnc(path.c_str(), buf);
+		}
+		end = std::chrono::high_resolution_clock::now();
+		diff = std::chrono::duration<double>(end-start).count();
+		std::cout << ((cached) ? ("cached") : ("uncached")) << " (depth 8, buffer):\t" << count / diff << " paths/sec" << std::endl;
+	}
+
+}
+
+/** path translation using the fixed IV vs. per-directory IVs (read once, then cached) */
+TEST(Benchmark, DirIVs) {
+
+	uint8_t key[32] = {};
+	std::shared_ptr<Cipher> cipher(CipherFactory::getByName("aes_cbc_256", key, 32));
+	const std::string root = "/tmp/kcryptfs_diriv_bench";
+	const std::string path = "/home/user/documents/projects/kCryptFS/src/files/FilePath.h";
+	mkdir(root.c_str(), 0700);
+	FilePath::writeDirIV(root);
+
+	// all folders along the path, each with its IV
+	FilePath setup(root.c_str(), cipher, nullptr, Settings::FILE_NAME_FORMAT_BASE64, true);
+	std::vector<std::string> folders;
+	for (size_t pos = path.find('/', 1); pos != std::string::npos; pos = path.find('/', pos + 1)) {
+		folders.push_back(path.substr(0, pos));
+		mkdir(setup.getAbsolutePathEnc(folders.back().c_str()).c_str(), 0700);
+		setup.createDirIV(folders.back().c_str());
+	}
+
+	for (int cached = 0; cached < 2; ++cached) {
+		for (int dirIVs = 0; dirIVs < 2; ++dirIVs) {
+			FilePath fp(root.c_str(), cipher, (cached) ? (std::make_shared<PathCache>(Settings::PATH_CACHE_BYTES)) : (nullptr), Settings::FILE_NAME_FORMAT_BASE64, dirIVs);
+			const uint32_t count = 1024*16;
+			PathBuffer buf;
+			auto start = std::chrono::high_resolution_clock::now();
+			for (uint32_t i = 0; i < count; ++i) {
+				fp.getAbsolutePathEnc(path.c_str(), buf);
+			}
+			auto end = std::chrono::high_resolution_clock::now();
+			auto diff = std::chrono::duration<double>(end-start).count();
+			std::cout << ((cached) ? ("cached") : ("uncached")) << ((dirIVs) ? (", per-directory IVs") : (", fixed IV")) << " (depth 8):\t" << count / diff << " paths/sec" << std::endl;
+		}
+	}
+
+	for (auto it = folders.rbegin(); it != folders.rend(); ++it) {
+		setup.removeDirIV(it->c_str());
+		rmdir(setup.getAbsolutePathEnc(it->c_str()).c_str());
+	}
+	unlink((root + "/" + Settings::FILE_PATH_DIR_IV).c_str());
+	rmdir(root.c_str());
+
+}
+
+/** lookups (encrypt + stat) and listings (readdir + decrypt) within one folder of 100k entries */
+static void _benchmarkNameFormat(const uint32_t format) {
+
+	const uint32_t count = 100*1000;
+	const std::string dir = "/tmp/kcryptfs_names_" + std::to_string(format);
+	mkdir(dir.c_str(), 0700);
+
+	uint8_t key[32] = {};
+	std::shared_ptr<Cipher> cipher(CipherFactory::getByName("aes_cbc_256", key, 32));
+	FilePath fp(dir.c_str(), cipher, nullptr, format);
+
+	for (uint32_t i = 0; i < count; ++i) {
+		const std::string path = "/document_" + std::to_string(i) + ".txt";
+		close(open(fp.getAbsolutePathEnc(path.c_str()).c_str(), O_CREAT | O_WRONLY, 0600));
+	}
+
+	auto start = std::chrono::high_resolution_clock::now();
+	struct stat st;
+	for (uint32_t i = 0; i < count; ++i) {
+		const std::string path = "/document_" + std::to_string(i) + ".txt";
+		if (stat(fp.getAbsolutePathEnc(path.c_str()).c_str(), &st) != 0) {throw Exception("stat failed");}
+	}
+	auto end = std::chrono::high_resolution_clock::now();
+	const double lookup = std::chrono::duration<double>(end-start).count();
+
+	start = std::chrono::high_resolution_clock::now();
+	DIR* dp = opendir(dir.c_str());
+	struct dirent* de;
+	DirListing single;
+	while ((de = readdir(dp)) != nullptr) {
+		if (de->d_name[0] == '.') {continue;}
+		single.push_back(DirEntry(de->d_name, fp.decrypt(de->d_name)));
+	}
+	const size_t listed = single.size();
+	closedir(dp);
+	end = std::chrono::high_resolution_clock::now();
+	const double listing = std::chrono::duration<double>(end-start).count();
+
+	// all names of the listing decrypted in batches (as done by readdir)
+	start = std::chrono::high_resolution_clock::now();
+	dp = opendir(dir.c_str());
+	DirListing batched;
+	while ((de = readdir(dp)) != nullptr) {batched.push_back(DirEntry(de->d_name, ""));}
+	fp.decryptEntries(dirfd(dp), batched);
+	closedir(dp);
+	end = std::chrono::high_resolution_clock::now();
+	const double listingBatched = std::chrono::duration<double>(end-start).count();
+
+	std::cout << ((format == Settings::FILE_NAME_FORMAT_BASE64) ? ("base64url") : ("legacy hex")) << " (" << listed << " entries):\t";
+	std::cout << count / lookup << " lookups/sec.\t" << listed / listing << " listed/sec.\t" << batched.size() / listingBatched << " listed/sec (batched)." << std::endl;
+
+	dp = opendir(dir.c_str());
+	while ((de = readdir(dp)) != nullptr) {
+		if (de->d_name[0] != '.') {unlinkat(dirfd(dp), de->d_name, 0);}
+	}
+	closedir(dp);
+	rmdir(dir.c_str());
+
+}
+
+TEST(Benchmark, NameFormats) {
+	_benchmarkNameFormat(Settings::FILE_NAME_FORMAT_LEGACY);
+	_benchmarkNameFormat(Settings::FILE_NAME_FORMAT_BASE64);
 }
 
 #endif
@@ -4,6 +4,10 @@
 
 #include "../cipher/CipherOpenSSL.h"
 #include "../cipher/CipherCryptoAPI.h"
+#include "../cipher/CipherFactory.h"
+
+#include <algorithm>
+#include <memory>
 
 
 void _testKeyChange(Cipher* cipher) {
@@ -75,6 +79,117 @@ void _testEnDeCrypt(Cipher* cEnc, Cipher* cDec) {
 
 }
 
+void _testBlocks(Cipher* cEnc, Cipher* cDec, const uint32_t blkSize) {
+
+	uint8_t key[32] = {13};
+	uint32_t keyLen = cEnc->getKeyLength();
+	uint32_t ivLen = cEnc->getIVLength();
+
+	// more blocks than the kernel backend keeps in flight
+	const uint32_t count = 20;
+	const uint32_t length = count * blkSize;
+	std::vector<uint8_t> src(length), enc(length), ref(length), dec(length), ivs(count * ivLen);
+	for (uint32_t i = 0; i < length; ++i) {src[i] = rand();}
+	for (uint32_t i = 0; i < count * ivLen; ++i) {ivs[i] = rand();}
+
+	cEnc->setKey(key, keyLen);
+	cDec->setKey(key, keyLen);
+
+	// batched encryption must match block-wise encryption
+	cEnc->encryptBlocks(src.data(), enc.data(), blkSize, count, ivs.data(), ivLen);
+	for (uint32_t b = 0; b < count; ++b) {
+		cEnc->encrypt(&src[b*blkSize], &ref[b*blkSize], blkSize, &ivs[b*ivLen], ivLen);
+	}
+	ASSERT_EQ(0, memcmp(ref.data(), enc.data(), length));
+
+	// batched decryption
+	cDec->decryptBlocks(enc.data(), dec.data(), blkSize, count, ivs.data(), ivLen);
+	ASSERT_EQ(0, memcmp(src.data(), dec.data(), length));
+
+}
+
+void _testMany(Cipher* cipher) {
+
+	uint8_t key[32] = {13};
+	uint8_t iv[16] = {7};
+	const uint32_t ivLen = cipher->getIVLength();
+	cipher->setKey(key, cipher->getKeyLength());
+
+	// messages of different lengths (e.g. file-names), all using the same IV
+	const std::vector<uint32_t> lengths = {96, 16, 32, 16, 256, 48, 96};
+	uint32_t total = 0;
+	for (const uint32_t len : lengths) {total += len;}
+	std::vector<uint8_t> src(total), enc(total), dec(total);
+	for (uint32_t i = 0; i < total; ++i) {src[i] = rand();}
+
+	uint32_t pos = 0;
+	for (const uint32_t len : lengths) {
+		cipher->encrypt(&src[pos], &enc[pos], len, iv, ivLen);
+		pos += len;
+	}
+
+	cipher->decryptMany(enc.data(), dec.data(), lengths.data(), lengths.size(), iv, ivLen);
+	ASSERT_EQ(0, memcmp(src.data(), dec.data(), total));
+
+	// just one message
+	cipher->decryptMany(enc.data(), dec.data(), lengths.data(), 1, iv, ivLen);
+	ASSERT_EQ(0, memcmp(src.data(), dec.data(), lengths[0]));
+
+}
+
+void _testAuth(Cipher* cipher) {
+
+	uint8_t key[32] = {13};
+	uint32_t keyLen = cipher->getKeyLength();
+
+	uint8_t nonce[12] = {7};
+	uint32_t nonceLen = cipher->getIVLength();
+
+	uint8_t tag[16];
+	ASSERT_EQ(16, cipher->getTagLength());
+
+	uint32_t length = 4096;
+	uint8_t src[length], enc[length], dec[length];
+	for (uint32_t i = 0; i < length; ++i) {src[i] = rand();}
+
+	cipher->setKey(key, keyLen);
+
+	uint8_t aad[24] = {3};
+
+	// encrypt, decrypt, check
+	cipher->encryptAuth(src, enc, length, nonce, nonceLen, aad, sizeof(aad), tag);
+	ASSERT_TRUE(cipher->decryptAuth(enc, dec, length, nonce, nonceLen, aad, sizeof(aad), tag));
+	ASSERT_EQ(0, memcmp(src, dec, length));
+
+	// modified ciphertext -> must fail
+	enc[100] ^= 1;
+	ASSERT_FALSE(cipher->decryptAuth(enc, dec, length, nonce, nonceLen, aad, sizeof(aad), tag));
+	enc[100] ^= 1;
+
+	// modified tag -> must fail
+	tag[0] ^= 1;
+	ASSERT_FALSE(cipher->decryptAuth(enc, dec, length, nonce, nonceLen, aad, sizeof(aad), tag));
+	tag[0] ^= 1;
+
+	// modified or missing additional data -> must fail
+	aad[20] ^= 1;
+	ASSERT_FALSE(cipher->decryptAuth(enc, dec, length, nonce, nonceLen, aad, sizeof(aad), tag));
+	aad[20] ^= 1;
+	ASSERT_FALSE(cipher->decryptAuth(enc, dec, length, nonce, nonceLen, nullptr, 0, tag));
+
+	// additional data only
+	uint8_t tag2[16];
+	cipher->encryptAuth(nullptr, nullptr, 0, nonce, nonceLen, aad, sizeof(aad), tag2);
+	ASSERT_TRUE(cipher->decryptAuth(nullptr, nullptr, 0, nonce, nonceLen, aad, sizeof(aad), tag2));
+	aad[0] ^= 1;
+	ASSERT_FALSE(cipher->decryptAuth(nullptr, nullptr, 0, nonce, nonceLen, aad, sizeof(aad), tag2));
+
+	// other nonce -> must fail
+	nonce[0] = 1;
+	ASSERT_FALSE(cipher->decryptAuth(enc, dec, length, nonce, nonceLen, aad, sizeof(aad), tag));
+
+}
+
 #ifdef WITH_OPENSSL
 TEST(CipherOpenSSL, AES) {
 
@@ -90,9 +205,75 @@ TEST(CipherOpenSSL, AES) {
 	_testEnDeCrypt(&aes192, &aes192);
 	_testEnDeCrypt(&aes256, &aes256);
 
+	_testBlocks(&aes128, &aes128, 4096);
+	_testBlocks(&aes256, &aes256, 64*1024);
+
+	_testMany(&aes128);
+	_testMany(&aes256);
+
+}
+
+TEST(CipherOpenSSL, Authenticated) {
+
+	CipherOpenSSL gcm128(OpenSSLCiphers::AES_GCM_128);
+	CipherOpenSSL gcm256(OpenSSLCiphers::AES_GCM_256);
+	CipherOpenSSL chacha(OpenSSLCiphers::CHACHA20_POLY1305);
+
+	_testAuth(&gcm128);
+	_testAuth(&gcm256);
+	_testAuth(&chacha);
+
+	// plain ciphers provide no tag
+	CipherOpenSSL aes256(OpenSSLCiphers::AES_CBC_256);
+	ASSERT_EQ(0, aes256.getTagLength());
+
 }
 #endif
 
+TEST(CipherFactory, Resolve) {
+
+	const std::vector<std::string> supported = CipherFactory::getSupported();
+
+	// backend-independent names map onto one of the compiled-in backends
+	for (const std::string alias : {"aes_cbc_128", "aes_cbc_192", "aes_cbc_256"}) {
+		const std::string name = CipherFactory::resolve(alias);
+		ASSERT_NE(supported.end(), std::find(supported.begin(), supported.end(), name)) << name;
+		std::unique_ptr<Cipher> cipher(CipherFactory::getByName(alias));
+		ASSERT_EQ(16, cipher->getIVLength());
+	}
+
+	// explicit backends are kept as they are
+	for (const std::string& name : supported) {
+		ASSERT_EQ(name, CipherFactory::resolve(name));
+	}
+
+	ASSERT_THROW(CipherFactory::getByName("aes_cbc_1024"), Exception);
+
+	// auto: the default algorithm on the fastest backend
+	ASSERT_EQ(CipherFactory::resolve("aes_cbc_256"), CipherFactory::resolve("auto"));
+	ASSERT_NE(supported.end(), std::find(supported.begin(), supported.end(), CipherFactory::resolve("auto")));
+
+}
+
+TEST(Factory, Calibrate) {
+
+	// the fastest usable candidate wins
+	auto measure = [] (const std::string& name) -> double {
+		if ("broken" == name) {throw Exception("not available");}
+		return ("fast" == name) ? (100) : (10);
+	};
+	ASSERT_EQ("fast", Factory::calibrate("test1", {"slow", "broken", "fast"}, measure));
+
+	// nothing usable: the first (preferred) candidate
+	ASSERT_EQ("broken", Factory::calibrate("test2", {"broken"}, measure));
+
+	// results are cached per alias, without determining the candidates again
+	ASSERT_EQ("fast", Factory::calibrate("test1", {"slow"}, measure));
+	auto notCalled = [] () -> std::vector<std::string> {throw Exception("candidates determined again");};
+	ASSERT_EQ("fast", Factory::calibrate("test1", notCalled, measure));
+
+}
+
 #ifdef WITH_KERNEL
 TEST(CipherCryptoAPI, AES) {
 
@@ -108,6 +289,12 @@ TEST(CipherCryptoAPI, AES) {
 	_testEnDeCrypt(&aes192, &aes192);
 	_testEnDeCrypt(&aes256, &aes256);
 
+	// 64k blocks are spliced into the kernel
+	_testBlocks(&aes128, &aes128, 4096);
+	_testBlocks(&aes256, &aes256, 64*1024);
+
+	_testMany(&aes256);
+
 }
 #endif
 
@@ -122,6 +309,9 @@ TEST(CipherCross, AES) {
 	_testEnDeCrypt(&aes256a, &aes256b);
 	_testEnDeCrypt(&aes256b, &aes256a);
 
+	_testBlocks(&aes256a, &aes256b, 4096);
+	_testBlocks(&aes256b, &aes256a, 64*1024);
+
 }
 #endif
 #endif
@@ -3,36 +3,139 @@
 #ifdef WITH_TESTS
 
 void _testMD5(Digest* digest) {
-	uint8_t out[16];
+	uint8_t out[64];
 	digest->hash((uint8_t*)"lorem ipsum", 11, out);
 	ASSERT_EQ("80a751fde577028640c419000e33eba6", Helper::toHexStr(out, 16));
 }
 
 void _testSHA256(Digest* digest) {
-	uint8_t out[16];
+	uint8_t out[64];
 	digest->hash((uint8_t*)"lorem ipsum", 11, out);
 	ASSERT_EQ("5e2bf57d3f40c4b6df69daf1936cb766f832374b4fc0259a7cbff06e2f70f269", Helper::toHexStr(out, 32));
 }
 
 void _testSHA512(Digest* digest) {
-	uint8_t out[16];
+	uint8_t out[64];
 	digest->hash((uint8_t*)"lorem ipsum", 11, out);
 	ASSERT_EQ("f80eebd9aabb1a15fb869ed568d858a5c0dca3d5da07a410e1bd988763918d973e344814625f7c844695b2de36ffd27af290d0e34362c51dee5947d58d40527a", Helper::toHexStr(out, 64));
 }
 
+/** RFC 4231 test cases 1, 2 and 6 (key larger than the block size) */
+void _testHMAC(Digest* digest) {
+	uint8_t out[64];
+	uint8_t key1[20]; memset(key1, 0x0b, sizeof(key1));
+	digest->setKey(key1, sizeof(key1));
+	digest->hash((uint8_t*)"Hi There", 8, out);
+	ASSERT_EQ("b0344c61d8db38535ca8afceaf0bf12b881dc200c9833da726e9376c2e32cff7", Helper::toHexStr(out, 32));
+	digest->setKey((uint8_t*)"Jefe", 4);
+	digest->hash((uint8_t*)"what do ya want for nothing?", 28, out);
+	ASSERT_EQ("5bdcc146bf60754e6a042426089575c75a003f089d2739839dec58b964ec3843", Helper::toHexStr(out, 32));
+	uint8_t key6[131]; memset(key6, 0xaa, sizeof(key6));
+	const std::string msg6 = "Test Using Larger Than Block-Size Key - Hash Key First";
+	digest->setKey(key6, sizeof(key6));
+	digest->hash((uint8_t*)msg6.c_str(), msg6.length(), out);
+	ASSERT_EQ("60e431591ee0b67f0d8a26aacbf5b77f8e0bc6213728c5140546040f0ee37f54", Helper::toHexStr(out, 32));
+}
+
+/** setting a new key after the digest was used, and restoring the former one, e.g. one key per file */
+void _testReKey(Digest* digest) {
+	uint8_t keyA[32] = {1, 2, 3};
+	uint8_t keyB[32] = {4, 5, 6};
+	uint8_t out1[64], out2[64], out3[64];
+	const uint8_t prefix[16] = {7};
+	digest->setKey(keyA, sizeof(keyA));
+	digest->hash((uint8_t*)"lorem ipsum", 11, out1);
+	digest->setKey(keyB, sizeof(keyB));
+	digest->hash((uint8_t*)"lorem ipsum", 11, out2);
+	ASSERT_NE(0, memcmp(out1, out2, 32));
+	digest->setKey(keyA, sizeof(keyA));
+	digest->hash((uint8_t*)"lorem ipsum", 11, out3);
+	ASSERT_EQ(0, memcmp(out1, out3, 32));
+	digest->setPrefix(prefix, sizeof(prefix));
+	digest->hashPrefixed((uint8_t*)"lorem ipsum", 11, out1);
+	digest->setKey(keyB, sizeof(keyB));
+	digest->hashPrefixed((uint8_t*)"lorem ipsum", 11, out2);
+	digest->setKey(keyA, sizeof(keyA));
+	digest->hashPrefixed((uint8_t*)"lorem ipsum", 11, out3);
+	ASSERT_NE(0, memcmp(out1, out2, 32));
+	ASSERT_EQ(0, memcmp(out1, out3, 32));
+}
+
+/** batched and prefixed hashing must match hash() */
+void _testBatch(Digest* digest) {
+
+	const uint32_t size = digest->getSize();
+	const uint32_t inLen = 8;
+	const uint32_t count = 19;
+	uint8_t in[count * inLen];
+	uint8_t outs[count * 64];
+	uint8_t out[64];
+	for (uint32_t i = 0; i < sizeof(in); ++i) {in[i] = (uint8_t)(i * 3);}
+
+	digest->hashMany(in, inLen, count, outs);
+	for (uint32_t i = 0; i < count; ++i) {
+		digest->hash(&in[i*inLen], inLen, out);
+		ASSERT_EQ(0, memcmp(out, &outs[i*size], size));
+	}
+
+	const uint8_t prefix[32] = {9,8,7};
+	uint8_t full[sizeof(prefix) + inLen];
+	memcpy(full, prefix, sizeof(prefix));
+	digest->setPrefix(prefix, sizeof(prefix));
+	digest->hashManyPrefixed(in, inLen, count, outs);
+	for (uint32_t i = 0; i < count; ++i) {
+		memcpy(full + sizeof(prefix), &in[i*inLen], inLen);
+		digest->hash(full, sizeof(full), out);
+		ASSERT_EQ(0, memcmp(out, &outs[i*size], size));
+		digest->hashPrefixed(&in[i*inLen], inLen, out);
+		ASSERT_EQ(0, memcmp(out, &outs[i*size], size));
+	}
+
+}
+
 #ifdef WITH_OPENSSL
+TEST(DigestOpenSSL, Batch) {
+	DigestOpenSSL sha(OpenSSLDigests::SHA256); _testBatch(&sha);
+}
+TEST(DigestOpenSSL, HMAC) {
+	DigestOpenSSL hmac(OpenSSLDigests::HMAC_SHA256); _testHMAC(&hmac);
+	_testReKey(&hmac);
+	uint8_t key[32] = {1};
+	hmac.setKey(key, sizeof(key)); _testBatch(&hmac);
+	DigestOpenSSL noKey(OpenSSLDigests::HMAC_SHA256);
+	uint8_t out[64];
+	ASSERT_ANY_THROW(noKey.hash(key, sizeof(key), out));
+}
 TEST(DigestOpenSSL, MD5) {
 	DigestOpenSSL md5(OpenSSLDigests::MD5); _testMD5(&md5);
 }
 TEST(DigestOpenSSL, SHA256) {
 	DigestOpenSSL sha(OpenSSLDigests::SHA256); _testSHA256(&sha);
 }
+TEST(DigestOpenSSL, SHA256_TRUNC20) {
+	DigestOpenSSL sha(OpenSSLDigests::SHA256_TRUNC20);
+	uint8_t out[64];
+	sha.hash((uint8_t*)"lorem ipsum", 11, out);
+	ASSERT_EQ(20u, sha.getSize());
+	ASSERT_EQ("5e2bf57d3f40c4b6df69daf1936cb766f832374b", Helper::toHexStr(out, 20));
+	_testBatch(&sha);
+}
 TEST(DigestOpenSSL, SHA512) {
 	DigestOpenSSL sha(OpenSSLDigests::SHA512); _testSHA512(&sha);
 }
 #endif
 
 #ifdef WITH_KERNEL
+TEST(DigestCryptoAPI, Batch) {
+	DigestCryptoAPI sha(CryptoAPIDigests::SHA256); _testBatch(&sha);
+}
+/** needs AF_ALG sockets, i.e. a kernel with CONFIG_CRYPTO_USER_API_HASH */
+TEST(DigestCryptoAPI, HMAC_NeedsAFALG) {
+	DigestCryptoAPI hmac(CryptoAPIDigests::HMAC_SHA256); _testHMAC(&hmac);
+	_testReKey(&hmac);
+	uint8_t key[32] = {1};
+	hmac.setKey(key, sizeof(key)); _testBatch(&hmac);
+}
 TEST(DigestCryptoAPI, MD5) {
 	DigestCryptoAPI md5(CryptoAPIDigests::MD5); _testMD5(&md5);
 }
@@ -44,5 +147,123 @@ TEST(DigestCryptoAPI, SHA512) {
 }
 #endif
 
+#if defined(WITH_KERNEL) && defined(WITH_OPENSSL)
+
+/** both backends must compute the same digest, e.g. kernel_sha1 is SHA-1 (not truncated SHA-256) */
+void _testCross(Digest* a, Digest* b) {
+	uint8_t in[200];
+	uint8_t outA[64];
+	uint8_t outB[64];
+	for (uint32_t i = 0; i < sizeof(in); ++i) {in[i] = (uint8_t)(i * 13);}
+	for (const uint32_t len : {0u, 8u, 40u, 64u, 200u}) {
+		a->hash(in, len, outA);
+		b->hash(in, len, outB);
+		ASSERT_EQ(Helper::toHexStr(outA, a->getSize()), Helper::toHexStr(outB, b->getSize()));
+	}
+}
+
+TEST(DigestCryptoAPI, CrossOpenSSL) {
+	DigestCryptoAPI sha1a(CryptoAPIDigests::SHA1);		DigestOpenSSL sha1b(OpenSSLDigests::SHA1);		_testCross(&sha1a, &sha1b);
+	DigestCryptoAPI sha256a(CryptoAPIDigests::SHA256);	DigestOpenSSL sha256b(OpenSSLDigests::SHA256);	_testCross(&sha256a, &sha256b);
+	DigestCryptoAPI truncA(CryptoAPIDigests::SHA256_TRUNC20);	DigestOpenSSL truncB(OpenSSLDigests::SHA256_TRUNC20);	_testCross(&truncA, &truncB);
+	DigestCryptoAPI sha512a(CryptoAPIDigests::SHA512);	DigestOpenSSL sha512b(OpenSSLDigests::SHA512);	_testCross(&sha512a, &sha512b);
+	DigestCryptoAPI md5a(CryptoAPIDigests::MD5);		DigestOpenSSL md5b(OpenSSLDigests::MD5);		_testCross(&md5a, &md5b);
+	DigestCryptoAPI hmacA(CryptoAPIDigests::HMAC_SHA256);	DigestOpenSSL hmacB(OpenSSLDigests::HMAC_SHA256);
+	uint8_t key[32] = {7, 7, 7};
+	hmacA.setKey(key, sizeof(key));
+	hmacB.setKey(key, sizeof(key));
+	_testCross(&hmacA, &hmacB);
+}
+
+#endif
+
+#ifdef WITH_NATIVE
+
+/** test vectors, streaming, batched and prefixed hashing for one kernel */
+void _testNative(const NativeDigest& cfg, const NativeKernel kernel, const std::vector<std::string>& expected) {
+
+	DigestNative d(cfg, kernel);
+	const uint32_t size = d.getSize();
+	uint8_t out[64];
+
+	// "abc", two-block message, one million 'a' (streamed)
+	d.hash((uint8_t*)"abc", 3, out);
+	ASSERT_EQ(expected[0], Helper::toHexStr(out, size));
+	const std::string two = "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq";
+	d.hash((uint8_t*)two.c_str(), two.length(), out);
+	ASSERT_EQ(expected[1], Helper::toHexStr(out, size));
+	std::vector<uint8_t> a(1000, 'a');
+	d.start();
+	for (int i = 0; i < 1000; ++i) {d.append(a.data(), a.size(), i == 999);}
+	d.get(out);
+	ASSERT_EQ(expected[2], Helper::toHexStr(out, size));
+
+	// batched and prefixed (single- and multi-block) must match hash()
+	for (const uint32_t inLen : {8u, 40u, 100u}) {
+		const uint32_t count = 21;
+		std::vector<uint8_t> in(count * inLen);
+		for (size_t i = 0; i < in.size(); ++i) {in[i] = (uint8_t)(i * 7);}
+		std::vector<uint8_t> outs(count * size);
+		d.hashMany(in.data(), inLen, count, outs.data());
+		for (uint32_t i = 0; i < count; ++i) {
+			d.hash(&in[i*inLen], inLen, out);
+			ASSERT_EQ(0, memcmp(out, &outs[i*size], size));
+		}
+		const uint8_t prefix[32] = {1,2,3,4};
+		d.setPrefix(prefix, sizeof(prefix));
+		d.hashManyPrefixed(in.data(), inLen, count, outs.data());
+		for (uint32_t i = 0; i < count; ++i) {
+			std::vector<uint8_t> full(prefix, prefix + sizeof(prefix));
+			full.insert(full.end(), &in[i*inLen], &in[i*inLen] + inLen);
+			d.hash(full.data(), full.size(), out);
+			ASSERT_EQ(0, memcmp(out, &outs[i*size], size));
+			d.hashPrefixed(&in[i*inLen], inLen, out);
+			ASSERT_EQ(0, memcmp(out, &outs[i*size], size));
+		}
+	}
+
+}
+
+/** all kernels the CPU supports */
+std::vector<NativeKernel> _getNativeKernels(const NativeDigest& cfg) {
+	std::vector<NativeKernel> res;
+	for (const NativeKernel k : {NativeKernel::AUTO, NativeKernel::SCALAR, NativeKernel::SHANI, NativeKernel::AVX2}) {
+		try {DigestNative d(cfg, k); res.push_back(k);} catch (...) {;}
+	}
+	return res;
+}
+
+TEST(DigestNative, SHA1) {
+	for (const NativeKernel k : _getNativeKernels(NativeDigests::SHA1)) {
+		_testNative(NativeDigests::SHA1, k, {
+			"a9993e364706816aba3e25717850c26c9cd0d89d",
+			"84983e441c3bd26ebaae4aa1f95129e5e54670f1",
+			"34aa973cd4c4daa4f61eeb2bdbad27316534016f"
+		});
+	}
+}
+
+TEST(DigestNative, SHA256) {
+	DigestNative sha(NativeDigests::SHA256); _testSHA256(&sha);
+	for (const NativeKernel k : _getNativeKernels(NativeDigests::SHA256)) {
+		_testNative(NativeDigests::SHA256, k, {
+			"ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad",
+			"248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1",
+			"cdc76e5c9914fb9281a1c7e284d73e67f1809a48a497200e046d39ccc7112cd0"
+		});
+	}
+}
+
+#endif
+
+TEST(DigestFactory, Auto) {
+
+	// every backend chosen for "auto" computes sha256
+	std::unique_ptr<Digest> sha(DigestFactory::getByName("auto"));
+	_testSHA256(sha.get());
+	ASSERT_EQ(DigestFactory::resolve("sha256"), DigestFactory::resolve("auto"));
+
+}
+
 
 #endif
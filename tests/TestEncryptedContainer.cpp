@@ -5,6 +5,9 @@
 #include <vector>
 #include <thread>
 
+#include "../iv/IVGeneratorCached.h"
+#include "../container/SizeCache.h"
+
 TEST(EncryptedFileContainer, Write) {
 	
 }
@@ -344,4 +347,578 @@ TEST(EncryptedFileContainer, EnDeCryptRandom) {
 
 }
 
+#ifdef WITH_OPENSSL
+
+TEST(EncryptedFileContainer, Authenticated) {
+
+	const uint8_t key[32] = {};
+	const uint32_t keyLen = 32;
+
+	std::shared_ptr<IVGenerator> ivGen(IVGeneratorFactory::getByName("sha256", key, keyLen));
+	std::shared_ptr<Cipher> gcm(CipherFactory::getByName("openssl_aes_gcm_256", key, keyLen));
+	std::shared_ptr<MemoryContainer> fc(new MemoryContainer());
+
+	EncryptedContainer efc(fc, gcm, ivGen);
+
+	// spans several metadata groups
+	const int testSize = 1024*1024*2;
+	const int CMP = 64*1024;
+	uint8_t buf[CMP];
+
+	uint8_t* rnd = (uint8_t*) malloc(testSize);
+	for (int i = 0; i < testSize; ++i) {rnd[i] = rand();}
+
+	// unaligned, overlapping writes
+	int start = 0;
+	while (start < testSize) {
+		const int size = std::min(testSize-start, 2048 + rand() % (128*1024-2048));
+		efc.write(&rnd[start], size, start);
+		start = (start+size == testSize) ? (testSize) : (start + size * 0.85f);
+	}
+
+	// unaligned reads
+	for (int i = 0; i < testSize-CMP; i+=CMP-1337) {
+		ASSERT_EQ(CMP, efc.read(&buf[0], CMP, i));
+		ASSERT_EQ(0, memcmp(&buf[0], &rnd[i], CMP));
+	}
+
+	// payload blocks keep their size: header + metadata blocks + payload
+	const int groups = (testSize / 4096 + Settings::AUTH_BLKS_PER_META - 1) / Settings::AUTH_BLKS_PER_META;
+	ASSERT_EQ(1, fc->read(buf, 1, 4096 + testSize + groups*4096 - 1));
+	ASSERT_EQ(0, fc->read(buf, 1, 4096 + testSize + groups*4096));
+
+	// tamper with the first payload block (behind the header and the first metadata block)
+	uint8_t b;
+	fc->read(&b, 1, 4096*2+100); b ^= 1;
+	fc->write(&b, 1, 4096*2+100);
+	ASSERT_EQ(-EIO, efc.read(&buf[0], 16, 0));
+	ASSERT_EQ(-EIO, efc.write(&buf[0], 16, 8));
+
+	// other blocks are unaffected
+	ASSERT_EQ(16, efc.read(&buf[0], 16, 4096));
+	ASSERT_EQ(0, memcmp(&buf[0], &rnd[4096], 16));
+
+	free(rnd);
+
+}
+
+TEST(EncryptedFileContainer, AuthenticatedSparse) {
+
+	const uint8_t key[32] = {};
+	const uint32_t keyLen = 32;
+
+	std::shared_ptr<IVGenerator> ivGen(IVGeneratorFactory::getByName("sha256", key, keyLen));
+	std::shared_ptr<Cipher> chacha(CipherFactory::getByName("openssl_chacha20_poly1305", key, keyLen));
+	std::shared_ptr<MemoryContainer> fc(new MemoryContainer());
+
+	EncryptedContainer efc(fc, chacha, ivGen);
+
+	uint8_t src[100];
+	uint8_t buf[4096];
+	for (int i = 0; i < 100; ++i) {src[i] = rand();}
+
+	// write behind a hole. never written blocks read as zero
+	efc.write(src, 100, 1024*1024);
+	ASSERT_EQ(4096, efc.read(buf, 4096, 8192));
+	for (int i = 0; i < 4096; ++i) {ASSERT_EQ(0, buf[i]);}
+
+	ASSERT_EQ(100, efc.read(buf, 100, 1024*1024));
+	ASSERT_EQ(0, memcmp(buf, src, 100));
+
+}
+
+TEST(EncryptedFileContainer, AuthenticatedConcurrent) {
+
+	const uint8_t key[32] = {};
+	const uint32_t keyLen = 32;
+
+	std::shared_ptr<IVGenerator> ivGen(IVGeneratorFactory::getByName("sha256", key, keyLen));
+	std::shared_ptr<Cipher> gcm(CipherFactory::getByName("openssl_aes_gcm_256", key, keyLen));
+	std::shared_ptr<MemoryContainer> fc(new MemoryContainer());
+
+	EncryptedContainer efc(fc, gcm, ivGen);
+	uint8_t src[4*4096];
+	memset(src, 7, sizeof(src));
+	efc.write(src, sizeof(src), 0);
+
+	// re-writing a block changes its data and its nonce/tag. reading must never see a mixture of both
+	std::thread writer([&] () {
+		for (int i = 0; i < 2000; ++i) {efc.write(src, sizeof(src), 0);}
+	});
+	uint8_t buf[sizeof(src)];
+	int failed = 0;
+	for (int i = 0; i < 2000; ++i) {
+		if (efc.read(buf, sizeof(buf), 0) != (ssize_t) sizeof(buf)) {++failed;}
+	}
+	writer.join();
+	ASSERT_EQ(0, failed);
+	ASSERT_EQ(0, memcmp(buf, src, sizeof(src)));
+
+}
+
+TEST(EncryptedFileContainer, AuthenticatedTamper) {
+
+	const uint8_t key[32] = {};
+	const uint32_t keyLen = 32;
+
+	std::shared_ptr<IVGenerator> ivGen(IVGeneratorFactory::getByName("sha256", key, keyLen));
+	std::shared_ptr<Cipher> gcm(CipherFactory::getByName("openssl_aes_gcm_256", key, keyLen));
+	std::shared_ptr<MemoryContainer> fc(new MemoryContainer());
+
+	uint8_t src[3*4096];
+	uint8_t buf[4096];
+	for (size_t i = 0; i < sizeof(src); ++i) {src[i] = rand();}
+
+	{
+		EncryptedContainer efc(fc, gcm, ivGen);
+		efc.write(src, sizeof(src), 0);
+	}
+
+	// layout: [header][meta 0][blk 0][blk 1][blk 2]
+	const int META = 4096;
+	const int BLK0 = 8192;
+
+	// modified file-size within the header -> refused
+	{
+		uint64_t size;
+		fc->read((uint8_t*) &size, sizeof(size), offsetof(EncryptedContainerHeader, fileSize));
+		size += 4096;
+		fc->write((const uint8_t*) &size, sizeof(size), offsetof(EncryptedContainerHeader, fileSize));
+		ASSERT_THROW(EncryptedContainer(fc, gcm, ivGen), Exception);
+		size -= 4096;
+		fc->write((const uint8_t*) &size, sizeof(size), offsetof(EncryptedContainerHeader, fileSize));
+	}
+
+	// swapped blocks (including their nonces and tags) -> refused
+	{
+		uint8_t blk0[4096], blk1[4096];
+		BlockAuth ba[2];
+		fc->read(blk0, 4096, BLK0);
+		fc->read(blk1, 4096, BLK0+4096);
+		fc->read((uint8_t*) ba, sizeof(ba), META);
+		std::swap(ba[0], ba[1]);
+		fc->write(blk1, 4096, BLK0);
+		fc->write(blk0, 4096, BLK0+4096);
+		fc->write((const uint8_t*) ba, sizeof(ba), META);
+		{
+			EncryptedContainer efc(fc, gcm, ivGen);
+			ASSERT_EQ(-EIO, efc.read(buf, 4096, 0));
+			ASSERT_EQ(-EIO, efc.read(buf, 4096, 4096));
+			ASSERT_EQ(4096, efc.read(buf, 4096, 8192));
+		}
+		std::swap(ba[0], ba[1]);
+		fc->write(blk0, 4096, BLK0);
+		fc->write(blk1, 4096, BLK0+4096);
+		fc->write((const uint8_t*) ba, sizeof(ba), META);
+	}
+
+	// zeroed nonce/tag below the file's end -> refused
+	{
+		const BlockAuth empty = {};
+		fc->write((const uint8_t*) &empty, sizeof(empty), META + sizeof(BlockAuth));
+		EncryptedContainer efc(fc, gcm, ivGen);
+		ASSERT_EQ(4096, efc.read(buf, 4096, 0));
+		ASSERT_EQ(0, memcmp(buf, src, 4096));
+		ASSERT_EQ(-EIO, efc.read(buf, 4096, 4096));
+	}
+
+	// payload without a header -> refused
+	{
+		const EncryptedContainerHeader empty = {};
+		fc->write((const uint8_t*) &empty, sizeof(empty), 0);
+		ASSERT_THROW(EncryptedContainer(fc, gcm, ivGen), Exception);
+	}
+
+}
+
+#endif
+
+void _testTruncate(std::shared_ptr<Cipher> cipher, std::shared_ptr<IVGenerator> ivGen, const int physicalBlocks) {
+
+	std::shared_ptr<MemoryContainer> fc(new MemoryContainer());
+
+	uint8_t src[3*4096+100];
+	uint8_t buf[sizeof(src)];
+	for (size_t i = 0; i < sizeof(src); ++i) {src[i] = rand();}
+
+	{
+		EncryptedContainer efc(fc, cipher, ivGen);
+		efc.write(src, sizeof(src), 0);
+
+		// shrink into the 2nd block
+		ASSERT_EQ(0, efc.truncate(5000));
+		ASSERT_EQ(5000, efc.getSize());
+		ASSERT_EQ(5000, efc.read(buf, sizeof(buf), 0));
+		ASSERT_EQ(0, memcmp(buf, src, 5000));
+
+		// all blocks behind the end are removed
+		ASSERT_EQ(1, fc->read(buf, 1, physicalBlocks*4096-1));
+		ASSERT_EQ(0, fc->read(buf, 1, physicalBlocks*4096));
+	}
+
+	{
+		// the new size is stored within the header
+		EncryptedContainer efc(fc, cipher, ivGen);
+		ASSERT_EQ(5000, efc.getSize());
+
+		// grow again: the former content behind the end is gone
+		ASSERT_EQ(0, efc.truncate(8192));
+		ASSERT_EQ(8192, efc.read(buf, sizeof(buf), 0));
+		ASSERT_EQ(0, memcmp(buf, src, 5000));
+		for (int i = 5000; i < 8192; ++i) {ASSERT_EQ(0, buf[i]);}
+
+		ASSERT_EQ(0, efc.truncate(0));
+		ASSERT_EQ(0, efc.getSize());
+		ASSERT_EQ(0, efc.read(buf, sizeof(buf), 0));
+		ASSERT_EQ(0, fc->read(buf, 1, 4096));
+	}
+
+}
+
+TEST(EncryptedFileContainer, Truncate) {
+
+	const uint8_t key[32] = {};
+	const uint32_t keyLen = 32;
+
+	std::shared_ptr<IVGenerator> ivGen(IVGeneratorFactory::getByName("sha256", key, keyLen));
+	std::shared_ptr<Cipher> cbc(CipherFactory::getByName("aes_cbc_256", key, keyLen));
+
+	// header + 2 blocks
+	_testTruncate(cbc, ivGen, 3);
+
+}
+
+#ifdef WITH_OPENSSL
+
+TEST(EncryptedFileContainer, TruncateAuthenticated) {
+
+	const uint8_t key[32] = {};
+	const uint32_t keyLen = 32;
+
+	std::shared_ptr<IVGenerator> ivGen(IVGeneratorFactory::getByName("sha256", key, keyLen));
+	std::shared_ptr<Cipher> gcm(CipherFactory::getByName("openssl_aes_gcm_256", key, keyLen));
+
+	// header + metadata + 2 blocks
+	_testTruncate(gcm, ivGen, 4);
+
+	// growing fills the gap: every block below the end is readable
+	std::shared_ptr<MemoryContainer> fc(new MemoryContainer());
+	EncryptedContainer efc(fc, gcm, ivGen);
+	uint8_t buf[4096];
+	ASSERT_EQ(0, efc.truncate(1024*1024));
+	ASSERT_EQ(4096, efc.read(buf, 4096, 512*1024));
+	for (int i = 0; i < 4096; ++i) {ASSERT_EQ(0, buf[i]);}
+
+}
+
+#endif
+
+static const std::vector<uint32_t> blockSizes = {4096, 8192, 16384, 32768, 65536};
+
+void _testBlockSize(std::shared_ptr<Cipher> cipher, std::shared_ptr<IVGenerator> ivGen, const uint32_t blkSize) {
+
+	std::shared_ptr<MemoryContainer> fc(new MemoryContainer());
+
+	const int testSize = 1024*1024;
+	const int CMP = 32*1024;
+	uint8_t buf[CMP];
+
+	uint8_t* rnd = (uint8_t*) malloc(testSize);
+	for (int i = 0; i < testSize; ++i) {rnd[i] = rand();}
+
+	{
+		EncryptedContainer efc(fc, cipher, ivGen, blkSize);
+		ASSERT_EQ(blkSize, efc.getBlockSize());
+
+		// unaligned, overlapping writes
+		int start = 0;
+		while (start < testSize) {
+			const int size = std::min(testSize-start, 1 + rand() % (128*1024-1));
+			efc.write(&rnd[start], size, start);
+			start = (start+size == testSize) ? (testSize) : (start + std::max(1, (int)(size * 0.85f)));
+		}
+		ASSERT_EQ(testSize, efc.getSize());
+	}
+
+	// re-open using another block-size. the one from the header must be used
+	{
+		EncryptedContainer efc(fc, cipher, ivGen, Settings::BLK_SIZE);
+		ASSERT_EQ(blkSize, efc.getBlockSize());
+		for (int i = 0; i < testSize-CMP; i+=CMP-1337) {
+			ASSERT_EQ(CMP, efc.read(&buf[0], CMP, i));
+			ASSERT_EQ(0, memcmp(&buf[0], &rnd[i], CMP));
+		}
+		ASSERT_EQ(100, efc.read(&buf[0], CMP, testSize-100));
+		ASSERT_EQ(0, memcmp(&buf[0], &rnd[testSize-100], 100));
+	}
+
+	free(rnd);
+
+}
+
+TEST(EncryptedFileContainer, BlockSizes) {
+
+	const uint8_t key[32] = {};
+	const uint32_t keyLen = 32;
+
+	std::shared_ptr<IVGenerator> ivGen(IVGeneratorFactory::getByName("sha256", key, keyLen));
+	std::shared_ptr<Cipher> aes(CipherFactory::getByName("aes_cbc_256", key, keyLen));
+	for (const uint32_t blkSize : blockSizes) {
+		_testBlockSize(aes, ivGen, blkSize);
+	}
+
+#ifdef WITH_OPENSSL
+	std::shared_ptr<Cipher> gcm(CipherFactory::getByName("openssl_aes_gcm_256", key, keyLen));
+	for (const uint32_t blkSize : blockSizes) {
+		_testBlockSize(gcm, ivGen, blkSize);
+	}
+#endif
+
+}
+
+TEST(EncryptedFileContainer, BlockSizeInvalid) {
+
+	ASSERT_FALSE(EncryptedContainer::isValidBlockSize(0));
+	ASSERT_FALSE(EncryptedContainer::isValidBlockSize(2048));
+	ASSERT_FALSE(EncryptedContainer::isValidBlockSize(12288));
+	ASSERT_FALSE(EncryptedContainer::isValidBlockSize(128*1024));
+	ASSERT_THROW(EncryptedContainer(new MemoryContainer(), nullptr, nullptr, 5000), Exception);
+
+}
+
+TEST(EncryptedFileContainer, BlockSizeLegacy) {
+
+	const uint8_t key[32] = {};
+	const uint32_t keyLen = 32;
+
+	std::shared_ptr<IVGenerator> ivGen(IVGeneratorFactory::getByName("sha256", key, keyLen));
+	std::shared_ptr<Cipher> aes(CipherFactory::getByName("aes_cbc_256", key, keyLen));
+	std::shared_ptr<MemoryContainer> fc(new MemoryContainer());
+
+	uint8_t src[10000];
+	uint8_t buf[10000];
+	for (int i = 0; i < 10000; ++i) {src[i] = rand();}
+
+	{
+		EncryptedContainer efc(fc, aes, ivGen);
+		efc.write(src, 10000, 0);
+	}
+
+	// turn into a container written before the block-size was stored
+	EncryptedContainerHeader header;
+	fc->read((uint8_t*)&header, sizeof(header), 0);
+	header.version = 0;
+	header.blockSize = 0;
+	fc->write((uint8_t*)&header, sizeof(header), 0);
+
+	// must still use 4096 byte blocks
+	EncryptedContainer efc(fc, aes, ivGen, 65536);
+	ASSERT_EQ(4096, efc.getBlockSize());
+	ASSERT_EQ(10000, efc.read(buf, 10000, 0));
+	ASSERT_EQ(0, memcmp(buf, src, 10000));
+
+}
+
+TEST(EncryptedFileContainer, FileNonce) {
+
+	const uint8_t key[32] = {};
+	const uint32_t keyLen = 32;
+
+	std::shared_ptr<IVGenerator> ivGen(IVGeneratorFactory::getByName("sha256", key, keyLen));
+	std::shared_ptr<Cipher> aes(CipherFactory::getByName("aes_cbc_256", key, keyLen));
+	std::shared_ptr<MemoryContainer> fc1(new MemoryContainer());
+	std::shared_ptr<MemoryContainer> fc2(new MemoryContainer());
+
+	uint8_t src[8192];
+	uint8_t enc1[8192];
+	uint8_t enc2[8192];
+	uint8_t buf[8192];
+	for (int i = 0; i < 8192; ++i) {src[i] = rand();}
+
+	// same content within two new files
+	{
+		EncryptedContainer efc1(fc1, aes, ivGen);
+		efc1.write(src, 8192, 0);
+		EncryptedContainer efc2(fc2, aes, ivGen);
+		efc2.write(src, 8192, 0);
+	}
+
+	// both got a random nonce -> different IVs -> different ciphertexts
+	EncryptedContainerHeader h1, h2;
+	fc1->read((uint8_t*)&h1, sizeof(h1), 0);
+	fc2->read((uint8_t*)&h2, sizeof(h2), 0);
+	ASSERT_FALSE(IVGenerator::isLegacyNonce(h1.fileNonce, sizeof(h1.fileNonce)));
+	ASSERT_NE(0, memcmp(h1.fileNonce, h2.fileNonce, sizeof(h1.fileNonce)));
+	fc1->read(enc1, 8192, sizeof(h1));
+	fc2->read(enc2, 8192, sizeof(h2));
+	ASSERT_NE(0, memcmp(enc1, enc2, 4096));
+	ASSERT_NE(0, memcmp(enc1+4096, enc2+4096, 4096));
+
+	// reading uses each file's own nonce
+	{
+		EncryptedContainer efc1(fc1, aes, ivGen);
+		ASSERT_EQ(8192, efc1.read(buf, 8192, 0));
+		ASSERT_EQ(0, memcmp(buf, src, 8192));
+		EncryptedContainer efc2(fc2, aes, ivGen);
+		ASSERT_EQ(8192, efc2.read(buf, 8192, 0));
+		ASSERT_EQ(0, memcmp(buf, src, 8192));
+	}
+
+	// legacy container without nonce: IVs derived from the key only
+	std::shared_ptr<MemoryContainer> fc3(new MemoryContainer());
+	EncryptedContainerHeader h3 = {};
+	h3.fileSize = 8192;
+	fc3->write((uint8_t*)&h3, sizeof(h3), 0);
+	uint8_t iv[16];
+	for (int b = 0; b < 2; ++b) {
+		ivGen->setFileNonce(h3.fileNonce, sizeof(h3.fileNonce));
+		ivGen->getIV(b*4096, iv, 16);
+		aes->encrypt(src+b*4096, enc1+b*4096, 4096, iv, 16);
+	}
+	fc3->write(enc1, 8192, sizeof(h3));
+	EncryptedContainer efc3(fc3, aes, ivGen);
+	ASSERT_EQ(8192, efc3.read(buf, 8192, 0));
+	ASSERT_EQ(0, memcmp(buf, src, 8192));
+
+}
+
+TEST(EncryptedFileContainer, FileNonceOnOpen) {
+
+	const uint8_t key[32] = {};
+	const uint32_t keyLen = 32;
+
+	std::shared_ptr<IVGenerator> ivGen1(IVGeneratorFactory::getByName("sha256", key, keyLen));
+	std::shared_ptr<IVGenerator> ivGen2(IVGeneratorFactory::getByName("sha256", key, keyLen));
+	std::shared_ptr<Cipher> aes(CipherFactory::getByName("aes_cbc_256", key, keyLen));
+	std::shared_ptr<MemoryContainer> fc(new MemoryContainer());
+
+	uint8_t src[8192];
+	uint8_t buf[8192];
+	for (int i = 0; i < 8192; ++i) {src[i] = rand();}
+
+	{
+
+		// opening a new file stores its header (and nonce) right away
+		EncryptedContainer efc1(fc, aes, ivGen1);
+		EncryptedContainerHeader h;
+		ASSERT_EQ((ssize_t) sizeof(h), fc->read((uint8_t*)&h, sizeof(h), 0));
+		ASSERT_FALSE(IVGenerator::isLegacyNonce(h.fileNonce, sizeof(h.fileNonce)));
+
+		// a second handle, opened before anything was written, uses the same nonce
+		EncryptedContainer efc2(fc, aes, ivGen2);
+		ASSERT_EQ(4096, efc2.write(src, 4096, 0));
+		ASSERT_EQ(4096, efc1.write(src+4096, 4096, 4096));
+
+	}
+
+	EncryptedContainer efc(fc, aes, ivGen1);
+	ASSERT_EQ(8192, efc.read(buf, 8192, 0));
+	ASSERT_EQ(0, memcmp(buf, src, 8192));
+
+}
+
+TEST(EncryptedFileContainer, IVCachePrefill) {
+
+	const uint8_t key[32] = {};
+	const uint32_t keyLen = 32;
+
+	std::shared_ptr<IVGenerator> ivGen(IVGeneratorFactory::getByName("sha256", key, keyLen));
+	std::shared_ptr<Cipher> aes(CipherFactory::getByName("aes_cbc_256", key, keyLen));
+	std::shared_ptr<MemoryContainer> fc(new MemoryContainer());
+
+	uint8_t src[3*8192];
+	uint8_t buf[3*8192];
+	for (size_t i = 0; i < sizeof(src); ++i) {src[i] = rand();}
+
+	{
+		EncryptedContainer efc(fc, aes, ivGen, 8192);
+		efc.write(src, sizeof(src), 0);
+	}
+
+	// opening derives the IVs of the file's blocks, using its nonce and block-size
+	std::shared_ptr<IVGenerator> cached = std::make_shared<IVGeneratorCached>(ivGen, std::make_shared<IVCacheTable>(1024));
+	Stats::get().reset();
+	EncryptedContainer efc(fc, aes, cached, 4096);
+	ASSERT_EQ(8192u, efc.getBlockSize());
+	ASSERT_EQ((ssize_t) sizeof(src), efc.read(buf, sizeof(buf), 0));
+	ASSERT_EQ(0, memcmp(buf, src, sizeof(src)));
+	ASSERT_EQ(3u, Stats::get().ivCacheHits);
+	ASSERT_EQ(0u, Stats::get().ivCacheMisses);
+
+}
+
+TEST(EncryptedFileContainer, SizeCache) {
+
+	const uint8_t key[32] = {};
+	const uint32_t keyLen = 32;
+
+	// an encrypted file holding 5000 bytes
+	unlink(TMP_FILE_1);
+	const int flags = O_RDWR|O_CREAT;
+	const int fd = open(TMP_FILE_1, flags, 0700);
+	{
+		std::shared_ptr<IVGenerator> ivGen(IVGeneratorFactory::getByName("sha256", key, keyLen));
+		std::shared_ptr<Cipher> aes(CipherFactory::getByName("aes_cbc_256", key, keyLen));
+		std::shared_ptr<FileContainer> fc(new FileContainer(fd, flags));
+		EncryptedContainer efc(fc, aes, ivGen);
+		uint8_t buf[5000] = {};
+		efc.write(buf, sizeof(buf), 0);
+	}
+	close(fd);
+
+	uint64_t size = 0;
+	ASSERT_TRUE(SizeCache::read(AT_FDCWD, TMP_FILE_1, size));
+	ASSERT_EQ(5000u, size);
+	ASSERT_FALSE(SizeCache::read(AT_FDCWD, "/tmp/kcryptfs_does_not_exist", size));
+
+	// sizes of just modified files are not cached
+	SizeCache cache(16);
+	struct stat st;
+	ASSERT_EQ(0, stat(TMP_FILE_1, &st));
+	ASSERT_EQ(5000u, cache.get(AT_FDCWD, TMP_FILE_1, st));
+	ASSERT_EQ(0u, cache.size());
+
+	// older ones are
+	struct timespec ts[2] = {{1000000, 0}, {1000000, 0}};
+	ASSERT_EQ(0, utimensat(AT_FDCWD, TMP_FILE_1, ts, 0));
+	ASSERT_EQ(0, stat(TMP_FILE_1, &st));
+	st.st_ctim.tv_sec -= 10;					// utimensat() updated the ctime
+	ASSERT_EQ(5000u, cache.get(AT_FDCWD, TMP_FILE_1, st));
+	ASSERT_EQ(1u, cache.size());
+	const uint64_t hits = Stats::get().sizeCacheHits;
+	ASSERT_EQ(5000u, cache.get(AT_FDCWD, "/tmp/kcryptfs_does_not_exist", st));
+	ASSERT_EQ(hits + 1, Stats::get().sizeCacheHits);
+
+	// the file was modified
+	struct stat st2 = st;
+	st2.st_size += 4096;
+	ASSERT_EQ(0u, cache.get(AT_FDCWD, "/tmp/kcryptfs_does_not_exist", st2));
+	ASSERT_EQ(0u, cache.size());
+
+	// limit
+	for (int i = 0; i < 100; ++i) {
+		st.st_ino = i;
+		cache.get(AT_FDCWD, TMP_FILE_1, st);
+		ASSERT_LE(cache.size(), 16u);
+	}
+	ASSERT_EQ(16u, cache.size());
+
+	// the least recently used size is dropped
+	st.st_ino = 84;
+	const uint64_t hits2 = Stats::get().sizeCacheHits;
+	cache.get(AT_FDCWD, TMP_FILE_1, st);					// 84 is used again
+	st.st_ino = 100;
+	cache.get(AT_FDCWD, TMP_FILE_1, st);					// drops 85
+	st.st_ino = 84;
+	cache.get(AT_FDCWD, TMP_FILE_1, st);
+	ASSERT_EQ(hits2 + 2, Stats::get().sizeCacheHits);
+	st.st_ino = 85;
+	cache.get(AT_FDCWD, TMP_FILE_1, st);
+	ASSERT_EQ(hits2 + 2, Stats::get().sizeCacheHits);
+	ASSERT_EQ(16u, cache.size());
+
+	unlink(TMP_FILE_1);
+
+}
+
 #endif
@@ -2,6 +2,8 @@
 
 #ifdef WITH_TESTS
 
+#include <set>
+
 TEST (FileNames, EnDeCryptFile) { 
 
 	uint8_t key[32] = {};
@@ -52,7 +54,7 @@ TEST (FileNames, EnDeCryptDotFolders) {
 	
 	ASSERT_EQ(".", fp.decrypt("."));				// ./ must not be decrypted
 	ASSERT_EQ("..", fp.decrypt(".."));				// ../ must not be decrypted
-	ASSERT_NE("...", fp.decrypt("..."));			// .../ MUST be decrypted
+	ASSERT_THROW(fp.decrypt("..."), Exception);		// .../ MUST be decrypted (and is no valid name)
 	
 	const std::string src = "/path/../with/./subs";						// must also work within full-paths
 	const std::string enc = fp.encryptRelativeFileName(src.c_str());
@@ -68,6 +70,333 @@ TEST (FileNames, EnDeCryptDotFolders) {
 	
 }
 
+TEST (FileNames, EnDeCryptCompact) {
+
+	uint8_t key[32] = {};
+	std::shared_ptr<Cipher> cipher(CipherFactory::getByName("aes_cbc_256", key, 32));
+	FilePath fp("/", cipher, nullptr, Settings::FILE_NAME_FORMAT_BASE64);
+
+	// the length depends on the name's length
+	ASSERT_EQ(22u, fp.encrypt("a").length());
+	ASSERT_EQ(22u, fp.encrypt(std::string(16, 'x')).length());
+	ASSERT_EQ(43u, fp.encrypt(std::string(17, 'x')).length());
+	ASSERT_EQ(235u, fp.encrypt(std::string(Settings::FILE_NAME_BASE64_ML, 'x')).length());
+
+	for (uint32_t len = 1; len <= Settings::FILE_NAME_BASE64_ML; ++len) {
+		const std::string ori(len, 'a' + len % 26);
+		const std::string enc = fp.encrypt(ori);
+		ASSERT_EQ(std::string::npos, enc.find_first_of("/.+="));
+		ASSERT_EQ(ori, fp.decrypt(enc));
+	}
+
+	const std::string src = "/path/../with/./subs/file.txt";
+	ASSERT_EQ(src, fp.decryptRelativeFileName(fp.encryptRelativeFileName(src.c_str()).c_str()));
+	ASSERT_EQ(".", fp.encrypt("."));
+	ASSERT_EQ("..", fp.decrypt(".."));
+
+	// too long names and foreign entries
+	try {
+		fp.encrypt(std::string(Settings::FILE_NAME_LONG_ML + 1, 'x'));
+		FAIL();
+	} catch (const Exception& e) {
+		ASSERT_EQ(ENAMETOOLONG, e.getErrno());
+	}
+	ASSERT_THROW(fp.decrypt("readme.txt"), Exception);
+	ASSERT_THROW(fp.decrypt("abc"), Exception);
+
+}
+
+TEST (FileNames, LongNames) {
+
+	const std::string dir = "/tmp/kcryptfs_longnames_test";
+	mkdir(dir.c_str(), 0700);
+
+	uint8_t key[32] = {};
+	std::shared_ptr<Cipher> cipher(CipherFactory::getByName("aes_cbc_256", key, 32));
+	FilePath fp(dir.c_str(), cipher, nullptr, Settings::FILE_NAME_FORMAT_BASE64);
+
+	// short names need no side-car
+	const std::string shrt(Settings::FILE_NAME_BASE64_ML, 's');
+	ASSERT_FALSE(FilePath::isLong(fp.encrypt(shrt).c_str()));
+	ASSERT_FALSE(fp.storeLongName(("/" + shrt).c_str()));
+
+	// long names are stored as fixed-length hash, the full name within the side-car
+	const std::string lng(Settings::FILE_NAME_LONG_ML, 'l');
+	const std::string enc = fp.encrypt(lng);
+	ASSERT_EQ(44u, enc.length());
+	ASSERT_TRUE(FilePath::isLong(enc.c_str()));
+	ASSERT_EQ(lng, fp.decrypt(enc));
+	ASSERT_EQ(enc, fp.encrypt(lng));
+	ASSERT_TRUE(fp.storeLongName(("/" + lng).c_str()));
+	const std::string sideCar = dir + "/" + Settings::FILE_NAME_LONG_SIDECAR + enc.substr(1);
+	ASSERT_EQ(0, access(sideCar.c_str(), F_OK));
+	ASSERT_TRUE(FilePath::isInternal(sideCar.c_str() + dir.length() + 1));
+
+	// an existing side-car belongs to an existing entry: must be kept, if creating the path fails
+	ASSERT_FALSE(fp.storeLongName(("/" + lng).c_str()));
+
+	// another instance (e.g. after remount) needs the side-car to decrypt the name
+	FilePath fp2(dir.c_str(), cipher, nullptr, Settings::FILE_NAME_FORMAT_BASE64);
+	ASSERT_THROW(fp2.decrypt(enc), Exception);
+	const int dirFD = open(dir.c_str(), O_RDONLY | O_DIRECTORY);
+	ASSERT_EQ(lng, fp2.decryptEntry(dirFD, enc.c_str()));
+	ASSERT_EQ(lng, fp2.decrypt(enc));
+	ASSERT_EQ(shrt, fp2.decryptEntry(dirFD, fp.encrypt(shrt).c_str()));
+
+	// removing the entry removes its side-car
+	fp.removeLongName(("/" + lng).c_str());
+	ASSERT_NE(0, access(sideCar.c_str(), F_OK));
+	FilePath fp3(dir.c_str(), cipher, nullptr, Settings::FILE_NAME_FORMAT_BASE64);
+	ASSERT_THROW(fp3.decryptEntry(dirFD, enc.c_str()), Exception);
+	close(dirFD);
+
+	rmdir(dir.c_str());
+
+}
+
+TEST (FileNames, DecryptEntries) {
+
+	const std::string dir = "/tmp/kcryptfs_entries_test";
+	mkdir(dir.c_str(), 0700);
+	const int dirFD = open(dir.c_str(), O_RDONLY | O_DIRECTORY);
+
+	uint8_t key[32] = {};
+	std::shared_ptr<Cipher> cipher(CipherFactory::getByName("aes_cbc_256", key, 32));
+
+	for (const uint32_t format : {Settings::FILE_NAME_FORMAT_LEGACY, Settings::FILE_NAME_FORMAT_BASE64}) {
+
+		FilePath fp(dir.c_str(), cipher, nullptr, format);
+
+		// more names than one batch holds, different lengths, and some foreign entries
+		std::vector<std::string> plain;
+		std::vector<std::string> names = {".", ".."};
+		for (uint32_t i = 0; i < 1000; ++i) {
+			plain.push_back(std::string(1 + i % 90, 'a' + i % 26) + std::to_string(i));
+			names.push_back(fp.encrypt(plain.back()));
+			if (i % 100 == 0) {names.push_back("foreign.txt");}
+		}
+		if (format == Settings::FILE_NAME_FORMAT_BASE64) {
+			plain.push_back(std::string(200, 'l'));
+			names.push_back(fp.encrypt(plain.back()));
+			fp.storeLongName(("/" + plain.back()).c_str());
+		}
+
+		// same as one by one, in the same order
+		DirListing listing;
+		for (const std::string& name : names) {listing.push_back(DirEntry(name, ""));}
+		ASSERT_EQ(10u, fp.decryptEntries(dirFD, listing));
+		ASSERT_EQ(plain.size() + 2, listing.size());
+		ASSERT_EQ(".", listing[0].plain);
+		ASSERT_EQ("..", listing[1].enc);
+		for (size_t i = 0; i < plain.size(); ++i) {
+			ASSERT_EQ(plain[i], listing[i+2].plain);
+			ASSERT_EQ(fp.decrypt(listing[i+2].enc), listing[i+2].plain);
+		}
+		if (format == Settings::FILE_NAME_FORMAT_BASE64) {fp.removeLongName(("/" + plain.back()).c_str());}
+
+	}
+
+	close(dirFD);
+	rmdir(dir.c_str());
+
+}
+
+TEST (FileNames, DirStream) {
+
+	const std::string dir = "/tmp/kcryptfs_dirstream_test";
+	mkdir(dir.c_str(), 0700);
+
+	uint8_t key[32] = {};
+	std::shared_ptr<Cipher> cipher(CipherFactory::getByName("aes_cbc_256", key, 32));
+	FilePath fp(dir.c_str(), cipher, nullptr, Settings::FILE_NAME_FORMAT_BASE64);
+
+	// more files than one chunk holds, one foreign and one internal file
+	std::set<std::string> plain = {".", ".."};
+	for (uint32_t i = 0; i < 1000; ++i) {plain.insert("file" + std::to_string(i));}
+	for (const std::string& name : plain) {
+		if (name[0] == '.') {continue;}
+		close(creat((dir + "/" + fp.encrypt(name)).c_str(), 0600));
+	}
+	close(creat((dir + "/foreign.txt").c_str(), 0600));
+	close(creat((dir + "/" + Settings::FILE_PATH_INTERNAL_PREFIX + "test").c_str(), 0600));
+
+	// list using a small buffer: every call continues at the last offset
+	DirStream ds(opendir(dir.c_str()), &fp, nullptr, "/");
+	std::vector<std::string> names;
+	std::vector<off_t> offsets;
+	off_t offset = 0;
+	for (int calls = 0; ; ++calls) {
+		ASSERT_LT(calls, 100);
+		size_t space = 37;
+		const size_t before = names.size();
+		ds.read(offset, [&] (const DirEntry& e, const struct stat& st, const off_t next) {
+			if (space == 0) {return true;}
+			--space;
+			if (e.plain[0] != '.') {EXPECT_TRUE(e.type == DT_REG || e.type == DT_UNKNOWN);}
+			EXPECT_EQ(DTTOIF(e.type), st.st_mode);
+			names.push_back(e.plain);
+			offsets.push_back(next);
+			offset = next;
+			return false;
+		});
+		if (names.size() == before) {break;}
+	}
+	ASSERT_EQ(plain.size(), names.size());
+	ASSERT_EQ(plain, std::set<std::string>(names.begin(), names.end()));
+	ASSERT_EQ(1u, ds.getSkipped());
+
+	// start over, then continue at an offset delivered before
+	std::vector<std::string> head;
+	ds.read(0, [&] (const DirEntry& e, const struct stat&, const off_t) {
+		if (head.size() == 9) {return true;}
+		head.push_back(e.plain);
+		return false;
+	});
+	ASSERT_EQ(std::vector<std::string>(names.begin(), names.begin() + 9), head);
+	std::vector<std::string> tail;
+	ds.read(offsets[499], [&] (const DirEntry& e, const struct stat&, const off_t) {tail.push_back(e.plain); return false;});
+	ASSERT_EQ(std::vector<std::string>(names.begin() + 500, names.end()), tail);
+	ASSERT_EQ(0, ds.close());
+
+	// entries come with their type
+	DirStream ds2(opendir(dir.c_str()), &fp, nullptr, "/");
+	size_t files = 0;
+	ds2.read(0, [&] (const DirEntry& e, const struct stat& st, const off_t) {
+		if (e.plain[0] == '.') {EXPECT_TRUE(S_ISDIR(st.st_mode)); return false;}
+		EXPECT_TRUE(S_ISREG(st.st_mode));
+		++files;
+		return false;
+	});
+	ASSERT_EQ(1000u, files);
+
+	for (const std::string& name : plain) {
+		if (name[0] != '.') {unlink((dir + "/" + fp.encrypt(name)).c_str());}
+	}
+	unlink((dir + "/foreign.txt").c_str());
+	unlink((dir + "/" + Settings::FILE_PATH_INTERNAL_PREFIX + "test").c_str());
+	rmdir(dir.c_str());
+
+}
+
+TEST (FileNames, DirIVs) {
+
+	const std::string dir = "/tmp/kcryptfs_diriv_test";
+	mkdir(dir.c_str(), 0700);
+	FilePath::writeDirIV(dir);
+
+	uint8_t key[32] = {};
+	std::shared_ptr<Cipher> cipher(CipherFactory::getByName("aes_cbc_256", key, 32));
+	FilePath fp(dir.c_str(), cipher, std::make_shared<PathCache>(1024*1024), Settings::FILE_NAME_FORMAT_BASE64, true);
+	FilePath uncached(dir.c_str(), cipher, nullptr, Settings::FILE_NAME_FORMAT_BASE64, true);
+	FilePath fixed(dir.c_str(), cipher, nullptr, Settings::FILE_NAME_FORMAT_BASE64, false);
+
+	// two folders, each with its own IV
+	for (const char* name : {"/a", "/b"}) {
+		ASSERT_EQ(0, mkdir(fp.getAbsolutePathEnc(name).c_str(), 0700));
+		fp.createDirIV(name);
+	}
+
+	// the same name differs within both folders and the root, cached or not
+	const std::string lng(200, 'l');
+	std::set<std::string> encs;
+	for (const std::string& path : std::vector<std::string>{"/x", "/a/x", "/b/x", "/a/" + lng, "/b/" + lng}) {
+		const std::string enc = fp.encryptRelativeFileName(path.c_str());
+		ASSERT_EQ(enc, uncached.encryptRelativeFileName(path.c_str()));
+		ASSERT_EQ(path, fp.decryptRelativeFileName(enc.c_str()));
+		encs.insert(enc.substr(enc.rfind('/')));
+	}
+	ASSERT_EQ(5u, encs.size());
+	ASSERT_NE(fixed.encryptRelativeFileName("/x"), fp.encryptRelativeFileName("/x"));
+
+	// listings use the folder's IV and hide it
+	close(creat(fp.getAbsolutePathEnc("/a/x").c_str(), 0600));
+	fp.storeLongName(("/a/" + lng).c_str());
+	close(creat(fp.getAbsolutePathEnc(("/a/" + lng).c_str()).c_str(), 0600));
+	std::vector<std::string> names;
+	DirStream ds(opendir(fp.getAbsolutePathEnc("/a").c_str()), &fp, nullptr, "/a");
+	ds.read(0, [&] (const DirEntry& e, const struct stat&, const off_t) {names.push_back(e.plain); return false;});
+	std::sort(names.begin(), names.end());
+	ASSERT_EQ(std::vector<std::string>({".", "..", lng, "x"}), names);
+	ASSERT_EQ(0u, ds.getSkipped());
+
+	// folders without IV use the fixed one
+	ASSERT_EQ(0, mkdir(fp.getAbsolutePathEnc("/c").c_str(), 0700));
+	fp.invalidate("/c");
+	const std::string enc = fp.encryptRelativeFileName("/c/x");
+	ASSERT_EQ(fixed.encrypt("x"), enc.substr(enc.rfind('/') + 1));
+
+	// the IV prevents removing folders, unless they are empty
+	ASSERT_THROW(fp.removeDirIV("/a"), Exception);
+	unlink(fp.getAbsolutePathEnc("/a/x").c_str());
+	unlink(fp.getAbsolutePathEnc(("/a/" + lng).c_str()).c_str());
+	fp.removeLongName(("/a/" + lng).c_str());
+	for (const char* name : {"/a", "/b", "/c"}) {
+		fp.removeDirIV(name);
+		ASSERT_EQ(0, rmdir(fp.getAbsolutePathEnc(name).c_str()));
+		fp.invalidate(name);
+	}
+
+	// a new folder with the same name gets a new IV
+	const std::string before = fp.encryptRelativeFileName("/a/x");
+	ASSERT_EQ(0, mkdir(fp.getAbsolutePathEnc("/a").c_str(), 0700));
+	fp.createDirIV("/a");
+	const std::string after = fp.encryptRelativeFileName("/a/x");
+	ASSERT_NE(before, after);
+
+	// removing the folder failed: it gets back the same IV
+	uint8_t iv[Settings::FILE_PATH_DIR_IV_LEN];
+	ASSERT_TRUE(fp.removeDirIV("/a", iv));
+	ASSERT_FALSE(fp.removeDirIV("/a", iv));
+	fp.restoreDirIV("/a", iv);
+	ASSERT_EQ(after, fp.encryptRelativeFileName("/a/x"));
+	ASSERT_EQ(after, FilePath(dir.c_str(), cipher, nullptr, Settings::FILE_NAME_FORMAT_BASE64, true).encryptRelativeFileName("/a/x"));
+	ASSERT_TRUE(fp.removeDirIV("/a"));
+
+	// read-only folders: write access is granted temporarily
+	ASSERT_EQ(0, mkdir(fp.getAbsolutePathEnc("/d").c_str(), 0700));
+	fp.createDirIV("/d");
+	ASSERT_EQ(0, chmod(fp.getAbsolutePathEnc("/d").c_str(), 0555));
+	const int dirFD = open(fp.getAbsolutePathEnc("/d").c_str(), O_RDONLY | O_DIRECTORY);
+	struct stat st;
+	ASSERT_EQ(7, FilePath::withWriteAccess(dirFD, [&] () {fstat(dirFD, &st); return 7;}));
+	ASSERT_EQ(0755u, st.st_mode & 07777);
+	fstat(dirFD, &st);
+	ASSERT_EQ(0555u, st.st_mode & 07777);
+	close(dirFD);
+	ASSERT_TRUE(fp.removeDirIV("/d", iv));
+	fp.restoreDirIV("/d", iv);
+	ASSERT_TRUE(fp.removeDirIV("/d"));
+	ASSERT_EQ(0, rmdir(fp.getAbsolutePathEnc("/d").c_str()));
+	fp.invalidate("/d");
+	rmdir(fp.getAbsolutePathEnc("/a").c_str());
+
+	unlink((dir + "/" + Settings::FILE_PATH_DIR_IV).c_str());
+	rmdir(dir.c_str());
+
+}
+
+TEST (FileNames, LegacyTooLong) {
+
+	uint8_t key[32] = {};
+	std::shared_ptr<Cipher> cipher(CipherFactory::getByName("aes_cbc_256", key, 32));
+	FilePath fp("/", cipher);
+	ASSERT_EQ(Settings::FILE_NAME_FORMAT_LEGACY, fp.getNameFormat());
+
+	const std::string ori(Settings::FILE_PATH_ML2, 'x');
+	ASSERT_EQ(ori, fp.decrypt(fp.encrypt(ori)));
+	try {
+		fp.encrypt(ori + "x");
+		FAIL();
+	} catch (const Exception& e) {
+		ASSERT_EQ(ENAMETOOLONG, e.getErrno());
+	}
+	ASSERT_THROW(fp.decrypt(std::string(Settings::FILE_PATH_ML + 2, 'a')), Exception);
+	ASSERT_THROW(fp.decrypt(std::string(Settings::FILE_PATH_ML - 2, 'a')), Exception);
+	ASSERT_THROW(fp.decrypt(std::string(Settings::FILE_PATH_ML, 'q')), Exception);
+	ASSERT_THROW(fp.decrypt("readme.txt"), Exception);
+
+}
+
 TEST (FileNames, RelAbsFileName) { 
 
 	uint8_t key[32] = {};
@@ -135,5 +464,158 @@ TEST (FileNames, SplitAndChange) {
 	
 }
 
+TEST (FileNames, SplitView) {
+
+	const std::string path = "/test//path/file.txt/";
+	FilePathParts parts(path.data(), path.length());
+	PathView part;
+	ASSERT_TRUE(parts.next(part));		ASSERT_EQ("test", part.str());		ASSERT_TRUE(part == "test");	ASSERT_FALSE(part == "tes");
+	ASSERT_TRUE(parts.next(part));		ASSERT_EQ("path", part.str());
+	ASSERT_TRUE(parts.next(part));		ASSERT_EQ("file.txt", part.str());
+	ASSERT_FALSE(parts.next(part));
+
+	FilePathParts root("/", 1);
+	ASSERT_FALSE(root.next(part));
+
+}
+
+TEST (FileNames, PathBuffer) {
+
+	uint8_t key[32] = {};
+	std::shared_ptr<Cipher> cipher(CipherFactory::getByName("aes_cbc_256", key, 32));
+	FilePath fp("/mnt/enc", cipher);
+
+	// same as the string variant
+	PathBuffer buf;
+	for (const char* p : {"/", "/a", "/a/b/file.txt", "/a/", "/x/../y"}) {
+		fp.getAbsolutePathEnc(p, buf);
+		ASSERT_EQ(fp.getAbsolutePathEnc(p), buf.str());
+		ASSERT_EQ(strlen(buf.c_str()), buf.length());
+	}
+
+	// paths are limited to PATH_MAX
+	std::string deep;
+	while (deep.length() < PATH_MAX / 4) {deep += "/dir";}
+	try {
+		fp.getAbsolutePathEnc(deep.c_str(), buf);
+		FAIL();
+	} catch (const Exception& e) {
+		ASSERT_EQ(ENAMETOOLONG, e.getErrno());
+	}
+
+}
+
+TEST (FileNames, PathCache) {
+
+	uint8_t key[32] = {};
+	std::shared_ptr<Cipher> cipher(CipherFactory::getByName("aes_cbc_256", key, 32));
+	std::shared_ptr<PathCache> cache = std::make_shared<PathCache>(1024*1024);
+	FilePath fp("/", cipher);
+	FilePath fpc("/", cipher, cache);
+
+	// same results as without cache, also when served from the cache
+	const std::vector<std::string> paths = {"/", "/a", "/a/b", "/a/b/file.txt", "/a/", "/a/./c", "/x/../y"};
+	for (int run = 0; run < 2; ++run) {
+		for (const std::string& p : paths) {
+			ASSERT_EQ(fp.encryptRelativeFileName(p.c_str()), fpc.encryptRelativeFileName(p.c_str())) << p;
+		}
+	}
+
+	// all folders along the path are cached
+	std::string enc;
+	ASSERT_TRUE(cache->get("/a/b", enc));
+	ASSERT_EQ(fp.encryptRelativeFileName("/a/b"), enc);
+
+	// invalidating a folder removes everything below, but not its siblings
+	fpc.encryptRelativeFileName("/ab/c");
+	fpc.invalidate("/a");
+	ASSERT_FALSE(cache->get("/a", enc));
+	ASSERT_FALSE(cache->get("/a/b/file.txt", enc));
+	ASSERT_TRUE(cache->get("/ab/c", enc));
+	fpc.invalidate("/");
+	ASSERT_EQ(0u, cache->size());
+
+}
+
+TEST (FileNames, PathCacheSeed) {
+
+	uint8_t key[32] = {};
+	std::shared_ptr<Cipher> cipher(CipherFactory::getByName("aes_cbc_256", key, 32));
+	std::shared_ptr<PathCache> cache = std::make_shared<PathCache>(1024*1024);
+	FilePath fp("/", cipher, cache);
+
+	DirListing listing;
+	listing.push_back(DirEntry(".", "."));
+	listing.push_back(DirEntry(fp.encrypt("file.txt"), "file.txt"));
+	fp.seed("/dir", listing);
+	fp.seed("/", listing);
+
+	std::string enc;
+	ASSERT_TRUE(cache->get("/dir/file.txt", enc));
+	ASSERT_EQ(fp.encryptRelativeFileNameUncached("/dir/file.txt"), enc);
+	ASSERT_TRUE(cache->get("/file.txt", enc));
+	ASSERT_EQ(fp.encryptRelativeFileNameUncached("/file.txt"), enc);
+	ASSERT_FALSE(cache->get("/dir/.", enc));
+
+}
+
+TEST (FileNames, DirCache) {
+
+	const std::string dir = "/tmp/kcryptfs_dircache_test";
+	mkdir(dir.c_str(), 0700);
+
+	// listings of just modified folders are not cached
+	DirCache cache(1024*1024);
+	std::shared_ptr<DirListing> listing = std::make_shared<DirListing>();
+	listing->push_back(DirEntry("abc", "x"));
+	struct stat st;
+	ASSERT_EQ(0, stat(dir.c_str(), &st));
+	cache.put(st, listing);
+	ASSERT_EQ(nullptr, cache.get(st));
+
+	// older ones are
+	struct timespec ts[2] = {{1000000, 0}, {1000000, 0}};
+	ASSERT_EQ(0, utimensat(AT_FDCWD, dir.c_str(), ts, 0));
+	ASSERT_EQ(0, stat(dir.c_str(), &st));
+	st.st_ctim.tv_sec -= 10;					// utimensat() updated the ctime
+	cache.put(st, listing);
+	ASSERT_NE(nullptr, cache.get(st));
+	ASSERT_EQ("x", cache.get(st)->at(0).plain);
+
+	// the folder was modified
+	struct stat st2 = st;
+	st2.st_mtim.tv_nsec += 1;
+	ASSERT_EQ(nullptr, cache.get(st2));
+	ASSERT_EQ(nullptr, cache.get(st));
+	ASSERT_EQ(0u, cache.size());
+
+	// memory limit
+	DirCache small(4096);
+	for (int i = 0; i < 100; ++i) {
+		st.st_ino = i;
+		small.put(st, listing);
+		ASSERT_LE(small.getBytes(), 4096u);
+	}
+
+	rmdir(dir.c_str());
+
+}
+
+TEST (FileNames, PathCacheLimit) {
+
+	PathCache cache(16 * 1024);
+	for (int i = 0; i < 1000; ++i) {
+		cache.put("/folder/file" + std::to_string(i), std::string(192, 'x'));
+		ASSERT_LE(cache.getBytes(), 16u * 1024);
+	}
+	ASSERT_LT(0u, cache.size());
+
+	ASSERT_TRUE(PathCache::isBelow("/a/b", "/a"));
+	ASSERT_TRUE(PathCache::isBelow("/a", "/a"));
+	ASSERT_FALSE(PathCache::isBelow("/ab", "/a"));
+	ASSERT_TRUE(PathCache::isBelow("/ab", "/"));
+
+}
+
 
 #endif
@@ -2,6 +2,9 @@
 
 #ifdef WITH_TESTS
 
+#include "../iv/IVGeneratorCached.h"
+#include <thread>
+
 TEST(IVGenerator, generate) {
 	
 	uint8_t key[32] = {};
@@ -25,6 +28,245 @@ TEST(IVGenerator, generate) {
 	
 }
 
+TEST(IVGenerator, essiv) {
+
+	uint8_t key[32] = {};
+	uint32_t keyLen = 32;
+
+	std::shared_ptr<IVGenerator> g(IVGeneratorFactory::getByName("essiv_sha256", key, keyLen));
+
+	uint8_t iv[16];
+	uint32_t ivLen = 16;
+
+	// IV = AES-256-ECB_SHA256(key)(offset)
+	g->getIV(0, iv, ivLen);
+	ASSERT_EQ("87eeabbc603b2f5cd49f03d2e811947f", Helper::toHexStr(iv, ivLen));
+	g->getIV(4096, iv, ivLen);
+	ASSERT_EQ("7e01e6dae0c57e56dc3ee704aabacc1c", Helper::toHexStr(iv, ivLen));
+
+}
+
+TEST(IVGenerator, hmac) {
+
+	uint8_t key[32] = {};
+	uint32_t keyLen = 32;
+	uint8_t nonce[16] = {1, 2, 3};
+
+	std::shared_ptr<IVGenerator> g(IVGeneratorFactory::getByName("hmac_sha256", key, keyLen));
+
+	uint8_t iv[16];
+	uint8_t iv2[16];
+	uint32_t ivLen = 16;
+
+	// IV = HMAC-SHA256_SHA256(key)(offset)
+	g->getIV(0, iv, ivLen);
+	ASSERT_EQ("3cca23bef9b98cb3b0d9f782443e8607", Helper::toHexStr(iv, ivLen));
+	g->getIV(4096, iv, ivLen);
+	ASSERT_EQ("b44c2f99b02493bafa834334387ab179", Helper::toHexStr(iv, ivLen));
+
+	// the nonce changes the key
+	g->setFileNonce(nonce, sizeof(nonce));
+	g->getIV(4096, iv2, ivLen);
+	ASSERT_NE(0, memcmp(iv, iv2, ivLen));
+
+}
+
+TEST(IVGenerator, batched) {
+
+	uint8_t key[32] = {3};
+	uint32_t keyLen = 32;
+
+	// more blocks than the generators process at once
+	const uint32_t count = 150;
+	const uint32_t ivLen = 16;
+	const uint32_t stride = 4096;
+	const size_t start = 1000 * stride;
+
+	for (const std::string name : {"sha256", "md5", "essiv_sha256", "hmac_sha256"}) {
+
+		std::shared_ptr<IVGenerator> g(IVGeneratorFactory::getByName(name, key, keyLen));
+
+		// batched IVs must match the single ones
+		uint8_t ivs[count * ivLen];
+		uint8_t iv[ivLen];
+		g->getIVs(start, stride, count, ivs, ivLen);
+		for (uint32_t i = 0; i < count; ++i) {
+			g->getIV(start + i*stride, iv, ivLen);
+			ASSERT_EQ(0, memcmp(iv, &ivs[i*ivLen], ivLen)) << name << " block " << i;
+		}
+
+	}
+
+}
+
+TEST(IVGenerator, cached) {
+
+	uint8_t key[32] = {5};
+	uint32_t keyLen = 32;
+	const uint32_t ivLen = 16;
+	const uint32_t stride = 4096;
+
+	std::shared_ptr<IVGenerator> ref(IVGeneratorFactory::getByName("sha256", key, keyLen));
+	std::shared_ptr<IVGenerator> gen(IVGeneratorFactory::getByName("sha256", key, keyLen));
+
+	std::shared_ptr<IVCacheTable> table = std::make_shared<IVCacheTable>(1000);
+	ASSERT_EQ(1024, table->size());
+	IVGeneratorCached cached(gen, table);
+	cached.prefill(0, stride, 64);
+
+	Stats::get().reset();
+	uint8_t iv1[ivLen];
+	uint8_t iv2[ivLen];
+	uint8_t ivs[300*ivLen];
+
+	// single IVs: prefilled ones are hits
+	for (uint32_t i = 0; i < 64; ++i) {
+		cached.getIV(i*stride, iv1, ivLen);
+		ref->getIV(i*stride, iv2, ivLen);
+		ASSERT_EQ(0, memcmp(iv1, iv2, ivLen));
+	}
+	ASSERT_EQ(64, Stats::get().ivCacheHits);
+
+	// batches, twice: always correct, the 2nd pass hits the cache
+	for (int pass = 0; pass < 2; ++pass) {
+		cached.getIVs(1000*stride, stride, 100, ivs, ivLen);
+		for (uint32_t i = 0; i < 100; ++i) {
+			ref->getIV((1000+i)*stride, iv2, ivLen);
+			ASSERT_EQ(0, memcmp(&ivs[i*ivLen], iv2, ivLen));
+		}
+	}
+	ASSERT_GT(Stats::get().ivCacheHits, 64+50);
+	ASSERT_EQ(64+200, Stats::get().ivCacheHits + Stats::get().ivCacheMisses);
+
+	// shorter IVs are a prefix of the cached ones
+	cached.getIV(5*stride, iv1, 8);
+	ref->getIV(5*stride, iv2, 8);
+	ASSERT_EQ(0, memcmp(iv1, iv2, 8));
+
+	// more blocks than the table holds -> many collisions
+	IVGeneratorCached small(gen, std::make_shared<IVCacheTable>(16));
+	small.getIVs(0, stride, 300, ivs, ivLen);
+	small.getIVs(0, stride, 300, ivs, ivLen);
+	for (uint32_t i = 0; i < 300; ++i) {
+		ref->getIV(i*stride, iv2, ivLen);
+		ASSERT_EQ(0, memcmp(&ivs[i*ivLen], iv2, ivLen));
+	}
+
+}
+
+TEST(IVGenerator, fileNonce) {
+
+	uint8_t key[32] = {};
+	uint32_t keyLen = 32;
+	uint8_t legacy[16] = {};
+	uint8_t nonce1[16] = {1, 2, 3};
+	uint8_t nonce2[16] = {4, 5, 6};
+	uint8_t ivA[16], ivB[16], ivC[16];
+
+	std::shared_ptr<IVCacheTable> table = std::make_shared<IVCacheTable>(64);
+
+	for (const std::string name : {"sha256", "essiv_sha256"}) {
+
+		std::shared_ptr<IVGenerator> plain(IVGeneratorFactory::getByName(name, key, keyLen));
+		std::shared_ptr<IVGenerator> gen(IVGeneratorFactory::getByName(name, key, keyLen));
+		IVGeneratorCached cached(plain, table);
+
+		for (IVGenerator* g : {gen.get(), (IVGenerator*) &cached}) {
+
+			// all-zero nonce: legacy IVs
+			g->getIV(4096, ivA, 16);
+			g->setFileNonce(legacy, 16);
+			g->getIV(4096, ivB, 16);
+			ASSERT_EQ(0, memcmp(ivA, ivB, 16));
+
+			// each nonce yields other IVs
+			g->setFileNonce(nonce1, 16);
+			g->getIV(4096, ivB, 16);
+			g->setFileNonce(nonce2, 16);
+			g->getIV(4096, ivC, 16);
+			ASSERT_NE(0, memcmp(ivA, ivB, 16));
+			ASSERT_NE(0, memcmp(ivB, ivC, 16));
+
+			// but stay the same for the same nonce
+			g->setFileNonce(nonce1, 16);
+			g->getIV(4096, ivC, 16);
+			ASSERT_EQ(0, memcmp(ivB, ivC, 16));
+			g->setFileNonce(legacy, 16);
+
+		}
+
+	}
+
+}
+
+TEST(IVGenerator, cachedThreads) {
+
+	uint8_t key[32] = {5};
+	uint32_t keyLen = 32;
+	const uint32_t ivLen = 16;
+
+	// one table, shared by several threads (each with its own generator)
+	std::shared_ptr<IVCacheTable> table = std::make_shared<IVCacheTable>(64);
+	std::vector<std::thread> threads;
+	std::atomic<int> errors(0);
+
+	for (int t = 0; t < 4; ++t) {
+		threads.push_back(std::thread([&] () {
+			std::shared_ptr<IVGenerator> ref(IVGeneratorFactory::getByName("sha256", key, keyLen));
+			std::shared_ptr<IVGenerator> gen(IVGeneratorFactory::getByName("sha256", key, keyLen));
+			IVGeneratorCached cached(gen, table);
+			uint8_t iv1[ivLen];
+			uint8_t iv2[ivLen];
+			for (uint32_t i = 0; i < 20000; ++i) {
+				const size_t pos = (rand() % 256) * 4096;
+				cached.getIV(pos, iv1, ivLen);
+				ref->getIV(pos, iv2, ivLen);
+				if (memcmp(iv1, iv2, ivLen)) {++errors;}
+			}
+		}));
+	}
+	for (std::thread& t : threads) {t.join();}
+	ASSERT_EQ(0, errors);
+
+}
+
+TEST(IVGenerator, sharedThreads) {
+
+	uint8_t key[32] = {7};
+	uint32_t keyLen = 32;
+	uint8_t nonce[16] = {1,2,3};
+	const uint32_t ivLen = 16;
+	const uint32_t num = 512;
+
+	// reference IVs, derived single-threaded
+	std::shared_ptr<IVGenerator> g(IVGeneratorFactory::getByName("sha256", key, keyLen));
+	g->setFileNonce(nonce, sizeof(nonce));
+	std::vector<uint8_t> ref(num * ivLen);
+	for (uint32_t i = 0; i < num; ++i) {g->getIV(i*4096, &ref[i*ivLen], ivLen);}
+
+	// one generator, shared by several threads
+	std::vector<std::thread> threads;
+	std::atomic<int> errors(0);
+	for (int t = 0; t < 4; ++t) {
+		threads.push_back(std::thread([&, t] () {
+			uint8_t iv[ivLen];
+			uint8_t ivs[8 * ivLen];
+			for (uint32_t r = 0; r < 50; ++r) {
+				for (uint32_t i = 0; i < num; ++i) {
+					const uint32_t idx = (i * (t+1)) % num;
+					g->getIV(idx*4096, iv, ivLen);
+					if (memcmp(iv, &ref[idx*ivLen], ivLen)) {++errors;}
+				}
+				g->getIVs(8*4096, 4096, 8, ivs, ivLen);
+				if (memcmp(ivs, &ref[8*ivLen], sizeof(ivs))) {++errors;}
+			}
+		}));
+	}
+	for (std::thread& t : threads) {t.join();}
+	ASSERT_EQ(0, errors);
+
+}
+
 /** get avg difference between two IVs */
 inline int getAvgDiff(const uint8_t* a, const uint8_t* b, const uint32_t len) {
 	int sum = 0;
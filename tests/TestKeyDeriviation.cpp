@@ -4,6 +4,8 @@
 
 #include "../derivation/KeyDerivationOpenSSL.h"
 #include "../derivation/KeyDerivationSCrypt.h"
+#include "../derivation/KeyDerivationArgon2.h"
+#include "../derivation/KeyDerivationParams.h"
 
 #ifdef WITH_OPENSSL
 
@@ -28,6 +30,27 @@ TEST(KeyDerivation, openSSL) {
 
 }
 
+TEST(KeyDerivation, openSSLParams) {
+
+	KeyDerivationOpenSSL kd(OpenSSLKeyDerivations::SHA_256);
+	ASSERT_EQ(Settings::PBKDF2_ITERATIONS, kd.getParams()["iterations"]);
+
+	// known PBKDF2-HMAC-SHA256 results
+	const std::string pass = "password";
+	const std::string salt = "salt";
+	uint8_t out1[32];
+	uint8_t out2[32];
+	kd.setParams(KeyDerivation::Params{{"iterations", 2}});
+	kd.derive((uint8_t*)pass.data(), pass.size(), (uint8_t*)salt.data(), salt.size(), out1, 32);
+	ASSERT_EQ("ae4d0c95af6b46d32d0adff928f06dd02a303f8ef3c251dfd6e2d85a95474c43", Helper::toHexStr(out1, 32));
+	kd.setParams(KeyDerivation::Params{{"iterations", 1}});
+	kd.derive((uint8_t*)pass.data(), pass.size(), (uint8_t*)salt.data(), salt.size(), out2, 32);
+	ASSERT_EQ("120fb6cffcf8b32c43e7225256c4f837a86548c92ccc35480805987cb70be17b", Helper::toHexStr(out2, 32));
+
+	ASSERT_THROW(kd.setParams(KeyDerivation::Params{{"iterations", 0}}), Exception);
+
+}
+
 #endif
 
 
@@ -39,4 +62,108 @@ TEST(KeyDerivation, SCrypt) {
 
 #endif
 
+TEST(KeyDerivation, Blake2b) {
+
+	const std::string abc = "abc";
+	uint8_t out[64];
+	Blake2b::hash((const uint8_t*)abc.data(), abc.size(), out, 64);
+	ASSERT_EQ("ba80a53f981c4d0d6a2797b69f12f6e94c212f14685ac4b74b12bb6fdbffa2d17d87c5392aab792dc252d5de4533cc9518d38aa8dbf1925ab92386edd4009923", Helper::toHexStr(out, 64));
+
+	// several blocks, appended in pieces
+	std::vector<uint8_t> data(1000);
+	for (size_t i = 0; i < data.size(); ++i) {data[i] = (uint8_t)i;}
+	uint8_t ref[32];
+	Blake2b::hash(data.data(), data.size(), ref, 32);
+	Blake2b b(32);
+	b.update(data.data(), 128);
+	b.update(data.data() + 128, 1);
+	b.update(data.data() + 129, 871);
+	b.final(out);
+	ASSERT_EQ(Helper::toHexStr(ref, 32), Helper::toHexStr(out, 32));
+
+}
+
+/** RFC 9106 test vectors */
+static std::string _argon2RFC(const Argon2Type type) {
+
+	uint8_t pass[32];	memset(pass, 0x01, sizeof(pass));
+	uint8_t salt[16];	memset(salt, 0x02, sizeof(salt));
+	uint8_t secret[8];	memset(secret, 0x03, sizeof(secret));
+	uint8_t ad[12];		memset(ad, 0x04, sizeof(ad));
+
+	KeyDerivationArgon2 kd(type);
+	kd.setParams(KeyDerivation::Params{{"passes", 3}, {"memory", 32}, {"lanes", 4}});
+	kd.setSecret(secret, sizeof(secret));
+	kd.setAssociatedData(ad, sizeof(ad));
+
+	uint8_t out[32];
+	kd.derive(pass, sizeof(pass), salt, sizeof(salt), out, sizeof(out));
+	return Helper::toHexStr(out, sizeof(out));
+
+}
+
+TEST(KeyDerivation, Argon2) {
+
+	ASSERT_EQ("512b391b6f1162975371d30919734294f868e3be3984f3c1a13a4db9fabe4acb", _argon2RFC(Argon2Type::D));
+	ASSERT_EQ("c814d9d1dc7f37aa13f0d77f2494bda1c8de6b016dd388d29952a4c4672b6ce8", _argon2RFC(Argon2Type::I));
+	ASSERT_EQ("0d640df58d78766c08c037a34a8b53c9d01ef0452d75b65eb52520e96b01e659", _argon2RFC(Argon2Type::ID));
+
+}
+
+TEST(KeyDerivation, Argon2Params) {
+
+	KeyDerivationArgon2 kd;
+	ASSERT_EQ(Settings::ARGON2_PASSES, kd.getParams()["passes"]);
+	ASSERT_EQ(Settings::ARGON2_MEMORY_KIB, kd.getParams()["memory"]);
+	ASSERT_EQ(Settings::ARGON2_LANES, kd.getParams()["lanes"]);
+
+	// output longer than one BLAKE2b hash, different parameters, different keys
+	const std::string pass = "helloWorld";
+	const uint8_t salt[16] = {1,2,3,4,5,6,7,8};
+	uint8_t out1[100];
+	uint8_t out2[100];
+	kd.setParams(KeyDerivation::Params{{"passes", 1}, {"memory", 256}, {"lanes", 2}});
+	kd.derive((uint8_t*)pass.data(), pass.size(), salt, 16, out1, 100);
+	kd.setParams(KeyDerivation::Params{{"lanes", 1}});
+	kd.derive((uint8_t*)pass.data(), pass.size(), salt, 16, out2, 100);
+	ASSERT_NE(Helper::toHexStr(out1, 100), Helper::toHexStr(out2, 100));
+	ASSERT_EQ(1u, kd.getParams()["passes"]);
+
+	ASSERT_THROW(kd.setParams(KeyDerivation::Params{{"passes", 0}}), Exception);
+	ASSERT_THROW(kd.setParams(KeyDerivation::Params{{"memory", 4}}), Exception);
+	ASSERT_THROW(kd.derive((uint8_t*)pass.data(), pass.size(), salt, 4, out1, 32), Exception);
+
+}
+
+TEST(KeyDerivation, calibrate) {
+
+	// calibration never weakens the defaults
+	KeyDerivationArgon2 kd;
+	kd.calibrate(1, Settings::KDF_DERIVATIONS_LEGACY);
+	ASSERT_LE(Settings::ARGON2_PASSES, kd.getParams()["passes"]);
+	ASSERT_LE(Settings::ARGON2_MEMORY_KIB, kd.getParams()["memory"]);
+	ASSERT_LE(Settings::ARGON2_LANES, kd.getParams()["lanes"]);
+
+	// volume configs: one derivation only
+	kd.calibrate(1, Settings::KDF_DERIVATIONS_VOLUME);
+	ASSERT_LE(Settings::ARGON2_PASSES, kd.getParams()["passes"]);
+	ASSERT_LT(0, kd.measureUnlock(Settings::KDF_DERIVATIONS_VOLUME));
+
+}
+
+TEST(KeyDerivation, paramsFile) {
+
+	const std::string file = "/tmp/kcryptfs_kdf_test";
+	KeyDerivationParams out("argon2id", KeyDerivation::Params{{"passes", 4}, {"memory", 1024}, {"lanes", 8}});
+	out.save(file);
+
+	const KeyDerivationParams in = KeyDerivationParams::load(file);
+	ASSERT_EQ("argon2id", in.getName());
+	ASSERT_EQ(out.getParams(), in.getParams());
+	unlink(file.c_str());
+
+	ASSERT_THROW(KeyDerivationParams::load(file), Exception);
+
+}
+
 #endif
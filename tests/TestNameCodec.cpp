@@ -0,0 +1,120 @@
+#include "Tests.h"
+
+#ifdef WITH_TESTS
+
+#include "../files/NameCodec.h"
+
+/** the former per-nibble hex encoding as reference */
+static void _refToHex(const uint8_t* bytes, const uint32_t len, char* chars) {
+	for (uint32_t i = 0; i < len; ++i) {
+		chars[i*2+0] = 'a' + ((bytes[i] >> 0) & 0xF);
+		chars[i*2+1] = 'a' + ((bytes[i] >> 4) & 0xF);
+	}
+}
+
+/** the former per-nibble hex decoding as reference (without validation) */
+static void _refFromHex(const char* chars, const uint32_t len, uint8_t* bytes) {
+	for (uint32_t i = 0; i < len / 2; ++i) {
+		bytes[i] = ((chars[i*2+0]-'a') << 0) | ((chars[i*2+1]-'a') << 4);
+	}
+}
+
+TEST (NameCodec, Hex) {
+
+	uint8_t src[100];
+	for (uint32_t i = 0; i < sizeof(src); ++i) {src[i] = (uint8_t)(i * 37 + 11);}
+
+	// same output as the former encoding for all lengths (vectorized blocks and remainder)
+	for (uint32_t len = 0; len <= sizeof(src); ++len) {
+		char ref[200];
+		char chars[200];
+		_refToHex(src, len, ref);
+		NameCodec::toHex(src, len, chars);
+		ASSERT_EQ(std::string(ref, len*2), std::string(chars, len*2));
+		uint8_t dst[100];
+		ASSERT_TRUE(NameCodec::fromHex(chars, len*2, dst));
+		ASSERT_EQ(0, memcmp(src, dst, len));
+	}
+
+	// every byte value
+	uint8_t all[256];
+	for (int i = 0; i < 256; ++i) {all[i] = (uint8_t)i;}
+	char chars[512];
+	uint8_t dst[256];
+	NameCodec::toHex(all, 256, chars);
+	ASSERT_TRUE(NameCodec::fromHex(chars, 512, dst));
+	ASSERT_EQ(0, memcmp(all, dst, 256));
+
+	// invalid characters are detected within vectorized blocks and the remainder
+	for (const uint32_t pos : {0u, 17u, 31u, 32u, 63u, 190u, 191u}) {
+		for (const char c : {'q', 'A', '`', '0', '\xe1'}) {
+			char bad[192];
+			NameCodec::toHex(all, 96, bad);
+			bad[pos] = c;
+			ASSERT_FALSE(NameCodec::fromHex(bad, 192, dst)) << pos << " " << c;
+		}
+	}
+	ASSERT_FALSE(NameCodec::fromHex("abc", 3, dst));		// odd length
+
+}
+
+TEST (NameCodec, Base64) {
+
+	const std::vector<std::pair<std::string, std::string>> vectors = {
+		{"", ""}, {"f", "Zg"}, {"fo", "Zm8"}, {"foo", "Zm9v"}, {"foob", "Zm9vYg"}, {"fooba", "Zm9vYmE"}, {"foobar", "Zm9vYmFy"}, {"\xfb\xff", "-_8"}
+	};
+	for (const auto& v : vectors) {
+		ASSERT_EQ(v.second, NameCodec::toBase64((const uint8_t*)v.first.data(), v.first.length()));
+		uint8_t out[16];
+		const int len = NameCodec::fromBase64(v.second.data(), v.second.length(), out, sizeof(out));
+		ASSERT_EQ(v.first, std::string((const char*)out, len));
+	}
+
+	// every byte value
+	uint8_t all[256];
+	for (int i = 0; i < 256; ++i) {all[i] = (uint8_t)i;}
+	const std::string enc = NameCodec::toBase64(all, 256);
+	uint8_t dst[256];
+	ASSERT_EQ(256, NameCodec::fromBase64(enc.data(), enc.length(), dst, sizeof(dst)));
+	ASSERT_EQ(0, memcmp(all, dst, 256));
+
+	uint8_t out[16];
+	ASSERT_EQ(-1, NameCodec::fromBase64("Zm9v+", 5, out, sizeof(out)));		// invalid length
+	ASSERT_EQ(-1, NameCodec::fromBase64("Zm9/", 4, out, sizeof(out)));		// not base64url
+	ASSERT_EQ(-1, NameCodec::fromBase64("Zm9\xc1", 4, out, sizeof(out)));	// not base64url
+	ASSERT_EQ(-1, NameCodec::fromBase64("Zm8=", 4, out, sizeof(out)));		// no padding
+	ASSERT_EQ(-1, NameCodec::fromBase64("Zh", 2, out, sizeof(out)));		// trailing bits
+	ASSERT_EQ(-1, NameCodec::fromBase64("Zm9", 3, out, sizeof(out)));		// trailing bits
+	ASSERT_EQ(-1, NameCodec::fromBase64("Zm9vYmFy", 8, out, 5));			// too long
+
+}
+
+TEST (Benchmark, NameCodec) {
+
+	// one legacy name (96 bytes, 192 characters) and one compact name (48 bytes)
+	uint8_t bytes[96];
+	for (uint32_t i = 0; i < sizeof(bytes); ++i) {bytes[i] = (uint8_t)(i * 73 + 5);}
+	char chars[192];
+	NameCodec::toHex(bytes, 96, chars);
+	const std::string b64 = NameCodec::toBase64(bytes, 48);
+	const uint32_t count = 1024*1024*4;
+	volatile uint8_t sink = 0;
+
+	auto run = [&] (const std::string& name, std::function<void()> func) {
+		auto start = std::chrono::high_resolution_clock::now();
+		for (uint32_t i = 0; i < count; ++i) {func();}
+		auto end = std::chrono::high_resolution_clock::now();
+		auto diff = std::chrono::duration<double>(end-start).count();
+		std::cout << name << ":\t" << count / diff / 1000000 << " M names/sec" << std::endl;
+	};
+
+	run("hex encode (scalar)",		[&] () {_refToHex(bytes, 96, chars); sink += chars[5];});
+	run("hex encode",				[&] () {NameCodec::toHex(bytes, 96, chars); sink += chars[5];});
+	run("hex decode (scalar)",		[&] () {_refFromHex(chars, 192, bytes); sink += bytes[5];});
+	run("hex decode (validated)",	[&] () {sink += NameCodec::fromHex(chars, 192, bytes); sink += bytes[5];});
+	run("base64url encode",			[&] () {sink += NameCodec::toBase64(bytes, 48)[5];});
+	run("base64url decode",			[&] () {sink += NameCodec::fromBase64(b64.data(), b64.length(), bytes, 48);});
+
+}
+
+#endif
@@ -0,0 +1,149 @@
+#include "Tests.h"
+
+#ifdef WITH_TESTS
+
+#ifdef WITH_OPENSSL
+
+#include "../Keys.h"
+#include "../VolumeConfig.h"
+
+#include <sys/stat.h>
+
+/** a volume config using fast parameters */
+static VolumeConfig _getVolume() {
+	VolumeConfig volume;
+	volume.set("cipher-filedata", "openssl_aes_cbc_256");
+	volume.set("cipher-filename", "openssl_aes_cbc_128");
+	volume.set("iv-gen", "openssl_sha256");
+	volume.set("block-size", "8192");
+	volume.setKeyDerivationParams(KeyDerivationParams("openssl_pbkdf2_sha256", KeyDerivation::Params{{"iterations", 1000}}));
+	return volume;
+}
+
+TEST(VolumeConfig, saveLoad) {
+
+	const std::string dir = "/tmp/kcryptfs_volume_test";
+	mkdir(dir.c_str(), 0700);
+	ASSERT_FALSE(VolumeConfig::exists(dir));
+
+	VolumeConfig volume = _getVolume();
+	volume.save(dir);
+	ASSERT_TRUE(VolumeConfig::exists(dir));
+
+	// replacing it leaves no temporary file behind
+	volume.save(dir);
+	ASSERT_NE(0, access((VolumeConfig::getFile(dir) + ".tmp").c_str(), F_OK));
+
+	const VolumeConfig loaded = VolumeConfig::load(dir);
+	ASSERT_EQ("openssl_aes_cbc_256", loaded.get("cipher-filedata"));
+	ASSERT_EQ("1", loaded.get("version"));
+	ASSERT_EQ("openssl_pbkdf2_sha256", loaded.getKeyDerivationParams().getName());
+	ASSERT_EQ(1000u, loaded.getKeyDerivationParams().getParams().at("iterations"));
+
+	unlink(VolumeConfig::getFile(dir).c_str());
+	rmdir(dir.c_str());
+
+	ASSERT_THROW(volume.set("a=b", "c"), Exception);
+
+}
+
+TEST(VolumeConfig, configuration) {
+
+	const VolumeConfig volume = _getVolume();
+
+	// no algorithms needed on the command-line
+	const char* argv1[] = {"binary", "/enc", "/dec"};
+	Configuration cfg(CMDLine(3, argv1), volume);
+	ASSERT_EQ(8192u, cfg.getBlockSize());
+	ASSERT_EQ(1000u, cfg.getKeyDerivation()->getParams()["iterations"]);
+
+	// the same is fine, a different one is not
+	const char* argv2[] = {"binary", "--cipher-filedata=openssl_aes_cbc_256", "/enc", "/dec"};
+	Configuration(CMDLine(4, argv2), volume);
+	const char* argv3[] = {"binary", "--cipher-filedata=openssl_aes_cbc_128", "/enc", "/dec"};
+	ASSERT_THROW(Configuration(CMDLine(4, argv3), volume), Exception);
+
+	// storing yields the same config
+	VolumeConfig stored;
+	cfg.store(stored);
+	ASSERT_EQ(volume.get("iv-gen"), stored.get("iv-gen"));
+	ASSERT_EQ(volume.get("kdf.iterations"), stored.get("kdf.iterations"));
+
+}
+
+TEST(VolumeConfig, storeAuto) {
+
+	const char* argv1[] = {"binary", "--cipher-filedata=auto", "--cipher-filename=auto", "--iv-gen=auto", "--key-derivation=openssl_pbkdf2_sha256", "/enc", "/dec"};
+	const Configuration cfg(CMDLine(7, argv1));
+
+	// volumes name the algorithm, not "auto"
+	VolumeConfig stored;
+	cfg.store(stored);
+	ASSERT_EQ("aes_cbc_256", stored.get("cipher-filedata"));
+	ASSERT_EQ("aes_cbc_256", stored.get("cipher-filename"));
+	ASSERT_EQ("sha256", stored.get("iv-gen"));
+
+	// "auto" still matches them on the command-line
+	Configuration(CMDLine(7, argv1), stored);
+
+}
+
+TEST(VolumeConfig, legacyIVGenerator) {
+
+	const char* argv1[] = {"binary", "--cipher-filedata=openssl_aes_cbc_256", "--cipher-filename=openssl_aes_cbc_128", "--iv-gen=sha1", "--key-derivation=openssl_pbkdf2_sha256", "/enc", "/dec"};
+	const char* argv2[] = {"binary", "--cipher-filedata=openssl_aes_cbc_256", "--cipher-filename=openssl_aes_cbc_128", "--iv-gen=kernel_sha1", "--key-derivation=openssl_pbkdf2_sha256", "/enc", "/dec"};
+
+	// ambiguous for legacy volumes, fine for new ones
+	ASSERT_THROW(Configuration(CMDLine(7, argv1), VolumeConfig(), true), Exception);
+	Configuration(CMDLine(7, argv1));
+
+	// the former kernel_sha1: the first 20 bytes of SHA-256
+	const Configuration cfg(CMDLine(7, argv2), VolumeConfig(), true);
+	VolumeConfig stored;
+	cfg.store(stored);
+	ASSERT_EQ("sha256_trunc20", stored.get("iv-gen"));
+
+}
+
+TEST(VolumeConfig, wrapKeys) {
+
+	VolumeConfig volume = _getVolume();
+	const char* argv[] = {"binary", "/enc", "/dec"};
+	const Configuration cfg(CMDLine(3, argv), volume);
+
+	Keys keys;
+	keys.generate(cfg);
+	ASSERT_EQ(32u, keys.getFileDataKey().len);
+	ASSERT_EQ(16u, keys.getFileNameKey().len);
+	const std::string data = Helper::toHexStr(keys.getFileDataKey().data, 32);
+	const std::string names = Helper::toHexStr(keys.getFileNameKey().data, 16);
+	ASSERT_NE(data.substr(0, 32), names);
+	keys.wrap(cfg, "secret", volume);
+
+	// wrong password
+	Keys keys2;
+	ASSERT_FALSE(keys2.unwrap(cfg, "Secret", volume));
+
+	// correct password
+	ASSERT_TRUE(keys2.unwrap(cfg, "secret", volume));
+	ASSERT_EQ(data, Helper::toHexStr(keys2.getFileDataKey().data, 32));
+	ASSERT_EQ(names, Helper::toHexStr(keys2.getFileNameKey().data, 16));
+
+	// changing the password keeps the keys
+	const std::string salt = volume.get("salt");
+	keys2.wrap(cfg, "other", volume);
+	ASSERT_NE(salt, volume.get("salt"));
+	Keys keys3;
+	ASSERT_FALSE(keys3.unwrap(cfg, "secret", volume));
+	ASSERT_TRUE(keys3.unwrap(cfg, "other", volume));
+	ASSERT_EQ(data, Helper::toHexStr(keys3.getFileDataKey().data, 32));
+
+	// tampered check
+	volume.set("key-check", std::string(64, '0'));
+	ASSERT_FALSE(keys3.unwrap(cfg, "other", volume));
+
+}
+
+#endif
+
+#endif
@@ -7,6 +7,7 @@
 #include "../container/MemoryContainer.h"
 #include "../container/EncryptedContainer.h"
 #include "../files/FilePath.h"
+#include "../files/DirStream.h"
 #include "../Helper.h"
 #include "../cipher/CipherFactory.h"
 #include "../digest/DigestFactory.h"